@@ -0,0 +1,105 @@
+#include <string.h>
+#include "adv_digest.h"
+#include "app_util.h"
+
+
+static uint8_t m_enc_advdata[2][BLE_GAP_ADV_SET_DATA_SIZE_MAX];              /**< Double-buffered encoded advertising data. */
+static uint8_t m_enc_scan_response_data[2][BLE_GAP_ADV_SET_DATA_SIZE_MAX];   /**< Double-buffered encoded scan response data. */
+static ble_gap_adv_data_t        m_adv_data[2];                             /**< Pointers to each buffer set. */
+static uint8_t                   m_active;                                  /**< Index of the buffer set handed to the SoftDevice. */
+static uint16_t                  m_digest_offset;                           /**< Offset of the digest in the advertising data. */
+static adv_digest_data_handler_t m_data_handler;
+
+
+/**@brief Function for encoding a digest into a buffer. */
+static void digest_encode(adv_digest_t const * p_digest, uint8_t * p_buf)
+{
+    p_buf[0] = p_digest->object_count;
+    (void)uint32_encode(p_digest->latest_object_id, &p_buf[1]);
+    (void)uint32_encode(p_digest->content_hash, &p_buf[5]);
+}
+
+
+ret_code_t adv_digest_init(ble_advdata_t             * p_advdata,
+                           ble_advdata_t const       * p_srdata,
+                           adv_digest_data_handler_t   data_handler,
+                           ble_gap_adv_data_t const ** pp_adv_data)
+{
+    ret_code_t                 err_code;
+    uint8_t                    digest[ADV_DIGEST_LEN] = {0};
+    ble_advdata_service_data_t service_data;
+    uint16_t                   offset = 0;
+
+    service_data.service_uuid = ADV_DIGEST_SERVICE_UUID;
+    service_data.data.p_data  = digest;
+    service_data.data.size    = sizeof(digest);
+
+    p_advdata->p_service_data_array = &service_data;
+    p_advdata->service_data_count   = 1;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(m_adv_data); i++)
+    {
+        m_adv_data[i].adv_data.p_data      = m_enc_advdata[i];
+        m_adv_data[i].adv_data.len         = BLE_GAP_ADV_SET_DATA_SIZE_MAX;
+        m_adv_data[i].scan_rsp_data.p_data = m_enc_scan_response_data[i];
+        m_adv_data[i].scan_rsp_data.len    = BLE_GAP_ADV_SET_DATA_SIZE_MAX;
+    }
+
+    m_active       = 0;
+    m_data_handler = data_handler;
+
+    err_code = ble_advdata_encode(p_advdata,
+                                  m_adv_data[m_active].adv_data.p_data,
+                                  &m_adv_data[m_active].adv_data.len);
+    p_advdata->p_service_data_array = NULL;
+    p_advdata->service_data_count   = 0;
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = ble_advdata_encode(p_srdata,
+                                  m_adv_data[m_active].scan_rsp_data.p_data,
+                                  &m_adv_data[m_active].scan_rsp_data.len);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    // Locate the digest once, so updates only have to patch those bytes.
+    if (ble_advdata_search(m_adv_data[m_active].adv_data.p_data,
+                           m_adv_data[m_active].adv_data.len,
+                           &offset,
+                           BLE_GAP_AD_TYPE_SERVICE_DATA) != sizeof(uint16_t) + ADV_DIGEST_LEN)
+    {
+        return NRF_ERROR_INTERNAL;
+    }
+    m_digest_offset = offset + sizeof(uint16_t);
+
+    *pp_adv_data = &m_adv_data[m_active];
+
+    return NRF_SUCCESS;
+}
+
+
+void adv_digest_update(adv_digest_t const * p_digest)
+{
+    uint8_t              next     = m_active ^ 1;
+    ble_gap_adv_data_t * p_active = &m_adv_data[m_active];
+    ble_gap_adv_data_t * p_next   = &m_adv_data[next];
+
+    // The SoftDevice still owns the active buffers; build the update in the other set.
+    memcpy(p_next->adv_data.p_data, p_active->adv_data.p_data, p_active->adv_data.len);
+    memcpy(p_next->scan_rsp_data.p_data, p_active->scan_rsp_data.p_data, p_active->scan_rsp_data.len);
+    p_next->adv_data.len      = p_active->adv_data.len;
+    p_next->scan_rsp_data.len = p_active->scan_rsp_data.len;
+
+    digest_encode(p_digest, &p_next->adv_data.p_data[m_digest_offset]);
+
+    m_active = next;
+
+    if (m_data_handler != NULL)
+    {
+        m_data_handler(p_next);
+    }
+}
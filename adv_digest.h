@@ -0,0 +1,84 @@
+/**@file
+ *
+ * @defgroup adv_digest Advertised object-directory digest
+ * @{
+ * @brief Object directory digest carried in the advertising payload.
+ *
+ * @details The digest is sent as OTS service data in the advertising packet, so scanners can tell
+ *          from a passive scan whether the dongle holds anything new before connecting:
+ *
+ *          | Offset | Size | Field                                      |
+ *          |--------|------|--------------------------------------------|
+ *          | 0      | 1    | Number of objects in the store             |
+ *          | 1      | 4    | ID of the most recent object (LE)          |
+ *          | 5      | 4    | Content hash prefix of that object (LE)    |
+ *
+ *          The advertising and scan response data are double-buffered. On an update the module
+ *          copies the active buffers, patches only the digest bytes in the copy, and hands the copy
+ *          to the SoftDevice, which switches buffers at the next advertising event.
+ */
+#ifndef ADV_DIGEST_H__
+#define ADV_DIGEST_H__
+
+#include <stdint.h>
+#include "ble_gap.h"
+#include "ble_advdata.h"
+#include "ble_ots.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADV_DIGEST_SERVICE_UUID     BLE_UUID_OTS_SERVICE    /**< Service data UUID the digest is sent under. */
+#define ADV_DIGEST_LEN              9                       /**< Length of the encoded digest. */
+
+
+/**@brief Object directory digest. */
+typedef struct
+{
+    uint8_t  object_count;          /**< Number of objects in the store. */
+    uint32_t latest_object_id;      /**< ID of the most recent object. */
+    uint32_t content_hash;          /**< Content hash (prefix) of the most recent object. */
+} adv_digest_t;
+
+
+/**@brief Handler called when a new set of advertising buffers must be used.
+ *
+ * @param[in] p_adv_data  Encoded advertising and scan response data to use from now on.
+ */
+typedef void (*adv_digest_data_handler_t)(ble_gap_adv_data_t const * p_adv_data);
+
+
+/**@brief Function for encoding the advertising payload with an empty digest.
+ *
+ * @details The digest is added to @p p_advdata as service data; the caller must not set
+ *          @ref ble_advdata_t::p_service_data_array itself.
+ *
+ * @param[in]  p_advdata     Advertising data content.
+ * @param[in]  p_srdata      Scan response data content.
+ * @param[in]  data_handler  Handler called on every digest update.
+ * @param[out] pp_adv_data   Encoded data to configure the advertising set with.
+ *
+ * @return NRF_SUCCESS, or an error code from ble_advdata_encode.
+ */
+ret_code_t adv_digest_init(ble_advdata_t             * p_advdata,
+                           ble_advdata_t const       * p_srdata,
+                           adv_digest_data_handler_t   data_handler,
+                           ble_gap_adv_data_t const ** pp_adv_data);
+
+
+/**@brief Function for updating the advertised digest.
+ *
+ * @param[in] p_digest  New digest.
+ */
+void adv_digest_update(adv_digest_t const * p_digest);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADV_DIGEST_H__
+
+/** @} */
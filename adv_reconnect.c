@@ -0,0 +1,361 @@
+#include <string.h>
+#include "adv_reconnect.h"
+#include "app_error.h"
+#include "app_util.h"
+#include "ble.h"
+#include "nrf_sdh_ble.h"
+#include "peer_manager.h"
+#include "msg.h"
+#include "transfer_metrics.h"
+
+
+/**@brief Address of a connected peer. */
+typedef struct
+{
+    uint16_t       conn_handle;         /**< Connection handle, BLE_CONN_HANDLE_INVALID if the entry is free. */
+    ble_gap_addr_t addr;                /**< Address the peer connected with. */
+} peer_entry_t;
+
+/**@brief Time-to-reconnect statistics for one phase. */
+typedef struct
+{
+    uint32_t count;                     /**< Number of connections made in this phase. */
+    uint32_t sum_us;                    /**< Sum of times from disconnection to connection. */
+    uint32_t min_us;                    /**< Shortest time seen. */
+    uint32_t max_us;                    /**< Longest time seen. */
+} reconnect_stats_t;
+
+static adv_reconnect_init_t  m_init;
+static adv_reconnect_phase_t m_phase = ADV_RECONNECT_PHASE_IDLE;
+static peer_entry_t          m_peers[NRF_SDH_BLE_PERIPHERAL_LINK_COUNT]; /**< Addresses of the connected peers. */
+static ble_gap_addr_t        m_peer_addr;                           /**< Address of the peer that disconnected last. */
+static bool                  m_peer_addr_valid;
+static ble_gap_irk_t         m_peer_irk;                            /**< IRK of that peer, if it is bonded and uses private addresses. */
+static bool                  m_peer_irk_valid;
+static uint32_t              m_disconnected_ticks;
+static bool                  m_reconnecting;                        /**< True between a disconnection and the next connection. */
+static reconnect_stats_t     m_stats[ADV_RECONNECT_PHASE_COUNT];
+
+static char const * const m_phase_names[ADV_RECONNECT_PHASE_COUNT] =
+{
+    "idle",
+    "directed",
+    "fast",
+    "slow",
+};
+
+
+/**@brief Function for configuring the advertising set for a phase and starting it. */
+static ret_code_t phase_start(adv_reconnect_phase_t phase)
+{
+    ret_code_t                 err_code;
+    ble_gap_adv_params_t       adv_params;
+    ble_gap_adv_data_t const * p_adv_data = m_init.p_adv_data;
+
+    memset(&adv_params, 0, sizeof(adv_params));
+
+    adv_params.primary_phy   = BLE_GAP_PHY_1MBPS;
+    adv_params.filter_policy = BLE_GAP_ADV_FP_ANY;
+
+    switch (phase)
+    {
+        case ADV_RECONNECT_PHASE_DIRECTED:
+            // Directed advertising carries no advertising data.
+            adv_params.properties.type = BLE_GAP_ADV_TYPE_CONNECTABLE_NONSCANNABLE_DIRECTED_HIGH_DUTY_CYCLE;
+            adv_params.p_peer_addr     = &m_peer_addr;
+            adv_params.duration        = ADV_RECONNECT_DIRECTED_DURATION;
+            p_adv_data                 = NULL;
+            break;
+
+        case ADV_RECONNECT_PHASE_FAST:
+            adv_params.properties.type = BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED;
+            adv_params.interval        = ADV_RECONNECT_FAST_INTERVAL;
+            adv_params.duration        = ADV_RECONNECT_FAST_DURATION;
+            break;
+
+        case ADV_RECONNECT_PHASE_SLOW:
+            adv_params.properties.type = BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED;
+            adv_params.interval        = ADV_RECONNECT_SLOW_INTERVAL;
+            adv_params.duration        = ADV_RECONNECT_SLOW_DURATION;
+            break;
+
+        default:
+            return NRF_ERROR_INVALID_PARAM;
+    }
+
+    err_code = sd_ble_gap_adv_set_configure(m_init.p_adv_handle, p_adv_data, &adv_params);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = sd_ble_gap_adv_start(*m_init.p_adv_handle, m_init.conn_cfg_tag);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    m_phase = phase;
+
+    if (m_init.phase_handler != NULL)
+    {
+        m_init.phase_handler(phase);
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+/**@brief Function for finding the address entry of a connection. */
+static peer_entry_t * peer_find(uint16_t conn_handle)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE(m_peers); i++)
+    {
+        if (m_peers[i].conn_handle == conn_handle)
+        {
+            return &m_peers[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**@brief Function for keeping the IRK of a bonded peer that is about to be lost.
+ *
+ * @details A peer with a resolvable private address comes back with a new one, which only its
+ *          IRK ties to the old one.
+ */
+static void peer_irk_save(uint16_t conn_handle)
+{
+    pm_peer_id_t           peer_id;
+    pm_peer_data_bonding_t bonding;
+
+    m_peer_irk_valid = false;
+
+    if (m_peer_addr.addr_type != BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE)
+    {
+        return;
+    }
+    if ((pm_peer_id_get(conn_handle, &peer_id) != NRF_SUCCESS) || (peer_id == PM_PEER_ID_INVALID))
+    {
+        return;
+    }
+    if (pm_peer_data_bonding_load(peer_id, &bonding) != NRF_SUCCESS)
+    {
+        return;
+    }
+
+    m_peer_irk       = bonding.peer_ble_id.id_info;
+    m_peer_irk_valid = true;
+}
+
+
+/**@brief Function for checking whether a new connection comes from the peer that was lost. */
+static bool peer_is_lost_one(ble_gap_addr_t const * p_addr)
+{
+    if (!m_peer_addr_valid)
+    {
+        return false;
+    }
+    if ((p_addr->addr_type == m_peer_addr.addr_type) &&
+        (memcmp(p_addr->addr, m_peer_addr.addr, BLE_GAP_ADDR_LEN) == 0))
+    {
+        return true;
+    }
+
+    return m_peer_irk_valid &&
+           (p_addr->addr_type == BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE) &&
+           pm_address_resolve(p_addr, &m_peer_irk);
+}
+
+
+/**@brief Function for recording the time to reconnect and printing the statistics. */
+static void reconnect_record(void)
+{
+    reconnect_stats_t * p_stats    = &m_stats[m_phase];
+    uint32_t            elapsed_us = transfer_metrics_elapsed_us(m_disconnected_ticks);
+
+    if ((p_stats->count == 0) || (elapsed_us < p_stats->min_us))
+    {
+        p_stats->min_us = elapsed_us;
+    }
+    if (elapsed_us > p_stats->max_us)
+    {
+        p_stats->max_us = elapsed_us;
+    }
+    p_stats->sum_us += elapsed_us;
+    p_stats->count++;
+
+    msg("Reconnected in %u us (%s phase)\r\n", elapsed_us, m_phase_names[m_phase]);
+
+    for (uint32_t i = ADV_RECONNECT_PHASE_DIRECTED; i < ADV_RECONNECT_PHASE_COUNT; i++)
+    {
+        if (m_stats[i].count != 0)
+        {
+            msg("  %s: n=%u avg=%u us min=%u us max=%u us\r\n",
+                m_phase_names[i],
+                m_stats[i].count,
+                m_stats[i].sum_us / m_stats[i].count,
+                m_stats[i].min_us,
+                m_stats[i].max_us);
+        }
+    }
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    ret_code_t     err_code;
+    peer_entry_t * p_peer;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            if (p_ble_evt->evt.gap_evt.params.connected.role != BLE_GAP_ROLE_PERIPH)
+            {
+                break;
+            }
+            p_peer = peer_find(BLE_CONN_HANDLE_INVALID);
+            if (p_peer != NULL)
+            {
+                p_peer->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+                p_peer->addr        = p_ble_evt->evt.gap_evt.params.connected.peer_addr;
+            }
+            // Other centrals may take a free link in the meantime; only the lost peer ends
+            // the reconnection.
+            if (m_reconnecting &&
+                peer_is_lost_one(&p_ble_evt->evt.gap_evt.params.connected.peer_addr))
+            {
+                reconnect_record();
+                m_reconnecting = false;
+            }
+            m_phase = ADV_RECONNECT_PHASE_IDLE;
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_peer = peer_find(p_ble_evt->evt.gap_evt.conn_handle);
+            if (p_peer == NULL)
+            {
+                break;
+            }
+            m_peer_addr          = p_peer->addr;
+            m_peer_addr_valid    = true;
+            peer_irk_save(p_peer->conn_handle);
+            p_peer->conn_handle  = BLE_CONN_HANDLE_INVALID;
+            m_disconnected_ticks = transfer_metrics_timestamp();
+            m_reconnecting       = true;
+            break;
+
+        case BLE_GAP_EVT_ADV_SET_TERMINATED:
+            if (p_ble_evt->evt.gap_evt.params.adv_set_terminated.reason !=
+                BLE_GAP_EVT_ADV_SET_TERMINATED_REASON_TIMEOUT)
+            {
+                break;
+            }
+            // Move on to the next, slower phase.
+            if (m_phase == ADV_RECONNECT_PHASE_DIRECTED)
+            {
+                err_code = phase_start(ADV_RECONNECT_PHASE_FAST);
+                APP_ERROR_CHECK(err_code);
+            }
+            else if (m_phase == ADV_RECONNECT_PHASE_FAST)
+            {
+                err_code = phase_start(ADV_RECONNECT_PHASE_SLOW);
+                APP_ERROR_CHECK(err_code);
+            }
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_adv_reconnect_obs, ADV_RECONNECT_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+ret_code_t adv_reconnect_init(adv_reconnect_init_t const * p_init)
+{
+    ble_gap_adv_params_t adv_params;
+
+    if ((p_init == NULL) || (p_init->p_adv_handle == NULL) || (p_init->p_adv_data == NULL))
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    m_init  = *p_init;
+    m_phase = ADV_RECONNECT_PHASE_IDLE;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(m_peers); i++)
+    {
+        m_peers[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    // Configure the set once so the handle is allocated and the data is validated at boot.
+    memset(&adv_params, 0, sizeof(adv_params));
+
+    adv_params.primary_phy     = BLE_GAP_PHY_1MBPS;
+    adv_params.duration        = ADV_RECONNECT_FAST_DURATION;
+    adv_params.properties.type = BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED;
+    adv_params.p_peer_addr     = NULL;
+    adv_params.filter_policy   = BLE_GAP_ADV_FP_ANY;
+    adv_params.interval        = ADV_RECONNECT_FAST_INTERVAL;
+
+    return sd_ble_gap_adv_set_configure(m_init.p_adv_handle, m_init.p_adv_data, &adv_params);
+}
+
+
+ret_code_t adv_reconnect_start(void)
+{
+    if (m_peer_addr_valid && m_reconnecting)
+    {
+        return phase_start(ADV_RECONNECT_PHASE_DIRECTED);
+    }
+
+    return phase_start(ADV_RECONNECT_PHASE_FAST);
+}
+
+
+ret_code_t adv_reconnect_stop(void)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    if (m_phase != ADV_RECONNECT_PHASE_IDLE)
+    {
+        err_code = sd_ble_gap_adv_stop(*m_init.p_adv_handle);
+        // The set may have timed out or connected already.
+        if (err_code == NRF_ERROR_INVALID_STATE)
+        {
+            err_code = NRF_SUCCESS;
+        }
+        m_phase = ADV_RECONNECT_PHASE_IDLE;
+    }
+
+    return err_code;
+}
+
+
+ret_code_t adv_reconnect_data_update(ble_gap_adv_data_t const * p_adv_data)
+{
+    m_init.p_adv_data = p_adv_data;
+
+    if ((m_phase != ADV_RECONNECT_PHASE_FAST) && (m_phase != ADV_RECONNECT_PHASE_SLOW))
+    {
+        return NRF_SUCCESS;
+    }
+
+    // Data only; the parameters of a running set cannot change.
+    return sd_ble_gap_adv_set_configure(m_init.p_adv_handle, p_adv_data, NULL);
+}
+
+
+adv_reconnect_phase_t adv_reconnect_phase_get(void)
+{
+    return m_phase;
+}
@@ -0,0 +1,111 @@
+/**@file
+ *
+ * @defgroup adv_reconnect Reconnect advertising policy
+ * @{
+ * @brief Phased advertising that brings a lost peer back as fast as possible.
+ *
+ * @details After a disconnection the module advertises directed, high duty cycle, to the previous
+ *          peer for a short window, then falls back to fast undirected advertising and finally to
+ *          slow undirected advertising. Phases advance on BLE_GAP_EVT_ADV_SET_TERMINATED. The time
+ *          from disconnection until the same peer connects again is recorded per phase and
+ *          reported over the debug channel. The peer is recognised by its address or, if it is
+ *          bonded and uses resolvable private addresses, by its IRK.
+ */
+#ifndef ADV_RECONNECT_H__
+#define ADV_RECONNECT_H__
+
+#include <stdint.h>
+#include "ble_gap.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADV_RECONNECT_BLE_OBSERVER_PRIO     1                           /**< Priority of the BLE observer. */
+
+#define ADV_RECONNECT_DIRECTED_DURATION     BLE_GAP_ADV_TIMEOUT_HIGH_DUTY_MAX /**< Directed high duty window (in units of 10 ms; 1.28 seconds). */
+#define ADV_RECONNECT_FAST_INTERVAL         64                          /**< Fast advertising interval (in units of 0.625 ms; 40 ms). */
+#define ADV_RECONNECT_FAST_DURATION         3000                        /**< Fast advertising window (in units of 10 ms; 30 seconds). */
+#define ADV_RECONNECT_SLOW_INTERVAL         1600                        /**< Slow advertising interval (in units of 0.625 ms; 1 second). */
+#define ADV_RECONNECT_SLOW_DURATION         BLE_GAP_ADV_TIMEOUT_GENERAL_UNLIMITED /**< Slow advertising never times out. */
+
+
+/**@brief Advertising phases. */
+typedef enum
+{
+    ADV_RECONNECT_PHASE_IDLE,           /**< Not advertising. */
+    ADV_RECONNECT_PHASE_DIRECTED,       /**< Directed high duty cycle advertising to the previous peer. */
+    ADV_RECONNECT_PHASE_FAST,           /**< Fast undirected advertising. */
+    ADV_RECONNECT_PHASE_SLOW,           /**< Slow undirected advertising. */
+    ADV_RECONNECT_PHASE_COUNT
+} adv_reconnect_phase_t;
+
+
+/**@brief Phase change handler type. */
+typedef void (*adv_reconnect_phase_handler_t)(adv_reconnect_phase_t phase);
+
+
+/**@brief Initialization parameters. */
+typedef struct
+{
+    uint8_t                     * p_adv_handle;     /**< Advertising set handle, shared with the application. */
+    ble_gap_adv_data_t const    * p_adv_data;       /**< Encoded advertising and scan response data for the undirected phases. */
+    uint8_t                       conn_cfg_tag;     /**< SoftDevice connection configuration tag. */
+    adv_reconnect_phase_handler_t phase_handler;    /**< Called on every phase change. Can be NULL. */
+} adv_reconnect_init_t;
+
+
+/**@brief Function for initializing the module and configuring the advertising set.
+ *
+ * @param[in] p_init Initialization parameters.
+ *
+ * @return NRF_SUCCESS or an error code from sd_ble_gap_adv_set_configure.
+ */
+ret_code_t adv_reconnect_init(adv_reconnect_init_t const * p_init);
+
+
+/**@brief Function for starting advertising.
+ *
+ * @details Starts with the directed phase if a previous peer is known, otherwise with the fast
+ *          phase.
+ *
+ * @return NRF_SUCCESS or an error code from the SoftDevice.
+ */
+ret_code_t adv_reconnect_start(void);
+
+
+/**@brief Function for stopping advertising and giving up the advertising set.
+ *
+ * @details Used when another module needs the set for a while. The phase goes back to idle;
+ *          @ref adv_reconnect_start configures the set again.
+ *
+ * @return NRF_SUCCESS or an error code from sd_ble_gap_adv_stop.
+ */
+ret_code_t adv_reconnect_stop(void);
+
+
+/**@brief Function for switching the undirected phases to new advertising data.
+ *
+ * @details If an undirected phase is running, the data is handed to the SoftDevice right away;
+ *          otherwise it is used when the next undirected phase starts. @p p_adv_data must point
+ *          to buffers other than the ones currently in use.
+ *
+ * @param[in] p_adv_data  New encoded advertising and scan response data.
+ *
+ * @return NRF_SUCCESS or an error code from sd_ble_gap_adv_set_configure.
+ */
+ret_code_t adv_reconnect_data_update(ble_gap_adv_data_t const * p_adv_data);
+
+
+/**@brief Function for getting the current phase. */
+adv_reconnect_phase_t adv_reconnect_phase_get(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADV_RECONNECT_H__
+
+/** @} */
@@ -0,0 +1,413 @@
+#include <string.h>
+#include "ble_bulk.h"
+#include "app_util.h"
+#include "hvx_queue.h"
+#include "transfer_metrics.h"
+
+
+#define DATA_MAX_LEN    (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)     /**< Largest data packet, sequence number included. */
+
+
+static ble_bulk_link_t * link_find(ble_bulk_t * p_bulk, uint16_t conn_handle)
+{
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < BLE_BULK_LINK_COUNT; i++)
+    {
+        if (p_bulk->links[i].conn_handle == conn_handle)
+        {
+            return &p_bulk->links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static void link_alloc(ble_bulk_t * p_bulk, uint16_t conn_handle)
+{
+    for (uint32_t i = 0; i < BLE_BULK_LINK_COUNT; i++)
+    {
+        if (p_bulk->links[i].conn_handle == BLE_CONN_HANDLE_INVALID)
+        {
+            memset(&p_bulk->links[i], 0, sizeof(p_bulk->links[i]));
+            p_bulk->links[i].conn_handle = conn_handle;
+            return;
+        }
+    }
+}
+
+
+/**@brief Function for sending a control response.
+ *
+ * @details Responses go through @ref hvx_queue, so they are not lost while data notifications
+ *          fill the SoftDevice queue.
+ */
+static ret_code_t ctrl_send(ble_bulk_t * p_bulk,
+                            uint16_t     conn_handle,
+                            uint8_t      op,
+                            uint8_t      status,
+                            uint32_t     count)
+{
+    uint8_t                rsp[BLE_BULK_CTRL_MAX_LEN];
+    uint16_t               len = sizeof(rsp);
+    ble_gatts_hvx_params_t hvx_params;
+
+    rsp[0] = op;
+    rsp[1] = status;
+    (void)uint32_encode(count, &rsp[2]);
+
+    memset(&hvx_params, 0, sizeof(hvx_params));
+    hvx_params.handle = p_bulk->control_handles.value_handle;
+    hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+    hvx_params.p_len  = &len;
+    hvx_params.p_data = rsp;
+
+    return hvx_queue_put(conn_handle, &hvx_params);
+}
+
+
+/**@brief Function for queueing downlink notifications until the SoftDevice queue is full.
+ *
+ * @details Called when a download starts and on every BLE_GATTS_EVT_HVN_TX_COMPLETE, so the
+ *          queue never drains while there is data left.
+ */
+static void data_pump(ble_bulk_t * p_bulk, ble_bulk_link_t * p_link)
+{
+    uint8_t                packet[DATA_MAX_LEN];
+    uint16_t               len;
+    uint32_t               chunk_max;
+    ble_gatts_hvx_params_t hvx_params;
+    ret_code_t             err_code;
+
+    chunk_max = nrf_ble_gatt_eff_mtu_get(p_bulk->p_gatt, p_link->conn_handle) - 3 - BLE_BULK_SEQ_LEN;
+
+    memset(&hvx_params, 0, sizeof(hvx_params));
+    hvx_params.handle = p_bulk->data_out_handles.value_handle;
+    hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+    hvx_params.p_len  = &len;
+    hvx_params.p_data = packet;
+
+    while (p_link->tx_active && (p_link->tx_offset < p_bulk->p_object->current_size))
+    {
+        uint32_t chunk = MIN(chunk_max, p_bulk->p_object->current_size - p_link->tx_offset);
+
+        (void)uint16_encode(p_link->tx_seq, packet);
+        memcpy(&packet[BLE_BULK_SEQ_LEN], &p_bulk->p_object->data[p_link->tx_offset], chunk);
+        len = (uint16_t)(BLE_BULK_SEQ_LEN + chunk);
+
+        err_code = sd_ble_gatts_hvx(p_link->conn_handle, &hvx_params);
+        if (err_code == NRF_ERROR_RESOURCES)
+        {
+            // Resumed on BLE_GATTS_EVT_HVN_TX_COMPLETE.
+            return;
+        }
+        if (err_code != NRF_SUCCESS)
+        {
+            // Notifications disabled; the client has to start over.
+            p_link->tx_active = false;
+            return;
+        }
+
+        hvx_queue_hvn_sent(p_link->conn_handle);
+        p_link->tx_offset += chunk;
+        p_link->tx_seq++;
+        transfer_metrics_bytes(p_link->conn_handle, TRANSFER_METRICS_TRANSPORT_GATT, chunk);
+    }
+
+    if (p_link->tx_active)
+    {
+        p_link->tx_active = false;
+        (void)ctrl_send(p_bulk, p_link->conn_handle, BLE_BULK_RSP_DOWNLOAD_DONE,
+                        BLE_BULK_STATUS_SUCCESS, p_link->tx_offset);
+    }
+}
+
+
+/**@brief Function for replacing the object with the staged upload.
+ *
+ * @details Downloads still running were reading the old object; they are ended.
+ */
+static void upload_commit(ble_bulk_t * p_bulk)
+{
+    for (uint32_t i = 0; i < BLE_BULK_LINK_COUNT; i++)
+    {
+        ble_bulk_link_t * p_link = &p_bulk->links[i];
+
+        if ((p_link->conn_handle != BLE_CONN_HANDLE_INVALID) && p_link->tx_active)
+        {
+            p_link->tx_active = false;
+            (void)ctrl_send(p_bulk, p_link->conn_handle, BLE_BULK_RSP_DOWNLOAD_DONE,
+                            BLE_BULK_STATUS_ABORTED, p_link->tx_offset);
+        }
+    }
+
+    memcpy(p_bulk->p_object->data, p_bulk->p_stage, p_bulk->upload_len);
+    p_bulk->p_object->current_size = p_bulk->upload_len;
+}
+
+
+static void upload_end(ble_bulk_t * p_bulk, uint8_t status)
+{
+    uint16_t conn_handle = p_bulk->upload_conn_handle;
+
+    if (status == BLE_BULK_STATUS_SUCCESS)
+    {
+        upload_commit(p_bulk);
+    }
+
+    p_bulk->upload_conn_handle = BLE_CONN_HANDLE_INVALID;
+    (void)ctrl_send(p_bulk, conn_handle, BLE_BULK_RSP_UPLOAD_DONE, status, p_bulk->upload_offset);
+
+    if ((status == BLE_BULK_STATUS_SUCCESS) && (p_bulk->evt_handler != NULL))
+    {
+        ble_bulk_evt_t evt;
+
+        evt.type        = BLE_BULK_EVT_OBJECT_RECEIVED;
+        evt.conn_handle = conn_handle;
+        p_bulk->evt_handler(p_bulk, &evt);
+    }
+}
+
+
+static void on_data_in(ble_bulk_t * p_bulk, ble_bulk_link_t * p_link, ble_gatts_evt_write_t const * p_write)
+{
+    uint16_t seq;
+    uint32_t len;
+
+    if ((p_link->conn_handle != p_bulk->upload_conn_handle) || (p_write->len < BLE_BULK_SEQ_LEN))
+    {
+        return;
+    }
+
+    seq = uint16_decode(p_write->data);
+    if (seq != p_link->rx_seq)
+    {
+        (void)ctrl_send(p_bulk, p_link->conn_handle, BLE_BULK_RSP_SEQ_ERROR,
+                        BLE_BULK_STATUS_INVALID, p_link->rx_seq);
+        return;
+    }
+
+    len = MIN(p_write->len - BLE_BULK_SEQ_LEN, p_bulk->upload_len - p_bulk->upload_offset);
+    memcpy(&p_bulk->p_stage[p_bulk->upload_offset], &p_write->data[BLE_BULK_SEQ_LEN], len);
+    p_bulk->upload_offset += len;
+    p_link->rx_seq++;
+
+    transfer_metrics_bytes(p_link->conn_handle, TRANSFER_METRICS_TRANSPORT_GATT, len);
+
+    if (p_bulk->upload_offset >= p_bulk->upload_len)
+    {
+        upload_end(p_bulk, BLE_BULK_STATUS_SUCCESS);
+    }
+}
+
+
+static void on_control(ble_bulk_t * p_bulk, ble_bulk_link_t * p_link, ble_gatts_evt_write_t const * p_write)
+{
+    uint32_t param = (p_write->len >= 5) ? uint32_decode(&p_write->data[1]) : 0;
+
+    if (p_write->len == 0)
+    {
+        return;
+    }
+
+    switch (p_write->data[0])
+    {
+        case BLE_BULK_OP_UPLOAD:
+            if ((p_write->len < 5) || (param == 0))
+            {
+                (void)ctrl_send(p_bulk, p_link->conn_handle, BLE_BULK_RSP_UPLOAD_DONE,
+                                BLE_BULK_STATUS_INVALID, 0);
+            }
+            else if ((param > p_bulk->p_object->alloc_len) || (param > p_bulk->stage_size))
+            {
+                (void)ctrl_send(p_bulk, p_link->conn_handle, BLE_BULK_RSP_UPLOAD_DONE,
+                                BLE_BULK_STATUS_TOO_LARGE, 0);
+            }
+            else if ((p_bulk->upload_conn_handle != BLE_CONN_HANDLE_INVALID) &&
+                     (p_bulk->upload_conn_handle != p_link->conn_handle))
+            {
+                (void)ctrl_send(p_bulk, p_link->conn_handle, BLE_BULK_RSP_UPLOAD_DONE,
+                                BLE_BULK_STATUS_BUSY, 0);
+            }
+            else
+            {
+                // Staged; the object is replaced only when the last byte arrives.
+                p_bulk->upload_conn_handle = p_link->conn_handle;
+                p_bulk->upload_len         = param;
+                p_bulk->upload_offset      = 0;
+                p_link->rx_seq             = 0;
+            }
+            break;
+
+        case BLE_BULK_OP_DOWNLOAD:
+            if ((p_write->len < 5) || (param > p_bulk->p_object->current_size))
+            {
+                (void)ctrl_send(p_bulk, p_link->conn_handle, BLE_BULK_RSP_DOWNLOAD_DONE,
+                                BLE_BULK_STATUS_INVALID, 0);
+                break;
+            }
+            if (p_bulk->upload_conn_handle != BLE_CONN_HANDLE_INVALID)
+            {
+                // The object is about to be replaced.
+                (void)ctrl_send(p_bulk, p_link->conn_handle, BLE_BULK_RSP_DOWNLOAD_DONE,
+                                BLE_BULK_STATUS_BUSY, 0);
+                break;
+            }
+            p_link->tx_offset = param;
+            p_link->tx_seq    = 0;
+            p_link->tx_active = true;
+            data_pump(p_bulk, p_link);
+            break;
+
+        case BLE_BULK_OP_ABORT:
+            p_link->tx_active = false;
+            if (p_bulk->upload_conn_handle == p_link->conn_handle)
+            {
+                upload_end(p_bulk, BLE_BULK_STATUS_ABORTED);
+            }
+            break;
+
+        default:
+            // Unknown request; ignored.
+            break;
+    }
+}
+
+
+void ble_bulk_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    ble_bulk_t      * p_bulk = (ble_bulk_t *)p_context;
+    ble_bulk_link_t * p_link;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            if (p_ble_evt->evt.gap_evt.params.connected.role == BLE_GAP_ROLE_PERIPH)
+            {
+                link_alloc(p_bulk, p_ble_evt->evt.gap_evt.conn_handle);
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_link = link_find(p_bulk, p_ble_evt->evt.gap_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                if (p_bulk->upload_conn_handle == p_link->conn_handle)
+                {
+                    p_bulk->upload_conn_handle = BLE_CONN_HANDLE_INVALID;
+                }
+                p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+            }
+            break;
+
+        case BLE_GATTS_EVT_WRITE:
+        {
+            ble_gatts_evt_write_t const * p_write = &p_ble_evt->evt.gatts_evt.params.write;
+
+            p_link = link_find(p_bulk, p_ble_evt->evt.gatts_evt.conn_handle);
+            if (p_link == NULL)
+            {
+                break;
+            }
+            if (p_write->handle == p_bulk->data_in_handles.value_handle)
+            {
+                on_data_in(p_bulk, p_link, p_write);
+            }
+            else if (p_write->handle == p_bulk->control_handles.value_handle)
+            {
+                on_control(p_bulk, p_link, p_write);
+            }
+        } break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            p_link = link_find(p_bulk, p_ble_evt->evt.gatts_evt.conn_handle);
+            if ((p_link != NULL) && p_link->tx_active)
+            {
+                data_pump(p_bulk, p_link);
+            }
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+
+ret_code_t ble_bulk_init(ble_bulk_t * p_bulk, ble_bulk_init_t const * p_bulk_init)
+{
+    ret_code_t            err_code;
+    ble_uuid_t            ble_uuid;
+    ble_uuid128_t         base_uuid = {BULK_UUID_BASE};
+    ble_add_char_params_t add_char_params;
+
+    if ((p_bulk == NULL) || (p_bulk_init == NULL) || (p_bulk_init->p_object == NULL) ||
+        (p_bulk_init->p_stage == NULL))
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    memset(p_bulk, 0, sizeof(*p_bulk));
+    p_bulk->evt_handler        = p_bulk_init->evt_handler;
+    p_bulk->p_object           = p_bulk_init->p_object;
+    p_bulk->p_gatt             = p_bulk_init->p_gatt;
+    p_bulk->p_stage            = p_bulk_init->p_stage;
+    p_bulk->stage_size         = p_bulk_init->stage_size;
+    p_bulk->upload_conn_handle = BLE_CONN_HANDLE_INVALID;
+
+    for (uint32_t i = 0; i < BLE_BULK_LINK_COUNT; i++)
+    {
+        p_bulk->links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    // Add service.
+    err_code = sd_ble_uuid_vs_add(&base_uuid, &p_bulk->uuid_type);
+    VERIFY_SUCCESS(err_code);
+
+    ble_uuid.type = p_bulk->uuid_type;
+    ble_uuid.uuid = BULK_UUID_SERVICE;
+
+    err_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &ble_uuid, &p_bulk->service_handle);
+    VERIFY_SUCCESS(err_code);
+
+    // Add Data In characteristic.
+    memset(&add_char_params, 0, sizeof(add_char_params));
+    add_char_params.uuid                     = BULK_UUID_DATA_IN;
+    add_char_params.uuid_type                = p_bulk->uuid_type;
+    add_char_params.max_len                  = DATA_MAX_LEN;
+    add_char_params.is_var_len               = true;
+    add_char_params.char_props.write_wo_resp = 1;
+    add_char_params.write_access             = SEC_OPEN;
+
+    err_code = characteristic_add(p_bulk->service_handle, &add_char_params, &p_bulk->data_in_handles);
+    VERIFY_SUCCESS(err_code);
+
+    // Add Data Out characteristic.
+    memset(&add_char_params, 0, sizeof(add_char_params));
+    add_char_params.uuid              = BULK_UUID_DATA_OUT;
+    add_char_params.uuid_type         = p_bulk->uuid_type;
+    add_char_params.max_len           = DATA_MAX_LEN;
+    add_char_params.is_var_len        = true;
+    add_char_params.char_props.notify = 1;
+    add_char_params.cccd_write_access = SEC_OPEN;
+
+    err_code = characteristic_add(p_bulk->service_handle, &add_char_params, &p_bulk->data_out_handles);
+    VERIFY_SUCCESS(err_code);
+
+    // Add Control characteristic.
+    memset(&add_char_params, 0, sizeof(add_char_params));
+    add_char_params.uuid              = BULK_UUID_CONTROL;
+    add_char_params.uuid_type         = p_bulk->uuid_type;
+    add_char_params.max_len           = BLE_BULK_CTRL_MAX_LEN;
+    add_char_params.is_var_len        = true;
+    add_char_params.char_props.write  = 1;
+    add_char_params.char_props.notify = 1;
+    add_char_params.write_access      = SEC_OPEN;
+    add_char_params.cccd_write_access = SEC_OPEN;
+
+    return characteristic_add(p_bulk->service_handle, &add_char_params, &p_bulk->control_handles);
+}
@@ -0,0 +1,184 @@
+/**@file
+ *
+ * @defgroup ble_bulk GATT Bulk Transfer Service
+ * @{
+ * @brief Object transfer over plain GATT for clients that cannot open an L2CAP CoC.
+ *
+ * @details The service works on the same object as OTS. It has three characteristics:
+ *
+ *          - Data In (Write Without Response): uplink packets.
+ *          - Data Out (Notify): downlink packets.
+ *          - Control (Write, Notify): requests from the client and status from the server.
+ *
+ *          Every data packet starts with a 16-bit sequence number (LE) followed by up to
+ *          ATT_MTU - 5 bytes of object data. Sequence numbers restart at 0 for every transfer.
+ *          An uplink packet with an unexpected sequence number is dropped and answered with
+ *          @ref BLE_BULK_RSP_SEQ_ERROR, carrying the sequence number the server expects; the
+ *          client resends from there.
+ *
+ *          Downlink notifications are queued until the SoftDevice runs out of buffers, and
+ *          more are queued on every BLE_GATTS_EVT_HVN_TX_COMPLETE. Several packets then go out
+ *          in each connection event.
+ *
+ *          | Control request          | Parameters             | Response                            |
+ *          |--------------------------|------------------------|-------------------------------------|
+ *          | @ref BLE_BULK_OP_UPLOAD   | Object length (u32)    | @ref BLE_BULK_RSP_UPLOAD_DONE       |
+ *          | @ref BLE_BULK_OP_DOWNLOAD | Start offset (u32)     | @ref BLE_BULK_RSP_DOWNLOAD_DONE     |
+ *          | @ref BLE_BULK_OP_ABORT    | -                      | -                                   |
+ *
+ *          Responses carry a status byte (@ref ble_bulk_status_t) and a byte count (u32).
+ *
+ *          An upload is staged in a buffer of its own and replaces the object only when its last
+ *          byte arrives. An aborted upload, or a client that goes away, leaves the object as it
+ *          was. While an upload is staged, downloads are refused with @ref BLE_BULK_STATUS_BUSY;
+ *          downloads still running when the object is replaced end with
+ *          @ref BLE_BULK_STATUS_ABORTED.
+ */
+#ifndef BLE_BULK_H__
+#define BLE_BULK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "ble_srv_common.h"
+#include "ble_ots.h"
+#include "nrf_ble_gatt.h"
+#include "nrf_sdh_ble.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLE_BULK_BLE_OBSERVER_PRIO  2                                   /**< Priority of the BLE observer. */
+#define BLE_BULK_LINK_COUNT         NRF_SDH_BLE_PERIPHERAL_LINK_COUNT   /**< Number of clients served at once. */
+#define BLE_BULK_HVN_TX_QUEUE_SIZE  6                                   /**< SoftDevice notification queue size per link. */
+
+/**@brief Macro for defining a ble_bulk instance.
+ *
+ * @param   _name   Name of the instance.
+ * @hideinitializer
+ */
+#define BLE_BULK_DEF(_name)                                                                         \
+static ble_bulk_t _name;                                                                            \
+NRF_SDH_BLE_OBSERVER(_name ## _obs,                                                                 \
+                     BLE_BULK_BLE_OBSERVER_PRIO,                                                    \
+                     ble_bulk_on_ble_evt, &_name)
+
+#define BULK_UUID_BASE        {0x3E, 0x6B, 0x1A, 0x52, 0x8C, 0x4D, 0x91, 0xA7, \
+                               0x2B, 0x45, 0xD0, 0xC3, 0x00, 0x00, 0x7F, 0x5B}
+#define BULK_UUID_SERVICE     0x0001
+#define BULK_UUID_DATA_IN     0x0002
+#define BULK_UUID_DATA_OUT    0x0003
+#define BULK_UUID_CONTROL     0x0004
+
+#define BLE_BULK_SEQ_LEN            2       /**< Length of the sequence number in a data packet. */
+#define BLE_BULK_CTRL_MAX_LEN       6       /**< Maximum length of a control request or response. */
+
+#define BLE_BULK_OP_UPLOAD          0x01    /**< Start an uplink transfer, replacing the object. */
+#define BLE_BULK_OP_DOWNLOAD        0x02    /**< Start a downlink transfer of the object. */
+#define BLE_BULK_OP_ABORT           0x03    /**< Abort the transfer in progress. */
+
+#define BLE_BULK_RSP_UPLOAD_DONE    0x81    /**< Uplink transfer ended. */
+#define BLE_BULK_RSP_DOWNLOAD_DONE  0x82    /**< Downlink transfer ended. */
+#define BLE_BULK_RSP_SEQ_ERROR      0x83    /**< Uplink packet out of sequence. */
+
+
+/**@brief Status of a transfer, sent in control responses. */
+typedef enum
+{
+    BLE_BULK_STATUS_SUCCESS,                /**< Transfer complete. */
+    BLE_BULK_STATUS_TOO_LARGE,              /**< Object does not fit in the store. */
+    BLE_BULK_STATUS_BUSY,                   /**< Another client is uploading, or a download was asked for while one is. */
+    BLE_BULK_STATUS_INVALID,                /**< Malformed request or offset out of range. */
+    BLE_BULK_STATUS_ABORTED,                /**< Aborted by the client. */
+} ble_bulk_status_t;
+
+
+/**@brief Event types. */
+typedef enum
+{
+    BLE_BULK_EVT_OBJECT_RECEIVED,           /**< An uplink transfer replaced the object. */
+} ble_bulk_evt_type_t;
+
+
+/**@brief Event structure. */
+typedef struct
+{
+    ble_bulk_evt_type_t type;               /**< Event type. */
+    uint16_t            conn_handle;        /**< Link the event happened on. */
+} ble_bulk_evt_t;
+
+
+/**@brief Transfer state of one client. */
+typedef struct
+{
+    uint16_t conn_handle;                   /**< Connection handle, BLE_CONN_HANDLE_INVALID if the entry is free. */
+    uint16_t rx_seq;                        /**< Next expected uplink sequence number. */
+    uint16_t tx_seq;                        /**< Next downlink sequence number. */
+    uint32_t tx_offset;                     /**< Next object offset to send. */
+    bool     tx_active;                     /**< Downlink transfer in progress. */
+} ble_bulk_link_t;
+
+typedef struct ble_bulk_s ble_bulk_t;
+
+/**@brief Event handler type. */
+typedef void (*ble_bulk_evt_handler_t)(ble_bulk_t * p_bulk, ble_bulk_evt_t const * p_evt);
+
+
+/**@brief Service initialization structure. */
+typedef struct
+{
+    ble_bulk_evt_handler_t evt_handler;     /**< Event handler. */
+    ble_ots_object_t     * p_object;        /**< Object shared with OTS. */
+    nrf_ble_gatt_t       * p_gatt;          /**< GATT module instance, for the ATT MTU of each link. */
+    uint8_t              * p_stage;         /**< Buffer uploads are staged in. */
+    uint32_t               stage_size;      /**< Size of the staging buffer; the longest upload. */
+} ble_bulk_init_t;
+
+
+/**@brief Service structure. */
+struct ble_bulk_s
+{
+    uint16_t                 service_handle;            /**< Handle of the service. */
+    ble_gatts_char_handles_t data_in_handles;           /**< Handles of the Data In characteristic. */
+    ble_gatts_char_handles_t data_out_handles;          /**< Handles of the Data Out characteristic. */
+    ble_gatts_char_handles_t control_handles;           /**< Handles of the Control characteristic. */
+    uint8_t                  uuid_type;                 /**< UUID type of the vendor base. */
+    ble_bulk_evt_handler_t   evt_handler;               /**< Event handler. */
+    ble_ots_object_t       * p_object;                  /**< Object shared with OTS. */
+    nrf_ble_gatt_t         * p_gatt;                    /**< GATT module instance. */
+    uint8_t                * p_stage;                   /**< Buffer uploads are staged in. */
+    uint32_t                 stage_size;                /**< Size of the staging buffer. */
+    uint16_t                 upload_conn_handle;        /**< Link uploading, BLE_CONN_HANDLE_INVALID if none. */
+    uint32_t                 upload_len;                /**< Length of the object being uploaded. */
+    uint32_t                 upload_offset;             /**< Bytes staged so far. */
+    ble_bulk_link_t          links[BLE_BULK_LINK_COUNT];/**< Per-client transfer state. */
+};
+
+
+/**@brief Function for initializing the service.
+ *
+ * @param[out] p_bulk       Service structure.
+ * @param[in]  p_bulk_init  Initialization parameters.
+ *
+ * @return NRF_SUCCESS or an error code from the SoftDevice.
+ */
+ret_code_t ble_bulk_init(ble_bulk_t * p_bulk, ble_bulk_init_t const * p_bulk_init);
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in] p_ble_evt  Bluetooth stack event.
+ * @param[in] p_context  Service structure.
+ */
+void ble_bulk_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLE_BULK_H__
+
+/** @} */
@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <string.h>
+#include "ble_capture.h"
+#include "nrf.h"
+#include "nordic_common.h"
+#include "ble.h"
+#include "nrf_sdh_ble.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "usb_stream.h"
+
+
+#define PACKET_HEADER_LEN   8           /**< Length of the link-type header in front of the event body. */
+#define PAD4(len)           (((len) + 3) & ~3)
+
+#define BLOCK_SHB           0x0A0D0D0A  /**< Section Header Block. */
+#define BLOCK_IDB           0x00000001  /**< Interface Description Block. */
+#define BLOCK_ISB           0x00000005  /**< Interface Statistics Block. */
+#define BLOCK_EPB           0x00000006  /**< Enhanced Packet Block. */
+#define BYTE_ORDER_MAGIC    0x1A2B3C4D
+
+#define OPT_END             0           /**< opt_endofopt. */
+#define OPT_COMMENT         1           /**< opt_comment. */
+#define OPT_ISB_IFRECV      4           /**< isb_ifrecv. */
+#define OPT_ISB_IFDROP      5           /**< isb_ifdrop. */
+
+#define SHB_LEN             28
+#define IDB_LEN             20
+#define EPB_OVERHEAD        32          /**< Enhanced Packet Block without packet data. */
+#define EPB_MAX_LEN         (EPB_OVERHEAD + PAD4(PACKET_HEADER_LEN + BLE_CAPTURE_SNAPLEN))
+#define COMMENT_MAX_LEN     120
+#define ISB_MAX_LEN         (24 + 2 * 12 + 4 + COMMENT_MAX_LEN + 4)
+
+/**@brief Recorded event. */
+typedef struct
+{
+    uint64_t ticks;                                 /**< app_timer ticks since boot. */
+    uint16_t id;                                    /**< Event ID. */
+    uint16_t conn_handle;                           /**< Connection handle. */
+    uint16_t orig_len;                              /**< Length of the whole event body. */
+    uint8_t  source;                                /**< @ref ble_capture_source_t. */
+    uint8_t  len;                                   /**< Bytes of the body in @ref data. */
+    uint8_t  data[BLE_CAPTURE_SNAPLEN];             /**< Start of the event body. */
+} capture_rec_t;
+
+/**@brief Cost of capture since start. */
+typedef struct
+{
+    uint64_t start_ticks;                           /**< Time of start. */
+    uint32_t recorded;                              /**< Records put in the ring. */
+    uint32_t dropped;                               /**< Records lost to a full ring. */
+    uint64_t record_cycles;                         /**< Cycles spent in @ref ble_capture_record. */
+    uint32_t record_cycles_max;                     /**< Longest @ref ble_capture_record. */
+    uint64_t convert_cycles;                        /**< Cycles spent making and queueing blocks. */
+    uint32_t converted;                             /**< Records sent to USB. */
+} capture_stats_t;
+
+static capture_rec_t     m_ring[BLE_CAPTURE_RING_COUNT];
+static uint8_t           m_head;                    /**< Oldest record. */
+static volatile uint8_t  m_count;                   /**< Records in the ring. */
+static volatile bool     m_running;                 /**< Capture started by the host. */
+static bool              m_header_pending;          /**< Section and interface blocks not sent yet. */
+static bool              m_stats_pending;           /**< Statistics block to send once the ring is empty. */
+static uint64_t          m_ticks;                   /**< app_timer ticks since boot, 64 bits wide. */
+static uint32_t          m_ticks_last;              /**< Counter value when @ref m_ticks was updated. */
+static capture_stats_t   m_stats;
+
+
+/**@brief Function for bringing the 64-bit tick count up to date.
+ *
+ * @details Must be called in a critical region, at least once per wrap of the RTC counter.
+ */
+static uint64_t ticks_update(void)
+{
+    uint32_t now = app_timer_cnt_get();
+
+    m_ticks     += app_timer_cnt_diff_compute(now, m_ticks_last);
+    m_ticks_last = now;
+
+    return m_ticks;
+}
+
+
+static uint64_t ticks_to_us(uint64_t ticks)
+{
+    return (ticks * 1000000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ;
+}
+
+
+static uint8_t * u64_encode(uint64_t value, uint8_t * p_out)
+{
+    (void)uint32_encode((uint32_t)value, p_out);
+    (void)uint32_encode((uint32_t)(value >> 32), p_out + 4);
+
+    return p_out + 8;
+}
+
+
+/**@brief Function for writing the head and tail of a block around a body that is already there.
+ *
+ * @return Length of the block.
+ */
+static uint16_t block_close(uint8_t * p_block, uint32_t type, uint16_t body_len)
+{
+    uint16_t len = 12 + body_len;
+
+    (void)uint32_encode(type, &p_block[0]);
+    (void)uint32_encode(len, &p_block[4]);
+    (void)uint32_encode(len, &p_block[len - 4]);
+
+    return len;
+}
+
+
+/**@brief Function for writing an option and its padding.
+ *
+ * @return Where the next option goes.
+ */
+static uint8_t * option_write(uint8_t * p_out, uint16_t code, void const * p_value, uint16_t len)
+{
+    uint16_t padded = PAD4(len);
+
+    (void)uint16_encode(code, &p_out[0]);
+    (void)uint16_encode(len, &p_out[2]);
+    memset(&p_out[4], 0, padded);
+    if (len > 0)
+    {
+        memcpy(&p_out[4], p_value, len);
+    }
+
+    return p_out + 4 + padded;
+}
+
+
+static uint16_t header_blocks_write(uint8_t * p_out)
+{
+    uint8_t * p_body = &p_out[8];
+    uint16_t  shb_len;
+
+    // Section Header Block: version 1.0, section length unknown.
+    (void)uint32_encode(BYTE_ORDER_MAGIC, &p_body[0]);
+    (void)uint16_encode(1, &p_body[4]);
+    (void)uint16_encode(0, &p_body[6]);
+    (void)u64_encode(UINT64_MAX, &p_body[8]);
+    shb_len = block_close(p_out, BLOCK_SHB, SHB_LEN - 12);
+
+    // Interface Description Block: microsecond timestamps by default.
+    p_out  = &p_out[shb_len];
+    p_body = &p_out[8];
+    (void)uint16_encode(BLE_CAPTURE_LINKTYPE, &p_body[0]);
+    (void)uint16_encode(0, &p_body[2]);
+    (void)uint32_encode(PACKET_HEADER_LEN + BLE_CAPTURE_SNAPLEN, &p_body[4]);
+
+    return shb_len + block_close(p_out, BLOCK_IDB, IDB_LEN - 12);
+}
+
+
+static uint16_t epb_write(uint8_t * p_out, capture_rec_t const * p_rec)
+{
+    uint8_t * p_body  = &p_out[8];
+    uint8_t * p_pkt   = &p_body[20];
+    uint64_t  ts      = ticks_to_us(p_rec->ticks);
+    uint16_t  cap_len = PACKET_HEADER_LEN + p_rec->len;
+    uint16_t  padded  = PAD4(cap_len);
+
+    (void)uint32_encode(0, &p_body[0]);
+    (void)uint32_encode((uint32_t)(ts >> 32), &p_body[4]);
+    (void)uint32_encode((uint32_t)ts, &p_body[8]);
+    (void)uint32_encode(cap_len, &p_body[12]);
+    (void)uint32_encode(PACKET_HEADER_LEN + p_rec->orig_len, &p_body[16]);
+
+    memset(p_pkt, 0, padded);
+    p_pkt[0] = p_rec->source;
+    (void)uint16_encode(p_rec->id, &p_pkt[2]);
+    (void)uint16_encode(p_rec->conn_handle, &p_pkt[4]);
+    (void)uint16_encode(p_rec->orig_len, &p_pkt[6]);
+    memcpy(&p_pkt[PACKET_HEADER_LEN], p_rec->data, p_rec->len);
+
+    return block_close(p_out, BLOCK_EPB, 20 + padded);
+}
+
+
+/**@brief Function for writing the statistics block that ends a capture. */
+static uint16_t isb_write(uint8_t * p_out)
+{
+    uint8_t * p_body = &p_out[8];
+    uint8_t * p_opt;
+    uint64_t  now;
+    uint64_t  elapsed_cycles;
+    uint32_t  load;
+    uint8_t   count[8];
+    char      comment[COMMENT_MAX_LEN];
+    int       comment_len;
+
+    CRITICAL_REGION_ENTER();
+    now = ticks_update();
+    CRITICAL_REGION_EXIT();
+
+    // CPU share in thousandths of a percent.
+    elapsed_cycles = ((now - m_stats.start_ticks) * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1) *
+                      SystemCoreClock) / APP_TIMER_CLOCK_FREQ;
+    load = (elapsed_cycles == 0) ? 0 :
+           (uint32_t)(((m_stats.record_cycles + m_stats.convert_cycles) * 100000) / elapsed_cycles);
+
+    comment_len = snprintf(comment, sizeof(comment),
+                           "record avg %lu max %lu cycles, convert avg %lu cycles, CPU %lu.%03lu%%",
+                           (unsigned long)((m_stats.recorded == 0) ? 0 : m_stats.record_cycles / m_stats.recorded),
+                           (unsigned long)m_stats.record_cycles_max,
+                           (unsigned long)((m_stats.converted == 0) ? 0 : m_stats.convert_cycles / m_stats.converted),
+                           (unsigned long)(load / 1000),
+                           (unsigned long)(load % 1000));
+    comment_len = MIN(MAX(comment_len, 0), (int)sizeof(comment) - 1);
+
+    now = ticks_to_us(now);
+    (void)uint32_encode(0, &p_body[0]);
+    (void)uint32_encode((uint32_t)(now >> 32), &p_body[4]);
+    (void)uint32_encode((uint32_t)now, &p_body[8]);
+
+    p_opt = &p_body[12];
+    (void)u64_encode((uint64_t)m_stats.recorded + m_stats.dropped, count);
+    p_opt = option_write(p_opt, OPT_ISB_IFRECV, count, sizeof(count));
+    (void)u64_encode(m_stats.dropped, count);
+    p_opt = option_write(p_opt, OPT_ISB_IFDROP, count, sizeof(count));
+    p_opt = option_write(p_opt, OPT_COMMENT, comment, (uint16_t)comment_len);
+    p_opt = option_write(p_opt, OPT_END, NULL, 0);
+
+    return block_close(p_out, BLOCK_ISB, (uint16_t)(p_opt - p_body));
+}
+
+
+void ble_capture_record(ble_capture_source_t source,
+                        uint16_t             id,
+                        uint16_t             conn_handle,
+                        void const         * p_data,
+                        uint16_t             len)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint32_t cycles;
+
+    if (!m_running)
+    {
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    if (m_count == BLE_CAPTURE_RING_COUNT)
+    {
+        m_stats.dropped++;
+    }
+    else
+    {
+        capture_rec_t * p_rec = &m_ring[(m_head + m_count) % BLE_CAPTURE_RING_COUNT];
+
+        p_rec->ticks       = ticks_update();
+        p_rec->id          = id;
+        p_rec->conn_handle = conn_handle;
+        p_rec->orig_len    = len;
+        p_rec->source      = (uint8_t)source;
+        p_rec->len         = (uint8_t)MIN(len, BLE_CAPTURE_SNAPLEN);
+        memcpy(p_rec->data, p_data, p_rec->len);
+        m_count++;
+        m_stats.recorded++;
+    }
+
+    cycles                    = DWT->CYCCNT - start;
+    m_stats.record_cycles    += cycles;
+    m_stats.record_cycles_max = MAX(m_stats.record_cycles_max, cycles);
+    CRITICAL_REGION_EXIT();
+}
+
+
+void ble_capture_on_frame(sdu_buf_t * p_buf)
+{
+    if (p_buf->len < 1)
+    {
+        return;
+    }
+
+    if (sdu_buf_payload(p_buf)[0] != 0)
+    {
+        CRITICAL_REGION_ENTER();
+        memset(&m_stats, 0, sizeof(m_stats));
+        m_stats.start_ticks = ticks_update();
+        m_head              = 0;
+        m_count             = 0;
+        m_header_pending    = true;
+        m_stats_pending     = false;
+        m_running           = true;
+        CRITICAL_REGION_EXIT();
+    }
+    else if (m_running)
+    {
+        m_running       = false;
+        m_stats_pending = true;
+    }
+}
+
+
+void ble_capture_process(void)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint8_t  block[MAX(SHB_LEN + IDB_LEN, ISB_MAX_LEN)];
+    uint8_t  count;
+
+    CRITICAL_REGION_ENTER();
+    (void)ticks_update();
+    count = m_count;
+    CRITICAL_REGION_EXIT();
+
+    if (m_header_pending)
+    {
+        if (usb_stream_frame_put(BLE_CAPTURE_FRAME_PCAPNG, block, header_blocks_write(block), NULL, 0)
+            != NRF_SUCCESS)
+        {
+            return;
+        }
+        m_header_pending = false;
+    }
+
+    // The producer only writes behind the records counted here, so they can be read
+    // outside the critical region. Several blocks share a buffer.
+    while (count > 0)
+    {
+        sdu_buf_t * p_buf = sdu_pool_alloc();
+        uint8_t   * p_out;
+        uint8_t     taken = 0;
+        ret_code_t  err_code;
+
+        if (p_buf == NULL)
+        {
+            break;
+        }
+
+        p_out = sdu_buf_payload(p_buf);
+        while ((taken < count) && (p_buf->len + EPB_MAX_LEN <= SDU_POOL_DATA_SIZE))
+        {
+            p_buf->len += epb_write(&p_out[p_buf->len],
+                                    &m_ring[(m_head + taken) % BLE_CAPTURE_RING_COUNT]);
+            taken++;
+        }
+
+        err_code = usb_stream_buf_put(BLE_CAPTURE_FRAME_PCAPNG, p_buf);
+        sdu_pool_release(p_buf);
+        if (err_code != NRF_SUCCESS)
+        {
+            break;
+        }
+
+        CRITICAL_REGION_ENTER();
+        m_head   = (m_head + taken) % BLE_CAPTURE_RING_COUNT;
+        m_count -= taken;
+        CRITICAL_REGION_EXIT();
+
+        count             -= taken;
+        m_stats.converted += taken;
+    }
+
+    m_stats.convert_cycles += DWT->CYCCNT - start;
+
+    if (m_stats_pending && (count == 0))
+    {
+        if (usb_stream_frame_put(BLE_CAPTURE_FRAME_PCAPNG, block, isb_write(block), NULL, 0)
+            == NRF_SUCCESS)
+        {
+            m_stats_pending = false;
+        }
+    }
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @details Every event body starts with the connection handle.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    ble_capture_record(BLE_CAPTURE_SOURCE_BLE,
+                       p_ble_evt->header.evt_id,
+                       p_ble_evt->evt.gap_evt.conn_handle,
+                       &p_ble_evt->evt,
+                       p_ble_evt->header.evt_len - sizeof(ble_evt_hdr_t));
+}
+
+NRF_SDH_BLE_OBSERVER(m_ble_capture_obs, BLE_CAPTURE_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+ret_code_t ble_capture_init(void)
+{
+    // The cycle counter may already run for boot_time; it is not reset here.
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+
+    m_running    = false;
+    m_head       = 0;
+    m_count      = 0;
+    m_ticks      = 0;
+    m_ticks_last = app_timer_cnt_get();
+
+    return NRF_SUCCESS;
+}
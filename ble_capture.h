@@ -0,0 +1,116 @@
+/**@file
+ *
+ * @defgroup ble_capture BLE event capture
+ * @{
+ * @brief Timestamped record of the BLE and OTS events the dongle handles, streamed to the host
+ *        as pcapng.
+ *
+ * @details The module's BLE observer records every SoftDevice event, including the GATT, ATT
+ *          and L2CAP channel events (credits, SDUs sent and received). The OTS event handler
+ *          records the OTS events through @ref ble_capture_record. Records go into a ring of
+ *          @ref BLE_CAPTURE_RING_COUNT fixed-size slots. Event bodies are cut to
+ *          @ref BLE_CAPTURE_SNAPLEN bytes; SDU data is not captured, only its length.
+ *
+ *          The host starts and stops capture with a @ref BLE_CAPTURE_FRAME_CONTROL frame (one
+ *          byte, 1: start, 0: stop). @ref ble_capture_process, called from the main loop,
+ *          turns the records into pcapng blocks. It sends each block as the payload of a
+ *          @ref BLE_CAPTURE_FRAME_PCAPNG frame, so the payloads, written out in order, make a
+ *          valid pcapng file:
+ *
+ *          - On start: a Section Header Block and an Interface Description Block with link type
+ *            @ref BLE_CAPTURE_LINKTYPE.
+ *          - For each record: an Enhanced Packet Block with a microsecond timestamp since boot.
+ *          - On stop: an Interface Statistics Block with the records captured and dropped, and
+ *            a comment giving the cost of capture in CPU cycles.
+ *
+ *          Packet layout of @ref BLE_CAPTURE_LINKTYPE:
+ *
+ *          | Offset | Size | Field                                                     |
+ *          |--------|------|-----------------------------------------------------------|
+ *          | 0      | 1    | Source (@ref ble_capture_source_t)                        |
+ *          | 1      | 1    | Reserved                                                  |
+ *          | 2      | 2    | Event ID (LE): ble_evt_hdr_t::evt_id or ble_ots_evt_type_t |
+ *          | 4      | 2    | Connection handle (LE)                                    |
+ *          | 6      | 2    | Length of the whole event body (LE)                       |
+ *          | 8      | n    | Event body, as the SoftDevice laid it out                 |
+ *
+ *          tools/ble_capture.py records the stream to a file and decodes it.
+ *
+ *          Recording costs a short copy in a critical region. While capture is stopped, it is a
+ *          single flag test. The cycles spent recording and converting are counted with the DWT
+ *          cycle counter, so their share of the CPU can be checked before capture is left on.
+ */
+#ifndef BLE_CAPTURE_H__
+#define BLE_CAPTURE_H__
+
+#include <stdint.h>
+#include "sdu_pool.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLE_CAPTURE_BLE_OBSERVER_PRIO   0       /**< Priority of the BLE observer. Runs first, so events are stamped as they arrive. */
+#define BLE_CAPTURE_RING_COUNT          64      /**< Records waiting for USB at most. */
+#define BLE_CAPTURE_SNAPLEN             48      /**< Bytes of an event body kept. */
+
+#define BLE_CAPTURE_FRAME_CONTROL       0x30    /**< Host to dongle: start or stop capture. */
+#define BLE_CAPTURE_FRAME_PCAPNG        0x31    /**< Dongle to host: one pcapng block. */
+
+#define BLE_CAPTURE_LINKTYPE            147     /**< LINKTYPE_USER0. */
+
+
+/**@brief Origin of a record. */
+typedef enum
+{
+    BLE_CAPTURE_SOURCE_BLE,                     /**< SoftDevice event. */
+    BLE_CAPTURE_SOURCE_OTS,                     /**< OTS event. */
+} ble_capture_source_t;
+
+
+/**@brief Function for initializing the module. Capture starts stopped.
+ *
+ * @return NRF_SUCCESS.
+ */
+ret_code_t ble_capture_init(void);
+
+
+/**@brief Function for recording an event.
+ *
+ * @details Can be called from any context. Does nothing while capture is stopped.
+ *
+ * @param[in] source       Origin of the event.
+ * @param[in] id           Event ID.
+ * @param[in] conn_handle  Connection the event belongs to.
+ * @param[in] p_data       Event body.
+ * @param[in] len          Length of the event body.
+ */
+void ble_capture_record(ble_capture_source_t source,
+                        uint16_t             id,
+                        uint16_t             conn_handle,
+                        void const         * p_data,
+                        uint16_t             len);
+
+
+/**@brief Function for handling a @ref BLE_CAPTURE_FRAME_CONTROL frame from the host.
+ *
+ * @param[in] p_buf  Buffer holding the frame payload.
+ */
+void ble_capture_on_frame(sdu_buf_t * p_buf);
+
+
+/**@brief Function for sending recorded events to the host. Call from the main loop.
+ *
+ * @details Stops when the USB stream is full and carries on at the next call.
+ */
+void ble_capture_process(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLE_CAPTURE_H__
+
+/** @} */
@@ -0,0 +1,442 @@
+#include <string.h>
+#include "ble_msg.h"
+#include "ble_conn_params.h"
+#include "ble_srv_common.h"
+#include "app_util_platform.h"
+#include "msg.h"
+#include "usb_stream.h"
+#include "event_trace.h"
+#include "hvx_queue.h"
+
+
+#define IDLE_CHECK_INTERVAL     (BLE_MSG_IDLE_TIMEOUT / 4)     /**< Interval of the idle check. */
+
+/**@brief Every link still gets its full event length within the fast interval. */
+STATIC_ASSERT(NRF_SDH_BLE_GAP_EVENT_LENGTH * NRF_SDH_BLE_TOTAL_LINK_COUNT <= BLE_MSG_FAST_MIN_INTERVAL);
+
+/**@brief Queued message. */
+typedef struct
+{
+    uint32_t queued_ticks;                          /**< Timestamp of ble_msg_send. */
+    uint16_t len;                                   /**< Length of the message. */
+    uint8_t  data[BLE_MSG_MAX_LEN];                 /**< Message. */
+} msg_entry_t;
+
+/**@brief Message state of one client. */
+typedef struct
+{
+    uint16_t    conn_handle;                        /**< Connection handle, BLE_CONN_HANDLE_INVALID if the entry is free. */
+    bool        fast;                               /**< The fast interval has been asked for. */
+    uint32_t    activity_ticks;                     /**< Timestamp of the last message either way. */
+    msg_entry_t queue[BLE_MSG_QUEUE_DEPTH];         /**< Messages waiting for the SoftDevice. */
+    uint8_t     head;                               /**< Index of the oldest queued message. */
+    uint8_t     count;                              /**< Number of queued messages. */
+    bool        pumping;                            /**< A context is handing messages to the SoftDevice. */
+    bool        pump_again;                         /**< The queue changed while it did. */
+    uint32_t    sent;                               /**< Messages handed to the SoftDevice since the link became fast. */
+    uint32_t    expired;                            /**< Messages dropped for age since the link became fast. */
+    uint32_t    max_wait_ticks;                     /**< Longest queueing time since the link became fast. */
+} msg_link_t;
+
+APP_TIMER_DEF(m_idle_timer);
+
+static uint16_t                 m_service_handle;
+static ble_gatts_char_handles_t m_rx_handles;
+static ble_gatts_char_handles_t m_tx_handles;
+static ble_gap_conn_params_t    m_fast_params;
+static ble_gap_conn_params_t    m_normal_params;
+static msg_link_t               m_links[BLE_MSG_LINK_COUNT];
+
+
+static msg_link_t * link_find(uint16_t conn_handle)
+{
+    for (uint32_t i = 0; i < BLE_MSG_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**@brief Function for checking whether the client has enabled notifications of TX.
+ *
+ * @details The CCCD is read back rather than tracked, so values restored for a bonded peer
+ *          count as well.
+ */
+static bool notification_enabled(uint16_t conn_handle)
+{
+    uint8_t           cccd[BLE_CCCD_VALUE_LEN];
+    ble_gatts_value_t value;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = sizeof(cccd);
+    value.p_value = cccd;
+
+    return (sd_ble_gatts_value_get(conn_handle, m_tx_handles.cccd_handle, &value) == NRF_SUCCESS) &&
+           ble_srv_is_notification_enabled(cccd);
+}
+
+
+/**@brief Function for noting traffic on a link and asking for the fast interval if needed. */
+static void link_activity(msg_link_t * p_link)
+{
+    p_link->activity_ticks = app_timer_cnt_get();
+
+    if (!p_link->fast &&
+        (ble_conn_params_change_conn_params(p_link->conn_handle, &m_fast_params) == NRF_SUCCESS))
+    {
+        p_link->fast           = true;
+        p_link->sent           = 0;
+        p_link->expired        = 0;
+        p_link->max_wait_ticks = 0;
+    }
+}
+
+
+/**@brief Function for taking the pump of a link, or asking its holder to run once more.
+ *
+ * @return true if the caller now pumps the queue.
+ */
+static bool pump_take(msg_link_t * p_link)
+{
+    bool taken;
+
+    CRITICAL_REGION_ENTER();
+    taken = !p_link->pumping;
+    if (taken)
+    {
+        p_link->pumping = true;
+    }
+    else
+    {
+        p_link->pump_again = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return taken;
+}
+
+
+/**@brief Function for handing queued messages to the SoftDevice until it is full.
+ *
+ * @details Called from the main loop and from the BLE event handler. Only the queue indexes are
+ *          updated in a critical region; sd_ble_gatts_hvx is called outside it. One context pumps
+ *          a link at a time, so the oldest message cannot be sent twice. A call that finds the
+ *          pump taken makes the holder run again before it lets go.
+ */
+static void queue_pump(msg_link_t * p_link)
+{
+    bool done = false;
+
+    if (!pump_take(p_link))
+    {
+        return;
+    }
+
+    while (!done)
+    {
+        uint32_t      now = app_timer_cnt_get();
+        msg_entry_t * p_entry;
+        uint32_t      waited;
+        ret_code_t    err_code;
+
+        CRITICAL_REGION_ENTER();
+        p_link->pump_again = false;
+        p_entry            = (p_link->count > 0) ? &p_link->queue[p_link->head] : NULL;
+        CRITICAL_REGION_EXIT();
+
+        // Producers only write behind the oldest message, so it stays as it is until popped.
+        while (p_entry != NULL)
+        {
+            ble_gatts_hvx_params_t hvx_params;
+
+            waited = app_timer_cnt_diff_compute(now, p_entry->queued_ticks);
+            if (waited > BLE_MSG_MAX_AGE)
+            {
+                p_link->expired++;
+            }
+            else
+            {
+                memset(&hvx_params, 0, sizeof(hvx_params));
+                hvx_params.handle = m_tx_handles.value_handle;
+                hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+                hvx_params.p_len  = &p_entry->len;
+                hvx_params.p_data = p_entry->data;
+
+                err_code = sd_ble_gatts_hvx(p_link->conn_handle, &hvx_params);
+                if (err_code == NRF_ERROR_RESOURCES)
+                {
+                    // Resumed on BLE_GATTS_EVT_HVN_TX_COMPLETE.
+                    break;
+                }
+                if (err_code == NRF_SUCCESS)
+                {
+                    hvx_queue_hvn_sent(p_link->conn_handle);
+                    p_link->sent++;
+                    p_link->max_wait_ticks = MAX(p_link->max_wait_ticks, waited);
+                }
+            }
+
+            CRITICAL_REGION_ENTER();
+            p_link->head = (p_link->head + 1) % BLE_MSG_QUEUE_DEPTH;
+            p_link->count--;
+            p_entry      = (p_link->count > 0) ? &p_link->queue[p_link->head] : NULL;
+            CRITICAL_REGION_EXIT();
+        }
+
+        // A message queued, or a TX_COMPLETE, while the SoftDevice was called is seen here.
+        CRITICAL_REGION_ENTER();
+        done = !p_link->pump_again;
+        if (done)
+        {
+            p_link->pumping = false;
+        }
+        CRITICAL_REGION_EXIT();
+    }
+}
+
+
+static ret_code_t link_send(msg_link_t * p_link, uint8_t const * p_data, uint16_t len)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    link_activity(p_link);
+
+    CRITICAL_REGION_ENTER();
+    if (p_link->count == BLE_MSG_QUEUE_DEPTH)
+    {
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        msg_entry_t * p_entry = &p_link->queue[(p_link->head + p_link->count) % BLE_MSG_QUEUE_DEPTH];
+
+        p_entry->queued_ticks = app_timer_cnt_get();
+        p_entry->len          = len;
+        memcpy(p_entry->data, p_data, len);
+        p_link->count++;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code == NRF_SUCCESS)
+    {
+        queue_pump(p_link);
+    }
+
+    return err_code;
+}
+
+
+ret_code_t ble_msg_send(uint16_t conn_handle, uint8_t const * p_data, uint16_t len)
+{
+    ret_code_t err_code = NRF_ERROR_INVALID_STATE;
+
+    if ((len == 0) || (len > BLE_MSG_MAX_LEN))
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    for (uint32_t i = 0; i < BLE_MSG_LINK_COUNT; i++)
+    {
+        msg_link_t * p_link = &m_links[i];
+
+        if ((p_link->conn_handle == BLE_CONN_HANDLE_INVALID) ||
+            ((conn_handle != BLE_MSG_CONN_HANDLE_ALL) && (conn_handle != p_link->conn_handle)) ||
+            !notification_enabled(p_link->conn_handle))
+        {
+            continue;
+        }
+
+        if (link_send(p_link, p_data, len) == NRF_SUCCESS)
+        {
+            err_code = NRF_SUCCESS;
+        }
+        else if (err_code != NRF_SUCCESS)
+        {
+            err_code = NRF_ERROR_NO_MEM;
+        }
+    }
+
+    return err_code;
+}
+
+
+void ble_msg_on_frame(sdu_buf_t * p_buf)
+{
+    uint8_t const * p_data = sdu_buf_payload(p_buf);
+    ret_code_t      err_code;
+
+    if (p_buf->len < sizeof(uint16_t))
+    {
+        return;
+    }
+
+    err_code = ble_msg_send(uint16_decode(p_data), &p_data[sizeof(uint16_t)], p_buf->len - sizeof(uint16_t));
+    if (err_code != NRF_SUCCESS)
+    {
+        msg("Message not sent: 0x%x\r\n", err_code);
+    }
+}
+
+
+/**@brief Function for forwarding a message from a client to the host. */
+static void on_rx_write(msg_link_t * p_link, ble_gatts_evt_write_t const * p_write)
+{
+    uint8_t head[sizeof(uint16_t)];
+
+    link_activity(p_link);
+
+    (void)uint16_encode(p_link->conn_handle, head);
+    (void)usb_stream_frame_put(BLE_MSG_FRAME_RECEIVED, head, sizeof(head), p_write->data, p_write->len);
+}
+
+
+/**@brief Function for asking for the normal interval again on links that have gone quiet. */
+static void idle_timeout_handler(void * p_context)
+{
+    uint32_t now = app_timer_cnt_get();
+
+    event_trace_record(EVENT_TRACE_SOURCE_TIMER, EVENT_TRACE_TIMER_MSG_IDLE, 0);
+
+    for (uint32_t i = 0; i < BLE_MSG_LINK_COUNT; i++)
+    {
+        msg_link_t * p_link = &m_links[i];
+
+        if ((p_link->conn_handle == BLE_CONN_HANDLE_INVALID) ||
+            !p_link->fast ||
+            (p_link->count > 0) ||
+            (app_timer_cnt_diff_compute(now, p_link->activity_ticks) < BLE_MSG_IDLE_TIMEOUT))
+        {
+            continue;
+        }
+
+        if (ble_conn_params_change_conn_params(p_link->conn_handle, &m_normal_params) == NRF_SUCCESS)
+        {
+            p_link->fast = false;
+            msg("Messages on 0x%04x: %u sent, %u expired, longest wait %u ticks\r\n",
+                p_link->conn_handle, p_link->sent, p_link->expired, p_link->max_wait_ticks);
+        }
+    }
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    msg_link_t * p_link;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            if (p_ble_evt->evt.gap_evt.params.connected.role != BLE_GAP_ROLE_PERIPH)
+            {
+                break;
+            }
+            p_link = link_find(BLE_CONN_HANDLE_INVALID);
+            if (p_link != NULL)
+            {
+                memset(p_link, 0, sizeof(*p_link));
+                p_link->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_link = link_find(p_ble_evt->evt.gap_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+            }
+            break;
+
+        case BLE_GATTS_EVT_WRITE:
+            p_link = link_find(p_ble_evt->evt.gatts_evt.conn_handle);
+            if ((p_link != NULL) &&
+                (p_ble_evt->evt.gatts_evt.params.write.handle == m_rx_handles.value_handle))
+            {
+                on_rx_write(p_link, &p_ble_evt->evt.gatts_evt.params.write);
+            }
+            break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            p_link = link_find(p_ble_evt->evt.gatts_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                queue_pump(p_link);
+            }
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_ble_msg_obs, BLE_MSG_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+ret_code_t ble_msg_init(void)
+{
+    ret_code_t            err_code;
+    ble_uuid_t            ble_uuid;
+    ble_uuid128_t         base_uuid = {BLE_MSG_UUID_BASE};
+    ble_add_char_params_t add_char_params;
+
+    for (uint32_t i = 0; i < BLE_MSG_LINK_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    err_code = sd_ble_gap_ppcp_get(&m_normal_params);
+    VERIFY_SUCCESS(err_code);
+
+    m_fast_params                   = m_normal_params;
+    m_fast_params.min_conn_interval = BLE_MSG_FAST_MIN_INTERVAL;
+    m_fast_params.max_conn_interval = BLE_MSG_FAST_MAX_INTERVAL;
+
+    err_code = app_timer_create(&m_idle_timer, APP_TIMER_MODE_REPEATED, idle_timeout_handler);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = app_timer_start(m_idle_timer, IDLE_CHECK_INTERVAL, NULL);
+    VERIFY_SUCCESS(err_code);
+
+    // Add service.
+    err_code = sd_ble_uuid_vs_add(&base_uuid, &ble_uuid.type);
+    VERIFY_SUCCESS(err_code);
+
+    ble_uuid.uuid = BLE_MSG_UUID_SERVICE;
+
+    err_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &ble_uuid, &m_service_handle);
+    VERIFY_SUCCESS(err_code);
+
+    // Add RX characteristic.
+    memset(&add_char_params, 0, sizeof(add_char_params));
+    add_char_params.uuid                     = BLE_MSG_UUID_RX;
+    add_char_params.uuid_type                = ble_uuid.type;
+    add_char_params.max_len                  = BLE_MSG_MAX_LEN;
+    add_char_params.is_var_len               = true;
+    add_char_params.char_props.write         = 1;
+    add_char_params.char_props.write_wo_resp = 1;
+    add_char_params.write_access             = SEC_OPEN;
+
+    err_code = characteristic_add(m_service_handle, &add_char_params, &m_rx_handles);
+    VERIFY_SUCCESS(err_code);
+
+    // Add TX characteristic.
+    memset(&add_char_params, 0, sizeof(add_char_params));
+    add_char_params.uuid              = BLE_MSG_UUID_TX;
+    add_char_params.uuid_type         = ble_uuid.type;
+    add_char_params.max_len           = BLE_MSG_MAX_LEN;
+    add_char_params.is_var_len        = true;
+    add_char_params.char_props.notify = 1;
+    add_char_params.cccd_write_access = SEC_OPEN;
+
+    return characteristic_add(m_service_handle, &add_char_params, &m_tx_handles);
+}
@@ -0,0 +1,114 @@
+/**@file
+ *
+ * @defgroup ble_msg Low-latency Message Service
+ * @{
+ * @brief Small control messages between the host and BLE clients, delivered within a few
+ *        connection events.
+ *
+ * @details The service has two characteristics:
+ *
+ *          - RX (Write, Write Without Response): messages from the client, forwarded to the
+ *            host as @ref BLE_MSG_FRAME_RECEIVED frames.
+ *          - TX (Notify): messages from the host, sent with @ref BLE_MSG_FRAME_SEND frames.
+ *
+ *          A message is at most @ref BLE_MSG_MAX_LEN bytes, so it fits one packet at the
+ *          default ATT MTU.
+ *
+ *          The normal connection interval of 100-200 ms is slow for interactive use. When a
+ *          message is queued or received on a link, the module asks the central for the fast
+ *          interval through ble_conn_params. Once the link has been quiet for
+ *          @ref BLE_MSG_IDLE_TIMEOUT, it asks for the normal parameters again.
+ *
+ *          The fast interval is 15 ms. Every link must still get its event length,
+ *          NRF_SDH_BLE_GAP_EVENT_LENGTH, within it, so the configured event length is kept
+ *          short: 6 links of 2.5 ms. Bulk links get more air time through connection event
+ *          extension, which main.c enables, whenever the other links leave the radio idle.
+ *
+ *          Messages go straight to the SoftDevice when it has room. Otherwise they wait in a
+ *          per-link queue of @ref BLE_MSG_QUEUE_DEPTH, which is served on
+ *          BLE_GATTS_EVT_HVN_TX_COMPLETE before the bulk and OTS queues, since the module's
+ *          observer runs first. A message that has waited longer than @ref BLE_MSG_MAX_AGE is
+ *          dropped instead of being sent late.
+ *
+ *          Host frames:
+ *
+ *          | Frame                       | Payload                                         |
+ *          |-----------------------------|-------------------------------------------------|
+ *          | @ref BLE_MSG_FRAME_SEND     | Connection handle (u16, 0xFFFF: all), message   |
+ *          | @ref BLE_MSG_FRAME_RECEIVED | Connection handle (u16), message                |
+ */
+#ifndef BLE_MSG_H__
+#define BLE_MSG_H__
+
+#include <stdint.h>
+#include "ble.h"
+#include "app_util.h"
+#include "app_timer.h"
+#include "nrf_sdh_ble.h"
+#include "sdu_pool.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLE_MSG_BLE_OBSERVER_PRIO   1                                   /**< Priority of the BLE observer. Ahead of the bulk and hvx_queue observers. */
+#define BLE_MSG_LINK_COUNT          NRF_SDH_BLE_PERIPHERAL_LINK_COUNT   /**< Number of clients served at once. */
+#define BLE_MSG_QUEUE_DEPTH         8                                   /**< Messages queued per link. */
+#define BLE_MSG_MAX_LEN             20                                  /**< Longest message. */
+
+#define BLE_MSG_FAST_MIN_INTERVAL   MSEC_TO_UNITS(15, UNIT_1_25_MS)     /**< Shortest connection interval asked for while messages flow. */
+#define BLE_MSG_FAST_MAX_INTERVAL   MSEC_TO_UNITS(15, UNIT_1_25_MS)     /**< Longest connection interval asked for while messages flow. */
+#define BLE_MSG_IDLE_TIMEOUT        APP_TIMER_TICKS(2000)               /**< Quiet time before the normal interval is asked for again. */
+#define BLE_MSG_MAX_AGE             APP_TIMER_TICKS(500)                /**< Queued messages older than this are dropped. */
+
+#define BLE_MSG_UUID_BASE           {0x3E, 0x6B, 0x1A, 0x52, 0x8C, 0x4D, 0x91, 0xA7, \
+                                     0x2B, 0x45, 0xD0, 0xC3, 0x00, 0x00, 0x81, 0x5B}
+#define BLE_MSG_UUID_SERVICE        0x0001
+#define BLE_MSG_UUID_RX             0x0002
+#define BLE_MSG_UUID_TX             0x0003
+
+#define BLE_MSG_FRAME_SEND          0x20    /**< Host to dongle: message to send. */
+#define BLE_MSG_FRAME_RECEIVED      0x21    /**< Dongle to host: message from a client. */
+
+#define BLE_MSG_CONN_HANDLE_ALL     0xFFFF  /**< Send to every client with notifications enabled. */
+
+
+/**@brief Function for initializing the module and adding the service.
+ *
+ * @details The normal connection parameters are read from the PPCP, so call this after
+ *          sd_ble_gap_ppcp_set.
+ *
+ * @return NRF_SUCCESS or an error code from the SoftDevice or app_timer.
+ */
+ret_code_t ble_msg_init(void);
+
+
+/**@brief Function for sending a message to a client.
+ *
+ * @param[in] conn_handle  Client, or @ref BLE_MSG_CONN_HANDLE_ALL.
+ * @param[in] p_data       Message.
+ * @param[in] len          Length of the message.
+ *
+ * @retval NRF_SUCCESS                Message sent or queued (for at least one client).
+ * @retval NRF_ERROR_INVALID_LENGTH   Message empty or longer than @ref BLE_MSG_MAX_LEN.
+ * @retval NRF_ERROR_INVALID_STATE    No such client with notifications enabled.
+ * @retval NRF_ERROR_NO_MEM           Queue full.
+ */
+ret_code_t ble_msg_send(uint16_t conn_handle, uint8_t const * p_data, uint16_t len);
+
+
+/**@brief Function for handling a @ref BLE_MSG_FRAME_SEND frame from the host.
+ *
+ * @param[in] p_buf  Buffer holding the frame payload.
+ */
+void ble_msg_on_frame(sdu_buf_t * p_buf);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLE_MSG_H__
+
+/** @} */
@@ -0,0 +1,112 @@
+#include "boot_time.h"
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "nrf_nvic.h"
+#include "app_util_platform.h"
+#include "msg.h"
+
+
+#define CYCLES_PER_US   (SystemCoreClock / 1000000)     /**< DWT cycles per microsecond. */
+
+static uint32_t m_phase_cycles[BOOT_TIME_PHASE_COUNT];  /**< CYCCNT when each phase was reached. */
+static volatile uint32_t m_marked_mask;                 /**< Bit n is set when phase n was stamped. */
+
+static char const * const m_phase_names[BOOT_TIME_PHASE_COUNT] =
+{
+    "core init",
+    "SoftDevice enabled",
+    "BLE ready",
+    "advertising started",
+    "first advertisement",
+    "USB started",
+    "CDC port open",
+};
+
+
+void boot_time_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT       = 0;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+    m_marked_mask     = 0;
+}
+
+
+void boot_time_mark(boot_time_phase_t phase)
+{
+    uint32_t cycles = DWT->CYCCNT;
+
+    CRITICAL_REGION_ENTER();
+    if ((m_marked_mask & (1UL << phase)) == 0)
+    {
+        m_phase_cycles[phase] = cycles;
+        m_marked_mask        |= (1UL << phase);
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+
+bool boot_time_is_marked(boot_time_phase_t phase)
+{
+    return (m_marked_mask & (1UL << phase)) != 0;
+}
+
+
+ret_code_t boot_time_first_adv_watch(void)
+{
+    ret_code_t err_code;
+
+    // The SoftDevice refuses the configuration while the radio is in use, so it is done once.
+    if (boot_time_is_marked(BOOT_TIME_PHASE_FIRST_ADV))
+    {
+        return NRF_SUCCESS;
+    }
+
+    err_code = sd_radio_notification_cfg_set(NRF_RADIO_NOTIFICATION_TYPE_INT_ON_INACTIVE,
+                                             NRF_RADIO_NOTIFICATION_DISTANCE_NONE);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = sd_nvic_ClearPendingIRQ(RADIO_NOTIFICATION_IRQn);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = sd_nvic_SetPriority(RADIO_NOTIFICATION_IRQn, APP_IRQ_PRIORITY_LOW);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    return sd_nvic_EnableIRQ(RADIO_NOTIFICATION_IRQn);
+}
+
+
+/**@brief Radio notification interrupt: the first radio event after advertising started has ended. */
+void RADIO_NOTIFICATION_IRQHandler(void)
+{
+    boot_time_mark(BOOT_TIME_PHASE_FIRST_ADV);
+
+    // The notification stays configured; only the interrupt is turned off.
+    (void)sd_nvic_DisableIRQ(RADIO_NOTIFICATION_IRQn);
+}
+
+
+void boot_time_report(void)
+{
+    msg("Boot phases (from main()):\r\n");
+    for (uint32_t i = 0; i < BOOT_TIME_PHASE_COUNT; i++)
+    {
+        if (boot_time_is_marked((boot_time_phase_t)i))
+        {
+            msg("  %s: %u us\r\n", m_phase_names[i], m_phase_cycles[i] / CYCLES_PER_US);
+        }
+        else
+        {
+            msg("  %s: -\r\n", m_phase_names[i]);
+        }
+    }
+}
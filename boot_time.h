@@ -0,0 +1,80 @@
+/**@file
+ *
+ * @defgroup boot_time Boot timing
+ * @{
+ * @brief Timestamps of the boot phases, from main() to the first advertisement.
+ *
+ * @details Phases are stamped with the CPU cycle counter (DWT CYCCNT), which runs from the
+ *          start of main() on the HFCLK. It does not depend on the LFCLK, which is still
+ *          starting during most of the boot, and wraps only after 67 s.
+ *
+ *          The end of the first advertising event is caught with a one-shot radio
+ *          notification, so the reported time includes the SoftDevice scheduling the first
+ *          event, not just the call to sd_ble_gap_adv_start.
+ *
+ *          Each phase is stamped the first time it is reached. The report goes out over the
+ *          debug channel when the host opens the CDC ACM port.
+ */
+#ifndef BOOT_TIME_H__
+#define BOOT_TIME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**@brief Boot phases, in the order main() normally reaches them. */
+typedef enum
+{
+    BOOT_TIME_PHASE_CORE_INIT,          /**< Timers, buffer pools, BSP and power management ready. LFCLK still starting. */
+    BOOT_TIME_PHASE_SD_ENABLED,         /**< SoftDevice enabled. Includes any wait for the LFCLK. */
+    BOOT_TIME_PHASE_BLE_READY,          /**< BLE stack, services and peer manager initialized. */
+    BOOT_TIME_PHASE_ADV_STARTED,        /**< Advertising started. */
+    BOOT_TIME_PHASE_FIRST_ADV,          /**< End of the first advertising event on air. */
+    BOOT_TIME_PHASE_USB_STARTED,        /**< USBD started; the host enumerates from here. */
+    BOOT_TIME_PHASE_PORT_OPEN,          /**< Host opened the CDC ACM port. */
+    BOOT_TIME_PHASE_COUNT
+} boot_time_phase_t;
+
+
+/**@brief Function for starting the time base. Call first thing in main(). */
+void boot_time_init(void);
+
+
+/**@brief Function for stamping a phase. Only the first stamp of each phase is kept.
+ *
+ * @details Can be called from any context.
+ */
+void boot_time_mark(boot_time_phase_t phase);
+
+
+/**@brief Function for checking whether a phase has been reached. */
+bool boot_time_is_marked(boot_time_phase_t phase);
+
+
+/**@brief Function for stamping @ref BOOT_TIME_PHASE_FIRST_ADV at the end of the next radio event.
+ *
+ * @details Call once, after the BLE stack is enabled and before advertising is started, as
+ *          the SoftDevice only takes the radio notification configuration while the radio is
+ *          idle. The first radio event to end is then the first advertisement. The interrupt
+ *          is turned off once the phase is stamped. Does nothing if the phase is stamped.
+ *
+ * @return NRF_SUCCESS or an error code from the SoftDevice.
+ */
+ret_code_t boot_time_first_adv_watch(void);
+
+
+/**@brief Function for sending the phase times to the host. */
+void boot_time_report(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOT_TIME_H__
+
+/** @} */
@@ -0,0 +1,208 @@
+#include <string.h>
+#include "event_trace.h"
+#include "nrf.h"
+#include "nordic_common.h"
+#include "ble.h"
+#include "nrf_sdh_ble.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "usb_stream.h"
+
+
+#define TRACE_MAGIC         0x54524345                          /**< Marks a ring left by a previous run. */
+#define HEADER_LEN          4                                   /**< Length of the data frame header. */
+#define RECS_PER_FRAME      ((SDU_POOL_DATA_SIZE - HEADER_LEN) / sizeof(event_trace_rec_t))
+
+STATIC_ASSERT(sizeof(event_trace_rec_t) == 8);
+
+/**@brief Ring, kept over a soft reset. */
+typedef struct
+{
+    uint32_t          magic;                                    /**< @ref TRACE_MAGIC when the ring is valid. */
+    uint32_t          head;                                     /**< Where the next record goes. */
+    uint32_t          count;                                    /**< Records in the ring. */
+    uint32_t          check;                                    /**< Copy of the fields above, to catch a ring damaged by the reset. */
+    event_trace_rec_t recs[EVENT_TRACE_COUNT];
+} trace_ring_t;
+
+static trace_ring_t      m_ring __attribute__((section(".non_init")));
+static uint32_t          m_ticks;                               /**< app_timer ticks since boot, 32 bits wide. */
+static uint32_t          m_ticks_last;                          /**< Counter value when @ref m_ticks was updated. */
+static volatile bool     m_dumping;                             /**< Recording paused for a dump. */
+static bool              m_dump_clear;                          /**< Empty the ring after the dump. */
+static uint16_t          m_dump_index;                          /**< Next record of the dump to send. */
+static uint16_t          m_dump_total;                          /**< Records in the dump. */
+static uint32_t          m_missed;                              /**< Events not recorded during the dump. */
+
+
+static uint32_t ring_check(void)
+{
+    return m_ring.magic ^ m_ring.head ^ (m_ring.count << 16);
+}
+
+
+/**@brief Function for adding a record. Must be called in a critical region. */
+static void ring_put(event_trace_source_t source, uint8_t id, uint16_t arg)
+{
+    event_trace_rec_t * p_rec = &m_ring.recs[m_ring.head];
+    sdu_pool_stats_t    pool;
+    uint32_t            now   = app_timer_cnt_get();
+
+    m_ticks     += app_timer_cnt_diff_compute(now, m_ticks_last);
+    m_ticks_last = now;
+
+    sdu_pool_stats_get(&pool);
+
+    p_rec->ticks = m_ticks;
+    p_rec->info  = (uint8_t)((source << EVENT_TRACE_SOURCE_POS) | MIN(pool.in_use, EVENT_TRACE_POOL_MASK));
+    p_rec->id    = id;
+    p_rec->arg   = arg;
+
+    m_ring.head = (m_ring.head + 1) % EVENT_TRACE_COUNT;
+    if (m_ring.count < EVENT_TRACE_COUNT)
+    {
+        m_ring.count++;
+    }
+    m_ring.check = ring_check();
+}
+
+
+void event_trace_record(event_trace_source_t source, uint8_t id, uint16_t arg)
+{
+    CRITICAL_REGION_ENTER();
+    if (m_dumping)
+    {
+        m_missed++;
+    }
+    else
+    {
+        ring_put(source, id, arg);
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+
+void event_trace_on_frame(sdu_buf_t * p_buf)
+{
+    CRITICAL_REGION_ENTER();
+    if (!m_dumping)
+    {
+        m_dumping    = true;
+        m_dump_clear = (p_buf->len > 0) && ((sdu_buf_payload(p_buf)[0] & 0x01) != 0);
+        m_dump_index = 0;
+        m_dump_total = (uint16_t)m_ring.count;
+        m_missed     = 0;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+
+void event_trace_process(void)
+{
+    uint8_t header[HEADER_LEN];
+
+    // The ring does not move while m_dumping is set, so it is read without a critical region.
+    while (m_dumping && (m_dump_index < m_dump_total))
+    {
+        uint32_t pos   = (m_ring.head + EVENT_TRACE_COUNT - m_dump_total + m_dump_index) % EVENT_TRACE_COUNT;
+        uint32_t count = MIN(MIN(RECS_PER_FRAME, m_dump_total - m_dump_index), EVENT_TRACE_COUNT - pos);
+
+        (void)uint16_encode(m_dump_index, &header[0]);
+        (void)uint16_encode(m_dump_total, &header[2]);
+
+        if (usb_stream_frame_put(EVENT_TRACE_FRAME_DATA,
+                                 header,
+                                 sizeof(header),
+                                 (uint8_t const *)&m_ring.recs[pos],
+                                 count * sizeof(event_trace_rec_t)) != NRF_SUCCESS)
+        {
+            return;
+        }
+        m_dump_index += count;
+    }
+
+    if (m_dumping)
+    {
+        CRITICAL_REGION_ENTER();
+        if (m_dump_clear)
+        {
+            m_ring.count = 0;
+            m_ring.check = ring_check();
+        }
+        if (m_missed > 0)
+        {
+            ring_put(EVENT_TRACE_SOURCE_GAP, 0, (uint16_t)MIN(m_missed, UINT16_MAX));
+        }
+        m_dumping = false;
+        CRITICAL_REGION_EXIT();
+    }
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    uint16_t arg;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_L2CAP_EVT_CH_CREDIT:
+            arg = p_ble_evt->evt.l2cap_evt.params.credit.credits;
+            break;
+
+        case BLE_L2CAP_EVT_CH_RX:
+            arg = p_ble_evt->evt.l2cap_evt.params.rx.sdu_len;
+            break;
+
+        case BLE_L2CAP_EVT_CH_TX:
+            arg = p_ble_evt->evt.l2cap_evt.params.tx.sdu_buf.len;
+            break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            arg = p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count;
+            break;
+
+        default:
+            // Every event body starts with the connection handle.
+            arg = p_ble_evt->evt.gap_evt.conn_handle;
+            break;
+    }
+
+    event_trace_record(EVENT_TRACE_SOURCE_BLE, (uint8_t)p_ble_evt->header.evt_id, arg);
+}
+
+NRF_SDH_BLE_OBSERVER(m_event_trace_obs, EVENT_TRACE_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+ret_code_t event_trace_init(void)
+{
+    bool carried = (m_ring.magic == TRACE_MAGIC) &&
+                   (m_ring.head < EVENT_TRACE_COUNT) &&
+                   (m_ring.count <= EVENT_TRACE_COUNT) &&
+                   (m_ring.check == ring_check());
+
+    if (!carried)
+    {
+        memset(&m_ring, 0, sizeof(m_ring));
+        m_ring.magic = TRACE_MAGIC;
+        m_ring.check = ring_check();
+    }
+
+    m_ticks      = 0;
+    m_ticks_last = app_timer_cnt_get();
+    m_dumping    = false;
+
+    if (carried)
+    {
+        CRITICAL_REGION_ENTER();
+        ring_put(EVENT_TRACE_SOURCE_RESET, 0, (uint16_t)NRF_POWER->RESETREAS);
+        CRITICAL_REGION_EXIT();
+    }
+
+    return NRF_SUCCESS;
+}
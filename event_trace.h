@@ -0,0 +1,140 @@
+/**@file
+ *
+ * @defgroup event_trace Event trace
+ * @{
+ * @brief Flight recorder of the events the dongle dispatches, for replay on the host.
+ *
+ * @details Every BLE event, USB device and CDC ACM event, app_timer timeout and USB stream
+ *          overflow is recorded as one 8-byte @ref event_trace_rec_t in a ring of
+ *          @ref EVENT_TRACE_COUNT records. When the ring is full, the oldest record is
+ *          overwritten, so the ring always holds the latest events.
+ *
+ *          The ring is in the .non_init section. It survives a soft reset, such as one caused by
+ *          the error handler, and carries on after a @ref EVENT_TRACE_SOURCE_RESET record. The
+ *          events that led to the reset can then be read out afterwards.
+ *
+ *          The host reads the ring with a @ref EVENT_TRACE_FRAME_DUMP frame. Its payload is
+ *          empty, or one byte of flags; bit 0 clears the ring after the dump. Recording pauses
+ *          while @ref event_trace_process sends the records, oldest first, in
+ *          @ref EVENT_TRACE_FRAME_DATA frames:
+ *
+ *          | Offset | Size | Field                                              |
+ *          |--------|------|----------------------------------------------------|
+ *          | 0      | 2    | Index of the first record in this frame (LE)       |
+ *          | 2      | 2    | Records in the dump (LE)                           |
+ *          | 4      | 8n   | Records                                            |
+ *
+ *          Events that come in during the dump are counted, and a @ref EVENT_TRACE_SOURCE_GAP
+ *          record is added when recording resumes.
+ *
+ *          tools/trace_replay.py saves a dump. It replays the dump through a model of the
+ *          dongle's buffer pool, USB stream and L2CAP credits, and reports timing and queueing.
+ *          With --harness it also feeds the dump to tests/host/trace_harness.c, which runs the
+ *          real @ref sdu_pool, @ref usb_stream and @ref host_link built for the host.
+ */
+#ifndef EVENT_TRACE_H__
+#define EVENT_TRACE_H__
+
+#include <stdint.h>
+#include "sdu_pool.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EVENT_TRACE_BLE_OBSERVER_PRIO   0       /**< Priority of the BLE observer. Runs first, so events are stamped as they arrive. */
+#define EVENT_TRACE_COUNT               512     /**< Records in the ring. */
+
+#define EVENT_TRACE_FRAME_DUMP          0x40    /**< Host to dongle: send the ring. */
+#define EVENT_TRACE_FRAME_DATA          0x41    /**< Dongle to host: part of the ring. */
+
+#define EVENT_TRACE_SOURCE_POS          5       /**< Position of the source in event_trace_rec_t::info. */
+#define EVENT_TRACE_POOL_MASK           0x1F    /**< Buffers in use, in event_trace_rec_t::info. */
+
+
+/**@brief Origin of a record. The meaning of the ID and argument depends on it. */
+typedef enum
+{
+    EVENT_TRACE_SOURCE_BLE,     /**< ID: low byte of the BLE event ID. Argument: see @ref event_trace_rec_t. */
+    EVENT_TRACE_SOURCE_USBD,    /**< ID: app_usbd_event_type_t. */
+    EVENT_TRACE_SOURCE_CDC,     /**< ID: app_usbd_cdc_acm_user_event_t. Argument: bytes read, for RX_DONE. */
+    EVENT_TRACE_SOURCE_TIMER,   /**< ID: @ref event_trace_timer_t. */
+    EVENT_TRACE_SOURCE_RESET,   /**< Trace carried over a reset. Argument: low half of RESETREAS. */
+    EVENT_TRACE_SOURCE_STREAM,  /**< ID: @ref event_trace_stream_t. Argument: frame length. */
+    EVENT_TRACE_SOURCE_GAP,     /**< Events missed during a dump. Argument: their number, saturated. */
+} event_trace_source_t;
+
+
+/**@brief Timers, for @ref EVENT_TRACE_SOURCE_TIMER. */
+typedef enum
+{
+    EVENT_TRACE_TIMER_METRICS_REPORT,   /**< Throughput report of @ref transfer_metrics. */
+    EVENT_TRACE_TIMER_MSG_IDLE,         /**< Idle check of @ref ble_msg. */
+} event_trace_timer_t;
+
+
+/**@brief USB stream incidents, for @ref EVENT_TRACE_SOURCE_STREAM. */
+typedef enum
+{
+    EVENT_TRACE_STREAM_QUEUE_FULL,      /**< Buffer refused, queue full. */
+    EVENT_TRACE_STREAM_WRITE_FAILED,    /**< Host link write refused; buffer dropped. */
+} event_trace_stream_t;
+
+
+/**@brief Record, as stored and sent (little endian).
+ *
+ * @details The argument of a BLE event is the credits given for
+ *          BLE_L2CAP_EVT_CH_CREDIT, the SDU length for BLE_L2CAP_EVT_CH_RX and
+ *          BLE_L2CAP_EVT_CH_TX, the count for BLE_GATTS_EVT_HVN_TX_COMPLETE, and the connection
+ *          handle for any other event.
+ */
+typedef struct
+{
+    uint32_t ticks;             /**< app_timer ticks since boot. */
+    uint8_t  info;              /**< Source (@ref event_trace_source_t) in the top 3 bits, @ref sdu_pool buffers in use in the rest. */
+    uint8_t  id;                /**< Event ID. */
+    uint16_t arg;               /**< Argument. */
+} event_trace_rec_t;
+
+
+/**@brief Function for initializing the module.
+ *
+ * @details Keeps a ring left in RAM by a soft reset and adds a @ref EVENT_TRACE_SOURCE_RESET
+ *          record to it. Call before the SoftDevice is enabled, so RESETREAS can still be read.
+ *
+ * @return NRF_SUCCESS.
+ */
+ret_code_t event_trace_init(void);
+
+
+/**@brief Function for recording an event. Can be called from any context.
+ *
+ * @param[in] source  Origin.
+ * @param[in] id      Event ID.
+ * @param[in] arg     Argument.
+ */
+void event_trace_record(event_trace_source_t source, uint8_t id, uint16_t arg);
+
+
+/**@brief Function for handling a @ref EVENT_TRACE_FRAME_DUMP frame from the host.
+ *
+ * @param[in] p_buf  Buffer holding the frame payload.
+ */
+void event_trace_on_frame(sdu_buf_t * p_buf);
+
+
+/**@brief Function for sending a requested dump to the host. Call from the main loop.
+ *
+ * @details Stops when the USB stream is full and carries on at the next call.
+ */
+void event_trace_process(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVENT_TRACE_H__
+
+/** @} */
@@ -0,0 +1,560 @@
+#include <string.h>
+#include "flash_log.h"
+#include "sdk_common.h"
+#include "nrf.h"
+#include "nordic_common.h"
+#include "app_util_platform.h"
+#include "flash_sched.h"
+#include "sdu_pool.h"
+
+
+#define PAGE_MAGIC          0x464C4F47                          /**< "FLOG": the page holds log data. */
+#define FDS_REGION_LEN      (FDS_VIRTUAL_PAGES * FDS_VIRTUAL_PAGE_SIZE * sizeof(uint32_t))
+#define REGION_LEN          (FLASH_LOG_PAGE_COUNT * FLASH_LOG_PAGE_SIZE)
+
+STATIC_ASSERT((FLASH_LOG_PAGE_DATA_LEN % sizeof(uint32_t)) == 0);
+STATIC_ASSERT(FLASH_LOG_ERASED_TARGET < FLASH_LOG_PAGE_COUNT);
+
+/**@brief State of a page. */
+typedef enum
+{
+    PAGE_DIRTY,                                                 /**< Holds data, or its content is unknown. */
+    PAGE_ERASING,                                               /**< Erase queued. */
+    PAGE_ERASED,                                                /**< Ready to be opened. */
+    PAGE_OPEN,                                                  /**< Header queued or written; holds run data. */
+} page_state_t;
+
+/**@brief A run that must not be erased. */
+typedef struct
+{
+    bool            in_use;
+    flash_log_run_t run;
+} live_run_t;
+
+static uint32_t          m_start_addr;                          /**< Start of the object region. */
+static page_state_t      m_state[FLASH_LOG_PAGE_COUNT];
+static uint32_t          m_seq[FLASH_LOG_PAGE_COUNT];           /**< Sequence number of each open page. */
+static uint32_t          m_headers[FLASH_LOG_PAGE_COUNT][3];    /**< Page headers, kept until written. */
+static live_run_t        m_live[FLASH_LOG_RUN_MAX];
+static uint16_t          m_head;                                /**< Page being written. */
+static uint16_t          m_head_off;                            /**< Next offset in the data area of @ref m_head. */
+static uint32_t          m_next_seq;
+static bool              m_run_open;
+static flash_log_run_t   m_run;                                 /**< Run being written. */
+static sdu_buf_t       * mp_stage;                              /**< Bytes gathered for the next write, or NULL. */
+static uint32_t          m_stage_addr;                          /**< Flash address of the first byte in @ref mp_stage. */
+static volatile uint32_t m_pending;                             /**< Flash operations queued. */
+static flash_log_stats_t m_stats;
+
+
+static uint32_t page_addr(uint16_t page)
+{
+    return m_start_addr + (uint32_t)page * FLASH_LOG_PAGE_SIZE;
+}
+
+
+/**@brief Function for getting the number of pages a run spans. */
+static uint16_t run_pages(flash_log_run_t const * p_run)
+{
+    return (uint16_t)MAX(1, CEIL_DIV(p_run->offset + p_run->len, FLASH_LOG_PAGE_DATA_LEN));
+}
+
+
+/**@brief Function for getting the first page of the oldest run that must be kept.
+ *
+ * @return Page index, or FLASH_LOG_PAGE_COUNT if nothing is kept.
+ */
+static uint16_t tail_get(void)
+{
+    flash_log_run_t const * p_oldest = m_run_open ? &m_run : NULL;
+
+    for (uint32_t i = 0; i < FLASH_LOG_RUN_MAX; i++)
+    {
+        if (m_live[i].in_use && ((p_oldest == NULL) || (m_live[i].run.seq < p_oldest->seq)))
+        {
+            p_oldest = &m_live[i].run;
+        }
+    }
+
+    return (p_oldest == NULL) ? FLASH_LOG_PAGE_COUNT : p_oldest->page;
+}
+
+
+/**@brief Function for getting the number of free pages after the head. */
+static uint16_t free_count(void)
+{
+    uint16_t tail = tail_get();
+
+    if (tail == FLASH_LOG_PAGE_COUNT)
+    {
+        return FLASH_LOG_PAGE_COUNT - 1;
+    }
+
+    return (uint16_t)((tail + FLASH_LOG_PAGE_COUNT - m_head - 1) % FLASH_LOG_PAGE_COUNT);
+}
+
+
+static uint16_t erased_ahead(void)
+{
+    uint16_t free  = free_count();
+    uint16_t count = 0;
+
+    while ((count < free) && (m_state[(m_head + 1 + count) % FLASH_LOG_PAGE_COUNT] == PAGE_ERASED))
+    {
+        count++;
+    }
+
+    return count;
+}
+
+
+static bool page_is_blank(uint16_t page)
+{
+    uint32_t const * p_word = (uint32_t const *)page_addr(page);
+
+    for (uint32_t i = 0; i < FLASH_LOG_PAGE_SIZE / sizeof(uint32_t); i++)
+    {
+        if (p_word[i] != 0xFFFFFFFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**@brief Function for queueing the gathered bytes, padded to a word. */
+static ret_code_t stage_flush(void)
+{
+    sdu_buf_t * p_buf = mp_stage;
+    uint16_t    pad;
+    ret_code_t  err_code;
+
+    if (p_buf == NULL)
+    {
+        return NRF_SUCCESS;
+    }
+    mp_stage = NULL;
+
+    pad = (uint16_t)((sizeof(uint32_t) - (p_buf->len % sizeof(uint32_t))) % sizeof(uint32_t));
+    memset(&sdu_buf_payload(p_buf)[p_buf->len], 0xFF, pad);
+    p_buf->len += pad;
+    m_head_off += pad;
+
+    // Counted first: the completion can come before the call returns. The buffer is released
+    // when the write completes.
+    m_pending++;
+    err_code = flash_sched_write(m_stage_addr, sdu_buf_payload(p_buf), p_buf->len, p_buf);
+    if (err_code != NRF_SUCCESS)
+    {
+        m_pending--;
+        m_stats.write_errors++;
+        sdu_pool_release(p_buf);
+        return err_code;
+    }
+
+    m_stats.bytes_written += p_buf->len - pad;
+
+    return NRF_SUCCESS;
+}
+
+
+/**@brief Function for moving the head to the next page and queueing its header. */
+static ret_code_t page_advance(void)
+{
+    uint16_t   next = (m_head + 1) % FLASH_LOG_PAGE_COUNT;
+    ret_code_t err_code;
+
+    if (free_count() == 0)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    if ((m_state[next] == PAGE_DIRTY) || (m_state[next] == PAGE_OPEN))
+    {
+        // The idle loop fell behind; the scheduler runs the header write after this erase.
+        m_pending++;
+        err_code = flash_sched_erase(page_addr(next), NULL);
+        if (err_code != NRF_SUCCESS)
+        {
+            m_pending--;
+            m_stats.write_errors++;
+            return err_code;
+        }
+        m_stats.path_erases++;
+    }
+
+    m_headers[next][0] = PAGE_MAGIC;
+    m_headers[next][1] = m_next_seq;
+    m_headers[next][2] = ~m_next_seq;
+
+    m_pending++;
+    err_code = flash_sched_write(page_addr(next), m_headers[next], sizeof(m_headers[next]), NULL);
+    if (err_code != NRF_SUCCESS)
+    {
+        m_pending--;
+        m_stats.write_errors++;
+        return err_code;
+    }
+
+    m_state[next] = PAGE_OPEN;
+    m_seq[next]   = m_next_seq++;
+    m_head        = next;
+    m_head_off    = 0;
+    m_stats.pages_written++;
+
+    return NRF_SUCCESS;
+}
+
+
+static void sched_evt_handler(flash_sched_evt_t const * p_evt)
+{
+    uint16_t page = (uint16_t)((p_evt->addr - m_start_addr) / FLASH_LOG_PAGE_SIZE);
+
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        m_stats.write_errors++;
+    }
+
+    switch (p_evt->op)
+    {
+        case FLASH_SCHED_OP_WRITE:
+            if (p_evt->p_param != NULL)
+            {
+                sdu_pool_release((sdu_buf_t *)p_evt->p_param);
+            }
+            break;
+
+        case FLASH_SCHED_OP_ERASE:
+            // A page opened meanwhile is no longer just erased.
+            if (m_state[page] == PAGE_ERASING)
+            {
+                m_state[page] = (p_evt->result == NRF_SUCCESS) ? PAGE_ERASED : PAGE_DIRTY;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    m_pending--;
+}
+
+
+void flash_log_process(void)
+{
+    if (!flash_sched_is_quiet())
+    {
+        // An erase holds the radio off for its whole length; wait for the links to go quiet.
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    {
+        uint16_t ahead = MIN(free_count(), FLASH_LOG_ERASED_TARGET);
+
+        // Queued inside the critical region, so a page the write path opens next is erased
+        // before its header is written rather than after.
+        for (uint16_t i = 0; i < ahead; i++)
+        {
+            uint16_t page = (m_head + 1 + i) % FLASH_LOG_PAGE_COUNT;
+
+            if (m_state[page] == PAGE_ERASING)
+            {
+                // One erase at a time, so radio events get the gaps in between.
+                break;
+            }
+            if ((m_state[page] == PAGE_DIRTY) || (m_state[page] == PAGE_OPEN))
+            {
+                m_state[page] = PAGE_ERASING;
+                m_pending++;
+                if (flash_sched_erase(page_addr(page), NULL) == NRF_SUCCESS)
+                {
+                    m_stats.idle_erases++;
+                }
+                else
+                {
+                    m_state[page] = PAGE_DIRTY;
+                    m_pending--;
+                }
+                break;
+            }
+        }
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+
+ret_code_t flash_log_run_begin(void)
+{
+    ret_code_t err_code;
+
+    if (m_run_open)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    if (m_head_off >= FLASH_LOG_PAGE_DATA_LEN)
+    {
+        err_code = page_advance();
+        VERIFY_SUCCESS(err_code);
+    }
+
+    m_run.seq    = m_seq[m_head];
+    m_run.page   = m_head;
+    m_run.offset = m_head_off;
+    m_run.len    = 0;
+    m_run_open   = true;
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t flash_log_append(uint8_t const * p_data, uint32_t len)
+{
+    ret_code_t err_code;
+
+    if (!m_run_open)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    while (len > 0)
+    {
+        uint32_t chunk;
+
+        if (m_head_off >= FLASH_LOG_PAGE_DATA_LEN)
+        {
+            err_code = stage_flush();
+            VERIFY_SUCCESS(err_code);
+            err_code = page_advance();
+            VERIFY_SUCCESS(err_code);
+        }
+
+        if (mp_stage == NULL)
+        {
+            mp_stage = sdu_pool_alloc();
+            if (mp_stage == NULL)
+            {
+                return NRF_ERROR_NO_MEM;
+            }
+            mp_stage->len = 0;
+            m_stage_addr  = page_addr(m_head) + FLASH_LOG_PAGE_HEADER_LEN + m_head_off;
+        }
+
+        chunk = MIN(len, MIN(SDU_POOL_DATA_SIZE - mp_stage->len, FLASH_LOG_PAGE_DATA_LEN - m_head_off));
+        memcpy(&sdu_buf_payload(mp_stage)[mp_stage->len], p_data, chunk);
+
+        mp_stage->len += chunk;
+        m_head_off    += chunk;
+        m_run.len     += chunk;
+        p_data        += chunk;
+        len           -= chunk;
+
+        if (mp_stage->len == SDU_POOL_DATA_SIZE)
+        {
+            err_code = stage_flush();
+            VERIFY_SUCCESS(err_code);
+        }
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t flash_log_run_end(flash_log_run_t * p_run)
+{
+    ret_code_t err_code;
+
+    if (!m_run_open)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    err_code = stage_flush();
+    VERIFY_SUCCESS(err_code);
+
+    for (uint32_t i = 0; i < FLASH_LOG_RUN_MAX; i++)
+    {
+        if (!m_live[i].in_use)
+        {
+            m_live[i].in_use = true;
+            m_live[i].run    = m_run;
+            m_run_open       = false;
+            *p_run           = m_run;
+            return NRF_SUCCESS;
+        }
+    }
+
+    // Too many live runs; the new one is dropped rather than overwritten later.
+    m_run_open = false;
+    return NRF_ERROR_NO_MEM;
+}
+
+
+void flash_log_run_abort(void)
+{
+    if (mp_stage != NULL)
+    {
+        // The bytes are never written; the next run starts after them, word aligned.
+        m_head_off += (sizeof(uint32_t) - (mp_stage->len % sizeof(uint32_t))) % sizeof(uint32_t);
+        sdu_pool_release(mp_stage);
+        mp_stage = NULL;
+    }
+
+    m_run_open = false;
+}
+
+
+ret_code_t flash_log_run_claim(flash_log_run_t const * p_run)
+{
+    uint16_t pages = run_pages(p_run);
+
+    if ((p_run->page >= FLASH_LOG_PAGE_COUNT) ||
+        (p_run->offset >= FLASH_LOG_PAGE_DATA_LEN) ||
+        (pages >= FLASH_LOG_PAGE_COUNT))
+    {
+        return NRF_ERROR_INVALID_DATA;
+    }
+
+    // Pages are opened in sequence, so a run's pages carry consecutive numbers.
+    for (uint16_t i = 0; i < pages; i++)
+    {
+        uint16_t page = (p_run->page + i) % FLASH_LOG_PAGE_COUNT;
+
+        if ((m_state[page] != PAGE_OPEN) || (m_seq[page] != p_run->seq + i))
+        {
+            return NRF_ERROR_INVALID_DATA;
+        }
+    }
+
+    for (uint32_t i = 0; i < FLASH_LOG_RUN_MAX; i++)
+    {
+        if (!m_live[i].in_use)
+        {
+            m_live[i].in_use = true;
+            m_live[i].run    = *p_run;
+            return NRF_SUCCESS;
+        }
+    }
+
+    return NRF_ERROR_NO_MEM;
+}
+
+
+void flash_log_run_release(flash_log_run_t const * p_run)
+{
+    for (uint32_t i = 0; i < FLASH_LOG_RUN_MAX; i++)
+    {
+        if (m_live[i].in_use && (m_live[i].run.seq == p_run->seq) && (m_live[i].run.page == p_run->page))
+        {
+            m_live[i].in_use = false;
+        }
+    }
+}
+
+
+ret_code_t flash_log_read(flash_log_run_t const * p_run, uint32_t offset, uint8_t * p_dst, uint32_t len)
+{
+    if ((offset > p_run->len) || (len > p_run->len - offset))
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    while (len > 0)
+    {
+        uint32_t pos     = p_run->offset + offset;
+        uint16_t page    = (uint16_t)((p_run->page + pos / FLASH_LOG_PAGE_DATA_LEN) % FLASH_LOG_PAGE_COUNT);
+        uint32_t in_page = pos % FLASH_LOG_PAGE_DATA_LEN;
+        uint32_t chunk   = MIN(len, FLASH_LOG_PAGE_DATA_LEN - in_page);
+
+        memcpy(p_dst, (uint8_t const *)(page_addr(page) + FLASH_LOG_PAGE_HEADER_LEN + in_page), chunk);
+
+        p_dst  += chunk;
+        offset += chunk;
+        len    -= chunk;
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+bool flash_log_is_busy(void)
+{
+    return (m_pending > 0) || (mp_stage != NULL);
+}
+
+
+void flash_log_stats_get(flash_log_stats_t * p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats              = m_stats;
+    p_stats->erased_ahead = erased_ahead();
+    p_stats->free_pages   = free_count();
+    CRITICAL_REGION_EXIT();
+}
+
+
+ret_code_t flash_log_init(void)
+{
+    uint32_t   end_addr;
+    uint32_t   newest   = 0;
+    bool       found    = false;
+    ret_code_t err_code;
+
+    // Same end of flash as FDS: below the bootloader if there is one. FDS takes the top pages.
+    end_addr = (NRF_UICR->NRFFW[0] != 0xFFFFFFFF) ? NRF_UICR->NRFFW[0]
+                                                  : (NRF_FICR->CODESIZE * NRF_FICR->CODEPAGESIZE);
+
+    end_addr    -= FDS_REGION_LEN;
+    m_start_addr = end_addr - REGION_LEN;
+
+    // The linker does not know the region; an image that grew into it would be erased.
+    if (CODE_END > m_start_addr)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    err_code = flash_sched_init(m_start_addr, end_addr, sched_evt_handler);
+    VERIFY_SUCCESS(err_code);
+
+    memset(m_live, 0, sizeof(m_live));
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_run_open = false;
+    mp_stage   = NULL;
+    m_pending  = 0;
+
+    for (uint16_t page = 0; page < FLASH_LOG_PAGE_COUNT; page++)
+    {
+        uint32_t const * p_header = (uint32_t const *)page_addr(page);
+
+        // An erase cut short by a reset can leave the header of a free page half erased.
+        if ((p_header[0] == PAGE_MAGIC) && (p_header[1] == ~p_header[2]))
+        {
+            m_state[page] = PAGE_OPEN;
+            m_seq[page]   = p_header[1];
+            if (!found || (m_seq[page] > newest))
+            {
+                newest = m_seq[page];
+                m_head = page;
+                found  = true;
+            }
+        }
+        else
+        {
+            m_state[page] = page_is_blank(page) ? PAGE_ERASED : PAGE_DIRTY;
+        }
+    }
+
+    if (!found)
+    {
+        m_head = FLASH_LOG_PAGE_COUNT - 1;
+    }
+
+    // Where the last run ended is not recorded, so the next one starts on a new page.
+    m_head_off = FLASH_LOG_PAGE_DATA_LEN;
+    m_next_seq = found ? newest + 1 : 0;
+
+    return NRF_SUCCESS;
+}
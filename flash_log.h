@@ -0,0 +1,170 @@
+/**@file
+ *
+ * @defgroup flash_log Log-structured flash allocator
+ * @{
+ * @brief Sequential allocator for object data in flash, with pages erased ahead of time.
+ *
+ * @details An nRF52840 page erase takes about 85 ms, during which the CPU stalls and the
+ *          SoftDevice has to fit the operation between radio events. Erasing while an object
+ *          arrives would hold up the L2CAP flow. This module keeps the erases off that path.
+ *
+ *          The object region is @ref FLASH_LOG_PAGE_COUNT pages just below the FDS pages, and is
+ *          used as a ring. Data is only ever appended at the head, so every page is erased once
+ *          per lap of the ring and wear is spread evenly over the region. Each page starts with a
+ *          header holding a sequence number and its complement, which is how the head is found
+ *          again after a reset; a header that an interrupted erase left half erased does not count.
+ *          A run started after a reset begins on a fresh page.
+ *
+ *          On the dongle, with the bootloader at 0xE0000 and 3 FDS pages, the region is
+ *          0xBD000-0xDD000. The project's FLASH_SIZE ends the application there, and
+ *          @ref flash_log_init refuses to start if the image reaches further.
+ *
+ *          A run is the data of one object. Pages of runs still in use (live) are never erased;
+ *          pages between the head and the oldest live run are free. @ref flash_log_process,
+ *          called from the idle loop, erases free pages until @ref FLASH_LOG_ERASED_TARGET are
+ *          ready ahead of the head. Only if the head reaches a page that is not erased yet is
+ *          the erase queued on the write path, and that is counted in the statistics.
+ *
+ *          Appended bytes are gathered in an @ref sdu_pool buffer and written one buffer at a
+ *          time, word aligned, through @ref flash_sched, which cuts writes to fit between
+ *          connection events. Idle erases wait until @ref flash_sched_is_quiet. The data stays
+ *          readable in place, at the addresses @ref flash_log_read computes.
+ */
+#ifndef FLASH_LOG_H__
+#define FLASH_LOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_LOG_PAGE_SIZE         4096                                /**< Size of a flash page. */
+#define FLASH_LOG_PAGE_COUNT        32                                  /**< Pages in the object region. */
+#define FLASH_LOG_PAGE_HEADER_LEN   12                                  /**< Magic, sequence number and its complement at the start of each page. */
+#define FLASH_LOG_PAGE_DATA_LEN     (FLASH_LOG_PAGE_SIZE - FLASH_LOG_PAGE_HEADER_LEN) /**< Run data per page. */
+#define FLASH_LOG_ERASED_TARGET     4                                   /**< Pages kept erased ahead of the head. */
+#define FLASH_LOG_RUN_MAX           4                                   /**< Live runs at most. */
+
+
+/**@brief Location of one object's data in the log. */
+typedef struct
+{
+    uint32_t seq;                   /**< Sequence number of the run's first page. */
+    uint16_t page;                  /**< Index of the first page in the region. */
+    uint16_t offset;                /**< Offset of the first byte in the data area of that page. */
+    uint32_t len;                   /**< Length of the run in bytes. */
+} flash_log_run_t;
+
+
+/**@brief Allocator statistics. */
+typedef struct
+{
+    uint32_t pages_written;         /**< Pages opened since init. */
+    uint32_t idle_erases;           /**< Pages erased from the idle loop. */
+    uint32_t path_erases;           /**< Pages that had to be erased on the write path. */
+    uint32_t bytes_written;         /**< Run bytes written. */
+    uint32_t write_errors;          /**< Flash operations that failed. */
+    uint16_t erased_ahead;          /**< Pages erased ahead of the head now. */
+    uint16_t free_pages;            /**< Pages neither live nor at the head now. */
+} flash_log_stats_t;
+
+
+/**@brief Function for initializing the allocator and finding the head of the log.
+ *
+ * @details Must be called after the SoftDevice is enabled. No run is live after init; the owner
+ *          of the runs claims the ones it still uses with @ref flash_log_run_claim.
+ *
+ * @retval NRF_ERROR_NO_MEM  The application image reaches into the object region. FLASH_SIZE in
+ *                           the project must end below it.
+ * @return NRF_SUCCESS or an error code from @ref flash_sched_init.
+ */
+ret_code_t flash_log_init(void);
+
+
+/**@brief Function for erasing free pages ahead of the head. Call from the idle loop. */
+void flash_log_process(void);
+
+
+/**@brief Function for starting a run at the head of the log.
+ *
+ * @return NRF_SUCCESS, NRF_ERROR_INVALID_STATE if a run is open, or NRF_ERROR_NO_MEM if no page
+ *         is free.
+ */
+ret_code_t flash_log_run_begin(void);
+
+
+/**@brief Function for appending bytes to the open run.
+ *
+ * @param[in] p_data  Bytes to append. Copied; the caller can reuse the buffer on return.
+ * @param[in] len     Number of bytes.
+ *
+ * @return NRF_SUCCESS, NRF_ERROR_INVALID_STATE if no run is open, NRF_ERROR_NO_MEM if the log,
+ *         the buffer pool or the flash queue is full.
+ */
+ret_code_t flash_log_append(uint8_t const * p_data, uint32_t len);
+
+
+/**@brief Function for closing the open run. The run is live until released.
+ *
+ * @param[out] p_run  Location of the run.
+ *
+ * @return NRF_SUCCESS, NRF_ERROR_INVALID_STATE if no run is open, or an error code from
+ *         @ref flash_sched_write.
+ */
+ret_code_t flash_log_run_end(flash_log_run_t * p_run);
+
+
+/**@brief Function for dropping the open run, if any. Its pages become free again. */
+void flash_log_run_abort(void);
+
+
+/**@brief Function for marking a run found after a reset as live.
+ *
+ * @param[in] p_run  Run to keep.
+ *
+ * @return NRF_SUCCESS, NRF_ERROR_INVALID_DATA if the run's pages do not hold it, or
+ *         NRF_ERROR_NO_MEM if @ref FLASH_LOG_RUN_MAX runs are live.
+ */
+ret_code_t flash_log_run_claim(flash_log_run_t const * p_run);
+
+
+/**@brief Function for letting the pages of a run be erased.
+ *
+ * @param[in] p_run  Run returned by @ref flash_log_run_end or claimed.
+ */
+void flash_log_run_release(flash_log_run_t const * p_run);
+
+
+/**@brief Function for reading run data.
+ *
+ * @param[in]  p_run   Run to read.
+ * @param[in]  offset  Offset in the run.
+ * @param[out] p_dst   Destination.
+ * @param[in]  len     Number of bytes.
+ *
+ * @return NRF_SUCCESS or NRF_ERROR_INVALID_LENGTH if the range is outside the run.
+ */
+ret_code_t flash_log_read(flash_log_run_t const * p_run, uint32_t offset, uint8_t * p_dst, uint32_t len);
+
+
+/**@brief Function for checking whether flash operations are still queued. */
+bool flash_log_is_busy(void);
+
+
+/**@brief Function for getting the statistics.
+ *
+ * @param[out] p_stats  Statistics.
+ */
+void flash_log_stats_get(flash_log_stats_t * p_stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_LOG_H__
+
+/** @} */
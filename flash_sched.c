@@ -0,0 +1,435 @@
+#include <string.h>
+#include "flash_sched.h"
+#include "sdk_common.h"
+#include "nordic_common.h"
+#include "app_util_platform.h"
+#include "ble.h"
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_sd.h"
+#include "transfer_metrics.h"
+#include "msg.h"
+
+
+#define UNIT_1_25_MS_US     1250                                /**< Connection interval unit, in us. */
+
+/**@brief Queued operation. */
+typedef struct
+{
+    flash_sched_op_t op;
+    uint32_t         addr;
+    uint8_t const  * p_src;
+    uint32_t         len;
+    uint32_t         done;                                      /**< Bytes written so far. */
+    void           * p_param;
+} sched_op_t;
+
+/**@brief Link followed for its interval and its packet reports. */
+typedef struct
+{
+    uint16_t conn_handle;                                       /**< Connection handle, BLE_CONN_HANDLE_INVALID if the entry is free. */
+    uint32_t interval_us;                                       /**< Connection interval. */
+    uint32_t last_ticks;                                        /**< Time of the last packet report. */
+    uint32_t last_epoch;                                        /**< @ref m_epoch at the last packet report. */
+    bool     active;                                            /**< @ref last_ticks is valid. */
+} sched_link_t;
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t * p_evt);
+
+NRF_FSTORAGE_DEF(nrf_fstorage_t m_fs) =
+{
+    .evt_handler = fstorage_evt_handler,
+};
+
+APP_TIMER_DEF(m_report_timer);
+
+static flash_sched_evt_handler_t m_handler;
+static sched_op_t                m_ops[FLASH_SCHED_QUEUE_SIZE];
+static uint32_t                  m_head;
+static volatile uint32_t         m_count;
+static volatile bool             m_in_flight;
+static uint32_t                  m_chunk;                       /**< Length of the write in nrf_fstorage. */
+static uint32_t                  m_started;                     /**< When the operation in nrf_fstorage was handed over. */
+static volatile uint32_t         m_epoch;                       /**< Bumped whenever an operation is handed over. */
+static sched_link_t              m_links[FLASH_SCHED_LINK_COUNT];
+static uint32_t                  m_traffic_ticks;               /**< Time of the last packet report on any link. */
+static bool                      m_traffic_seen;
+static flash_sched_stats_t       m_stats;
+static flash_sched_stats_t       m_reported;                    /**< Statistics at the last report. */
+
+
+static sched_link_t * link_find(uint16_t conn_handle)
+{
+    for (uint32_t i = 0; i < FLASH_SCHED_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**@brief Function for sizing a write chunk to the gap the links leave between their events. */
+static uint32_t chunk_len_get(void)
+{
+    uint32_t interval_us = UINT32_MAX;
+    uint32_t links       = 0;
+    uint32_t event_us;
+    uint32_t gap_us;
+    uint32_t len;
+
+    for (uint32_t i = 0; i < FLASH_SCHED_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+        {
+            interval_us = MIN(interval_us, m_links[i].interval_us);
+            links++;
+        }
+    }
+
+    if (links == 0)
+    {
+        return NRF_FSTORAGE_SD_MAX_WRITE_SIZE;
+    }
+
+    // The SoftDevice shortens events so that every link gets its turn in the interval.
+    event_us = MIN(NRF_SDH_BLE_GAP_EVENT_LENGTH * UNIT_1_25_MS_US, interval_us / links);
+    gap_us   = interval_us - event_us * links;
+    len      = (gap_us > FLASH_SCHED_MARGIN_US)
+               ? ((gap_us - FLASH_SCHED_MARGIN_US) / FLASH_SCHED_WORD_US) * sizeof(uint32_t)
+               : 0;
+
+    return MAX(FLASH_SCHED_MIN_CHUNK, MIN(len, NRF_FSTORAGE_SD_MAX_WRITE_SIZE));
+}
+
+
+/**@brief Function for taking the operation at the head of the queue off it. */
+static void op_pop(sched_op_t * p_op, ret_code_t result, flash_sched_evt_t * p_evt)
+{
+    p_evt->op      = p_op->op;
+    p_evt->addr    = p_op->addr;
+    p_evt->result  = result;
+    p_evt->p_param = p_op->p_param;
+
+    if (result != NRF_SUCCESS)
+    {
+        m_stats.errors++;
+    }
+
+    m_head = (m_head + 1) % FLASH_SCHED_QUEUE_SIZE;
+    m_count--;
+}
+
+
+/**@brief Function for handing the next chunk or erase to nrf_fstorage, if none is there. */
+static void submit(void)
+{
+    for (;;)
+    {
+        sched_op_t      * p_op = NULL;
+        flash_sched_evt_t evt;
+        ret_code_t        err_code;
+
+        CRITICAL_REGION_ENTER();
+        if (!m_in_flight && (m_count > 0))
+        {
+            m_in_flight = true;
+            p_op        = &m_ops[m_head];
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (p_op == NULL)
+        {
+            return;
+        }
+
+        // Set before the call; the completion can arrive before it returns.
+        m_started = transfer_metrics_timestamp();
+        m_epoch++;
+
+        if (p_op->op == FLASH_SCHED_OP_WRITE)
+        {
+            m_chunk = MIN(p_op->len - p_op->done, chunk_len_get());
+            m_stats.chunk_len = (uint16_t)m_chunk;
+            m_stats.chunks++;
+            err_code = nrf_fstorage_write(&m_fs, p_op->addr + p_op->done, p_op->p_src + p_op->done, m_chunk, NULL);
+        }
+        else
+        {
+            m_chunk  = 0;
+            err_code = nrf_fstorage_erase(&m_fs, p_op->addr, 1, NULL);
+        }
+
+        if (err_code == NRF_SUCCESS)
+        {
+            return;
+        }
+
+        CRITICAL_REGION_ENTER();
+        op_pop(p_op, err_code, &evt);
+        m_in_flight = false;
+        CRITICAL_REGION_EXIT();
+
+        m_handler(&evt);
+    }
+}
+
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t * p_evt)
+{
+    sched_op_t      * p_op = &m_ops[m_head];
+    flash_sched_evt_t evt;
+    bool              done = true;
+
+    m_stats.busy_us += transfer_metrics_elapsed_us(m_started);
+
+    CRITICAL_REGION_ENTER();
+    if (p_evt->result == NRF_SUCCESS)
+    {
+        if (p_op->op == FLASH_SCHED_OP_WRITE)
+        {
+            p_op->done           += m_chunk;
+            m_stats.bytes_written += m_chunk;
+            done                  = (p_op->done >= p_op->len);
+        }
+        else
+        {
+            m_stats.pages_erased++;
+        }
+    }
+    if (done)
+    {
+        op_pop(p_op, p_evt->result, &evt);
+    }
+    m_in_flight = false;
+    CRITICAL_REGION_EXIT();
+
+    if (done)
+    {
+        m_handler(&evt);
+    }
+
+    submit();
+}
+
+
+static ret_code_t op_queue(flash_sched_op_t op, uint32_t addr, void const * p_src, uint32_t len, void * p_param)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    CRITICAL_REGION_ENTER();
+    if (m_count == FLASH_SCHED_QUEUE_SIZE)
+    {
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        sched_op_t * p_op = &m_ops[(m_head + m_count) % FLASH_SCHED_QUEUE_SIZE];
+
+        p_op->op      = op;
+        p_op->addr    = addr;
+        p_op->p_src   = p_src;
+        p_op->len     = len;
+        p_op->done    = 0;
+        p_op->p_param = p_param;
+        m_count++;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code == NRF_SUCCESS)
+    {
+        submit();
+    }
+
+    return err_code;
+}
+
+
+ret_code_t flash_sched_write(uint32_t addr, void const * p_src, uint32_t len, void * p_param)
+{
+    return op_queue(FLASH_SCHED_OP_WRITE, addr, p_src, len, p_param);
+}
+
+
+ret_code_t flash_sched_erase(uint32_t addr, void * p_param)
+{
+    return op_queue(FLASH_SCHED_OP_ERASE, addr, NULL, 0, p_param);
+}
+
+
+bool flash_sched_is_busy(void)
+{
+    return m_count > 0;
+}
+
+
+bool flash_sched_is_quiet(void)
+{
+    return !m_traffic_seen ||
+           (transfer_metrics_elapsed_us(m_traffic_ticks) >= FLASH_SCHED_QUIET_MS * 1000);
+}
+
+
+void flash_sched_stats_get(flash_sched_stats_t * p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_stats;
+    CRITICAL_REGION_EXIT();
+}
+
+
+/**@brief Function for recording a packet report and counting the connection events missed
+ *        since the last one.
+ */
+static void on_packets(sched_link_t * p_link)
+{
+    uint32_t now = transfer_metrics_timestamp();
+
+    if (p_link->active)
+    {
+        uint32_t gap_us = transfer_metrics_elapsed_us(p_link->last_ticks);
+
+        // Longer gaps mean the link had nothing to send, not that events were missed.
+        if ((gap_us > p_link->interval_us + p_link->interval_us / 2) &&
+            (gap_us < FLASH_SCHED_QUIET_MS * 1000))
+        {
+            uint32_t missed = (gap_us + p_link->interval_us / 2) / p_link->interval_us - 1;
+
+            if (m_in_flight || (m_epoch != p_link->last_epoch))
+            {
+                m_stats.misses_flash += missed;
+            }
+            else
+            {
+                m_stats.misses_idle += missed;
+            }
+        }
+    }
+
+    p_link->active     = true;
+    p_link->last_ticks = now;
+    p_link->last_epoch = m_epoch;
+    m_traffic_ticks    = now;
+    m_traffic_seen     = true;
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    sched_link_t * p_link;
+    uint16_t       conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+
+    if (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED)
+    {
+        p_link = link_find(BLE_CONN_HANDLE_INVALID);
+        if (p_link != NULL)
+        {
+            memset(p_link, 0, sizeof(*p_link));
+            p_link->conn_handle = conn_handle;
+            p_link->interval_us = p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval *
+                                  UNIT_1_25_MS_US;
+        }
+        return;
+    }
+
+    // Every event body starts with the connection handle.
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return;
+    }
+    p_link = link_find(conn_handle);
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            p_link->interval_us = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval *
+                                  UNIT_1_25_MS_US;
+            p_link->active      = false;
+            break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+        case BLE_GATTS_EVT_WRITE:
+        case BLE_GATTC_EVT_HVX:
+        case BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE:
+        case BLE_L2CAP_EVT_CH_TX:
+        case BLE_L2CAP_EVT_CH_RX:
+            on_packets(p_link);
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_flash_sched_obs, FLASH_SCHED_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+static void report_timeout_handler(void * p_context)
+{
+    flash_sched_stats_t now;
+
+    UNUSED_PARAMETER(p_context);
+
+    flash_sched_stats_get(&now);
+
+    if ((now.chunks != m_reported.chunks) || (now.pages_erased != m_reported.pages_erased))
+    {
+        msg("Flash: %u B/s in %u chunks of %u B, %u erases, busy %u ms; missed events: %u with flash, %u without\r\n",
+            now.bytes_written - m_reported.bytes_written,
+            now.chunks - m_reported.chunks,
+            now.chunk_len,
+            now.pages_erased - m_reported.pages_erased,
+            (now.busy_us - m_reported.busy_us) / 1000,
+            now.misses_flash - m_reported.misses_flash,
+            now.misses_idle - m_reported.misses_idle);
+    }
+
+    m_reported = now;
+}
+
+
+ret_code_t flash_sched_init(uint32_t start_addr, uint32_t end_addr, flash_sched_evt_handler_t handler)
+{
+    ret_code_t err_code;
+
+    if (handler == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    m_handler       = handler;
+    m_head          = 0;
+    m_count         = 0;
+    m_in_flight     = false;
+    m_fs.start_addr = start_addr;
+    m_fs.end_addr   = end_addr;
+
+    for (uint32_t i = 0; i < FLASH_SCHED_LINK_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    err_code = nrf_fstorage_init(&m_fs, &nrf_fstorage_sd, NULL);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = app_timer_create(&m_report_timer, APP_TIMER_MODE_REPEATED, report_timeout_handler);
+    VERIFY_SUCCESS(err_code);
+
+    return app_timer_start(m_report_timer, FLASH_SCHED_REPORT_INTERVAL, NULL);
+}
@@ -0,0 +1,144 @@
+/**@file
+ *
+ * @defgroup flash_sched Flash operation scheduler
+ * @{
+ * @brief Queue in front of nrf_fstorage_sd that cuts writes to fit between connection events.
+ *
+ * @details The SoftDevice runs a flash operation only when it fits before the next radio event,
+ *          and retries it otherwise. A write that is longer than any gap in the radio schedule
+ *          is retried until it fails, and while it is tried, connection events can slip.
+ *
+ *          The scheduler keeps one operation at a time in nrf_fstorage. It follows the
+ *          connection interval of every link and splits each write into chunks that fit the gap
+ *          the links leave free: the shortest interval, less the event time each link may use
+ *          (NRF_SDH_BLE_GAP_EVENT_LENGTH, limited to an even share of the interval), less
+ *          @ref FLASH_SCHED_MARGIN_US. A word takes @ref FLASH_SCHED_WORD_US to write. Without
+ *          links, writes go out whole. Operations run in the order they were queued.
+ *
+ *          A page erase takes about 85 ms and cannot be split, so callers that can wait should
+ *          erase only while @ref flash_sched_is_quiet returns true: no link has exchanged data
+ *          for @ref FLASH_SCHED_QUIET_MS.
+ *
+ *          Missed connection events are inferred: while a link is busy, the SoftDevice reports
+ *          acknowledged packets every connection event, so a gap of more than 1.5 intervals
+ *          between such reports counts as missed events. Misses are counted apart depending on
+ *          whether a flash operation was running. Every @ref FLASH_SCHED_REPORT_INTERVAL with
+ *          flash activity, the flash throughput and both miss counts are printed together.
+ */
+#ifndef FLASH_SCHED_H__
+#define FLASH_SCHED_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_timer.h"
+#include "nrf_sdh_ble.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_SCHED_BLE_OBSERVER_PRIO   0                               /**< Priority of the BLE observer. Runs first, so packet reports are timed as they arrive. */
+#define FLASH_SCHED_QUEUE_SIZE          24                              /**< Operations queued at most. */
+#define FLASH_SCHED_LINK_COUNT          NRF_SDH_BLE_TOTAL_LINK_COUNT    /**< Links followed at once. */
+
+#define FLASH_SCHED_WORD_US             41                              /**< Longest time to write one word (nRF52840 t_WRITE). */
+#define FLASH_SCHED_MARGIN_US           500                             /**< Time left free around a chunk for SoftDevice overhead. */
+#define FLASH_SCHED_MIN_CHUNK           16                              /**< Smallest chunk, in bytes, whatever the gap. */
+#define FLASH_SCHED_QUIET_MS            250                             /**< Time without link traffic before erases are let through. */
+#define FLASH_SCHED_REPORT_INTERVAL     APP_TIMER_TICKS(1000)           /**< Interval between reports. */
+
+
+/**@brief Kinds of operation. */
+typedef enum
+{
+    FLASH_SCHED_OP_WRITE,
+    FLASH_SCHED_OP_ERASE,
+} flash_sched_op_t;
+
+
+/**@brief Completion of an operation. */
+typedef struct
+{
+    flash_sched_op_t op;            /**< Kind of operation. */
+    uint32_t         addr;          /**< Address the operation started at. */
+    ret_code_t       result;        /**< NRF_SUCCESS or the error of the chunk that failed. */
+    void           * p_param;       /**< Parameter given when the operation was queued. */
+} flash_sched_evt_t;
+
+
+/**@brief Completion handler type. */
+typedef void (*flash_sched_evt_handler_t)(flash_sched_evt_t const * p_evt);
+
+
+/**@brief Scheduler statistics since init. */
+typedef struct
+{
+    uint32_t bytes_written;         /**< Bytes written. */
+    uint32_t pages_erased;          /**< Pages erased. */
+    uint32_t chunks;                /**< Writes handed to nrf_fstorage. */
+    uint32_t errors;                /**< Operations that failed. */
+    uint32_t busy_us;               /**< Time with an operation in nrf_fstorage. */
+    uint32_t misses_flash;          /**< Connection events missed while flash was busy. */
+    uint32_t misses_idle;           /**< Connection events missed while flash was idle. */
+    uint16_t chunk_len;             /**< Chunk length in use now. */
+} flash_sched_stats_t;
+
+
+/**@brief Function for initializing the scheduler and its nrf_fstorage instance.
+ *
+ * @details Must be called after the SoftDevice is enabled.
+ *
+ * @param[in] start_addr  Start of the flash region the scheduler may change.
+ * @param[in] end_addr    End of the region.
+ * @param[in] handler     Called when an operation completes.
+ *
+ * @return NRF_SUCCESS or an error code from nrf_fstorage or app_timer.
+ */
+ret_code_t flash_sched_init(uint32_t start_addr, uint32_t end_addr, flash_sched_evt_handler_t handler);
+
+
+/**@brief Function for queueing a write.
+ *
+ * @param[in] addr     Destination, word aligned.
+ * @param[in] p_src    Data, word aligned. Must stay valid until the operation completes.
+ * @param[in] len      Length, a multiple of 4.
+ * @param[in] p_param  Handed back on completion.
+ *
+ * @return NRF_SUCCESS or NRF_ERROR_NO_MEM if the queue is full.
+ */
+ret_code_t flash_sched_write(uint32_t addr, void const * p_src, uint32_t len, void * p_param);
+
+
+/**@brief Function for queueing a page erase.
+ *
+ * @param[in] addr     Start of the page.
+ * @param[in] p_param  Handed back on completion.
+ *
+ * @return NRF_SUCCESS or NRF_ERROR_NO_MEM if the queue is full.
+ */
+ret_code_t flash_sched_erase(uint32_t addr, void * p_param);
+
+
+/**@brief Function for checking whether operations are queued or running. */
+bool flash_sched_is_busy(void);
+
+
+/**@brief Function for checking whether the links have been quiet long enough for an erase. */
+bool flash_sched_is_quiet(void);
+
+
+/**@brief Function for getting the statistics.
+ *
+ * @param[out] p_stats  Statistics.
+ */
+void flash_sched_stats_get(flash_sched_stats_t * p_stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_SCHED_H__
+
+/** @} */
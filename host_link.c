@@ -0,0 +1,217 @@
+#include <stdbool.h>
+#include <string.h>
+#include "host_link.h"
+#include "transfer_metrics.h"
+
+
+/**@brief State of one kind of link. */
+typedef struct
+{
+    host_link_t const * p_link;                 /**< Open link of this kind, or NULL. */
+    bool                busy;                   /**< A write is in progress. */
+    uint32_t            tx_started;             /**< Timestamp of the write in progress. */
+    size_t              tx_len;                 /**< Length of the write in progress. */
+    host_link_stats_t   stats;
+} link_cb_t;
+
+static host_link_evt_handler_t m_handler;
+static link_cb_t               m_cb[HOST_LINK_ID_COUNT];
+
+
+/**@brief Function for getting the state of a link, NULL if the link is not open. */
+static link_cb_t * cb_get(host_link_t const * p_link)
+{
+    if ((p_link == NULL) || (p_link->id >= HOST_LINK_ID_COUNT) || (m_cb[p_link->id].p_link != p_link))
+    {
+        return NULL;
+    }
+
+    return &m_cb[p_link->id];
+}
+
+
+static void evt_send(host_link_evt_type_t type, host_link_t const * p_link, uint8_t const * p_data, size_t len)
+{
+    host_link_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.type   = type;
+    evt.p_link = p_link;
+    evt.p_data = p_data;
+    evt.len    = len;
+    m_handler(&evt);
+}
+
+
+ret_code_t host_link_init(host_link_evt_handler_t handler)
+{
+    if (handler == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    m_handler = handler;
+    memset(m_cb, 0, sizeof(m_cb));
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t host_link_open(host_link_t const * p_link)
+{
+    link_cb_t * p_cb;
+    ret_code_t  err_code;
+
+    if ((p_link == NULL) || (p_link->id >= HOST_LINK_ID_COUNT))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    p_cb = &m_cb[p_link->id];
+    if (p_cb->p_link != NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    // Open first, so the link can report events while it starts.
+    memset(p_cb, 0, sizeof(*p_cb));
+    p_cb->p_link = p_link;
+
+    err_code = p_link->p_ops->open(p_link);
+    if (err_code != NRF_SUCCESS)
+    {
+        p_cb->p_link = NULL;
+    }
+
+    return err_code;
+}
+
+
+ret_code_t host_link_write(host_link_t const * p_link, uint8_t const * p_data, size_t len)
+{
+    link_cb_t * p_cb = cb_get(p_link);
+    ret_code_t  err_code;
+
+    if (p_cb == NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (p_cb->busy)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    // Set before the call in case the link ends the write at once.
+    p_cb->busy       = true;
+    p_cb->tx_started = transfer_metrics_timestamp();
+    p_cb->tx_len     = len;
+
+    err_code = p_link->p_ops->write(p_link, p_data, len);
+    if (err_code != NRF_SUCCESS)
+    {
+        p_cb->busy = false;
+        if (err_code == NRF_ERROR_BUSY)
+        {
+            p_cb->stats.tx_held++;
+        }
+        else
+        {
+            p_cb->stats.tx_failed++;
+        }
+    }
+
+    return err_code;
+}
+
+
+host_link_state_t host_link_state_get(host_link_t const * p_link)
+{
+    link_cb_t * p_cb = cb_get(p_link);
+
+    if (p_cb == NULL)
+    {
+        return HOST_LINK_STATE_CLOSED;
+    }
+    if (p_cb->busy)
+    {
+        return HOST_LINK_STATE_BUSY;
+    }
+
+    return p_link->p_ops->state_get(p_link);
+}
+
+
+void host_link_process(void)
+{
+    for (uint32_t i = 0; i < HOST_LINK_ID_COUNT; i++)
+    {
+        host_link_t const * p_link = m_cb[i].p_link;
+
+        if ((p_link != NULL) && (p_link->p_ops->process != NULL))
+        {
+            p_link->p_ops->process(p_link);
+        }
+    }
+}
+
+
+void host_link_stats_get(host_link_t const * p_link, host_link_stats_t * p_stats)
+{
+    link_cb_t * p_cb = cb_get(p_link);
+
+    if (p_cb == NULL)
+    {
+        memset(p_stats, 0, sizeof(*p_stats));
+        return;
+    }
+
+    *p_stats = p_cb->stats;
+}
+
+
+host_link_t const * host_link_get(host_link_id_t id)
+{
+    return (id < HOST_LINK_ID_COUNT) ? m_cb[id].p_link : NULL;
+}
+
+
+void host_link_on_rx(host_link_t const * p_link, uint8_t const * p_data, size_t len)
+{
+    link_cb_t * p_cb = cb_get(p_link);
+
+    if (p_cb == NULL)
+    {
+        return;
+    }
+
+    p_cb->stats.rx_bytes += len;
+    evt_send(HOST_LINK_EVT_RX, p_link, p_data, len);
+}
+
+
+void host_link_on_tx_done(host_link_t const * p_link)
+{
+    link_cb_t * p_cb = cb_get(p_link);
+
+    if ((p_cb == NULL) || !p_cb->busy)
+    {
+        return;
+    }
+
+    p_cb->busy             = false;
+    p_cb->stats.tx_bytes  += p_cb->tx_len;
+    p_cb->stats.tx_writes += 1;
+    p_cb->stats.tx_us     += transfer_metrics_elapsed_us(p_cb->tx_started);
+    evt_send(HOST_LINK_EVT_TX_DONE, p_link, NULL, 0);
+}
+
+
+void host_link_on_ready(host_link_t const * p_link)
+{
+    if (cb_get(p_link) == NULL)
+    {
+        return;
+    }
+
+    evt_send(HOST_LINK_EVT_READY, p_link, NULL, 0);
+}
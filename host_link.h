@@ -0,0 +1,225 @@
+/**@file
+ *
+ * @defgroup host_link Host link
+ * @{
+ * @brief Transport interface under @ref usb_stream, with one implementation per kind of link.
+ *
+ * @details A link is a @ref host_link_t: a table of operations, @ref host_link_ops_t, and the
+ *          context the implementation needs. The implementations are:
+ *
+ *          | Link                 | Carried over                                        |
+ *          |----------------------|-----------------------------------------------------|
+ *          | @ref host_link_cdc   | USB CDC ACM                                         |
+ *          | @ref host_link_uart  | UARTE, through @ref host_uart                       |
+ *          | @ref host_link_rtt   | A SEGGER RTT channel, through the debugger          |
+ *          | @ref host_link_mem   | RAM, for tests that run without a host              |
+ *
+ *          Every link works the same way:
+ *          - @ref host_link_open starts it.
+ *          - @ref host_link_write starts an asynchronous write, one at a time. The data is sent
+ *            from where it is, and must stay unchanged until @ref HOST_LINK_EVT_TX_DONE.
+ *          - Data from the host comes as @ref HOST_LINK_EVT_RX.
+ *          - @ref host_link_state_get gives the flow control state. A link that holds off a
+ *            write with NRF_ERROR_BUSY reports @ref HOST_LINK_EVT_READY once it can take it, so
+ *            nothing has to retry in a loop.
+ *
+ *          Events are reported in the main loop, from @ref host_link_process or from the USB
+ *          event queue, never from an interrupt.
+ *
+ *          Every link counts what it moves. @ref host_link_stats_get gives the bytes written and
+ *          the time writes were in progress, from which the throughput of each link follows.
+ */
+#ifndef HOST_LINK_H__
+#define HOST_LINK_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**@brief Kinds of link. There is at most one link of each kind. */
+typedef enum
+{
+    HOST_LINK_ID_CDC,
+    HOST_LINK_ID_UART,
+    HOST_LINK_ID_RTT,
+    HOST_LINK_ID_MEM,
+    HOST_LINK_ID_COUNT,
+} host_link_id_t;
+
+
+/**@brief Flow control state of a link. */
+typedef enum
+{
+    HOST_LINK_STATE_CLOSED,                     /**< Nobody is listening; writes fail. */
+    HOST_LINK_STATE_READY,                      /**< A write can start. */
+    HOST_LINK_STATE_BUSY,                       /**< A write is in progress, or the host holds the link off. */
+} host_link_state_t;
+
+
+typedef struct host_link_s host_link_t;
+
+
+/**@brief Operations of a link. Called through the host_link functions only. */
+typedef struct
+{
+    /**@brief Start the link. */
+    ret_code_t (*open)(host_link_t const * p_link);
+
+    /**@brief Start a write.
+     *
+     * @retval NRF_SUCCESS      The write started; @ref HOST_LINK_EVT_TX_DONE follows.
+     * @retval NRF_ERROR_BUSY   Held off; @ref HOST_LINK_EVT_READY follows.
+     * @return Any other error if the write cannot be done.
+     */
+    ret_code_t (*write)(host_link_t const * p_link, uint8_t const * p_data, size_t len);
+
+    /**@brief Get the flow control state, not counting a write in progress. */
+    host_link_state_t (*state_get)(host_link_t const * p_link);
+
+    /**@brief Do the work of the main loop. NULL if there is none. */
+    void (*process)(host_link_t const * p_link);
+} host_link_ops_t;
+
+
+/**@brief Link instance. Defined by the macro of each implementation. */
+struct host_link_s
+{
+    host_link_ops_t const * p_ops;
+    host_link_id_t          id;
+    char const            * p_name;
+    void const            * p_context;          /**< Context of the implementation. */
+};
+
+
+/**@brief Link event types. */
+typedef enum
+{
+    HOST_LINK_EVT_RX,                           /**< Data received. */
+    HOST_LINK_EVT_TX_DONE,                      /**< The write in progress has ended. */
+    HOST_LINK_EVT_READY,                        /**< A write that was held off can start now. */
+} host_link_evt_type_t;
+
+
+/**@brief Link event. */
+typedef struct
+{
+    host_link_evt_type_t type;
+    host_link_t const  * p_link;
+    uint8_t const      * p_data;                /**< Data of @ref HOST_LINK_EVT_RX, valid during the call. */
+    size_t               len;                   /**< Length of the data. */
+} host_link_evt_t;
+
+
+/**@brief Link event handler type. */
+typedef void (*host_link_evt_handler_t)(host_link_evt_t const * p_evt);
+
+
+/**@brief Link statistics. */
+typedef struct
+{
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;                          /**< Bytes of writes that ended. */
+    uint32_t tx_writes;                         /**< Writes that ended. */
+    uint32_t tx_us;                             /**< Time writes were in progress, in us. */
+    uint32_t tx_held;                           /**< Writes held off by flow control. */
+    uint32_t tx_failed;                         /**< Writes refused, mostly because the link was closed. */
+} host_link_stats_t;
+
+
+/**@brief Function for initializing the module.
+ *
+ * @param[in] handler  Handler of the events of every link.
+ *
+ * @return NRF_SUCCESS or NRF_ERROR_NULL.
+ */
+ret_code_t host_link_init(host_link_evt_handler_t handler);
+
+
+/**@brief Function for starting a link.
+ *
+ * @param[in] p_link  Link.
+ *
+ * @retval NRF_SUCCESS              The link started.
+ * @retval NRF_ERROR_INVALID_STATE  A link of the same kind is already open.
+ * @return Any other error from the implementation.
+ */
+ret_code_t host_link_open(host_link_t const * p_link);
+
+
+/**@brief Function for starting a write.
+ *
+ * @param[in] p_link  Link.
+ * @param[in] p_data  Data; must stay unchanged until @ref HOST_LINK_EVT_TX_DONE.
+ * @param[in] len     Length of the data.
+ *
+ * @retval NRF_SUCCESS              The write started.
+ * @retval NRF_ERROR_BUSY           A write is in progress or the link is held off. Wait for
+ *                                  @ref HOST_LINK_EVT_TX_DONE or @ref HOST_LINK_EVT_READY.
+ * @retval NRF_ERROR_INVALID_STATE  The link is closed or not open.
+ * @return Any other error from the implementation.
+ */
+ret_code_t host_link_write(host_link_t const * p_link, uint8_t const * p_data, size_t len);
+
+
+/**@brief Function for getting the flow control state of a link.
+ *
+ * @param[in] p_link  Link.
+ */
+host_link_state_t host_link_state_get(host_link_t const * p_link);
+
+
+/**@brief Function for doing the work of every open link. Call from the main loop. */
+void host_link_process(void);
+
+
+/**@brief Function for getting the statistics of a link.
+ *
+ * @param[in]  p_link   Link.
+ * @param[out] p_stats  Statistics.
+ */
+void host_link_stats_get(host_link_t const * p_link, host_link_stats_t * p_stats);
+
+
+/**@brief Function for getting the open link of a kind.
+ *
+ * @param[in] id  Kind of link.
+ *
+ * @return The link, or NULL if none of this kind is open.
+ */
+host_link_t const * host_link_get(host_link_id_t id);
+
+
+/**@brief Function for reporting data received. For implementations only.
+ *
+ * @param[in] p_link  Link.
+ * @param[in] p_data  Data, valid during the call.
+ * @param[in] len     Length of the data.
+ */
+void host_link_on_rx(host_link_t const * p_link, uint8_t const * p_data, size_t len);
+
+
+/**@brief Function for reporting the end of the write in progress. For implementations only.
+ *
+ * @param[in] p_link  Link.
+ */
+void host_link_on_tx_done(host_link_t const * p_link);
+
+
+/**@brief Function for reporting that a link can take writes again. For implementations only.
+ *
+ * @param[in] p_link  Link.
+ */
+void host_link_on_ready(host_link_t const * p_link);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_LINK_H__
+
+/** @} */
@@ -0,0 +1,37 @@
+#include "host_link_cdc.h"
+
+
+static ret_code_t cdc_open(host_link_t const * p_link)
+{
+    // The class starts with USBD; there is nothing to do here.
+    return NRF_SUCCESS;
+}
+
+
+static ret_code_t cdc_write(host_link_t const * p_link, uint8_t const * p_data, size_t len)
+{
+    return app_usbd_cdc_acm_write(p_link->p_context, p_data, len);
+}
+
+
+static host_link_state_t cdc_state_get(host_link_t const * p_link)
+{
+    uint32_t dtr = 0;
+
+    if ((app_usbd_cdc_acm_line_state_get(p_link->p_context, APP_USBD_CDC_ACM_LINE_STATE_DTR, &dtr) != NRF_SUCCESS) ||
+        (dtr == 0))
+    {
+        return HOST_LINK_STATE_CLOSED;
+    }
+
+    return HOST_LINK_STATE_READY;
+}
+
+
+const host_link_ops_t host_link_cdc_ops =
+{
+    .open      = cdc_open,
+    .write     = cdc_write,
+    .state_get = cdc_state_get,
+    .process   = NULL,
+};
@@ -0,0 +1,54 @@
+/**@file
+ *
+ * @defgroup host_link_cdc CDC ACM host link
+ * @{
+ * @ingroup host_link
+ * @brief @ref host_link over the data interface of a USB CDC ACM class instance.
+ *
+ * @details Writes go straight to app_usbd_cdc_acm_write, from the caller's memory. The class
+ *          reports its events to the application's handler, which passes them on:
+ *
+ *          | CDC ACM event                         | Call                                   |
+ *          |---------------------------------------|----------------------------------------|
+ *          | APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN   | @ref host_link_on_ready                |
+ *          | APP_USBD_CDC_ACM_USER_EVT_TX_DONE     | @ref host_link_on_tx_done              |
+ *          | APP_USBD_CDC_ACM_USER_EVT_RX_DONE     | @ref host_link_on_rx, with the data    |
+ *
+ *          The link is closed until the host opens the port and sets DTR. The class itself is
+ *          appended to USBD by the application, with the other classes.
+ */
+#ifndef HOST_LINK_CDC_H__
+#define HOST_LINK_CDC_H__
+
+#include "host_link.h"
+#include "app_usbd_cdc_acm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const host_link_ops_t host_link_cdc_ops;
+
+
+/**@brief Macro for defining the link.
+ *
+ * @param name     Name of the link.
+ * @param cdc_acm  CDC ACM instance, defined with APP_USBD_CDC_ACM_GLOBAL_DEF.
+ */
+#define HOST_LINK_CDC_DEF(name, cdc_acm)                    \
+    static const host_link_t name =                         \
+    {                                                       \
+        .p_ops     = &host_link_cdc_ops,                    \
+        .id        = HOST_LINK_ID_CDC,                      \
+        .p_name    = "cdc",                                 \
+        .p_context = &(cdc_acm),                            \
+    }
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_LINK_CDC_H__
+
+/** @} */
@@ -0,0 +1,100 @@
+#include <stdbool.h>
+#include <string.h>
+#include "host_link_mem.h"
+
+
+static size_t m_len;                            /**< Bytes written and not read yet. */
+static bool   m_tx_done;                        /**< A write was copied and has not been reported yet. */
+static bool   m_held;                           /**< A write did not fit. */
+static bool   m_ready;                          /**< Room was made for it and has not been reported yet. */
+
+
+static ret_code_t mem_open(host_link_t const * p_link)
+{
+    m_len     = 0;
+    m_tx_done = false;
+    m_held    = false;
+    m_ready   = false;
+
+    return NRF_SUCCESS;
+}
+
+
+static ret_code_t mem_write(host_link_t const * p_link, uint8_t const * p_data, size_t len)
+{
+    host_link_mem_buf_t const * p_buf = p_link->p_context;
+
+    if (len > p_buf->size)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (len > p_buf->size - m_len)
+    {
+        m_held = true;
+        return NRF_ERROR_BUSY;
+    }
+
+    memcpy(&p_buf->p_data[m_len], p_data, len);
+    m_len    += len;
+    m_tx_done = true;
+
+    return NRF_SUCCESS;
+}
+
+
+static host_link_state_t mem_state_get(host_link_t const * p_link)
+{
+    return m_held ? HOST_LINK_STATE_BUSY : HOST_LINK_STATE_READY;
+}
+
+
+static void mem_process(host_link_t const * p_link)
+{
+    if (m_tx_done)
+    {
+        m_tx_done = false;
+        host_link_on_tx_done(p_link);
+    }
+    if (m_ready)
+    {
+        m_ready = false;
+        host_link_on_ready(p_link);
+    }
+}
+
+
+void host_link_mem_inject(host_link_t const * p_link, uint8_t const * p_data, size_t len)
+{
+    host_link_on_rx(p_link, p_data, len);
+}
+
+
+size_t host_link_mem_read(host_link_t const * p_link, uint8_t * p_out, size_t max)
+{
+    host_link_mem_buf_t const * p_buf = p_link->p_context;
+    size_t                      len   = (max < m_len) ? max : m_len;
+
+    if (p_out != NULL)
+    {
+        memcpy(p_out, p_buf->p_data, len);
+    }
+    memmove(p_buf->p_data, &p_buf->p_data[len], m_len - len);
+    m_len -= len;
+
+    if (m_held && (len > 0))
+    {
+        m_held  = false;
+        m_ready = true;
+    }
+
+    return len;
+}
+
+
+const host_link_ops_t host_link_mem_ops =
+{
+    .open      = mem_open,
+    .write     = mem_write,
+    .state_get = mem_state_get,
+    .process   = mem_process,
+};
@@ -0,0 +1,87 @@
+/**@file
+ *
+ * @defgroup host_link_mem RAM host link
+ * @{
+ * @ingroup host_link
+ * @brief @ref host_link that keeps written data in RAM and takes received data from the caller.
+ *
+ * @details For tests of the stream and of the modules above it that run without a host, on the
+ *          dongle or in a host build: the test injects what the host would send with
+ *          @ref host_link_mem_inject and reads what the dongle wrote with @ref host_link_mem_read.
+ *
+ *          Writes are copied into the buffer given to @ref HOST_LINK_MEM_DEF. A write that does
+ *          not fit is held off until @ref host_link_mem_read makes room, which shows how the
+ *          stream behaves under flow control. The end of a write, and the link becoming ready
+ *          again, are reported from @ref host_link_process, as on the real links.
+ *
+ *          tests/host/test_host_link.c runs @ref usb_stream over this link in a host build.
+ */
+#ifndef HOST_LINK_MEM_H__
+#define HOST_LINK_MEM_H__
+
+#include "host_link.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**@brief Buffer of the link. */
+typedef struct
+{
+    uint8_t * p_data;
+    size_t    size;
+} host_link_mem_buf_t;
+
+extern const host_link_ops_t host_link_mem_ops;
+
+
+/**@brief Macro for defining the link. There can be only one.
+ *
+ * @param name      Name of the link.
+ * @param buf_size  Bytes of written data the link can hold.
+ */
+#define HOST_LINK_MEM_DEF(name, buf_size)                   \
+    static uint8_t name ## _data[buf_size];                 \
+    static const host_link_mem_buf_t name ## _buf =         \
+    {                                                       \
+        .p_data = name ## _data,                            \
+        .size   = (buf_size),                               \
+    };                                                      \
+    static const host_link_t name =                         \
+    {                                                       \
+        .p_ops     = &host_link_mem_ops,                    \
+        .id        = HOST_LINK_ID_MEM,                      \
+        .p_name    = "mem",                                 \
+        .p_context = &name ## _buf,                         \
+    }
+
+
+/**@brief Function for passing data to the link as if the host had sent it.
+ *
+ * @details Reported as @ref HOST_LINK_EVT_RX before the function returns.
+ *
+ * @param[in] p_link  Link.
+ * @param[in] p_data  Data.
+ * @param[in] len     Length of the data.
+ */
+void host_link_mem_inject(host_link_t const * p_link, uint8_t const * p_data, size_t len);
+
+
+/**@brief Function for taking written data out of the link.
+ *
+ * @param[in]  p_link  Link.
+ * @param[out] p_out   Where to copy the data, or NULL to drop it.
+ * @param[in]  max     Bytes to take at most.
+ *
+ * @return Bytes taken, oldest first.
+ */
+size_t host_link_mem_read(host_link_t const * p_link, uint8_t * p_out, size_t max);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_LINK_MEM_H__
+
+/** @} */
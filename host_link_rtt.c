@@ -0,0 +1,80 @@
+#include <stdbool.h>
+#include "host_link_rtt.h"
+#include "SEGGER_RTT.h"
+
+
+static uint8_t         m_up[HOST_LINK_RTT_UP_SIZE];
+static uint8_t         m_down[HOST_LINK_RTT_DOWN_SIZE];
+static uint8_t const * mp_tx;                   /**< Part of the write not yet in the up buffer. */
+static size_t          m_tx_left;
+static bool            m_tx_pending;
+static bool            m_host_seen;             /**< The host has sent something, so a debugger is attached. */
+
+
+static ret_code_t rtt_open(host_link_t const * p_link)
+{
+    m_tx_pending = false;
+    m_host_seen  = false;
+
+    // Writes are trimmed to the room left, and the rest is written later.
+    if ((SEGGER_RTT_ConfigUpBuffer(HOST_LINK_RTT_CHANNEL, "Stream", m_up, sizeof(m_up),
+                                   SEGGER_RTT_MODE_NO_BLOCK_TRIM) < 0) ||
+        (SEGGER_RTT_ConfigDownBuffer(HOST_LINK_RTT_CHANNEL, "Stream", m_down, sizeof(m_down),
+                                     SEGGER_RTT_MODE_NO_BLOCK_SKIP) < 0))
+    {
+        return NRF_ERROR_NOT_SUPPORTED;
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+static ret_code_t rtt_write(host_link_t const * p_link, uint8_t const * p_data, size_t len)
+{
+    mp_tx        = p_data;
+    m_tx_left    = len;
+    m_tx_pending = true;
+
+    return NRF_SUCCESS;
+}
+
+
+static host_link_state_t rtt_state_get(host_link_t const * p_link)
+{
+    return m_host_seen ? HOST_LINK_STATE_READY : HOST_LINK_STATE_CLOSED;
+}
+
+
+static void rtt_process(host_link_t const * p_link)
+{
+    uint8_t  rx[HOST_LINK_RTT_DOWN_SIZE];
+    unsigned len;
+
+    if (m_tx_pending)
+    {
+        len        = SEGGER_RTT_WriteNoLock(HOST_LINK_RTT_CHANNEL, mp_tx, m_tx_left);
+        mp_tx     += len;
+        m_tx_left -= len;
+        if (m_tx_left == 0)
+        {
+            m_tx_pending = false;
+            host_link_on_tx_done(p_link);
+        }
+    }
+
+    len = SEGGER_RTT_ReadNoLock(HOST_LINK_RTT_CHANNEL, rx, sizeof(rx));
+    if (len > 0)
+    {
+        m_host_seen = true;
+        host_link_on_rx(p_link, rx, len);
+    }
+}
+
+
+const host_link_ops_t host_link_rtt_ops =
+{
+    .open      = rtt_open,
+    .write     = rtt_write,
+    .state_get = rtt_state_get,
+    .process   = rtt_process,
+};
@@ -0,0 +1,52 @@
+/**@file
+ *
+ * @defgroup host_link_rtt RTT host link
+ * @{
+ * @ingroup host_link
+ * @brief @ref host_link over a SEGGER RTT channel, for boards on a debugger without USB or UART.
+ *
+ * @details The link uses up and down buffers @ref HOST_LINK_RTT_CHANNEL; channel 0 stays with
+ *          the RTT terminal and the log. The debugger reads the up buffer while the CPU runs, so
+ *          a write is copied into it in parts, as room frees up, from @ref host_link_process.
+ *          The write ends once its last byte is in the buffer.
+ *
+ *          Without a debugger attached, nothing empties the up buffer. The link therefore stays
+ *          closed until the host has sent something on the down buffer.
+ */
+#ifndef HOST_LINK_RTT_H__
+#define HOST_LINK_RTT_H__
+
+#include "host_link.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_LINK_RTT_CHANNEL       1           /**< RTT channel of the link. */
+#define HOST_LINK_RTT_UP_SIZE       2048        /**< Up buffer; four frames. */
+#define HOST_LINK_RTT_DOWN_SIZE     256         /**< Down buffer. */
+
+extern const host_link_ops_t host_link_rtt_ops;
+
+
+/**@brief Macro for defining the link. There can be only one.
+ *
+ * @param name  Name of the link.
+ */
+#define HOST_LINK_RTT_DEF(name)                             \
+    static const host_link_t name =                         \
+    {                                                       \
+        .p_ops     = &host_link_rtt_ops,                    \
+        .id        = HOST_LINK_ID_RTT,                      \
+        .p_name    = "rtt",                                 \
+        .p_context = NULL,                                  \
+    }
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_LINK_RTT_H__
+
+/** @} */
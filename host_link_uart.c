@@ -0,0 +1,57 @@
+#include "host_link_uart.h"
+
+
+static host_link_t const * mp_link;            /**< The UARTE is one peripheral, so there is one link. */
+
+
+static void host_uart_evt_handler(host_uart_evt_t const * p_evt)
+{
+    switch (p_evt->type)
+    {
+        case HOST_UART_EVT_RX:
+            host_link_on_rx(mp_link, p_evt->p_data, p_evt->len);
+            break;
+
+        case HOST_UART_EVT_TX_DONE:
+            host_link_on_tx_done(mp_link);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+static ret_code_t uart_open(host_link_t const * p_link)
+{
+    mp_link = p_link;
+
+    return host_uart_init(p_link->p_context, host_uart_evt_handler);
+}
+
+
+static ret_code_t uart_write(host_link_t const * p_link, uint8_t const * p_data, size_t len)
+{
+    return host_uart_write(p_data, len);
+}
+
+
+static host_link_state_t uart_state_get(host_link_t const * p_link)
+{
+    return host_uart_tx_held() ? HOST_LINK_STATE_BUSY : HOST_LINK_STATE_READY;
+}
+
+
+static void uart_process(host_link_t const * p_link)
+{
+    host_uart_process();
+}
+
+
+const host_link_ops_t host_link_uart_ops =
+{
+    .open      = uart_open,
+    .write     = uart_write,
+    .state_get = uart_state_get,
+    .process   = uart_process,
+};
@@ -0,0 +1,59 @@
+/**@file
+ *
+ * @defgroup host_link_uart UARTE host link
+ * @{
+ * @ingroup host_link
+ * @brief @ref host_link over @ref host_uart.
+ *
+ * @details Writes go out by EasyDMA from the caller's memory. When the host holds the link off,
+ *          CTS stops the UARTE in hardware and the write simply takes longer, so a write is
+ *          never refused with NRF_ERROR_BUSY. @ref host_link_state_get still reports
+ *          @ref HOST_LINK_STATE_BUSY while CTS is inactive, so a caller can see that the host is
+ *          not taking data. Received data and the end of writes are reported from
+ *          @ref host_link_process.
+ */
+#ifndef HOST_LINK_UART_H__
+#define HOST_LINK_UART_H__
+
+#include "host_link.h"
+#include "host_uart.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const host_link_ops_t host_link_uart_ops;
+
+
+/**@brief Macro for defining the link.
+ *
+ * @param name  Name of the link.
+ * @param tx    TXD pin.
+ * @param rx    RXD pin.
+ * @param rts   RTS pin.
+ * @param cts   CTS pin.
+ */
+#define HOST_LINK_UART_DEF(name, tx, rx, rts, cts)          \
+    static const host_uart_config_t name ## _config =       \
+    {                                                       \
+        .tx_pin  = (tx),                                    \
+        .rx_pin  = (rx),                                    \
+        .rts_pin = (rts),                                   \
+        .cts_pin = (cts),                                   \
+    };                                                      \
+    static const host_link_t name =                         \
+    {                                                       \
+        .p_ops     = &host_link_uart_ops,                   \
+        .id        = HOST_LINK_ID_UART,                     \
+        .p_name    = "uart",                                \
+        .p_context = &name ## _config,                      \
+    }
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_LINK_UART_H__
+
+/** @} */
@@ -0,0 +1,177 @@
+#include <string.h>
+#include "host_uart.h"
+#include "sdk_common.h"
+#include "app_util_platform.h"
+#include "nrf_gpio.h"
+#include "nrf_libuarte_async.h"
+
+
+#define UARTE_INSTANCE      1           /**< UARTE0 is left to the legacy UART driver and the log backend. */
+#define TIMER_BYTES         1           /**< Counts received bytes. */
+#define TIMER_TIMEOUT       2           /**< Ends a buffer on an idle line. TIMER0 belongs to the SoftDevice. */
+
+NRF_LIBUARTE_ASYNC_DEFINE(m_libuarte,
+                          UARTE_INSTANCE,
+                          TIMER_BYTES,
+                          NRF_LIBUARTE_PERIPHERAL_NOT_USED,
+                          TIMER_TIMEOUT,
+                          HOST_UART_RX_BUF_SIZE,
+                          HOST_UART_RX_BUF_COUNT);
+
+/**@brief Received block waiting for the main loop. */
+typedef struct
+{
+    uint8_t * p_data;
+    size_t    len;
+} rx_block_t;
+
+static host_uart_evt_handler_t m_handler;
+static rx_block_t              m_rx_queue[HOST_UART_RX_QUEUE_SIZE];
+static uint8_t                 m_rx_head;
+static volatile uint8_t        m_rx_count;                 /**< Changed by the interrupt while the main loop reads. */
+static volatile bool           m_tx_done;                  /**< A write ended and has not been reported yet. */
+static uint32_t                m_cts_pin;
+static host_uart_stats_t       m_stats;
+
+
+/**@brief Function for handling libuarte events, in the UARTE interrupt. */
+static void libuarte_evt_handler(void * p_context, nrf_libuarte_async_evt_t * p_evt)
+{
+    bool queued = false;
+
+    switch (p_evt->type)
+    {
+        case NRF_LIBUARTE_ASYNC_EVT_RX_DATA:
+            if (m_rx_count < HOST_UART_RX_QUEUE_SIZE)
+            {
+                rx_block_t * p_block = &m_rx_queue[(m_rx_head + m_rx_count) % HOST_UART_RX_QUEUE_SIZE];
+
+                p_block->p_data = p_evt->data.rxtx.p_data;
+                p_block->len    = p_evt->data.rxtx.length;
+                m_rx_count++;
+                queued = true;
+            }
+            m_stats.rx_bytes += p_evt->data.rxtx.length;
+            if (!queued)
+            {
+                m_stats.rx_dropped += p_evt->data.rxtx.length;
+                nrf_libuarte_async_rx_free(&m_libuarte, p_evt->data.rxtx.p_data, p_evt->data.rxtx.length);
+            }
+            break;
+
+        case NRF_LIBUARTE_ASYNC_EVT_TX_DONE:
+            m_stats.tx_bytes += p_evt->data.rxtx.length;
+            m_tx_done         = true;
+            break;
+
+        case NRF_LIBUARTE_ASYNC_EVT_ERROR:
+        case NRF_LIBUARTE_ASYNC_EVT_OVERRUN_ERROR:
+            m_stats.errors++;
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+void host_uart_process(void)
+{
+    rx_block_t      block;
+    host_uart_evt_t evt;
+
+    // Only this function takes blocks out, so the oldest one stays put while it is handled.
+    while (m_rx_count > 0)
+    {
+        block = m_rx_queue[m_rx_head];
+
+        memset(&evt, 0, sizeof(evt));
+        evt.type   = HOST_UART_EVT_RX;
+        evt.p_data = block.p_data;
+        evt.len    = block.len;
+        m_handler(&evt);
+
+        CRITICAL_REGION_ENTER();
+        m_rx_head = (m_rx_head + 1) % HOST_UART_RX_QUEUE_SIZE;
+        m_rx_count--;
+        CRITICAL_REGION_EXIT();
+
+        nrf_libuarte_async_rx_free(&m_libuarte, block.p_data, block.len);
+    }
+
+    // Reported here rather than in the interrupt so the next write starts in the main loop,
+    // like those of the USB classes.
+    if (m_tx_done)
+    {
+        m_tx_done = false;
+
+        memset(&evt, 0, sizeof(evt));
+        evt.type = HOST_UART_EVT_TX_DONE;
+        m_handler(&evt);
+    }
+}
+
+
+ret_code_t host_uart_write(uint8_t const * p_data, size_t len)
+{
+    // libuarte takes a non-const pointer but only reads from it.
+    return nrf_libuarte_async_tx(&m_libuarte, (uint8_t *)p_data, len);
+}
+
+
+bool host_uart_tx_held(void)
+{
+    // CTS is active low. The UARTE connects the input buffer of the pin, so GPIO can read it.
+    return (nrf_gpio_pin_read(m_cts_pin) != 0);
+}
+
+
+void host_uart_stats_get(host_uart_stats_t * p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_stats;
+    CRITICAL_REGION_EXIT();
+}
+
+
+ret_code_t host_uart_init(host_uart_config_t const * p_config, host_uart_evt_handler_t handler)
+{
+    ret_code_t err_code;
+
+    if ((p_config == NULL) || (handler == NULL))
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    nrf_libuarte_async_config_t config =
+    {
+        .tx_pin     = p_config->tx_pin,
+        .rx_pin     = p_config->rx_pin,
+        .rts_pin    = p_config->rts_pin,
+        .cts_pin    = p_config->cts_pin,
+        .baudrate   = HOST_UART_BAUDRATE,
+        .parity     = NRF_UARTE_PARITY_EXCLUDED,
+        .hwfc       = NRF_UARTE_HWFC_ENABLED,
+        .timeout_us = HOST_UART_TIMEOUT_US,
+        .int_prio   = APP_IRQ_PRIORITY_LOW_MID,
+    };
+
+    m_handler  = handler;
+    m_rx_head  = 0;
+    m_rx_count = 0;
+    m_tx_done  = false;
+    m_cts_pin  = p_config->cts_pin;
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    err_code = nrf_libuarte_async_init(&m_libuarte, &config, libuarte_evt_handler, NULL);
+    VERIFY_SUCCESS(err_code);
+
+    // Hold both inputs at their idle level while nothing is wired to them: RX high, and CTS
+    // high, so an open CTS holds writes off instead of letting them out to nobody.
+    nrf_gpio_cfg_input(p_config->rx_pin, NRF_GPIO_PIN_PULLUP);
+    nrf_gpio_cfg_input(p_config->cts_pin, NRF_GPIO_PIN_PULLUP);
+
+    nrf_libuarte_async_enable(&m_libuarte);
+
+    return NRF_SUCCESS;
+}
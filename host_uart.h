@@ -0,0 +1,132 @@
+/**@file
+ *
+ * @defgroup host_uart UARTE host link
+ * @{
+ * @brief The host stream over UARTE, for gateways that have no USB.
+ *
+ * @details Built on libuarte_async from the SDK. Received bytes go by EasyDMA into a chain of
+ *          @ref HOST_UART_RX_BUF_COUNT buffers; the UARTE moves on to the next buffer in hardware,
+ *          so no byte is lost between buffers. A TIMER counts received bytes through PPI and a
+ *          second TIMER ends a partly filled buffer once the line has been idle for
+ *          @ref HOST_UART_TIMEOUT_US. RTS/CTS flow control is on: when every buffer is waiting
+ *          to be processed, the UARTE stops the host with RTS.
+ *
+ *          Buffers are filled in the UARTE interrupt but handed to the event handler from
+ *          @ref host_uart_process, in the main loop, and given back to libuarte after the
+ *          handler returns. Data is sent straight from the caller's memory, one transfer at a
+ *          time; the end of a transfer is also reported from @ref host_uart_process.
+ */
+#ifndef HOST_UART_H__
+#define HOST_UART_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "nrf_uarte.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_UART_BAUDRATE          NRF_UARTE_BAUDRATE_1000000  /**< Line rate. */
+#define HOST_UART_TIMEOUT_US        100                         /**< Idle time that ends a partly filled RX buffer; 10 characters at 1 Mbaud. */
+#define HOST_UART_RX_BUF_SIZE       256                         /**< Size of each RX buffer. */
+#define HOST_UART_RX_BUF_COUNT      8                           /**< RX buffers; 20 ms of data at 1 Mbaud. */
+#define HOST_UART_RX_QUEUE_SIZE     (2 * HOST_UART_RX_BUF_COUNT) /**< RX blocks waiting for the main loop at most. A buffer ended by the timeout can give several. */
+
+
+/**@brief Pins of the link. */
+typedef struct
+{
+    uint32_t tx_pin;
+    uint32_t rx_pin;
+    uint32_t rts_pin;
+    uint32_t cts_pin;
+} host_uart_config_t;
+
+
+/**@brief Link event types. */
+typedef enum
+{
+    HOST_UART_EVT_RX,                           /**< Data received. */
+    HOST_UART_EVT_TX_DONE,                      /**< The last write has been sent. */
+} host_uart_evt_type_t;
+
+
+/**@brief Link event. */
+typedef struct
+{
+    host_uart_evt_type_t type;
+    uint8_t const      * p_data;                /**< Data of @ref HOST_UART_EVT_RX, valid during the call. */
+    size_t               len;                   /**< Length of the data. */
+} host_uart_evt_t;
+
+
+/**@brief Link event handler type. */
+typedef void (*host_uart_evt_handler_t)(host_uart_evt_t const * p_evt);
+
+
+/**@brief Link statistics. */
+typedef struct
+{
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t errors;                            /**< Framing, parity and overrun errors reported by the UARTE. */
+    uint32_t rx_dropped;                        /**< Bytes dropped because the main loop fell @ref HOST_UART_RX_QUEUE_SIZE blocks behind. */
+} host_uart_stats_t;
+
+
+/**@brief Function for initializing and starting the link.
+ *
+ * @param[in] p_config  Pins.
+ * @param[in] handler   Event handler.
+ *
+ * @return NRF_SUCCESS or an error code from libuarte.
+ */
+ret_code_t host_uart_init(host_uart_config_t const * p_config, host_uart_evt_handler_t handler);
+
+
+/**@brief Function for sending data.
+ *
+ * @details The data is sent from where it is, by EasyDMA, so it must be in RAM and stay
+ *          unchanged until @ref HOST_UART_EVT_TX_DONE.
+ *
+ * @param[in] p_data  Data.
+ * @param[in] len     Length.
+ *
+ * @retval NRF_SUCCESS      The transfer started.
+ * @retval NRF_ERROR_BUSY   A transfer is in progress.
+ */
+ret_code_t host_uart_write(uint8_t const * p_data, size_t len);
+
+
+/**@brief Function for checking whether the host holds the link off.
+ *
+ * @details A transfer does not wait for this: the UARTE starts it and stops at the next byte
+ *          while CTS is inactive. The transfer then takes as long as the host holds it off.
+ *
+ * @retval true   CTS is inactive; a transfer would not move until the host raises it.
+ * @retval false  The host takes data.
+ */
+bool host_uart_tx_held(void);
+
+
+/**@brief Function for reporting received data and finished writes to the event handler. Call from the main loop. */
+void host_uart_process(void);
+
+
+/**@brief Function for getting the link statistics.
+ *
+ * @param[out] p_stats  Statistics.
+ */
+void host_uart_stats_get(host_uart_stats_t * p_stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_UART_H__
+
+/** @} */
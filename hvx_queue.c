@@ -0,0 +1,442 @@
+#include <stdbool.h>
+#include <string.h>
+#include "hvx_queue.h"
+#include "app_util_platform.h"
+#include "nrf_balloc.h"
+#include "nrf_sdh_ble.h"
+
+
+#define SLAB_CLASS_COUNT    3
+
+/**@brief Queued packet. */
+typedef struct
+{
+    uint16_t                 handle;        /**< Attribute value handle. */
+    uint8_t                  type;          /**< BLE_GATT_HVX_NOTIFICATION or BLE_GATT_HVX_INDICATION. */
+    uint8_t                  slab;          /**< Slab class holding the data. */
+    uint16_t                 len;           /**< Data length. */
+    uint8_t                * p_data;        /**< Data, in a slab element. */
+    hvx_queue_done_handler_t done_handler;  /**< Called when the notification is acknowledged, or NULL. */
+    uint32_t                 tag;           /**< Passed to the handler. */
+} hvx_entry_t;
+
+/**@brief Notification in the SoftDevice whose sender waits for its acknowledgement. */
+typedef struct
+{
+    uint32_t                 ticket;        /**< Position among all notifications sent on the link. */
+    hvx_queue_done_handler_t handler;
+    uint32_t                 tag;
+} hvx_tracked_t;
+
+/**@brief Queue of one link. */
+typedef struct
+{
+    uint16_t      conn_handle;          /**< Connection handle, BLE_CONN_HANDLE_INVALID if the entry is free. */
+    uint8_t       head;                 /**< Index of the oldest packet. */
+    uint8_t       count;                /**< Number of queued packets. */
+    bool          pumping;              /**< A context is handing packets to the SoftDevice. */
+    bool          pump_again;           /**< The queue changed while it did. */
+    hvx_entry_t   entries[HVX_QUEUE_DEPTH];
+    uint32_t      hvn_sent;             /**< Notifications the SoftDevice took on the link, from any module. */
+    uint32_t      hvn_done;             /**< Notifications it acknowledged. */
+    uint8_t       tracked_head;         /**< Index of the oldest tracked notification. */
+    uint8_t       tracked_count;
+    hvx_tracked_t tracked[HVX_QUEUE_DEPTH];
+} hvx_link_t;
+
+STATIC_ASSERT(HVX_QUEUE_SMALL_SIZE < HVX_QUEUE_MEDIUM_SIZE);
+STATIC_ASSERT(HVX_QUEUE_MEDIUM_SIZE < HVX_QUEUE_LARGE_SIZE);
+
+NRF_BALLOC_DEF(m_slab_small, HVX_QUEUE_SMALL_SIZE, HVX_QUEUE_SMALL_COUNT);
+NRF_BALLOC_DEF(m_slab_medium, HVX_QUEUE_MEDIUM_SIZE, HVX_QUEUE_MEDIUM_COUNT);
+NRF_BALLOC_DEF(m_slab_large, HVX_QUEUE_LARGE_SIZE, HVX_QUEUE_LARGE_COUNT);
+
+static nrf_balloc_t const * const m_slabs[SLAB_CLASS_COUNT] =
+{
+    &m_slab_small,
+    &m_slab_medium,
+    &m_slab_large,
+};
+
+static uint16_t const m_slab_sizes[SLAB_CLASS_COUNT] =
+{
+    HVX_QUEUE_SMALL_SIZE,
+    HVX_QUEUE_MEDIUM_SIZE,
+    HVX_QUEUE_LARGE_SIZE,
+};
+
+static hvx_link_t       m_links[HVX_QUEUE_LINK_COUNT];
+static nrf_ble_gatt_t * mp_gatt;
+
+
+static hvx_link_t * link_find(uint16_t conn_handle)
+{
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < HVX_QUEUE_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**@brief Function for taking the oldest packet off a link and freeing its data. */
+static void entry_free(hvx_link_t * p_link)
+{
+    uint8_t * p_data = NULL;
+    uint8_t   slab   = 0;
+
+    // Read before the slot is given back: a put from another context may reuse it at once.
+    CRITICAL_REGION_ENTER();
+    if (p_link->count > 0)
+    {
+        p_data       = p_link->entries[p_link->head].p_data;
+        slab         = p_link->entries[p_link->head].slab;
+        p_link->head = (p_link->head + 1) % HVX_QUEUE_DEPTH;
+        p_link->count--;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (p_data != NULL)
+    {
+        nrf_balloc_free(m_slabs[slab], p_data);
+    }
+}
+
+
+/**@brief Function for counting a notification the SoftDevice took, and tracking it if its
+ *        sender waits for the acknowledgement.
+ */
+static void hvn_sent(hvx_link_t * p_link, hvx_queue_done_handler_t handler, uint32_t tag)
+{
+    CRITICAL_REGION_ENTER();
+    if ((handler != NULL) && (p_link->tracked_count < HVX_QUEUE_DEPTH))
+    {
+        hvx_tracked_t * p_tracked =
+            &p_link->tracked[(p_link->tracked_head + p_link->tracked_count) % HVX_QUEUE_DEPTH];
+
+        p_tracked->ticket  = p_link->hvn_sent;
+        p_tracked->handler = handler;
+        p_tracked->tag     = tag;
+        p_link->tracked_count++;
+    }
+    p_link->hvn_sent++;
+    CRITICAL_REGION_EXIT();
+}
+
+
+/**@brief Function for handling BLE_GATTS_EVT_HVN_TX_COMPLETE: the oldest notifications of the
+ *        link are acknowledged, and the handlers of tracked ones among them are called.
+ */
+static void hvn_done(hvx_link_t * p_link, uint8_t count)
+{
+    hvx_tracked_t tracked;
+    bool          found = true;
+
+    CRITICAL_REGION_ENTER();
+    p_link->hvn_done += count;
+    CRITICAL_REGION_EXIT();
+
+    while (found)
+    {
+        CRITICAL_REGION_ENTER();
+        found = (p_link->tracked_count > 0) &&
+                ((int32_t)(p_link->tracked[p_link->tracked_head].ticket - p_link->hvn_done) < 0);
+        if (found)
+        {
+            tracked              = p_link->tracked[p_link->tracked_head];
+            p_link->tracked_head = (p_link->tracked_head + 1) % HVX_QUEUE_DEPTH;
+            p_link->tracked_count--;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (found)
+        {
+            tracked.handler(p_link->conn_handle, tracked.tag);
+        }
+    }
+}
+
+
+/**@brief Function for taking the pump of a link, or asking its holder to run once more.
+ *
+ * @return true if the caller now pumps the queue.
+ */
+static bool pump_take(hvx_link_t * p_link)
+{
+    bool taken;
+
+    CRITICAL_REGION_ENTER();
+    taken = !p_link->pumping;
+    if (taken)
+    {
+        p_link->pumping = true;
+    }
+    else
+    {
+        p_link->pump_again = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return taken;
+}
+
+
+/**@brief Function for handing queued packets to the SoftDevice until it is full.
+ *
+ * @details Called from the context of @ref hvx_queue_put and from the BLE event handler. Only
+ *          the queue indexes are updated in a critical region; sd_ble_gatts_hvx is called outside
+ *          it. One context pumps a link at a time, so the oldest packet cannot be sent twice. A
+ *          call that finds the pump taken makes the holder run again before it lets go.
+ */
+static void link_pump(hvx_link_t * p_link)
+{
+    bool done = false;
+
+    if (!pump_take(p_link))
+    {
+        return;
+    }
+
+    while (!done)
+    {
+        hvx_entry_t * p_entry;
+
+        CRITICAL_REGION_ENTER();
+        p_link->pump_again = false;
+        p_entry            = (p_link->count > 0) ? &p_link->entries[p_link->head] : NULL;
+        CRITICAL_REGION_EXIT();
+
+        // Producers only write behind the oldest packet, so it stays as it is until freed.
+        while (p_entry != NULL)
+        {
+            uint16_t               len = p_entry->len;
+            ble_gatts_hvx_params_t hvx_params;
+            ret_code_t             err_code;
+
+            memset(&hvx_params, 0, sizeof(hvx_params));
+            hvx_params.handle = p_entry->handle;
+            hvx_params.type   = p_entry->type;
+            hvx_params.p_len  = &len;
+            hvx_params.p_data = p_entry->p_data;
+
+            err_code = sd_ble_gatts_hvx(p_link->conn_handle, &hvx_params);
+            if ((err_code == NRF_ERROR_RESOURCES) || (err_code == NRF_ERROR_BUSY))
+            {
+                // Notification queue full or indication outstanding; resumed by the next
+                // HVN_TX_COMPLETE or HVC event.
+                break;
+            }
+            if ((err_code == NRF_SUCCESS) && (p_entry->type == BLE_GATT_HVX_NOTIFICATION))
+            {
+                hvn_sent(p_link, p_entry->done_handler, p_entry->tag);
+            }
+
+            // Sent, or refused for good (CCCD not enabled): either way the packet is done.
+            entry_free(p_link);
+
+            CRITICAL_REGION_ENTER();
+            p_entry = (p_link->count > 0) ? &p_link->entries[p_link->head] : NULL;
+            CRITICAL_REGION_EXIT();
+        }
+
+        // A packet queued, or a completion, while the SoftDevice was called is seen here.
+        CRITICAL_REGION_ENTER();
+        done = !p_link->pump_again;
+        if (done)
+        {
+            p_link->pumping = false;
+        }
+        CRITICAL_REGION_EXIT();
+    }
+}
+
+
+ret_code_t hvx_queue_put(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx)
+{
+    return hvx_queue_put_tracked(conn_handle, p_hvx, NULL, 0);
+}
+
+
+ret_code_t hvx_queue_put_tracked(uint16_t                       conn_handle,
+                                 ble_gatts_hvx_params_t const * p_hvx,
+                                 hvx_queue_done_handler_t       handler,
+                                 uint32_t                       tag)
+{
+    hvx_link_t * p_link   = link_find(conn_handle);
+    ret_code_t   err_code = NRF_SUCCESS;
+    uint8_t    * p_data;
+    uint16_t     len;
+    uint8_t      slab;
+
+    if (p_link == NULL)
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+
+    len = (p_hvx->p_len != NULL) ? *p_hvx->p_len : 0;
+    if (len > nrf_ble_gatt_eff_mtu_get(mp_gatt, conn_handle) - 3)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    for (slab = 0; (slab < SLAB_CLASS_COUNT - 1) && (len > m_slab_sizes[slab]); slab++)
+    {
+        // Find the smallest class the packet fits in.
+    }
+
+    // nrf_balloc has its own critical region; the copy is made before the packet is visible.
+    p_data = nrf_balloc_alloc(m_slabs[slab]);
+    if (p_data == NULL)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+    memcpy(p_data, p_hvx->p_data, len);
+
+    CRITICAL_REGION_ENTER();
+    if (p_link->count == HVX_QUEUE_DEPTH)
+    {
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        hvx_entry_t * p_entry = &p_link->entries[(p_link->head + p_link->count) % HVX_QUEUE_DEPTH];
+
+        p_entry->p_data       = p_data;
+        p_entry->handle       = p_hvx->handle;
+        p_entry->type         = p_hvx->type;
+        p_entry->slab         = slab;
+        p_entry->len          = len;
+        p_entry->done_handler = handler;
+        p_entry->tag          = tag;
+        p_link->count++;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code != NRF_SUCCESS)
+    {
+        nrf_balloc_free(m_slabs[slab], p_data);
+        return err_code;
+    }
+
+    // Sends only from the head, so the order is kept whoever pumps.
+    link_pump(p_link);
+
+    return NRF_SUCCESS;
+}
+
+
+void hvx_queue_hvn_sent(uint16_t conn_handle)
+{
+    hvx_link_t * p_link = link_find(conn_handle);
+
+    if (p_link != NULL)
+    {
+        hvn_sent(p_link, NULL, 0);
+    }
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    hvx_link_t * p_link;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            p_link = NULL;
+            for (uint32_t i = 0; (p_link == NULL) && (i < HVX_QUEUE_LINK_COUNT); i++)
+            {
+                if (m_links[i].conn_handle == BLE_CONN_HANDLE_INVALID)
+                {
+                    p_link = &m_links[i];
+                }
+            }
+            if (p_link != NULL)
+            {
+                p_link->head          = 0;
+                p_link->count         = 0;
+                p_link->pumping       = false;
+                p_link->pump_again    = false;
+                p_link->hvn_sent      = 0;
+                p_link->hvn_done      = 0;
+                p_link->tracked_head  = 0;
+                p_link->tracked_count = 0;
+                p_link->conn_handle   = p_ble_evt->evt.gap_evt.conn_handle;
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_link = link_find(p_ble_evt->evt.gap_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                // Unknown from now on, so no put can add to the queue while it is emptied.
+                p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+                while (p_link->count > 0)
+                {
+                    entry_free(p_link);
+                }
+            }
+            break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            p_link = link_find(p_ble_evt->evt.gatts_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                hvn_done(p_link, p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count);
+                link_pump(p_link);
+            }
+            break;
+
+        case BLE_GATTS_EVT_HVC:
+            p_link = link_find(p_ble_evt->evt.gatts_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                link_pump(p_link);
+            }
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_hvx_queue_obs, HVX_QUEUE_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+ret_code_t hvx_queue_init(nrf_ble_gatt_t * p_gatt)
+{
+    ret_code_t err_code;
+
+    mp_gatt = p_gatt;
+
+    for (uint32_t i = 0; i < HVX_QUEUE_LINK_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    for (uint32_t i = 0; i < SLAB_CLASS_COUNT; i++)
+    {
+        err_code = nrf_balloc_init(m_slabs[i]);
+        if (err_code != NRF_SUCCESS)
+        {
+            return err_code;
+        }
+    }
+
+    return NRF_SUCCESS;
+}
@@ -0,0 +1,123 @@
+/**@file
+ *
+ * @defgroup hvx_queue MTU-sized notification queue
+ * @{
+ * @brief Per-link queue of notifications and indications, with data held in size-class slabs.
+ *
+ * @details The SoftDevice holds only hvn_tx_queue_size notifications per link. Anything sent
+ *          while that queue is full would be lost, so this module keeps the packets
+ *          and hands them to the SoftDevice as soon as it has room again. That happens on
+ *          BLE_GATTS_EVT_HVN_TX_COMPLETE for notifications and on BLE_GATTS_EVT_HVC for
+ *          indications.
+ *
+ *          Packet data is copied into the smallest slab class it fits in. Short status messages
+ *          then do not take a full-MTU buffer. A packet may be as long as the ATT MTU negotiated
+ *          on its link allows.
+ *
+ *          @ref hvx_queue_put can be called from the main loop and from BLE event handlers. The
+ *          queue indexes are updated in critical regions, and one context at a time hands
+ *          packets to the SoftDevice.
+ *
+ *          The SoftDevice acknowledges notifications in the order it took them, per link, with
+ *          a count only. To tell a sender when its own notification went over the air, the module
+ *          numbers every notification the SoftDevice takes on a link. Modules that call
+ *          sd_ble_gatts_hvx themselves report theirs with @ref hvx_queue_hvn_sent, so that the
+ *          numbering covers them too. Two contexts sending at the same moment can be numbered
+ *          in the wrong order, which moves an acknowledgement by one notification at most.
+ */
+#ifndef HVX_QUEUE_H__
+#define HVX_QUEUE_H__
+
+#include <stdint.h>
+#include "ble_gatts.h"
+#include "nrf_ble_gatt.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HVX_QUEUE_BLE_OBSERVER_PRIO     2                               /**< Priority of the BLE observer. */
+#define HVX_QUEUE_LINK_COUNT            NRF_SDH_BLE_TOTAL_LINK_COUNT    /**< Number of links with a queue. */
+#define HVX_QUEUE_DEPTH                 8                               /**< Packets queued per link. */
+
+#define HVX_QUEUE_SMALL_SIZE            32                              /**< Element size of the small slab class. */
+#define HVX_QUEUE_SMALL_COUNT           16                              /**< Elements in the small slab class. */
+#define HVX_QUEUE_MEDIUM_SIZE           96                              /**< Element size of the medium slab class. */
+#define HVX_QUEUE_MEDIUM_COUNT          8                               /**< Elements in the medium slab class. */
+#define HVX_QUEUE_LARGE_SIZE            (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3) /**< Element size of the large slab class: one full-MTU packet. */
+#define HVX_QUEUE_LARGE_COUNT           8                               /**< Elements in the large slab class. */
+
+
+/**@brief Handler of the acknowledgement of a tracked notification.
+ *
+ * @param[in] conn_handle  Link.
+ * @param[in] tag          Tag given to @ref hvx_queue_put_tracked.
+ */
+typedef void (*hvx_queue_done_handler_t)(uint16_t conn_handle, uint32_t tag);
+
+
+/**@brief Function for initializing the module.
+ *
+ * @param[in] p_gatt  GATT module instance, for the ATT MTU of each link.
+ *
+ * @return NRF_SUCCESS or an error code from nrf_balloc_init.
+ */
+ret_code_t hvx_queue_init(nrf_ble_gatt_t * p_gatt);
+
+
+/**@brief Function for sending a notification or indication.
+ *
+ * @details The data is copied, so the caller's buffer can be reused at once. If the
+ *          SoftDevice has room and nothing is queued ahead, the packet goes to the
+ *          SoftDevice right away.
+ *
+ * @param[in] conn_handle  Connection handle.
+ * @param[in] p_hvx        Parameters as for sd_ble_gatts_hvx. The offset is ignored.
+ *
+ * @retval NRF_SUCCESS               Packet sent or queued.
+ * @retval NRF_ERROR_INVALID_LENGTH  Packet longer than the link's ATT MTU allows.
+ * @retval NRF_ERROR_NO_MEM          Queue of the link or slab class full.
+ * @retval BLE_ERROR_INVALID_CONN_HANDLE  Unknown link.
+ */
+ret_code_t hvx_queue_put(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx);
+
+
+/**@brief Function for sending a notification and learning when the peer's link layer has
+ *        acknowledged it.
+ *
+ * @details As @ref hvx_queue_put. The handler is called from the BLE event handler once the
+ *          notification is acknowledged. It is not called if the link goes down first, or if
+ *          more than @ref HVX_QUEUE_DEPTH tracked notifications of the link are in the
+ *          SoftDevice at once.
+ *
+ * @param[in] conn_handle  Connection handle.
+ * @param[in] p_hvx        Parameters as for sd_ble_gatts_hvx. Must be a notification.
+ * @param[in] handler      Acknowledgement handler.
+ * @param[in] tag          Passed to the handler.
+ *
+ * @return As @ref hvx_queue_put.
+ */
+ret_code_t hvx_queue_put_tracked(uint16_t                       conn_handle,
+                                 ble_gatts_hvx_params_t const * p_hvx,
+                                 hvx_queue_done_handler_t       handler,
+                                 uint32_t                       tag);
+
+
+/**@brief Function for reporting a notification sent with sd_ble_gatts_hvx outside the queue.
+ *
+ * @details Call after every notification the SoftDevice took, so acknowledgements of tracked
+ *          notifications are matched correctly.
+ *
+ * @param[in] conn_handle  Connection handle.
+ */
+void hvx_queue_hvn_sent(uint16_t conn_handle);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HVX_QUEUE_H__
+
+/** @} */
@@ -0,0 +1,157 @@
+#include <string.h>
+#include "link_ctx.h"
+#include "nrf_sdh_ble.h"
+
+
+static link_ctx_t          m_links[LINK_CTX_COUNT];
+static ble_ots_t           m_ots_template;          /**< OTS state of a link that has just connected. */
+static uint16_t            m_l2cap_buffer_len;      /**< Length of the receive buffer of each link, 0 before init. */
+static link_ctx_filter_t   m_filter;                /**< Events it claims never reach the OTS module. */
+
+
+link_ctx_t * link_ctx_find(uint16_t conn_handle)
+{
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < LINK_CTX_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**@brief Function for giving a link a fresh copy of the template instance.
+ *
+ * @details The parts of an OTS instance point at each other, and the L2CAP part receives into
+ *          the buffer given at init. In the copy, both are pointed at the link's own.
+ */
+static void link_ots_make(link_ctx_t * p_link)
+{
+    ble_ots_t * p_ots = &p_link->ots;
+
+    *p_ots = m_ots_template;
+
+    p_ots->object_chars.p_ots                             = p_ots;
+    p_ots->oacp_chars.p_ots                               = p_ots;
+    p_ots->oacp_chars.ots_l2cap.p_ots_oacp                = &p_ots->oacp_chars;
+    p_ots->oacp_chars.ots_l2cap.rx_params.sdu_buf.p_data  = p_link->p_l2cap_buffer;
+    p_ots->oacp_chars.ots_l2cap.rx_params.sdu_buf.len     = m_l2cap_buffer_len;
+}
+
+
+static link_ctx_t * link_alloc(uint16_t conn_handle)
+{
+    for (uint32_t i = 0; i < LINK_CTX_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == BLE_CONN_HANDLE_INVALID)
+        {
+            m_links[i].conn_handle = conn_handle;
+            link_ots_make(&m_links[i]);
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+uint32_t link_ctx_count(void)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < LINK_CTX_COUNT; i++)
+    {
+        if (m_links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+
+/**@brief Function for dispatching a BLE event to the OTS instance of the link it belongs to.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    // All connection-related events carry the connection handle first.
+    uint16_t     conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    link_ctx_t * p_link;
+
+    if (m_l2cap_buffer_len == 0)
+    {
+        return;
+    }
+
+    if ((p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED) &&
+        (p_ble_evt->evt.gap_evt.params.connected.role == BLE_GAP_ROLE_PERIPH))
+    {
+        p_link = link_alloc(conn_handle);
+    }
+    else
+    {
+        p_link = link_ctx_find(conn_handle);
+    }
+
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    if ((m_filter == NULL) ||
+        !m_filter(p_ble_evt) ||
+        (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED) ||
+        (p_ble_evt->header.evt_id == BLE_GAP_EVT_DISCONNECTED))
+    {
+        ble_ots_on_ble_evt(p_ble_evt, &p_link->ots);
+    }
+
+    if (p_ble_evt->header.evt_id == BLE_GAP_EVT_DISCONNECTED)
+    {
+        p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_link_ctx_obs, BLE_OTS_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+ret_code_t link_ctx_init(ble_ots_t const * p_ots, uint8_t * p_l2cap_buffers, uint16_t l2cap_buffer_len)
+{
+    if ((p_ots == NULL) || (p_l2cap_buffers == NULL))
+    {
+        return NRF_ERROR_NULL;
+    }
+    if (l2cap_buffer_len == 0)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    for (uint32_t i = 0; i < LINK_CTX_COUNT; i++)
+    {
+        m_links[i].conn_handle    = BLE_CONN_HANDLE_INVALID;
+        m_links[i].p_l2cap_buffer = &p_l2cap_buffers[i * l2cap_buffer_len];
+    }
+
+    m_ots_template     = *p_ots;
+    m_l2cap_buffer_len = l2cap_buffer_len;
+
+    return NRF_SUCCESS;
+}
+
+
+void link_ctx_filter_set(link_ctx_filter_t filter)
+{
+    m_filter = filter;
+}
@@ -0,0 +1,96 @@
+/**@file
+ *
+ * @defgroup link_ctx Per-link transfer contexts
+ * @{
+ * @brief Table of per-connection OTS and L2CAP state for serving several centrals at once.
+ *
+ * @details The OTS GATT service exists once in the attribute table, but the OTS module keeps the
+ *          connection handle, OACP procedure and L2CAP CoC state of a single client inside its
+ *          @ref ble_ots_t instance. This module gives every link an instance of its own, made
+ *          from the initialized one when the link connects, with its own L2CAP receive buffer.
+ *          BLE events go straight to the instance of the link they belong to, so the OTS module
+ *          and the application OTS event handler always see the state of the right link.
+ *
+ *          The OTS instance must be declared without @ref BLE_OTS_DEF, since this module
+ *          dispatches BLE events to the per-link copies instead.
+ */
+#ifndef LINK_CTX_H__
+#define LINK_CTX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble_ots.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LINK_CTX_COUNT      NRF_SDH_BLE_PERIPHERAL_LINK_COUNT   /**< Number of simultaneous links served. */
+
+
+/**@brief Transfer context of one link. */
+typedef struct
+{
+    uint16_t  conn_handle;          /**< Connection handle, BLE_CONN_HANDLE_INVALID if the entry is free. */
+    ble_ots_t ots;                  /**< OTS, OACP and L2CAP CoC state of the link. */
+    uint8_t * p_l2cap_buffer;       /**< L2CAP receive buffer of the link. */
+} link_ctx_t;
+
+
+/**@brief Filter run on every event of a link before it goes to the OTS module.
+ *
+ * @return true to keep the event from the OTS module.
+ */
+typedef bool (*link_ctx_filter_t)(ble_evt_t const * p_ble_evt);
+
+
+/**@brief Function for initializing the module.
+ *
+ * @details Must be called after @ref ble_ots_init. The initialized instance is used as the
+ *          template for every new link. Link i receives into
+ *          @p p_l2cap_buffers + i * @p l2cap_buffer_len; the template may have been given the
+ *          first of these buffers.
+ *
+ * @param[in] p_ots             Initialized OTS instance.
+ * @param[in] p_l2cap_buffers   @ref LINK_CTX_COUNT L2CAP receive buffers, one after the other.
+ * @param[in] l2cap_buffer_len  Length of each buffer.
+ *
+ * @retval NRF_SUCCESS              Module initialized.
+ * @retval NRF_ERROR_NULL           @p p_ots or @p p_l2cap_buffers is NULL.
+ * @retval NRF_ERROR_INVALID_PARAM  @p l2cap_buffer_len is 0.
+ */
+ret_code_t link_ctx_init(ble_ots_t const * p_ots, uint8_t * p_l2cap_buffers, uint16_t l2cap_buffer_len);
+
+
+/**@brief Function for finding the context of a link.
+ *
+ * @param[in] conn_handle  Connection handle.
+ *
+ * @return Pointer to the context, or NULL if the link is not known.
+ */
+link_ctx_t * link_ctx_find(uint16_t conn_handle);
+
+
+/**@brief Function for getting the number of links in use. */
+uint32_t link_ctx_count(void);
+
+
+/**@brief Function for setting the event filter.
+ *
+ * @details Lets another module serve some requests on a link in place of the OTS module.
+ *          The filter sees connection and disconnection events too, but cannot keep them
+ *          from the OTS module.
+ *
+ * @param[in] filter  Filter, or NULL for none.
+ */
+void link_ctx_filter_set(link_ctx_filter_t filter);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LINK_CTX_H__
+
+/** @} */
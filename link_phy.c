@@ -0,0 +1,330 @@
+#include <string.h>
+#include "link_phy.h"
+#include "ble.h"
+#include "ble_hci.h"
+#include "nordic_common.h"
+#include "msg.h"
+
+
+/**@brief PHYs from fastest to most robust. */
+static uint8_t const m_ladder[] = {BLE_GAP_PHY_2MBPS, BLE_GAP_PHY_1MBPS, BLE_GAP_PHY_CODED};
+
+/**@brief Step up and step down thresholds per rung of @ref m_ladder, in dBm. */
+static int8_t const m_up_dbm[]   = {INT8_MAX,             LINK_PHY_1M_UP_DBM,   LINK_PHY_CODED_UP_DBM};
+static int8_t const m_down_dbm[] = {LINK_PHY_2M_DOWN_DBM, LINK_PHY_1M_DOWN_DBM, INT8_MIN};
+
+/**@brief Collapse threshold per rung of @ref m_ladder, in percent of the best interval. */
+static uint8_t const m_collapse_pct[] = {LINK_PHY_2M_COLLAPSE_PCT, LINK_PHY_1M_COLLAPSE_PCT, 0};
+
+/**@brief Loss a busy link must show to step down, per rung of @ref m_ladder. 0 if none is needed. */
+static uint8_t const m_loss_pct[] = {0, LINK_PHY_1M_LOSS_PCT, 0};
+
+static char const * const m_phy_names[] = {"2M", "1M", "Coded"};
+
+#define RUNG_1M     1
+#define RUNG_COUNT  ARRAY_SIZE(m_ladder)
+
+/**@brief Monitor state of one link. */
+typedef struct
+{
+    uint16_t conn_handle;                   /**< Connection handle, BLE_CONN_HANDLE_INVALID if the entry is free. */
+    uint8_t  rung;                          /**< Current PHY, as an index into @ref m_ladder. */
+    uint8_t  pending;                       /**< Rung asked for, or RUNG_COUNT if none. */
+    uint8_t  refused;                       /**< Bit n set if the peer refused rung n. */
+    bool     held;                          /**< The link is on a PHY the module asked for. */
+    bool     rssi_valid;                    /**< @ref rssi_avg holds a sample. */
+    int16_t  rssi_avg;                      /**< Average RSSI, in 1/16 dBm. */
+    uint8_t  up_count;                      /**< Good intervals in a row. */
+    uint8_t  down_count;                    /**< Bad intervals in a row. */
+    uint32_t down_acked;                    /**< Packets acknowledged in those intervals. */
+    uint8_t  dwell;                         /**< Intervals left without a decision. */
+    uint32_t acked;                         /**< Packets acknowledged in this interval. */
+    uint32_t acked_best;                    /**< Most packets acknowledged in an interval on this PHY. */
+} phy_link_t;
+
+APP_TIMER_DEF(m_eval_timer);
+
+static phy_link_t m_links[LINK_PHY_LINK_COUNT];
+
+
+static phy_link_t * link_find(uint16_t conn_handle)
+{
+    for (uint32_t i = 0; i < LINK_PHY_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static uint8_t rung_of(uint8_t phy)
+{
+    for (uint8_t i = 0; i < RUNG_COUNT; i++)
+    {
+        if (m_ladder[i] == phy)
+        {
+            return i;
+        }
+    }
+
+    return RUNG_1M;
+}
+
+
+static void rssi_update(phy_link_t * p_link, int8_t rssi)
+{
+    int16_t sample = (int16_t)(rssi * 16);
+
+    if (!p_link->rssi_valid)
+    {
+        p_link->rssi_avg   = sample;
+        p_link->rssi_valid = true;
+    }
+    else
+    {
+        p_link->rssi_avg += (sample - p_link->rssi_avg) / LINK_PHY_RSSI_WEIGHT;
+    }
+}
+
+
+/**@brief Function for asking the peer to move the link to another PHY. */
+static void phy_request(phy_link_t * p_link, uint8_t rung)
+{
+    ble_gap_phys_t phys;
+    ret_code_t     err_code;
+
+    if ((p_link->refused & (1 << rung)) != 0)
+    {
+        return;
+    }
+
+    phys.tx_phys = m_ladder[rung];
+    phys.rx_phys = m_ladder[rung];
+
+    err_code = sd_ble_gap_phy_update(p_link->conn_handle, &phys);
+    if (err_code == NRF_SUCCESS)
+    {
+        p_link->pending = rung;
+        msg("PHY 0x%04x: %s to %s, RSSI %d dBm\r\n",
+            p_link->conn_handle,
+            m_phy_names[p_link->rung],
+            m_phy_names[rung],
+            p_link->rssi_avg / 16);
+    }
+    // Otherwise a procedure is running; the next interval tries again.
+}
+
+
+/**@brief Function for judging one interval of a link. */
+static void link_evaluate(phy_link_t * p_link)
+{
+    int8_t   rssi;
+    uint8_t  ch_index;
+    int16_t  dbm;
+    bool     collapse;
+    bool     loss;
+    uint32_t acked = p_link->acked;
+
+    if (sd_ble_gap_rssi_get(p_link->conn_handle, &rssi, &ch_index) == NRF_SUCCESS)
+    {
+        rssi_update(p_link, rssi);
+    }
+
+    p_link->acked      = 0;
+    p_link->acked_best = MAX(p_link->acked_best, acked);
+
+    if (!p_link->rssi_valid || (p_link->pending != RUNG_COUNT))
+    {
+        return;
+    }
+    if (p_link->dwell > 0)
+    {
+        p_link->dwell--;
+        return;
+    }
+
+    dbm = p_link->rssi_avg / 16;
+
+    // A link that has gone quiet is not judged; one that still sends a trickle at a signal
+    // too weak to step up is.
+    collapse = (p_link->acked_best >= LINK_PHY_BUSY_PACKETS) &&
+               (acked > 0) &&
+               (acked * 100 < p_link->acked_best * m_collapse_pct[p_link->rung]) &&
+               (dbm <= m_up_dbm[p_link->rung]);
+
+    if ((dbm < m_down_dbm[p_link->rung]) || collapse)
+    {
+        p_link->down_count++;
+        p_link->down_acked += acked;
+    }
+    else
+    {
+        p_link->down_count = 0;
+        p_link->down_acked = 0;
+    }
+    p_link->up_count = ((dbm > m_up_dbm[p_link->rung]) && !collapse) ? p_link->up_count + 1 : 0;
+
+    // A busy link only steps down once it delivers less over the whole streak, so a fading dip
+    // or a weak but working signal does not leave it on a slower PHY.
+    loss = (m_loss_pct[p_link->rung] == 0) ||
+           (p_link->acked_best < LINK_PHY_BUSY_PACKETS) ||
+           (p_link->down_acked * 100 < p_link->acked_best * p_link->down_count * m_loss_pct[p_link->rung]);
+
+    if ((p_link->down_count >= LINK_PHY_DOWN_PERIODS) && (p_link->rung + 1 < RUNG_COUNT) && loss)
+    {
+        phy_request(p_link, p_link->rung + 1);
+    }
+    else if ((p_link->up_count >= LINK_PHY_UP_PERIODS) && (p_link->rung > 0))
+    {
+        phy_request(p_link, p_link->rung - 1);
+    }
+}
+
+
+static void eval_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    for (uint32_t i = 0; i < LINK_PHY_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+        {
+            link_evaluate(&m_links[i]);
+        }
+    }
+}
+
+
+static void on_phy_update(phy_link_t * p_link, ble_gap_evt_phy_update_t const * p_update)
+{
+    if (p_link->pending != RUNG_COUNT)
+    {
+        if ((p_update->status != BLE_HCI_STATUS_CODE_SUCCESS) ||
+            (p_update->tx_phy != m_ladder[p_link->pending]))
+        {
+            p_link->refused |= (1 << p_link->pending);
+        }
+        else
+        {
+            p_link->held = true;
+        }
+        p_link->pending = RUNG_COUNT;
+    }
+
+    if (p_update->status == BLE_HCI_STATUS_CODE_SUCCESS)
+    {
+        p_link->rung = rung_of(p_update->tx_phy);
+    }
+
+    // Packet counts and streaks of the old PHY say nothing about the new one.
+    p_link->acked_best = 0;
+    p_link->up_count   = 0;
+    p_link->down_count = 0;
+    p_link->down_acked = 0;
+    p_link->dwell      = LINK_PHY_DWELL_PERIODS;
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    phy_link_t * p_link;
+
+    if (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED)
+    {
+        p_link = link_find(BLE_CONN_HANDLE_INVALID);
+        if (p_link != NULL)
+        {
+            memset(p_link, 0, sizeof(*p_link));
+            p_link->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+            p_link->rung        = RUNG_1M;
+            p_link->pending     = RUNG_COUNT;
+            (void)sd_ble_gap_rssi_start(p_link->conn_handle,
+                                        LINK_PHY_RSSI_THRESHOLD_DBM,
+                                        LINK_PHY_RSSI_SKIP_COUNT);
+        }
+        return;
+    }
+
+    // Every event body starts with the connection handle.
+    if (p_ble_evt->evt.gap_evt.conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return;
+    }
+    p_link = link_find(p_ble_evt->evt.gap_evt.conn_handle);
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+            break;
+
+        case BLE_GAP_EVT_RSSI_CHANGED:
+            rssi_update(p_link, p_ble_evt->evt.gap_evt.params.rssi_changed.rssi);
+            break;
+
+        case BLE_GAP_EVT_PHY_UPDATE:
+            on_phy_update(p_link, &p_ble_evt->evt.gap_evt.params.phy_update);
+            break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            p_link->acked += p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count;
+            break;
+
+        case BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE:
+            p_link->acked += p_ble_evt->evt.gattc_evt.params.write_cmd_tx_complete.count;
+            break;
+
+        case BLE_L2CAP_EVT_CH_TX:
+        case BLE_L2CAP_EVT_CH_RX:
+            p_link->acked++;
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_link_phy_obs, LINK_PHY_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+uint8_t link_phy_preferred(uint16_t conn_handle)
+{
+    phy_link_t const * p_link = link_find(conn_handle);
+
+    if ((p_link == NULL) || !p_link->held)
+    {
+        return BLE_GAP_PHY_AUTO;
+    }
+
+    return m_ladder[p_link->rung];
+}
+
+
+ret_code_t link_phy_init(void)
+{
+    ret_code_t err_code;
+
+    for (uint32_t i = 0; i < LINK_PHY_LINK_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    err_code = app_timer_create(&m_eval_timer, APP_TIMER_MODE_REPEATED, eval_timeout_handler);
+    VERIFY_SUCCESS(err_code);
+
+    return app_timer_start(m_eval_timer, LINK_PHY_EVAL_INTERVAL, NULL);
+}
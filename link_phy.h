@@ -0,0 +1,98 @@
+/**@file
+ *
+ * @defgroup link_phy Adaptive PHY
+ * @{
+ * @brief Link quality monitor that moves each link between the 2M, 1M and Coded PHYs.
+ *
+ * @details Each link starts on 1M. The module keeps an average of the RSSI, fed by
+ *          BLE_GAP_EVT_RSSI_CHANGED and by a sample taken every @ref LINK_PHY_EVAL_INTERVAL. It also
+ *          counts packets acknowledged per interval: notifications, write commands and L2CAP SDUs.
+ *
+ *          The SoftDevice does not report CRC errors or retransmissions per connection event. A
+ *          collapse in acknowledged packets while the link is busy and the signal is not strong
+ *          is taken as their effect. It counts as a reason to step down, the same as a weak RSSI.
+ *          A collapse must be deep enough that the slower PHY would deliver more, even without
+ *          errors.
+ *
+ *          On 1M, a link that is busy steps down to Coded only on a measured loss: on average over
+ *          the bad intervals, it must deliver less than @ref LINK_PHY_1M_LOSS_PCT of its best
+ *          interval, well below what Coded gives. A weak RSSI alone, or a single deep fade, is
+ *          not enough; the way back from Coded is slow, so a step down for a dip costs more
+ *          than the dip. An idle link steps down on RSSI alone.
+ *
+ *          Every interval the link is judged against the thresholds of its PHY:
+ *
+ *          | PHY   | Step up when RSSI above       | Step down when RSSI below       |
+ *          |-------|-------------------------------|---------------------------------|
+ *          | 2M    | -                             | @ref LINK_PHY_2M_DOWN_DBM       |
+ *          | 1M    | @ref LINK_PHY_1M_UP_DBM       | @ref LINK_PHY_1M_DOWN_DBM       |
+ *          | Coded | @ref LINK_PHY_CODED_UP_DBM    | -                               |
+ *
+ *          Each PHY is left 5-10 dB away from where it was entered. A step up needs
+ *          @ref LINK_PHY_UP_PERIODS good intervals in a row, and a step down needs
+ *          @ref LINK_PHY_DOWN_PERIODS bad ones. After a change, the link stays on its new PHY for
+ *          @ref LINK_PHY_DWELL_PERIODS. A PHY the peer refused is not asked for again on that
+ *          link.
+ *
+ *          tools/phy_sim.py runs the same policy, with the constants read from this file, against
+ *          simulated links.
+ */
+#ifndef LINK_PHY_H__
+#define LINK_PHY_H__
+
+#include <stdint.h>
+#include "ble_gap.h"
+#include "app_timer.h"
+#include "nrf_sdh_ble.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LINK_PHY_BLE_OBSERVER_PRIO  2                                   /**< Priority of the BLE observer. */
+#define LINK_PHY_LINK_COUNT         NRF_SDH_BLE_TOTAL_LINK_COUNT        /**< Links monitored at once. */
+#define LINK_PHY_EVAL_INTERVAL      APP_TIMER_TICKS(1000)               /**< Interval between decisions. */
+
+#define LINK_PHY_RSSI_THRESHOLD_DBM 2       /**< Change that raises BLE_GAP_EVT_RSSI_CHANGED. */
+#define LINK_PHY_RSSI_SKIP_COUNT    4       /**< Samples that must differ before it is raised. */
+#define LINK_PHY_RSSI_WEIGHT        4       /**< New samples count 1/LINK_PHY_RSSI_WEIGHT in the average. */
+
+#define LINK_PHY_2M_DOWN_DBM        -85     /**< 2M to 1M below this. */
+#define LINK_PHY_1M_UP_DBM          -75     /**< 1M to 2M above this. */
+#define LINK_PHY_1M_DOWN_DBM        -97     /**< 1M to Coded below this. */
+#define LINK_PHY_CODED_UP_DBM       -92     /**< Coded to 1M above this. */
+
+#define LINK_PHY_UP_PERIODS         3       /**< Good intervals in a row before a step up. */
+#define LINK_PHY_DOWN_PERIODS       2       /**< Bad intervals in a row before a step down. */
+#define LINK_PHY_DWELL_PERIODS      5       /**< Intervals without a decision after a change. */
+
+#define LINK_PHY_2M_COLLAPSE_PCT    50      /**< On 2M, an interval below this share of the best one counts as a collapse. About the 1M to 2M goodput ratio. */
+#define LINK_PHY_1M_COLLAPSE_PCT    12      /**< On 1M, likewise. About the Coded to 1M goodput ratio. */
+#define LINK_PHY_1M_LOSS_PCT        6       /**< On 1M, a busy link steps down only below this share of the best interval, on average over the bad intervals. */
+#define LINK_PHY_BUSY_PACKETS       20      /**< Packets in the best interval before collapses are judged. */
+
+
+/**@brief Function for initializing the module.
+ *
+ * @return NRF_SUCCESS or an error code from app_timer.
+ */
+ret_code_t link_phy_init(void);
+
+
+/**@brief Function for getting the PHY to accept when the peer asks for a change.
+ *
+ * @param[in] conn_handle  Connection handle.
+ *
+ * @return The PHY the module holds the link on, or BLE_GAP_PHY_AUTO if it holds none.
+ */
+uint8_t link_phy_preferred(uint16_t conn_handle);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LINK_PHY_H__
+
+/** @} */
@@ -0,0 +1,321 @@
+#include <string.h>
+#include "loopback.h"
+#include "ble.h"
+#include "ble_srv_common.h"
+#include "nrf_sdh_ble.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "hvx_queue.h"
+#include "transfer_metrics.h"
+#include "usb_stream.h"
+
+
+#define RESULT_LEN      17      /**< Length of a result payload. */
+
+/**@brief Request waiting for its echo. */
+typedef struct
+{
+    bool     in_use;                    /**< Entry holds a request. */
+    bool     acked;                     /**< Notification acknowledged by the link layer. */
+    uint32_t seq;                       /**< Sequence number from the host. */
+    uint32_t order;                     /**< Send order, to find the oldest entry. */
+    uint32_t in_ticks;                  /**< Timestamp of the request from USB. */
+    uint32_t acked_ticks;               /**< Timestamp of the acknowledgement. */
+} pending_t;
+
+static nrf_ble_gatt_t           * mp_gatt;
+static uint16_t                   m_service_handle;
+static ble_gatts_char_handles_t   m_char_handles;
+static uint16_t                   m_conn_handle = BLE_CONN_HANDLE_INVALID;  /**< Client that enabled notifications. */
+static pending_t                  m_pending[LOOPBACK_PENDING_COUNT];
+static uint32_t                   m_order;
+
+
+static uint32_t ticks_to_us(uint32_t to, uint32_t from)
+{
+    return TRANSFER_METRICS_TICKS_TO_US(app_timer_cnt_diff_compute(to, from));
+}
+
+
+/**@brief Function for sending a result frame to the host.
+ *
+ * @param[in] seq        Sequence number of the request.
+ * @param[in] status     Outcome.
+ * @param[in] p_pending  Request, or NULL for a request that never went out.
+ */
+static void result_send(uint32_t seq, loopback_status_t status, pending_t const * p_pending)
+{
+    uint8_t  result[RESULT_LEN];
+    uint32_t now = app_timer_cnt_get();
+
+    memset(result, 0, sizeof(result));
+    (void)uint32_encode(seq, &result[0]);
+    result[4] = (uint8_t)status;
+
+    if (p_pending != NULL)
+    {
+        if (p_pending->acked)
+        {
+            (void)uint32_encode(ticks_to_us(p_pending->acked_ticks, p_pending->in_ticks), &result[5]);
+            if (status == LOOPBACK_STATUS_SUCCESS)
+            {
+                (void)uint32_encode(ticks_to_us(now, p_pending->acked_ticks), &result[9]);
+            }
+        }
+        (void)uint32_encode(ticks_to_us(now, p_pending->in_ticks), &result[13]);
+    }
+
+    (void)usb_stream_frame_put(LOOPBACK_FRAME_RESULT, result, sizeof(result), NULL, 0);
+}
+
+
+/**@brief Function for finding the oldest pending request. */
+static pending_t * pending_oldest(void)
+{
+    pending_t * p_oldest = NULL;
+
+    for (uint32_t i = 0; i < LOOPBACK_PENDING_COUNT; i++)
+    {
+        pending_t * p_entry = &m_pending[i];
+
+        if (!p_entry->in_use)
+        {
+            continue;
+        }
+        if ((p_oldest == NULL) || ((int32_t)(p_entry->order - p_oldest->order) < 0))
+        {
+            p_oldest = p_entry;
+        }
+    }
+
+    return p_oldest;
+}
+
+
+static pending_t * pending_free_find(void)
+{
+    for (uint32_t i = 0; i < LOOPBACK_PENDING_COUNT; i++)
+    {
+        if (!m_pending[i].in_use)
+        {
+            return &m_pending[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**@brief Function for giving up all pending requests, when the client goes away. */
+static void pending_flush(void)
+{
+    pending_t * p_entry;
+
+    while ((p_entry = pending_oldest()) != NULL)
+    {
+        result_send(p_entry->seq, LOOPBACK_STATUS_LOST, p_entry);
+        p_entry->in_use = false;
+    }
+}
+
+
+/**@brief Function for handling the acknowledgement of a loopback notification.
+ *
+ * @details Only notifications of this module are tracked by @ref hvx_queue, so traffic of
+ *          other services on the link is not taken for an acknowledgement.
+ *
+ * @param[in] conn_handle  Link.
+ * @param[in] tag          Send order of the request.
+ */
+static void on_notification_acked(uint16_t conn_handle, uint32_t tag)
+{
+    uint32_t now = app_timer_cnt_get();
+
+    for (uint32_t i = 0; i < LOOPBACK_PENDING_COUNT; i++)
+    {
+        pending_t * p_entry = &m_pending[i];
+
+        if (p_entry->in_use && (p_entry->order == tag) && !p_entry->acked)
+        {
+            p_entry->acked       = true;
+            p_entry->acked_ticks = now;
+            return;
+        }
+    }
+}
+
+
+void loopback_on_request(sdu_buf_t * p_buf)
+{
+    uint32_t               in_ticks = app_timer_cnt_get();
+    uint8_t              * p_data   = sdu_buf_payload(p_buf);
+    uint16_t               len      = p_buf->len;
+    uint32_t               seq;
+    pending_t            * p_entry;
+    pending_t              evicted;
+    uint32_t               order;
+    bool                   full;
+    ble_gatts_hvx_params_t hvx_params;
+
+    if (len < LOOPBACK_SEQ_LEN)
+    {
+        result_send(0, LOOPBACK_STATUS_INVALID, NULL);
+        return;
+    }
+    seq = uint32_decode(p_data);
+
+    if (m_conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        result_send(seq, LOOPBACK_STATUS_NO_CLIENT, NULL);
+        return;
+    }
+    if (len > nrf_ble_gatt_eff_mtu_get(mp_gatt, m_conn_handle) - 3)
+    {
+        result_send(seq, LOOPBACK_STATUS_INVALID, NULL);
+        return;
+    }
+
+    // Called from the main loop. BLE events come in interrupts, and the acknowledgement can
+    // come before hvx_queue_put_tracked returns, so the request is recorded first.
+    CRITICAL_REGION_ENTER();
+    p_entry = pending_free_find();
+    full    = (p_entry == NULL);
+    if (full)
+    {
+        // The oldest request is given up.
+        p_entry = pending_oldest();
+        evicted = *p_entry;
+    }
+    order             = m_order++;
+    p_entry->in_use   = true;
+    p_entry->acked    = false;
+    p_entry->seq      = seq;
+    p_entry->order    = order;
+    p_entry->in_ticks = in_ticks;
+    CRITICAL_REGION_EXIT();
+
+    if (full)
+    {
+        result_send(evicted.seq, LOOPBACK_STATUS_LOST, &evicted);
+    }
+
+    memset(&hvx_params, 0, sizeof(hvx_params));
+    hvx_params.handle = m_char_handles.value_handle;
+    hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+    hvx_params.p_len  = &len;
+    hvx_params.p_data = p_data;
+
+    if (hvx_queue_put_tracked(m_conn_handle, &hvx_params, on_notification_acked, order) != NRF_SUCCESS)
+    {
+        p_entry->in_use = false;
+        result_send(seq, LOOPBACK_STATUS_TX_FAILED, NULL);
+    }
+}
+
+
+static void on_write(ble_evt_t const * p_ble_evt)
+{
+    ble_gatts_evt_write_t const * p_write     = &p_ble_evt->evt.gatts_evt.params.write;
+    uint16_t                      conn_handle = p_ble_evt->evt.gatts_evt.conn_handle;
+
+    if ((p_write->handle == m_char_handles.cccd_handle) && (p_write->len == 2))
+    {
+        if (ble_srv_is_notification_enabled(p_write->data))
+        {
+            m_conn_handle = conn_handle;
+        }
+        else if (conn_handle == m_conn_handle)
+        {
+            pending_flush();
+            m_conn_handle = BLE_CONN_HANDLE_INVALID;
+        }
+        return;
+    }
+
+    if ((p_write->handle != m_char_handles.value_handle) ||
+        (conn_handle != m_conn_handle) ||
+        (p_write->len < LOOPBACK_SEQ_LEN))
+    {
+        return;
+    }
+
+    uint32_t seq = uint32_decode(p_write->data);
+
+    for (uint32_t i = 0; i < LOOPBACK_PENDING_COUNT; i++)
+    {
+        if (m_pending[i].in_use && (m_pending[i].seq == seq))
+        {
+            result_send(seq, LOOPBACK_STATUS_SUCCESS, &m_pending[i]);
+            m_pending[i].in_use = false;
+            return;
+        }
+    }
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_DISCONNECTED:
+            if (p_ble_evt->evt.gap_evt.conn_handle == m_conn_handle)
+            {
+                pending_flush();
+                m_conn_handle = BLE_CONN_HANDLE_INVALID;
+            }
+            break;
+
+        case BLE_GATTS_EVT_WRITE:
+            on_write(p_ble_evt);
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_loopback_obs, LOOPBACK_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+ret_code_t loopback_init(nrf_ble_gatt_t * p_gatt)
+{
+    ret_code_t            err_code;
+    ble_uuid_t            ble_uuid;
+    ble_uuid128_t         base_uuid = {LOOPBACK_UUID_BASE};
+    ble_add_char_params_t add_char_params;
+
+    if (p_gatt == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    mp_gatt       = p_gatt;
+    m_conn_handle = BLE_CONN_HANDLE_INVALID;
+    memset(m_pending, 0, sizeof(m_pending));
+
+    err_code = sd_ble_uuid_vs_add(&base_uuid, &ble_uuid.type);
+    VERIFY_SUCCESS(err_code);
+
+    ble_uuid.uuid = LOOPBACK_UUID_SERVICE;
+
+    err_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &ble_uuid, &m_service_handle);
+    VERIFY_SUCCESS(err_code);
+
+    memset(&add_char_params, 0, sizeof(add_char_params));
+    add_char_params.uuid                     = LOOPBACK_UUID_CHAR;
+    add_char_params.uuid_type                = ble_uuid.type;
+    add_char_params.max_len                  = NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3;
+    add_char_params.is_var_len               = true;
+    add_char_params.char_props.write_wo_resp = 1;
+    add_char_params.char_props.notify        = 1;
+    add_char_params.write_access             = SEC_OPEN;
+    add_char_params.cccd_write_access        = SEC_OPEN;
+
+    return characteristic_add(m_service_handle, &add_char_params, &m_char_handles);
+}
@@ -0,0 +1,98 @@
+/**@file
+ *
+ * @defgroup loopback USB-BLE loopback
+ * @{
+ * @brief Round trip from the host over USB to a BLE client and back, with dongle timestamps.
+ *
+ * @details The host sends @ref LOOPBACK_FRAME_REQUEST frames over the CDC ACM port. The dongle
+ *          sends the payload unchanged as a notification of the Loopback characteristic to the
+ *          client that enabled them. The reference client writes every notification straight
+ *          back to the same characteristic. The dongle then sends a @ref LOOPBACK_FRAME_RESULT
+ *          frame with its timestamps to the host.
+ *
+ *          Request payload (at most ATT_MTU - 3 bytes):
+ *
+ *          | Offset | Size | Field                                 |
+ *          |--------|------|---------------------------------------|
+ *          | 0      | 4    | Sequence number (LE), chosen by host  |
+ *          | 4      | n    | Any data                              |
+ *
+ *          Result payload:
+ *
+ *          | Offset | Size | Field                                                      |
+ *          |--------|------|------------------------------------------------------------|
+ *          | 0      | 4    | Sequence number                                            |
+ *          | 4      | 1    | Status (@ref loopback_status_t)                            |
+ *          | 5      | 4    | USB request in to notification acknowledged, in us          |
+ *          | 9      | 4    | Notification acknowledged to echo received, in us           |
+ *          | 13     | 4    | USB request in to result out, in us                         |
+ *
+ *          The host adds its own send and receive times; the difference to the last field is
+ *          the time spent on USB both ways. tools/loopback.py runs the test and prints
+ *          percentiles per hop.
+ *
+ *          The acknowledgement of a notification comes from @ref hvx_queue_put_tracked, which
+ *          matches BLE_GATTS_EVT_HVN_TX_COMPLETE against the notifications of this module only.
+ *          Other notifications on the client link do not count as acknowledgements, but they
+ *          still share the link and lengthen the first hop.
+ */
+#ifndef LOOPBACK_H__
+#define LOOPBACK_H__
+
+#include <stdint.h>
+#include "nrf_ble_gatt.h"
+#include "sdu_pool.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOOPBACK_BLE_OBSERVER_PRIO  2           /**< Priority of the BLE observer. */
+#define LOOPBACK_PENDING_COUNT      8           /**< Requests waiting for their echo at most. */
+
+#define LOOPBACK_UUID_BASE          {0x3E, 0x6B, 0x1A, 0x52, 0x8C, 0x4D, 0x91, 0xA7, \
+                                     0x2B, 0x45, 0xD0, 0xC3, 0x00, 0x00, 0x80, 0x5B}
+#define LOOPBACK_UUID_SERVICE       0x0001
+#define LOOPBACK_UUID_CHAR          0x0002
+
+#define LOOPBACK_FRAME_REQUEST      0x10        /**< Host to dongle: request to send. */
+#define LOOPBACK_FRAME_RESULT       0x11        /**< Dongle to host: timestamps of a request. */
+
+#define LOOPBACK_SEQ_LEN            4           /**< Length of the sequence number. */
+
+
+/**@brief Status of a request. */
+typedef enum
+{
+    LOOPBACK_STATUS_SUCCESS,                    /**< Echo received. */
+    LOOPBACK_STATUS_NO_CLIENT,                  /**< No client has enabled notifications. */
+    LOOPBACK_STATUS_INVALID,                    /**< Shorter than a sequence number or longer than the ATT MTU allows. */
+    LOOPBACK_STATUS_TX_FAILED,                  /**< Notification could not be queued. */
+    LOOPBACK_STATUS_LOST,                       /**< No echo before the request was pushed out by newer ones. */
+} loopback_status_t;
+
+
+/**@brief Function for initializing the module and adding the Loopback service.
+ *
+ * @param[in] p_gatt  GATT module instance, for the ATT MTU of the client link.
+ *
+ * @return NRF_SUCCESS or an error code from the SoftDevice.
+ */
+ret_code_t loopback_init(nrf_ble_gatt_t * p_gatt);
+
+
+/**@brief Function for handling a @ref LOOPBACK_FRAME_REQUEST frame from the host.
+ *
+ * @param[in] p_buf  Buffer holding the request payload.
+ */
+void loopback_on_request(sdu_buf_t * p_buf);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOOPBACK_H__
+
+/** @} */
@@ -35,6 +35,39 @@
 #include "nrf_drv_clock.h"
 #include "ble_ots.h"
 #include "ble_advertising.h"
+#include "peer_manager.h"
+#include "peer_manager_handler.h"
+#include "msg.h"
+#include "transfer_metrics.h"
+#include "adv_reconnect.h"
+#include "adv_digest.h"
+#include "link_ctx.h"
+#include "ble_bulk.h"
+#include "hvx_queue.h"
+#include "ots_collector.h"
+#include "sdu_pool.h"
+#include "usb_stream.h"
+#include "boot_time.h"
+#include "virtual_object.h"
+#include "loopback.h"
+#include "ble_msg.h"
+#include "ble_capture.h"
+#include "event_trace.h"
+#include "link_phy.h"
+#include "obj_broadcast.h"
+#include "scan_bridge.h"
+#include "obj_store.h"
+#include "usb_vendor.h"
+#include "usb_bench.h"
+#include "host_link_cdc.h"
+#include "host_link_uart.h"
+#include "host_link_rtt.h"
+#if APP_USBD_MSC_ENABLED
+#include "app_usbd_msc.h"
+#include "obj_disk.h"
+#endif
+#include "ble_conn_state.h"
+#include "crc32.h"
 
 
 #define ADVERTISING_LED                 BSP_BOARD_LED_0                         /**< Is on when device is advertising. */
@@ -47,8 +80,8 @@
 #define APP_BLE_OBSERVER_PRIO           3                                       /**< Application's BLE observer priority. You shouldn't need to modify this value. */
 #define APP_BLE_CONN_CFG_TAG            1                                       /**< A tag identifying the SoftDevice BLE configuration. */
 
-#define APP_ADV_INTERVAL                64                                      /**< The advertising interval (in units of 0.625 ms; this value corresponds to 40 ms). */
-#define APP_ADV_DURATION                BLE_GAP_ADV_TIMEOUT_GENERAL_UNLIMITED   /**< The advertising time-out (in units of seconds). When set to 0, we will never time out. */
+#define APP_ADV_INTERVAL                ADV_RECONNECT_FAST_INTERVAL             /**< The advertising interval (in units of 0.625 ms; this value corresponds to 40 ms). */
+#define APP_ADV_DURATION                ADV_RECONNECT_FAST_DURATION             /**< The advertising time-out (in units of 10 ms). */
 
 
 #define MIN_CONN_INTERVAL               MSEC_TO_UNITS(100, UNIT_1_25_MS)        /**< Minimum acceptable connection interval (0.5 seconds). */
@@ -60,18 +93,27 @@
 #define NEXT_CONN_PARAMS_UPDATE_DELAY   APP_TIMER_TICKS(5000)                   /**< Time between each call to sd_ble_gap_conn_param_update after the first call (5 seconds). */
 #define MAX_CONN_PARAMS_UPDATE_COUNT    3                                       /**< Number of attempts before giving up the connection parameter negotiation. */
 
+#define SEC_PARAM_BOND                  1                                       /**< Perform bonding. */
+#define SEC_PARAM_MITM                  0                                       /**< Man In The Middle protection not required. */
+#define SEC_PARAM_LESC                  0                                       /**< LE Secure Connections not enabled. */
+#define SEC_PARAM_KEYPRESS              0                                       /**< Keypress notifications not enabled. */
+#define SEC_PARAM_IO_CAPABILITIES       BLE_GAP_IO_CAPS_NONE                    /**< No I/O capabilities. */
+#define SEC_PARAM_OOB                   0                                       /**< Out Of Band data not available. */
+#define SEC_PARAM_MIN_KEY_SIZE          7                                       /**< Minimum encryption key size. */
+#define SEC_PARAM_MAX_KEY_SIZE          16                                      /**< Maximum encryption key size. */
+
 #define BUTTON_DETECTION_DELAY          APP_TIMER_TICKS(50)                     /**< Delay from a GPIOTE event until a button is reported as pushed (in number of timer ticks). */
 
 #define DEAD_BEEF                       0xDEADBEEF                              /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 #define MAX_ALLOCATED_OBJECT_SIZE       1024
+#define APP_RAM_END                     0x20040000                              /**< End of RAM, where the application RAM ends. */
 #define UART_TX_BUF_SIZE                256                                     /**< UART TX buffer size. */
 #define UART_RX_BUF_SIZE                256                                     /**< UART RX buffer size. */
-#define USB_TX_BUFFER_SIZE              256
 #define UART_RX_PIN                     29
 #define UART_TX_PIN                     31
-#define UART_RTS_PIN                    UART_PIN_DISCONNECTED                   // Pin not used
-#define UART_CTS_PIN                    UART_PIN_DISCONNECTED                   // Pin not used
-#define READ_SIZE                       1
+#define UART_RTS_PIN                    NRF_GPIO_PIN_MAP(1, 13)                 /**< Host link RTS, output. */
+#define UART_CTS_PIN                    NRF_GPIO_PIN_MAP(1, 15)                 /**< Host link CTS, input. */
+#define READ_SIZE                       NRF_DRV_USBD_EPSIZE                     /**< CDC ACM read size: one full-speed bulk packet. */
 #define L2CAP_RX_MPS                    60                               
 #define L2CAP_TX_MPS                    40                              
 #define L2CAP_RX_MTU                    30 
@@ -81,24 +123,57 @@
 #define BTN_CDC_DATA_KEY_RELEASE        (bsp_event_t)(BSP_EVENT_KEY_LAST + 1)
 
 #define MAIN_DEBUG                      1
+#define MSG_RING_SIZE                   1024                                    /**< Debug text waiting for a pool buffer. Must be a power of two. */
+#define MSG_LINE_MAX                    128                                     /**< Longest message; longer ones are cut. */
+
+#ifndef HOST_UART_ENABLED
+#if defined(BOARD_PCA10059)
+#define HOST_UART_ENABLED               0                                       /**< The dongle has bare pads on the UART pins; build with 1 once something is wired to them. */
+#else
+#define HOST_UART_ENABLED               1                                       /**< Carry the host stream over UARTE as well as USB. */
+#endif
+#endif
+#ifndef HOST_RTT_ENABLED
+#define HOST_RTT_ENABLED                1                                       /**< Carry the host stream over RTT channel 1 as well. */
+#endif
+#ifndef HOST_LINK_DEFAULT
+#define HOST_LINK_DEFAULT               m_link_cdc                              /**< Link of the host stream until the host uses another one. */
+#endif
+
+#define VOBJ_PATTERN                    VIRTUAL_OBJECT_PATTERN_PRNG             /**< Content of the synthetic object read at VIRTUAL_OBJECT_OFFSET. */
+#define VOBJ_SEED                       0x5EED0001                              /**< Seed of the synthetic object. Give the same to tools/ots_verify.py. */
+
+/**@brief Each link gets an equal share of the shortest connection interval as its event length. */
+STATIC_ASSERT(NRF_SDH_BLE_GAP_EVENT_LENGTH * NRF_SDH_BLE_TOTAL_LINK_COUNT <= MIN_CONN_INTERVAL);
+
+/**@brief The interval ble_msg asks for while messages flow is faster than the normal one. */
+STATIC_ASSERT(BLE_MSG_FAST_MAX_INTERVAL < MIN_CONN_INTERVAL);
 
 BLE_ADVERTISING_DEF(m_advertising);
 BLE_LBS_DEF(m_lbs);                                                             /**< LED Button Service instance. */
 NRF_BLE_GATT_DEF(m_gatt);                                                       /**< GATT module instance. */
-NRF_BLE_QWR_DEF(m_qwr);  
-BLE_OTS_DEF(m_ots);                                                        /**< Context for the Queued Write module.*/
+NRF_BLE_QWRS_DEF(m_qwr, NRF_SDH_BLE_TOTAL_LINK_COUNT);                         /**< Context for the Queued Write module, one per link.*/
+BLE_BULK_DEF(m_bulk);                                                           /**< GATT Bulk Transfer Service instance, for clients without L2CAP CoC. */
+static ble_ots_t m_ots;                                                         /**< Object Transfer Service instance. link_ctx copies it for every link and dispatches BLE events to the copies. */
 NRF_BLE_GQ_DEF(m_ble_gatt_queue,                                               /**< BLE GATT Queue instance. */
-               NRF_SDH_BLE_PERIPHERAL_LINK_COUNT,                           
+               NRF_SDH_BLE_TOTAL_LINK_COUNT,                           
                NRF_BLE_GQ_QUEUE_SIZE);
 
-static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;                        /**< Handle of the current connection. */
 static ble_ots_object_t m_ots_object;
-static uint8_t m_l2cap_buffer[MAX_ALLOCATED_OBJECT_SIZE];
+static uint8_t m_l2cap_buffers[LINK_CTX_COUNT][MAX_ALLOCATED_OBJECT_SIZE];          /**< L2CAP receive buffer of each OTS link. */
+static uint8_t m_bulk_stage[MAX_ALLOCATED_OBJECT_SIZE];                         /**< Uploads over the GATT bulk service, until they are complete. */
 static uint8_t m_adv_handle = BLE_GAP_ADV_SET_HANDLE_NOT_SET;                   /**< Advertising handle used to identify an advertising set. */
-static uint8_t m_enc_advdata[BLE_GAP_ADV_SET_DATA_SIZE_MAX];                    /**< Buffer for storing an encoded advertising set. */
-static uint8_t m_enc_scan_response_data[BLE_GAP_ADV_SET_DATA_SIZE_MAX];         /**< Buffer for storing an encoded scan data. */
+static char m_msg_ring[MSG_RING_SIZE];                                          /**< Debug text not yet handed to usb_stream. */
+static uint32_t m_msg_head;                                                     /**< Where the next message goes in m_msg_ring; runs freely. */
+static uint32_t m_msg_tail;                                                     /**< Oldest text in m_msg_ring; runs freely. */
+static uint32_t m_msg_dropped;                                                  /**< Messages that found the ring full since the last flush. */
+static sdu_buf_t * mp_msg_sent;                                                 /**< Text buffer last queued, held until usb_stream has sent it. */
+static uint32_t m_latest_object_id;                                             /**< ID of the most recently received object, advertised in the digest. */
 static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
                                     app_usbd_cdc_acm_user_event_t event);
+static void usb_vendor_evt_handler(usb_vendor_evt_t const * p_evt);
+static void usb_start(void);
+static void msg_flush(void);
 
 static ble_uuid_t m_adv_uuids[] =           /**< Universally unique service identifiers. */
 {
@@ -107,10 +182,6 @@ static ble_uuid_t m_adv_uuids[] =           /**< Universally unique service iden
 
 
 
-void msg(const char *format, ...);
-void msg_hexdump(const uint8_t *data, size_t data_length);
-
-
 #define CDC_ACM_COMM_INTERFACE  0
 #define CDC_ACM_COMM_EPIN       NRF_DRV_USBD_EPIN2
 
@@ -118,12 +189,18 @@ void msg_hexdump(const uint8_t *data, size_t data_length);
 #define CDC_ACM_DATA_EPIN       NRF_DRV_USBD_EPIN1
 #define CDC_ACM_DATA_EPOUT      NRF_DRV_USBD_EPOUT1
 
+#define VENDOR_INTERFACE        2
+#define VENDOR_EPIN             NRF_DRV_USBD_EPIN3
+#define VENDOR_EPOUT            NRF_DRV_USBD_EPOUT3
+
+#define MSC_INTERFACE           3
+#define MSC_WORKBUFFER_SIZE     (4 * OBJ_DISK_BLOCK_SIZE)  /**< Sectors moved per MSC transfer. */
+
 #ifndef USBD_POWER_DETECTION
 #define USBD_POWER_DETECTION false
 #endif
 
-static char m_rx_buffer[READ_SIZE];
-static char m_tx_buffer[NRF_DRV_USBD_EPSIZE];
+static uint8_t m_rx_buffer[READ_SIZE];
 static bool m_send_flag = 0;
 uint8_t test_data[] = {0x48, 0x65, 0x6C, 0x6C, 0x6F, 0x20, 0x57, 0x6F, 0x72, 0x6C, 0x64};
 
@@ -138,22 +215,37 @@ APP_USBD_CDC_ACM_GLOBAL_DEF(m_app_cdc_acm,
                             APP_USBD_CDC_COMM_PROTOCOL_AT_V250
 );
 
+USB_VENDOR_GLOBAL_DEF(m_usb_vendor,
+                      usb_vendor_evt_handler,
+                      VENDOR_INTERFACE,
+                      VENDOR_EPIN,
+                      VENDOR_EPOUT);
+
+HOST_LINK_CDC_DEF(m_link_cdc, m_app_cdc_acm);                                  /**< Host link over the CDC ACM port. */
+#if HOST_UART_ENABLED
+HOST_LINK_UART_DEF(m_link_uart, UART_TX_PIN, UART_RX_PIN, UART_RTS_PIN, UART_CTS_PIN); /**< Host link over UARTE. */
+#endif
+#if HOST_RTT_ENABLED
+HOST_LINK_RTT_DEF(m_link_rtt);                                                  /**< Host link over RTT. */
+#endif
 
-/**@brief Struct that contains pointers to the encoded advertising data. */
-static ble_gap_adv_data_t m_adv_data =
+#if APP_USBD_MSC_ENABLED
+static void msc_user_ev_handler(app_usbd_class_inst_t const * p_inst,
+                                app_usbd_msc_user_event_t     event)
 {
-    .adv_data =
-    {
-        .p_data = m_enc_advdata,
-        .len    = BLE_GAP_ADV_SET_DATA_SIZE_MAX
-    },
-    .scan_rsp_data =
-    {
-        .p_data = m_enc_scan_response_data,
-        .len    = BLE_GAP_ADV_SET_DATA_SIZE_MAX
+    UNUSED_PARAMETER(p_inst);
+    UNUSED_PARAMETER(event);
+}
 
-    }
-};
+OBJ_DISK_DEF(m_obj_disk);
+
+APP_USBD_MSC_GLOBAL_DEF(m_app_msc,
+                        MSC_INTERFACE,
+                        msc_user_ev_handler,
+                        APP_USBD_MSC_ENDPOINT_LIST(4, 4),
+                        (NRF_BLOCKDEV_BASE_ADDR(m_obj_disk, block_dev)),
+                        MSC_WORKBUFFER_SIZE);
+#endif
 
 
 static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
@@ -161,16 +253,25 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
 {
     app_usbd_cdc_acm_t const * p_cdc_acm = app_usbd_cdc_acm_class_get(p_inst);
 
+    if (event != APP_USBD_CDC_ACM_USER_EVT_RX_DONE)
+    {
+        event_trace_record(EVENT_TRACE_SOURCE_CDC, (uint8_t)event, 0);
+    }
+
     switch (event)
     {
         case APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN:
         {
             //bsp_board_led_on(BSP_BOARD_LED_1);
+            boot_time_mark(BOOT_TIME_PHASE_PORT_OPEN);
+            usb_stream_link_set(&m_link_cdc);
+            host_link_on_ready(&m_link_cdc);
+            boot_time_report();
 
             /*Setup first transfer*/
-            ret_code_t ret = app_usbd_cdc_acm_read(&m_app_cdc_acm,
-                                                   m_rx_buffer,
-                                                   READ_SIZE);
+            ret_code_t ret = app_usbd_cdc_acm_read_any(&m_app_cdc_acm,
+                                                       m_rx_buffer,
+                                                       READ_SIZE);
             UNUSED_VARIABLE(ret);
             break;
         }
@@ -179,6 +280,7 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
             break;
         case APP_USBD_CDC_ACM_USER_EVT_TX_DONE:
             //bsp_board_led_invert(BSP_BOARD_LED_3);
+            host_link_on_tx_done(&m_link_cdc);
             break;
         case APP_USBD_CDC_ACM_USER_EVT_RX_DONE:
         {
@@ -187,11 +289,13 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
             {
                 /*Get amount of data transfered*/
                 size_t size = app_usbd_cdc_acm_rx_size(p_cdc_acm);
+                event_trace_record(EVENT_TRACE_SOURCE_CDC, (uint8_t)event, (uint16_t)size);
+                host_link_on_rx(&m_link_cdc, m_rx_buffer, size);
 
                 /* Fetch data until internal buffer is empty */
-                ret = app_usbd_cdc_acm_read(&m_app_cdc_acm,
-                                            m_rx_buffer,
-                                            READ_SIZE);
+                ret = app_usbd_cdc_acm_read_any(&m_app_cdc_acm,
+                                                m_rx_buffer,
+                                                READ_SIZE);
             } while (ret == NRF_SUCCESS);
 
             //bsp_board_led_invert(BSP_BOARD_LED_2);
@@ -202,6 +306,37 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
     }
 }
 
+
+/**@brief Function for handling events of the vendor interface.
+ *
+ * @details Frames move to the vendor interface while the host has it open. Debug text stays on
+ *          the host link.
+ */
+static void usb_vendor_evt_handler(usb_vendor_evt_t const * p_evt)
+{
+    switch (p_evt->type)
+    {
+        case USB_VENDOR_EVT_OPEN:
+            usb_stream_vendor_set(&m_usb_vendor);
+            break;
+
+        case USB_VENDOR_EVT_CLOSE:
+            usb_stream_vendor_set(NULL);
+            break;
+
+        case USB_VENDOR_EVT_RX:
+            usb_stream_on_vendor_rx(p_evt->p_data, p_evt->len);
+            break;
+
+        case USB_VENDOR_EVT_TX_DONE:
+            usb_stream_on_vendor_tx_done();
+            break;
+
+        default:
+            break;
+    }
+}
+
 /**@brief Function for assert macro callback.
  *
  * @details This function will be called in case of an assert in the SoftDevice.
@@ -277,6 +412,9 @@ static void gatt_init(void)
 {
     ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, NULL);
     APP_ERROR_CHECK(err_code);
+
+    err_code = hvx_queue_init(&m_gatt);
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -302,6 +440,46 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 }
 
 
+/**@brief Function for handling advertising phase changes of the reconnect policy.
+ *
+ * @param[in] phase  Phase that was just started.
+ */
+static void on_adv_phase(adv_reconnect_phase_t phase)
+{
+    if (phase == ADV_RECONNECT_PHASE_DIRECTED)
+    {
+        msg("Directed advertising to previous peer\r\n");
+    }
+}
+
+
+/**@brief Function for handling a digest update that produced new advertising buffers.
+ *
+ * @param[in] p_adv_data  Encoded advertising data to use from now on.
+ */
+static void on_adv_data_update(ble_gap_adv_data_t const * p_adv_data)
+{
+    ret_code_t err_code = adv_reconnect_data_update(p_adv_data);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for refreshing the advertised object directory digest.
+ *
+ * @details Called whenever the object store changes.
+ */
+static void adv_digest_refresh(void)
+{
+    adv_digest_t digest;
+
+    digest.object_count     = (m_ots_object.current_size > 0) ? 1 : 0;
+    digest.latest_object_id = m_latest_object_id;
+    digest.content_hash     = crc32_compute(m_ots_object.data, m_ots_object.current_size, NULL);
+
+    adv_digest_update(&digest);
+}
+
+
 /**@brief Function for initializing the Advertising functionality.
  *
  * @details Encodes the required advertising data and passes it to the stack.
@@ -335,17 +513,23 @@ static void advertising_init(void)
 */
 
     
-    ret_code_t    err_code;
-    ble_advdata_t advdata;
-    ble_advdata_t srdata;
+    ret_code_t                 err_code;
+    ble_advdata_t              advdata;
+    ble_advdata_t              srdata;
+    ble_gap_adv_data_t const * p_adv_data;
 
-    ble_uuid_t adv_uuids[] = {{LBS_UUID_SERVICE, m_lbs.uuid_type}};
+    ble_uuid_t adv_uuids[] =
+    {
+        {LBS_UUID_SERVICE, m_lbs.uuid_type},
+        m_adv_uuids[0]
+    };
 
-    // Build and set advertising data.
+    // Build and set advertising data. The object directory digest is added as OTS service data,
+    // which leaves no room for the appearance in the advertising packet.
     memset(&advdata, 0, sizeof(advdata));
 
     advdata.name_type          = BLE_ADVDATA_FULL_NAME;
-    advdata.include_appearance = true;
+    advdata.include_appearance = false;
     advdata.flags              = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
 
 
@@ -353,27 +537,22 @@ static void advertising_init(void)
     srdata.uuids_complete.uuid_cnt = sizeof(adv_uuids) / sizeof(adv_uuids[0]);
     srdata.uuids_complete.p_uuids  = adv_uuids;
 
-    err_code = ble_advdata_encode(&advdata, m_adv_data.adv_data.p_data, &m_adv_data.adv_data.len);
+    err_code = adv_digest_init(&advdata, &srdata, on_adv_data_update, &p_adv_data);
     APP_ERROR_CHECK(err_code);
 
-    err_code = ble_advdata_encode(&srdata, m_adv_data.scan_rsp_data.p_data, &m_adv_data.scan_rsp_data.len);
-    APP_ERROR_CHECK(err_code);
+    adv_reconnect_init_t adv_init;
 
-    ble_gap_adv_params_t adv_params;
+    // Advertising parameters are owned by the reconnect policy, which switches between
+    // directed, fast and slow advertising.
+    memset(&adv_init, 0, sizeof(adv_init));
 
-    // Set advertising parameters.
-    memset(&adv_params, 0, sizeof(adv_params));
+    adv_init.p_adv_handle  = &m_adv_handle;
+    adv_init.p_adv_data    = p_adv_data;
+    adv_init.conn_cfg_tag  = APP_BLE_CONN_CFG_TAG;
+    adv_init.phase_handler = on_adv_phase;
 
-    adv_params.primary_phy     = BLE_GAP_PHY_1MBPS;
-    adv_params.duration        = APP_ADV_DURATION;
-    adv_params.properties.type = BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED;
-    adv_params.p_peer_addr     = NULL;
-    adv_params.filter_policy   = BLE_GAP_ADV_FP_ANY;
-    adv_params.interval        = APP_ADV_INTERVAL;
-
-    err_code = sd_ble_gap_adv_set_configure(&m_adv_handle, &m_adv_data, &adv_params);
+    err_code = adv_reconnect_init(&adv_init);
     APP_ERROR_CHECK(err_code);
-    
 }
 
 
@@ -434,12 +613,37 @@ static void print_object_data(ble_ots_object_t * p_ots_obj)
 }
 
 
+/**@brief Function for handling a new object, received over OTS or the GATT bulk service.
+ */
+static void object_received(void)
+{
+    print_object_data(&m_ots_object);
+    m_latest_object_id++;
+    adv_digest_refresh();
+    obj_broadcast_object_changed();
+    obj_store_object_received();
+}
+
+
+/**@brief Function for handling the object restored from flash after a reset.
+ */
+static void object_restored(void)
+{
+    m_latest_object_id++;
+    adv_digest_refresh();
+    obj_broadcast_object_changed();
+}
+
+
 static void ble_ots_evt_handler(ble_ots_t * p_ots, ble_ots_evt_t * p_evt)
 {
+    ble_capture_record(BLE_CAPTURE_SOURCE_OTS, p_evt->type, p_ots->conn_handle, &p_evt->evt, sizeof(p_evt->evt));
+
     switch (p_evt->type)
     {
         case BLE_OTS_EVT_OACP:
             msg("Got oacp event %i", p_evt->evt.oacp_evt.type);
+            transfer_metrics_milestone(p_ots->conn_handle, TRANSFER_METRICS_MILESTONE_FIRST_OACP);
 
             switch (p_evt->evt.oacp_evt.type)
             {
@@ -452,6 +656,7 @@ static void ble_ots_evt_handler(ble_ots_t * p_ots, ble_ots_evt_t * p_evt)
                 case BLE_OTS_OACP_EVT_EXECUTE:
                     break;
                 case BLE_OTS_OACP_EVT_REQ_WRITE:
+                    obj_store_write_begin(p_ots->conn_handle);
                     break;
             }
             break;
@@ -466,7 +671,7 @@ static void ble_ots_evt_handler(ble_ots_t * p_ots, ble_ots_evt_t * p_evt)
             msg("Indications Disabled");
             break;
         case BLE_OTS_EVT_OBJECT_RECEIVED:
-            print_object_data(&m_ots_object);
+            object_received();
             break;
         default:
             // no implementation needed
@@ -475,21 +680,34 @@ static void ble_ots_evt_handler(ble_ots_t * p_ots, ble_ots_evt_t * p_evt)
 }
 
 
+static void ble_bulk_evt_handler(ble_bulk_t * p_bulk, ble_bulk_evt_t const * p_evt)
+{
+    if (p_evt->type == BLE_BULK_EVT_OBJECT_RECEIVED)
+    {
+        msg("Object received over GATT on 0x%04x", p_evt->conn_handle);
+        object_received();
+    }
+}
+
 
 /**@brief Function for initializing services that will be used by the application.
  */
 static void services_init(void)
 {
     ret_code_t         err_code;
-    ble_lbs_init_t     init     = {0};
-    ble_ots_init_t     ots_init = {0};
-    nrf_ble_qwr_init_t qwr_init = {0};
+    ble_lbs_init_t     init      = {0};
+    ble_ots_init_t     ots_init  = {0};
+    ble_bulk_init_t    bulk_init = {0};
+    nrf_ble_qwr_init_t qwr_init  = {0};
     
     // Initialize Queued Write Module.
     qwr_init.error_handler = nrf_qwr_error_handler;
 
-    err_code = nrf_ble_qwr_init(&m_qwr, &qwr_init);
-    APP_ERROR_CHECK(err_code);
+    for (uint32_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+    {
+        err_code = nrf_ble_qwr_init(&m_qwr[i], &qwr_init);
+        APP_ERROR_CHECK(err_code);
+    }
 
     // Initialize LBS.
     init.led_write_handler = led_write_handler;
@@ -524,8 +742,8 @@ static void services_init(void)
     ots_init.object_chars_init.properties_read_access = SEC_OPEN;
 
     ots_init.oacp_init.p_ots            = &m_ots;
-    ots_init.oacp_init.l2cap_buffer_len = sizeof(m_ots_object);
-    ots_init.oacp_init.p_l2cap_buffer   = m_l2cap_buffer;
+    ots_init.oacp_init.l2cap_buffer_len = MAX_ALLOCATED_OBJECT_SIZE;
+    ots_init.oacp_init.p_l2cap_buffer   = m_l2cap_buffers[0];
 
     ots_init.oacp_init.write_access      = SEC_OPEN;
     ots_init.oacp_init.cccd_write_access = SEC_OPEN;
@@ -535,6 +753,32 @@ static void services_init(void)
 
     err_code = ble_ots_init(&m_ots, &ots_init);
     APP_ERROR_CHECK(err_code);
+
+    err_code = link_ctx_init(&m_ots, m_l2cap_buffers[0], MAX_ALLOCATED_OBJECT_SIZE);
+    APP_ERROR_CHECK(err_code);
+
+    // Serve benchmark reads above VIRTUAL_OBJECT_OFFSET from generated content.
+    err_code = virtual_object_init(VOBJ_PATTERN, VOBJ_SEED);
+    APP_ERROR_CHECK(err_code);
+    link_ctx_filter_set(virtual_object_on_ble_evt);
+
+    // Initialize the GATT bulk service on the same object.
+    bulk_init.evt_handler = ble_bulk_evt_handler;
+    bulk_init.p_object    = &m_ots_object;
+    bulk_init.p_gatt      = &m_gatt;
+    bulk_init.p_stage     = m_bulk_stage;
+    bulk_init.stage_size  = sizeof(m_bulk_stage);
+
+    err_code = ble_bulk_init(&m_bulk, &bulk_init);
+    APP_ERROR_CHECK(err_code);
+
+    // Initialize the USB-BLE loopback service.
+    err_code = loopback_init(&m_gatt);
+    APP_ERROR_CHECK(err_code);
+
+    // Initialize the low-latency message service.
+    err_code = ble_msg_init();
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -555,7 +799,7 @@ static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
 
     if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
     {
-        err_code = sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
+        err_code = sd_ble_gap_disconnect(p_evt->conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
         APP_ERROR_CHECK(err_code);
     }
 }
@@ -594,18 +838,140 @@ static void conn_params_init(void)
 }
 
 
+/**@brief Function for handling Peer Manager events.
+ *
+ * @details Bonds and the system attributes (CCCD values) of bonded peers are stored in FDS by the
+ *          Peer Manager, and restored on reconnection, so a known client can start an OACP
+ *          procedure without re-enabling indications first.
+ *
+ * @param[in] p_evt  Peer Manager event.
+ */
+static void pm_evt_handler(pm_evt_t const * p_evt)
+{
+    pm_handler_on_pm_evt(p_evt);
+    pm_handler_disconnect_on_sec_failure(p_evt);
+    pm_handler_flash_clean(p_evt);
+
+    switch (p_evt->evt_id)
+    {
+        case PM_EVT_CONN_SEC_SUCCEEDED:
+            if (p_evt->params.conn_sec_succeeded.procedure == PM_CONN_SEC_PROCEDURE_ENCRYPTION)
+            {
+                transfer_metrics_peer_bonded(p_evt->conn_handle);
+            }
+            transfer_metrics_milestone(p_evt->conn_handle, TRANSFER_METRICS_MILESTONE_SECURED);
+            break;
+
+        case PM_EVT_LOCAL_DB_CACHE_APPLIED:
+            transfer_metrics_peer_bonded(p_evt->conn_handle);
+            transfer_metrics_milestone(p_evt->conn_handle, TRANSFER_METRICS_MILESTONE_SYS_ATTR);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/**@brief Function for the Peer Manager initialization.
+ */
+static void peer_manager_init(void)
+{
+    ble_gap_sec_params_t sec_param;
+    ret_code_t           err_code;
+
+    err_code = pm_init();
+    APP_ERROR_CHECK(err_code);
+
+    memset(&sec_param, 0, sizeof(ble_gap_sec_params_t));
+
+    // Security parameters to be used for all security procedures.
+    sec_param.bond           = SEC_PARAM_BOND;
+    sec_param.mitm           = SEC_PARAM_MITM;
+    sec_param.lesc           = SEC_PARAM_LESC;
+    sec_param.keypress       = SEC_PARAM_KEYPRESS;
+    sec_param.io_caps        = SEC_PARAM_IO_CAPABILITIES;
+    sec_param.oob            = SEC_PARAM_OOB;
+    sec_param.min_key_size   = SEC_PARAM_MIN_KEY_SIZE;
+    sec_param.max_key_size   = SEC_PARAM_MAX_KEY_SIZE;
+    sec_param.kdist_own.enc  = 1;
+    sec_param.kdist_own.id   = 1;
+    sec_param.kdist_peer.enc = 1;
+    sec_param.kdist_peer.id  = 1;
+
+    err_code = pm_sec_params_set(&sec_param);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = pm_register(pm_evt_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for initializing the collector that pulls objects from sensor nodes.
+ */
+static void collector_init(void)
+{
+    ots_collector_init_t init;
+    ret_code_t           err_code;
+
+    init.p_gatt_queue = &m_ble_gatt_queue;
+    init.conn_cfg_tag = APP_BLE_CONN_CFG_TAG;
+    init.rx_mps       = L2CAP_RX_MPS;
+
+    err_code = ots_collector_init(&init);
+    APP_ERROR_CHECK(err_code);
+}
+
+
 /**@brief Function for starting advertising.
  */
 static void advertising_start(void)
 {
     ret_code_t           err_code;
-    err_code = sd_ble_gap_adv_start(m_adv_handle, APP_BLE_CONN_CFG_TAG);
+
+    // Broadcast holds the advertising set; it hands it back through on_broadcast_stop.
+    if (obj_broadcast_is_active())
+    {
+        return;
+    }
+
+    err_code = adv_reconnect_start();
     APP_ERROR_CHECK(err_code);
+    boot_time_mark(BOOT_TIME_PHASE_ADV_STARTED);
 
     bsp_board_led_on(ADVERTISING_LED);
 }
 
 
+/**@brief Function for resuming connectable advertising once object broadcast stops.
+ */
+static void on_broadcast_stop(void)
+{
+    if (ble_conn_state_peripheral_conn_count() < NRF_SDH_BLE_PERIPHERAL_LINK_COUNT)
+    {
+        advertising_start();
+    }
+}
+
+
+/**@brief Function for initializing connectionless broadcast of the object.
+ */
+static void broadcast_init(void)
+{
+    ret_code_t           err_code;
+    obj_broadcast_init_t init;
+
+    memset(&init, 0, sizeof(init));
+
+    init.p_adv_handle = &m_adv_handle;
+    init.p_object     = &m_ots_object;
+    init.stop_handler = on_broadcast_stop;
+
+    err_code = obj_broadcast_init(&init);
+    APP_ERROR_CHECK(err_code);
+}
+
+
 /**@brief Function for handling BLE events.
  *
  * @param[in]   p_ble_evt   Bluetooth stack event.
@@ -615,55 +981,75 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 {
     ret_code_t err_code;
 
+    // Sensor nodes are collected from without pairing.
+    if ((p_ble_evt->header.evt_id != BLE_GAP_EVT_CONNECTED) ||
+        (p_ble_evt->evt.gap_evt.params.connected.role == BLE_GAP_ROLE_PERIPH))
+    {
+        pm_handler_secure_on_connection(p_ble_evt);
+    }
+
     switch (p_ble_evt->header.evt_id)
     {
         case BLE_GAP_EVT_CONNECTED:
-            msg("Connected\r\n");
+        {
+            uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+
+            if (p_ble_evt->evt.gap_evt.params.connected.role != BLE_GAP_ROLE_PERIPH)
+            {
+                // Central links belong to ots_collector.
+                break;
+            }
+
+            msg("Connected 0x%04x (%u links)\r\n", conn_handle, link_ctx_count());
             bsp_board_led_on(CONNECTED_LED);
             bsp_board_led_off(ADVERTISING_LED);
-            m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-            err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
+            err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr[ble_conn_state_conn_idx(conn_handle)],
+                                                      conn_handle);
             APP_ERROR_CHECK(err_code);
-            err_code = app_button_enable();
-            APP_ERROR_CHECK(err_code);
-            break;
+            if (ble_conn_state_peripheral_conn_count() == 1)
+            {
+                err_code = app_button_enable();
+                APP_ERROR_CHECK(err_code);
+            }
+            // Keep advertising while there are free links.
+            if (ble_conn_state_peripheral_conn_count() < NRF_SDH_BLE_PERIPHERAL_LINK_COUNT)
+            {
+                advertising_start();
+            }
+        } break;
 
         case BLE_GAP_EVT_DISCONNECTED:
-            msg("Disconnected\r\n");
-            bsp_board_led_off(CONNECTED_LED);
-            m_conn_handle = BLE_CONN_HANDLE_INVALID;
-            err_code = app_button_disable();
+            if (ble_conn_state_role(p_ble_evt->evt.gap_evt.conn_handle) != BLE_GAP_ROLE_PERIPH)
+            {
+                break;
+            }
+            msg("Disconnected 0x%04x\r\n", p_ble_evt->evt.gap_evt.conn_handle);
+            if (ble_conn_state_peripheral_conn_count() == 0)
+            {
+                bsp_board_led_off(CONNECTED_LED);
+                err_code = app_button_disable();
+                APP_ERROR_CHECK(err_code);
+            }
+            // adv_reconnect has recorded the peer: start over with the directed phase, even if
+            // undirected advertising is still running for the free links.
+            err_code = adv_reconnect_stop();
             APP_ERROR_CHECK(err_code);
             advertising_start();
             break;
 
-        case BLE_GAP_EVT_SEC_PARAMS_REQUEST:
-            // Pairing not supported
-            err_code = sd_ble_gap_sec_params_reply(m_conn_handle,
-                                                   BLE_GAP_SEC_STATUS_PAIRING_NOT_SUPP,
-                                                   NULL,
-                                                   NULL);
-            APP_ERROR_CHECK(err_code);
-            break;
-
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
         {
-            //msg("PHY update request\r\n");
+            // Peers get their way unless link_phy has moved the link for its signal.
+            uint8_t              phy  = link_phy_preferred(p_ble_evt->evt.gap_evt.conn_handle);
             ble_gap_phys_t const phys =
             {
-                .rx_phys = BLE_GAP_PHY_AUTO,
-                .tx_phys = BLE_GAP_PHY_AUTO,
+                .rx_phys = phy,
+                .tx_phys = phy,
             };
             err_code = sd_ble_gap_phy_update(p_ble_evt->evt.gap_evt.conn_handle, &phys);
             APP_ERROR_CHECK(err_code);
         } break;
 
-        case BLE_GATTS_EVT_SYS_ATTR_MISSING:
-            // No system attributes have been stored.
-            err_code = sd_ble_gatts_sys_attr_set(m_conn_handle, NULL, 0, 0);
-            APP_ERROR_CHECK(err_code);
-            break;
-
         case BLE_GATTC_EVT_TIMEOUT:
             // Disconnect on GATT Client timeout event.
             msg("GATT Client Timeout.\r\n");
@@ -687,25 +1073,129 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 }
 
 
+/**@brief Function for reporting that RAM_START is too low for the SoftDevice configuration.
+ *
+ * @details The dongle has no log backend, so the value the SoftDevice needs is sent to the host
+ *          instead, once a second while USB keeps running. Patch it in with
+ *          "tools/ram_budget.py patch --ram-start <value>". Does not return.
+ *
+ * @param[in] ram_start  Application RAM start required by the SoftDevice.
+ */
+static void ram_start_report(uint32_t ram_start)
+{
+    usb_start();
+
+    for (;;)
+    {
+        msg("SoftDevice needs RAM_START=0x%08x, RAM_SIZE=0x%x\r\n",
+            ram_start, APP_RAM_END - ram_start);
+
+        for (uint32_t i = 0; i < 1000; i++)
+        {
+            while (app_usbd_event_queue_process())
+            {
+                /* Nothing to do */
+            }
+            msg_flush();
+            nrf_delay_ms(1);
+        }
+    }
+}
+
+
+/**@brief Function for setting a SoftDevice configuration even if RAM_START is too low for it.
+ *
+ * @details sd_ble_cfg_set refuses a configuration that does not fit above @p ram_start. It is
+ *          then set against the end of RAM instead, so that nrf_sdh_ble_enable still fails, but
+ *          reports the RAM start the whole configuration needs.
+ *
+ * @param[in]    cfg_id     Configuration ID.
+ * @param[in]    p_cfg      Configuration.
+ * @param[in]    ram_start  Application RAM start.
+ * @param[inout] p_no_mem   Set to true if the configuration did not fit.
+ *
+ * @return NRF_SUCCESS or an error code from sd_ble_cfg_set.
+ */
+static ret_code_t ble_cfg_set(uint32_t cfg_id, ble_cfg_t const * p_cfg, uint32_t ram_start, bool * p_no_mem)
+{
+    ret_code_t err_code = sd_ble_cfg_set(cfg_id, p_cfg, ram_start);
+
+    if (err_code == NRF_ERROR_NO_MEM)
+    {
+        *p_no_mem = true;
+        err_code  = sd_ble_cfg_set(cfg_id, p_cfg, APP_RAM_END);
+    }
+
+    return err_code;
+}
+
+
 /**@brief Function for initializing the BLE stack.
  *
- * @details Initializes the SoftDevice and the BLE event interrupt.
+ * @details Initializes the SoftDevice and the BLE event interrupt. If RAM_START is too low for
+ *          the configuration, the RAM start it needs is reported to the host instead, see
+ *          @ref ram_start_report.
  */
 static void ble_stack_init(void)
 {
     ret_code_t err_code;
+    bool       no_mem = false;
 
     err_code = nrf_sdh_enable_request();
     APP_ERROR_CHECK(err_code);
+    boot_time_mark(BOOT_TIME_PHASE_SD_ENABLED);
 
     // Configure the BLE stack using the default settings.
     // Fetch the start address of the application RAM.
     uint32_t ram_start = 0;
     err_code = nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start);
+    if (err_code == NRF_ERROR_NO_MEM)
+    {
+        // Part of the defaults is missing, so the value reported below falls short; after
+        // patching it, the next boot reports the rest.
+        no_mem   = true;
+        err_code = NRF_SUCCESS;
+    }
+    APP_ERROR_CHECK(err_code);
+
+    // One L2CAP CoC per link: the OTS object channel, served on peripheral links and
+    // opened by ots_collector on central links. Its TX queue holds the SDUs that
+    // virtual_object keeps in flight.
+    ble_cfg_t ble_cfg;
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag                        = APP_BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.rx_mps        = L2CAP_RX_MPS;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.tx_mps        = L2CAP_TX_MPS;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.rx_queue_size = 1;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.tx_queue_size = VIRTUAL_OBJECT_TX_SDU_MAX;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.ch_count      = 1;
+    err_code = ble_cfg_set(BLE_CONN_CFG_L2CAP, &ble_cfg, ram_start, &no_mem);
+    APP_ERROR_CHECK(err_code);
+
+    // Room for several bulk notifications per connection event.
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag                            = APP_BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = BLE_BULK_HVN_TX_QUEUE_SIZE;
+    err_code = ble_cfg_set(BLE_CONN_CFG_GATTS, &ble_cfg, ram_start, &no_mem);
     APP_ERROR_CHECK(err_code);
 
     // Enable BLE stack.
     err_code = nrf_sdh_ble_enable(&ram_start);
+    if ((err_code == NRF_ERROR_NO_MEM) || no_mem)
+    {
+        ram_start_report(ram_start);
+    }
+    APP_ERROR_CHECK(err_code);
+
+    // Let a link run past its event length while the other links leave the radio idle.
+    ble_opt_t opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.common_opt.conn_evt_ext.enable = 1;
+    err_code = sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &opt);
+    APP_ERROR_CHECK(err_code);
+
+    // The radio is still idle, so the notification for the first advertisement can be set up.
+    err_code = boot_time_first_adv_watch();
     APP_ERROR_CHECK(err_code);
 
     // Register a handler for BLE events.
@@ -713,6 +1203,26 @@ static void ble_stack_init(void)
 }
 
 
+/**@brief Function for sending the button state to one connected link.
+ *
+ * @param[in] conn_handle  Connection handle.
+ * @param[in] p_context    Pointer to the button action.
+ */
+static void button_state_send(uint16_t conn_handle, void * p_context)
+{
+    uint8_t    button_action = *(uint8_t *)p_context;
+    ret_code_t err_code      = ble_lbs_on_button_change(conn_handle, &m_lbs, button_action);
+
+    if (err_code != NRF_SUCCESS &&
+        err_code != BLE_ERROR_INVALID_CONN_HANDLE &&
+        err_code != NRF_ERROR_INVALID_STATE &&
+        err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+
 /**@brief Function for handling events from the button handler module.
  *
  * @param[in] pin_no        The pin that the event applies to.
@@ -720,20 +1230,11 @@ static void ble_stack_init(void)
  */
 static void button_event_handler(uint8_t pin_no, uint8_t button_action)
 {
-    ret_code_t err_code;
-
     switch (pin_no)
     {
         case LEDBUTTON_BUTTON:
             msg("Send button state change.");
-            err_code = ble_lbs_on_button_change(m_conn_handle, &m_lbs, button_action);
-            if (err_code != NRF_SUCCESS &&
-                err_code != BLE_ERROR_INVALID_CONN_HANDLE &&
-                err_code != NRF_ERROR_INVALID_STATE &&
-                err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING)
-            {
-                APP_ERROR_CHECK(err_code);
-            }
+            UNUSED_RETURN_VALUE(ble_conn_state_for_each_connected(button_state_send, &button_action));
             break;
 
         default:
@@ -786,6 +1287,9 @@ static void power_management_init(void)
  */
 static void idle_state_handle(void)
 {
+    // Commits and erases for the object store happen here, off the transfer path.
+    obj_store_process();
+
     if (NRF_LOG_PROCESS() == false)
     {
         nrf_pwr_mgmt_run();
@@ -807,6 +1311,8 @@ void uart_error_handle(app_uart_evt_t * p_event)
 
 static void usbd_user_ev_handler(app_usbd_event_type_t event)
 {
+    event_trace_record(EVENT_TRACE_SOURCE_USBD, (uint8_t)event, 0);
+
     switch (event)
     {
         case APP_USBD_EVT_DRV_SUSPEND:
@@ -816,6 +1322,7 @@ static void usbd_user_ev_handler(app_usbd_event_type_t event)
             //bsp_board_led_on(BSP_BOARD_LED_0);
             break;
         case APP_USBD_EVT_STARTED:
+            boot_time_mark(BOOT_TIME_PHASE_USB_STARTED);
             break;
         case APP_USBD_EVT_STOPPED:
             app_usbd_disable();
@@ -844,6 +1351,51 @@ static void usbd_user_ev_handler(app_usbd_event_type_t event)
 
 
 
+/**@brief Function for handling a frame from the host.
+ *
+ * @param[in] type   Frame type.
+ * @param[in] p_buf  Buffer holding the payload.
+ */
+static void usb_frame_handler(uint8_t type, sdu_buf_t * p_buf)
+{
+    switch (type)
+    {
+        case LOOPBACK_FRAME_REQUEST:
+            loopback_on_request(p_buf);
+            break;
+
+        case BLE_MSG_FRAME_SEND:
+            ble_msg_on_frame(p_buf);
+            break;
+
+        case BLE_CAPTURE_FRAME_CONTROL:
+            ble_capture_on_frame(p_buf);
+            break;
+
+        case EVENT_TRACE_FRAME_DUMP:
+            event_trace_on_frame(p_buf);
+            break;
+
+        case OBJ_BROADCAST_FRAME_CONTROL:
+            obj_broadcast_on_frame(p_buf);
+            break;
+
+        case SCAN_BRIDGE_FRAME_CONTROL:
+            scan_bridge_on_frame(p_buf);
+            break;
+
+        case USB_BENCH_FRAME_CONTROL:
+        case USB_BENCH_FRAME_DATA:
+            usb_bench_on_frame(type, p_buf);
+            break;
+
+        default:
+            // Unknown frames are dropped.
+            break;
+    }
+}
+
+
 void usb_init(void)
 {
     ret_code_t err_code;
@@ -853,11 +1405,39 @@ void usb_init(void)
     app_usbd_serial_num_generate();
     err_code = app_usbd_init(&usbd_config);         
     APP_ERROR_CHECK(err_code);
+
+    err_code = usb_stream_init(&HOST_LINK_DEFAULT);
+    APP_ERROR_CHECK(err_code);
+    usb_stream_rx_handler_set(usb_frame_handler);
+    err_code = host_link_open(&m_link_cdc);
+    APP_ERROR_CHECK(err_code);
     
     app_usbd_class_inst_t const * class_cdc_acm = app_usbd_cdc_acm_class_inst_get(&m_app_cdc_acm);
     err_code = app_usbd_class_append(class_cdc_acm);
     APP_ERROR_CHECK(err_code);
 
+    err_code = app_usbd_class_append(usb_vendor_class_inst_get(&m_usb_vendor));
+    APP_ERROR_CHECK(err_code);
+
+#if APP_USBD_MSC_ENABLED
+    // The stored object as a file on a disk. Hosts mount it writable, but every write fails;
+    // see obj_disk.h.
+    err_code = app_usbd_class_append(app_usbd_msc_class_inst_get(&m_app_msc));
+    APP_ERROR_CHECK(err_code);
+#endif
+}
+
+
+/**@brief Function for starting USB, after the SoftDevice is enabled.
+ *
+ * @details Setup requests from the host are only handled once the main loop runs, so starting
+ *          USBD earlier would only make the host wait. Starting it after advertising lets
+ *          enumeration run alongside the first advertising events instead of in front of them.
+ */
+static void usb_start(void)
+{
+    ret_code_t err_code;
+
     if (USBD_POWER_DETECTION)
     {
         err_code = app_usbd_power_events_enable();
@@ -918,14 +1498,123 @@ static void init_bsp(void)
     bsp_board_init(BSP_INIT_LEDS);
 }
 
+/**@brief Function for starting the LFCLK without waiting for it.
+ *
+ * @details The crystal takes a few hundred milliseconds to start. Everything up to enabling the
+ *          SoftDevice runs meanwhile, and the SoftDevice takes over the running clock.
+ */
 static void clock_init(void)
 {
     ret_code_t ret = nrf_drv_clock_init();
     APP_ERROR_CHECK(ret);
     nrf_drv_clock_lfclk_request(NULL);
-    while(!nrf_drv_clock_lfclk_is_running())
+}
+
+
+STATIC_ASSERT(IS_POWER_OF_TWO(MSG_RING_SIZE));
+
+/**@brief Function for adding a message to the debug text ring.
+ *
+ * @details Called from any context. A message that does not fit whole is dropped and counted.
+ */
+static void msg_text_put(char const * p_text, uint32_t len)
+{
+    CRITICAL_REGION_ENTER();
+    if (MSG_RING_SIZE - (m_msg_head - m_msg_tail) < len)
+    {
+        m_msg_dropped++;
+    }
+    else
+    {
+        uint32_t index = m_msg_head & (MSG_RING_SIZE - 1);
+        uint32_t part  = MIN(len, MSG_RING_SIZE - index);
+
+        memcpy(&m_msg_ring[index], p_text, part);
+        memcpy(m_msg_ring, &p_text[part], len - part);
+        m_msg_head += len;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+
+/**@brief Function for handing the debug text gathered so far to usb_stream.
+ *
+ * @details Called from the main loop. The text goes out in one buffer at a time, taken with
+ *          sdu_pool_alloc_spare, so debug text holds at most one queue slot of usb_stream and
+ *          never the buffers the transfer path needs. The next buffer is queued only once the
+ *          stream has sent the previous one.
+ */
+static void msg_flush(void)
+{
+    sdu_buf_t * p_buf;
+    uint8_t   * p_text;
+    uint32_t    head;
+    uint32_t    tail;
+    uint32_t    dropped;
+    uint32_t    len;
+    uint32_t    index;
+    uint32_t    part;
+
+    if (mp_msg_sent != NULL)
+    {
+        // usb_stream drops its reference from the main loop as well.
+        if (mp_msg_sent->ref_count > 1)
+        {
+            return;
+        }
+        sdu_pool_release(mp_msg_sent);
+        mp_msg_sent = NULL;
+    }
+
+    CRITICAL_REGION_ENTER();
+    head    = m_msg_head;
+    tail    = m_msg_tail;
+    dropped = m_msg_dropped;
+    CRITICAL_REGION_EXIT();
+
+    if ((head == tail) && (dropped == 0))
+    {
+        return;
+    }
+
+    p_buf = sdu_pool_alloc_spare();
+    if (p_buf == NULL)
+    {
+        return;
+    }
+    p_text = sdu_buf_payload(p_buf);
+
+    // Messages only write to the free part of the ring, so the text is copied out unlocked.
+    len   = MIN(head - tail, SDU_POOL_DATA_SIZE - MSG_LINE_MAX);
+    index = tail & (MSG_RING_SIZE - 1);
+    part  = MIN(len, MSG_RING_SIZE - index);
+    memcpy(p_text, &m_msg_ring[index], part);
+    memcpy(&p_text[part], m_msg_ring, len - part);
+
+    // The drop count goes after the text that was kept, at the end of the ring.
+    if (len != head - tail)
+    {
+        dropped = 0;
+    }
+
+    CRITICAL_REGION_ENTER();
+    m_msg_tail    += len;
+    m_msg_dropped -= dropped;
+    CRITICAL_REGION_EXIT();
+
+    if (dropped != 0)
+    {
+        len += snprintf((char *)&p_text[len], MSG_LINE_MAX, "[%u messages dropped]\r\n", (unsigned int)dropped);
+    }
+    p_buf->len = len;
+
+    if (usb_stream_raw_put(p_buf) == NRF_SUCCESS)
+    {
+        mp_msg_sent = p_buf;
+    }
+    else
     {
-        /* Just waiting */
+        sdu_pool_release(p_buf);
     }
 }
 
@@ -933,13 +1622,17 @@ static void clock_init(void)
 #ifdef MAIN_DEBUG
 void msg(const char *format, ...)
 {
-    memset(m_tx_buffer, 0, NRF_DRV_USBD_EPSIZE);
+    char line[MSG_LINE_MAX];
+
     va_list args;
     va_start(args, format);
-    vsnprintf(m_tx_buffer, USB_TX_BUFFER_SIZE, format, args);
+    int len = vsnprintf(line, sizeof(line), format, args);
     va_end(args);
 
-    app_usbd_cdc_acm_write(&m_app_cdc_acm, m_tx_buffer, strlen(m_tx_buffer));
+    if (len > 0)
+    {
+        msg_text_put(line, MIN((uint32_t)len, sizeof(line) - 1));
+    }
 }
 #else 
 {
@@ -949,10 +1642,9 @@ void msg(const char *format, ...)
 
 void msg_hexdump(const uint8_t *data, size_t data_length) {
     int len_in_line = 16; 
-    char hex_buffer[len_in_line * 3 + 1]; 
 
     for(size_t i = 0; i < data_length; i += len_in_line){
-        memset(hex_buffer, 0, sizeof(hex_buffer));
+        char   hex_buffer[16 * 3 + 3];
         size_t bytes_to_copy = (data_length - i < len_in_line) ? (data_length - i) : len_in_line;
 
         
@@ -960,9 +1652,9 @@ void msg_hexdump(const uint8_t *data, size_t data_length) {
             snprintf(&hex_buffer[j * 3], 4, "%02X ", data[i + j]);
         }
 
-        
-        app_usbd_cdc_acm_write(&m_app_cdc_acm, hex_buffer, bytes_to_copy * 3);
-        app_usbd_cdc_acm_write(&m_app_cdc_acm, "\r\n", 2); // Xuống dòng sau mỗi dòng hexdump
+        // Xuống dòng sau mỗi dòng hexdump
+        memcpy(&hex_buffer[bytes_to_copy * 3], "\r\n", 2);
+        msg_text_put(hex_buffer, bytes_to_copy * 3 + 2);
     }
 }
 
@@ -973,13 +1665,34 @@ void msg_hexdump(const uint8_t *data, size_t data_length) {
 int main(void)
 {
     ret_code_t ret;
+    bool       collector_started = false;
 
+    boot_time_init();
     log_init();
     clock_init();
+
+    // Runs while the LFCLK starts.
     timers_init();
+    ret = sdu_pool_init();
+    APP_ERROR_CHECK(ret);
+    ret = event_trace_init();
+    APP_ERROR_CHECK(ret);
+    ret = transfer_metrics_init();
+    APP_ERROR_CHECK(ret);
+    ret = ble_capture_init();
+    APP_ERROR_CHECK(ret);
     usb_init();
+#if HOST_UART_ENABLED
+    ret = host_link_open(&m_link_uart);
+    APP_ERROR_CHECK(ret);
+#endif
+#if HOST_RTT_ENABLED
+    ret = host_link_open(&m_link_rtt);
+    APP_ERROR_CHECK(ret);
+#endif
     init_bsp();
     power_management_init();
+    boot_time_mark(BOOT_TIME_PHASE_CORE_INIT);
     
     // Initialize BLE
     ble_stack_init();
@@ -988,8 +1701,19 @@ int main(void)
     services_init();
     advertising_init();
     conn_params_init();
+    peer_manager_init();
+    ret = obj_store_init(&m_ots_object, object_restored);
+    APP_ERROR_CHECK(ret);
+    collector_init();
+    broadcast_init();
+    ret = scan_bridge_init();
+    APP_ERROR_CHECK(ret);
+    ret = link_phy_init();
+    APP_ERROR_CHECK(ret);
+    boot_time_mark(BOOT_TIME_PHASE_BLE_READY);
   
     advertising_start();
+    usb_start();
      
     while (true)
     {
@@ -997,6 +1721,20 @@ int main(void)
         {
             /* Nothing to do */
         }
+
+        // Scanning waits for the first advertisement so it does not delay it.
+        if (!collector_started && boot_time_is_marked(BOOT_TIME_PHASE_FIRST_ADV))
+        {
+            ret = ots_collector_start();
+            APP_ERROR_CHECK(ret);
+            collector_started = true;
+        }
+
+        ble_capture_process();
+        event_trace_process();
+        msg_flush();
+        host_link_process();
+        usb_bench_process();
         
 
 
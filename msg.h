@@ -0,0 +1,30 @@
+#ifndef MSG_H__
+#define MSG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**@brief Function for printing a formatted debug message to the host, on the current host link.
+ *
+ * @param[in] format printf-style format string.
+ */
+void msg(const char *format, ...);
+
+
+/**@brief Function for printing a buffer to the host as rows of hex bytes.
+ *
+ * @param[in] data        Data to print.
+ * @param[in] data_length Number of bytes to print.
+ */
+void msg_hexdump(const uint8_t *data, size_t data_length);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MSG_H__
@@ -0,0 +1,271 @@
+#include <string.h>
+#include "obj_broadcast.h"
+#include "app_error.h"
+#include "ble.h"
+#include "nordic_common.h"
+#include "nrf_sdh_ble.h"
+#include "crc32.h"
+#include "adv_reconnect.h"
+#include "msg.h"
+
+
+#define AD_HEADER_LEN   4                                   /**< AD length, AD type and service UUID. */
+#define SEGMENT_MAX     UINT8_MAX                           /**< Segments an object can be cut into. */
+
+/**@brief Description of the object being sent, taken when broadcast starts or the object changes. */
+typedef struct
+{
+    uint16_t len;                                           /**< Object length. */
+    uint32_t crc;                                           /**< CRC32 of the object. */
+    uint8_t  count;                                         /**< Number of segments. */
+} object_info_t;
+
+static obj_broadcast_init_t m_init;
+static volatile bool        m_active;
+static object_info_t        m_info;
+static uint8_t              m_version;                      /**< Bumped on every object change. */
+static uint8_t              m_segment;                      /**< Segment being advertised. */
+static bool                 m_restart;                      /**< Start the next cycle with segment 0. */
+static uint32_t             m_cycles;                       /**< Complete cycles since broadcast started. */
+static uint8_t              m_adv_buf[OBJ_BROADCAST_ADV_LEN];
+
+static ble_gap_adv_data_t m_adv_data =
+{
+    .adv_data      = {.p_data = m_adv_buf, .len = 0},
+    .scan_rsp_data = {.p_data = NULL,      .len = 0},
+};
+
+
+static ret_code_t info_update(void)
+{
+    uint16_t len = (uint16_t)m_init.p_object->current_size;
+
+    if (len == 0)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (CEIL_DIV(len, OBJ_BROADCAST_CHUNK_LEN) > SEGMENT_MAX)
+    {
+        return NRF_ERROR_DATA_SIZE;
+    }
+
+    m_info.len   = len;
+    m_info.crc   = crc32_compute(m_init.p_object->data, len, NULL);
+    m_info.count = (uint8_t)CEIL_DIV(len, OBJ_BROADCAST_CHUNK_LEN);
+
+    return NRF_SUCCESS;
+}
+
+
+/**@brief Function for putting the current segment in the set and starting it. */
+static ret_code_t segment_start(void)
+{
+    ret_code_t           err_code;
+    ble_gap_adv_params_t adv_params;
+    uint16_t             offset = m_segment * OBJ_BROADCAST_CHUNK_LEN;
+    uint16_t             chunk  = MIN(OBJ_BROADCAST_CHUNK_LEN, m_info.len - offset);
+    uint8_t            * p      = m_adv_buf;
+
+    // The set is stopped between segments, so its buffer can be rewritten in place.
+    p[0] = (uint8_t)(AD_HEADER_LEN - 1 + OBJ_BROADCAST_HEADER_LEN + chunk);
+    p[1] = BLE_GAP_AD_TYPE_SERVICE_DATA;
+    (void)uint16_encode(BLE_UUID_OTS_SERVICE, &p[2]);
+    p += AD_HEADER_LEN;
+
+    p[0] = OBJ_BROADCAST_FORMAT;
+    p[1] = m_version;
+    p[2] = m_segment;
+    p[3] = m_info.count;
+    (void)uint16_encode(m_info.len, &p[4]);
+    (void)uint32_encode(m_info.crc, &p[6]);
+    memcpy(&p[OBJ_BROADCAST_HEADER_LEN], &m_init.p_object->data[offset], chunk);
+
+    m_adv_data.adv_data.len = AD_HEADER_LEN + OBJ_BROADCAST_HEADER_LEN + chunk;
+
+    memset(&adv_params, 0, sizeof(adv_params));
+
+    adv_params.properties.type = BLE_GAP_ADV_TYPE_EXTENDED_NONCONNECTABLE_NONSCANNABLE_UNDIRECTED;
+    adv_params.primary_phy     = BLE_GAP_PHY_1MBPS;
+    adv_params.secondary_phy   = OBJ_BROADCAST_SECONDARY_PHY;
+    adv_params.interval        = OBJ_BROADCAST_INTERVAL;
+    adv_params.max_adv_evts    = OBJ_BROADCAST_REPEATS;
+    adv_params.duration        = BLE_GAP_ADV_TIMEOUT_GENERAL_UNLIMITED;
+    adv_params.filter_policy   = BLE_GAP_ADV_FP_ANY;
+
+    err_code = sd_ble_gap_adv_set_configure(m_init.p_adv_handle, &m_adv_data, &adv_params);
+    VERIFY_SUCCESS(err_code);
+
+    return sd_ble_gap_adv_start(*m_init.p_adv_handle, BLE_CONN_CFG_TAG_DEFAULT);
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    ret_code_t err_code;
+
+    if ((p_ble_evt->header.evt_id != BLE_GAP_EVT_ADV_SET_TERMINATED) || !m_active)
+    {
+        return;
+    }
+    // Timeouts of connectable advertising are left to the reconnect policy.
+    if ((p_ble_evt->evt.gap_evt.params.adv_set_terminated.reason !=
+         BLE_GAP_EVT_ADV_SET_TERMINATED_REASON_LIMIT_REACHED) ||
+        (p_ble_evt->evt.gap_evt.params.adv_set_terminated.adv_handle != *m_init.p_adv_handle))
+    {
+        return;
+    }
+
+    if (m_restart)
+    {
+        m_restart = false;
+        m_segment = 0;
+    }
+    else if (++m_segment >= m_info.count)
+    {
+        m_segment = 0;
+        m_cycles++;
+    }
+
+    err_code = segment_start();
+    APP_ERROR_CHECK(err_code);
+}
+
+NRF_SDH_BLE_OBSERVER(m_obj_broadcast_obs, OBJ_BROADCAST_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+ret_code_t obj_broadcast_init(obj_broadcast_init_t const * p_init)
+{
+    if ((p_init == NULL) ||
+        (p_init->p_adv_handle == NULL) ||
+        (p_init->p_object == NULL) ||
+        (p_init->stop_handler == NULL))
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    m_init   = *p_init;
+    m_active = false;
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t obj_broadcast_start(void)
+{
+    ret_code_t err_code;
+
+    if (m_active)
+    {
+        return NRF_SUCCESS;
+    }
+
+    err_code = info_update();
+    VERIFY_SUCCESS(err_code);
+
+    err_code = adv_reconnect_stop();
+    VERIFY_SUCCESS(err_code);
+
+    m_segment = 0;
+    m_restart = false;
+    m_cycles  = 0;
+    m_active  = true;
+
+    err_code = segment_start();
+    if (err_code != NRF_SUCCESS)
+    {
+        m_active = false;
+        m_init.stop_handler();
+        return err_code;
+    }
+
+    msg("Broadcast v%u: %u bytes in %u segments\r\n", m_version, m_info.len, m_info.count);
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t obj_broadcast_stop(void)
+{
+    ret_code_t err_code;
+
+    if (!m_active)
+    {
+        return NRF_SUCCESS;
+    }
+
+    // Cleared first, so a segment that ends meanwhile does not start the next one.
+    m_active = false;
+
+    err_code = sd_ble_gap_adv_stop(*m_init.p_adv_handle);
+    if (err_code == NRF_ERROR_INVALID_STATE)
+    {
+        err_code = NRF_SUCCESS;
+    }
+    VERIFY_SUCCESS(err_code);
+
+    msg("Broadcast v%u stopped after %u cycles\r\n", m_version, m_cycles);
+
+    m_init.stop_handler();
+
+    return NRF_SUCCESS;
+}
+
+
+void obj_broadcast_object_changed(void)
+{
+    m_version++;
+
+    if (!m_active)
+    {
+        return;
+    }
+
+    if (info_update() != NRF_SUCCESS)
+    {
+        // Nothing left to send.
+        APP_ERROR_CHECK(obj_broadcast_stop());
+        return;
+    }
+
+    // The segment on air keeps its old header; receivers drop it once they see the new version.
+    m_restart = true;
+    m_cycles  = 0;
+
+    msg("Broadcast v%u: %u bytes in %u segments\r\n", m_version, m_info.len, m_info.count);
+}
+
+
+bool obj_broadcast_is_active(void)
+{
+    return m_active;
+}
+
+
+void obj_broadcast_on_frame(sdu_buf_t * p_buf)
+{
+    ret_code_t err_code;
+
+    if (p_buf->len < 1)
+    {
+        return;
+    }
+
+    if (sdu_buf_payload(p_buf)[0] != 0)
+    {
+        err_code = obj_broadcast_start();
+    }
+    else
+    {
+        err_code = obj_broadcast_stop();
+    }
+
+    if (err_code != NRF_SUCCESS)
+    {
+        msg("Broadcast: error 0x%x\r\n", err_code);
+    }
+}
@@ -0,0 +1,130 @@
+/**@file
+ *
+ * @defgroup obj_broadcast Connectionless object broadcast
+ * @{
+ * @brief Sends the OTS object in extended advertising, so any number of receivers can pick it up
+ *        without connecting.
+ *
+ * @details While broadcast runs, the module borrows the advertising set from the reconnect
+ *          policy and advertises it as extended, non-connectable and non-scannable. The object is
+ *          cut into segments of at most @ref OBJ_BROADCAST_CHUNK_LEN bytes. Each segment is the
+ *          whole payload of the set, one OTS service data field, which the SoftDevice spreads
+ *          over an AUX_ADV_IND and its AUX_CHAIN_IND PDUs. A segment is advertised
+ *          @ref OBJ_BROADCAST_REPEATS times, then BLE_GAP_EVT_ADV_SET_TERMINATED moves the set on
+ *          to the next one. After the last segment the cycle starts again.
+ *
+ *          Service data layout, after the 16-bit OTS UUID:
+ *
+ *          | Offset | Size | Field                                                    |
+ *          |--------|------|----------------------------------------------------------|
+ *          | 0      | 1    | Format, @ref OBJ_BROADCAST_FORMAT                        |
+ *          | 1      | 1    | Object version, changes whenever the object does         |
+ *          | 2      | 1    | Segment index                                            |
+ *          | 3      | 1    | Segment count                                            |
+ *          | 4      | 2    | Object length (LE)                                       |
+ *          | 6      | 4    | CRC32 of the whole object (LE)                           |
+ *          | 10     | n    | Object bytes from index * @ref OBJ_BROADCAST_CHUNK_LEN   |
+ *
+ *          A receiver collects segments of one version until it has all of them and the CRC
+ *          matches. Segments of another version start it over. The digest in the legacy
+ *          advertising packet uses the same UUID but is shorter than this header, and is only
+ *          sent while broadcast is stopped.
+ *
+ *          The host starts and stops broadcast with a @ref OBJ_BROADCAST_FRAME_CONTROL frame
+ *          (one byte, 1: start, 0: stop). tools/obj_broadcast.py sends it, and collects and
+ *          checks the object from a scanner.
+ */
+#ifndef OBJ_BROADCAST_H__
+#define OBJ_BROADCAST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble_gap.h"
+#include "ble_ots.h"
+#include "app_util.h"
+#include "sdu_pool.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBJ_BROADCAST_BLE_OBSERVER_PRIO 2                                           /**< Priority of the BLE observer. */
+
+#define OBJ_BROADCAST_INTERVAL          MSEC_TO_UNITS(100, UNIT_0_625_MS)           /**< Advertising interval. */
+#define OBJ_BROADCAST_REPEATS           3                                           /**< Advertising events per segment. More suit receivers that scan with a low duty cycle. */
+#define OBJ_BROADCAST_SECONDARY_PHY     BLE_GAP_PHY_1MBPS                           /**< PHY of the auxiliary and chained PDUs. */
+
+#define OBJ_BROADCAST_FORMAT            1                                           /**< Version of the segment layout. */
+#define OBJ_BROADCAST_HEADER_LEN        10                                          /**< Length of the segment header. */
+#define OBJ_BROADCAST_ADV_LEN           BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED /**< Payload of the advertising set. */
+#define OBJ_BROADCAST_CHUNK_LEN         (OBJ_BROADCAST_ADV_LEN - 4 - OBJ_BROADCAST_HEADER_LEN) /**< Object bytes per segment, after the AD length, AD type and UUID. */
+
+#define OBJ_BROADCAST_FRAME_CONTROL     0x50                                        /**< Host to dongle: start or stop broadcast. */
+
+
+/**@brief Handler called once broadcast has stopped, to start connectable advertising again. */
+typedef void (*obj_broadcast_stop_handler_t)(void);
+
+
+/**@brief Initialization parameters. */
+typedef struct
+{
+    uint8_t                    * p_adv_handle;  /**< Advertising set handle, shared with the application. */
+    ble_ots_object_t const     * p_object;      /**< Object to broadcast. */
+    obj_broadcast_stop_handler_t stop_handler;  /**< Called when broadcast stops. */
+} obj_broadcast_init_t;
+
+
+/**@brief Function for initializing the module. Broadcast starts stopped.
+ *
+ * @param[in] p_init  Initialization parameters.
+ *
+ * @return NRF_SUCCESS, or NRF_ERROR_NULL if a parameter is missing.
+ */
+ret_code_t obj_broadcast_init(obj_broadcast_init_t const * p_init);
+
+
+/**@brief Function for starting broadcast of the object.
+ *
+ * @details Stops connectable advertising. Links already up are not affected.
+ *
+ * @return NRF_SUCCESS, NRF_ERROR_INVALID_LENGTH if the object is empty, or an error code from
+ *         the SoftDevice.
+ */
+ret_code_t obj_broadcast_start(void);
+
+
+/**@brief Function for stopping broadcast. Calls the stop handler.
+ *
+ * @return NRF_SUCCESS or an error code from sd_ble_gap_adv_stop.
+ */
+ret_code_t obj_broadcast_stop(void);
+
+
+/**@brief Function for telling the module that the object changed.
+ *
+ * @details If broadcast runs, the version is bumped and the cycle starts over with the next
+ *          segment sent.
+ */
+void obj_broadcast_object_changed(void);
+
+
+/**@brief Function for checking whether broadcast owns the advertising set. */
+bool obj_broadcast_is_active(void);
+
+
+/**@brief Function for handling a @ref OBJ_BROADCAST_FRAME_CONTROL frame from the host.
+ *
+ * @param[in] p_buf  Buffer holding the frame payload.
+ */
+void obj_broadcast_on_frame(sdu_buf_t * p_buf);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OBJ_BROADCAST_H__
+
+/** @} */
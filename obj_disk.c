@@ -0,0 +1,461 @@
+#include <stdio.h>
+#include <string.h>
+#include "obj_disk.h"
+#include "sdk_common.h"
+#include "app_util.h"
+#include "flash_log.h"
+#include "obj_store.h"
+
+
+#define RESERVED_SECTORS    1
+#define FAT_COUNT           2
+#define FAT_SECTORS         3                                               /**< Enough for the 12-bit entries of every cluster. */
+#define ROOT_ENTRIES        16                                              /**< One sector of directory entries. */
+#define ROOT_LBA            (RESERVED_SECTORS + FAT_COUNT * FAT_SECTORS)
+#define DATA_LBA            (ROOT_LBA + 1)
+#define CLUSTER_COUNT       (OBJ_DISK_BLOCK_COUNT - DATA_LBA)
+#define CLUSTER_INFO        2                                               /**< First cluster of INFO.TXT. */
+#define CLUSTER_OBJECT      3                                               /**< First cluster of the object. */
+#define FAT_EOC             0xFFF                                           /**< End of a cluster chain. */
+
+#define DIR_ENTRY_LEN       32
+#define ATTR_READ_ONLY      0x01
+#define ATTR_VOLUME_ID      0x08
+#define ATTR_LFN            0x0F
+#define LFN_CHARS           13                                              /**< Name characters per long name entry. */
+#define LFN_ENTRIES_MAX     CEIL_DIV(OBJ_JOURNAL_NAME_LEN, LFN_CHARS)
+#define FAT_DATE            ((41 << 9) | (1 << 5) | 1)                      /**< 2021-01-01; the dongle has no clock. */
+
+STATIC_ASSERT(CLUSTER_COUNT < 4085);                                        // FAT12.
+STATIC_ASSERT((CLUSTER_COUNT + 2) * 3 / 2 <= FAT_SECTORS * OBJ_DISK_BLOCK_SIZE);
+STATIC_ASSERT(3 + LFN_ENTRIES_MAX <= ROOT_ENTRIES);
+
+static const uint8_t m_object_short_name[11] = {'O', 'B', 'J', 'E', 'C', 'T', ' ', ' ', 'B', 'I', 'N'};
+
+static const nrf_block_dev_geometry_t     m_geometry = {OBJ_DISK_BLOCK_COUNT, OBJ_DISK_BLOCK_SIZE};
+static const nrf_block_dev_info_strings_t m_info_strings =
+{
+    .p_vendor   = "Nordic",
+    .p_product  = "OTS object store",
+    .p_revision = "1.0",
+};
+
+static nrf_block_dev_ev_handler m_ev_handler;
+static void const             * mp_context;
+static obj_journal_entry_t      m_entry;                                    /**< Commit the volume shows. */
+static bool                     m_has_object;
+static char                     m_info[OBJ_DISK_BLOCK_SIZE];                /**< Content of INFO.TXT. */
+static uint16_t                 m_info_len;
+
+
+/**@brief Function for taking the committed object as the content of the volume. */
+static void snapshot_take(void)
+{
+    int len;
+
+    m_has_object = obj_store_current_get(&m_entry);
+
+    if (m_has_object)
+    {
+        len = snprintf(m_info, sizeof(m_info),
+                       "Name: %.*s\r\nSize: %lu\r\nCRC32: %08lX\r\nCommit: %lu\r\n",
+                       (int)strnlen(m_entry.name, sizeof(m_entry.name)), m_entry.name,
+                       (unsigned long)m_entry.size,
+                       (unsigned long)m_entry.checksum,
+                       (unsigned long)m_entry.seq);
+    }
+    else
+    {
+        len = snprintf(m_info, sizeof(m_info), "No object stored\r\n");
+    }
+
+    m_info_len = (uint16_t)MIN((uint32_t)MAX(len, 0), sizeof(m_info) - 1);
+}
+
+
+static uint32_t object_clusters(void)
+{
+    // Not CEIL_DIV, which wraps for an empty object.
+    return m_has_object ? (m_entry.size + OBJ_DISK_BLOCK_SIZE - 1) / OBJ_DISK_BLOCK_SIZE : 0;
+}
+
+
+/**@brief Function for getting the 12-bit FAT entry of a cluster. */
+static uint16_t fat_entry(uint32_t cluster)
+{
+    uint32_t last = CLUSTER_OBJECT + object_clusters() - 1;
+
+    if (cluster == 0)
+    {
+        return 0xFF8;                                                       // Media descriptor.
+    }
+    if ((cluster == 1) || (cluster == CLUSTER_INFO))
+    {
+        return FAT_EOC;
+    }
+    if ((cluster >= CLUSTER_OBJECT) && (cluster <= last) && m_has_object)
+    {
+        return (cluster == last) ? FAT_EOC : (uint16_t)(cluster + 1);
+    }
+
+    return 0;
+}
+
+
+static void fat_sector(uint32_t index, uint8_t * p_dst)
+{
+    for (uint32_t i = 0; i < OBJ_DISK_BLOCK_SIZE; i++)
+    {
+        // Two entries share three bytes.
+        uint32_t byte = index * OBJ_DISK_BLOCK_SIZE + i;
+        uint32_t pair = (byte / 3) * 2;
+
+        switch (byte % 3)
+        {
+            case 0:
+                p_dst[i] = (uint8_t)fat_entry(pair);
+                break;
+
+            case 1:
+                p_dst[i] = (uint8_t)(((fat_entry(pair) >> 8) & 0x0F) | ((fat_entry(pair + 1) & 0x0F) << 4));
+                break;
+
+            default:
+                p_dst[i] = (uint8_t)(fat_entry(pair + 1) >> 4);
+                break;
+        }
+    }
+}
+
+
+static void boot_sector(uint8_t * p_dst)
+{
+    static const uint8_t jump[3] = {0xEB, 0x3C, 0x90};
+
+    memcpy(&p_dst[0], jump, sizeof(jump));
+    memcpy(&p_dst[3], "MSWIN4.1", 8);
+    (void)uint16_encode(OBJ_DISK_BLOCK_SIZE, &p_dst[11]);
+    p_dst[13] = 1;                                                          // Sectors per cluster.
+    (void)uint16_encode(RESERVED_SECTORS, &p_dst[14]);
+    p_dst[16] = FAT_COUNT;
+    (void)uint16_encode(ROOT_ENTRIES, &p_dst[17]);
+    (void)uint16_encode(OBJ_DISK_BLOCK_COUNT, &p_dst[19]);
+    p_dst[21] = 0xF8;                                                       // Fixed disk.
+    (void)uint16_encode(FAT_SECTORS, &p_dst[22]);
+    (void)uint16_encode(1, &p_dst[24]);                                     // Sectors per track.
+    (void)uint16_encode(1, &p_dst[26]);                                     // Heads.
+    p_dst[36] = 0x80;                                                       // Drive number.
+    p_dst[38] = 0x29;                                                       // The next three fields are valid.
+    (void)uint32_encode(0x0B1E0000 | (m_entry.seq & 0xFFFF), &p_dst[39]);   // Volume serial number.
+    memcpy(&p_dst[43], "OTS STORE  ", 11);
+    memcpy(&p_dst[54], "FAT12   ", 8);
+    p_dst[510] = 0x55;
+    p_dst[511] = 0xAA;
+}
+
+
+static void dir_entry_short(uint8_t       * p_dst,
+                            uint8_t const * p_name,
+                            uint8_t         attr,
+                            uint16_t        cluster,
+                            uint32_t        size)
+{
+    memcpy(&p_dst[0], p_name, 11);
+    p_dst[11] = attr;
+    (void)uint16_encode(FAT_DATE, &p_dst[16]);                              // Created.
+    (void)uint16_encode(FAT_DATE, &p_dst[18]);                              // Accessed.
+    (void)uint16_encode(FAT_DATE, &p_dst[24]);                              // Written.
+    (void)uint16_encode(cluster, &p_dst[26]);
+    (void)uint32_encode(size, &p_dst[28]);
+}
+
+
+static uint8_t short_name_checksum(uint8_t const * p_name)
+{
+    uint8_t sum = 0;
+
+    for (uint32_t i = 0; i < 11; i++)
+    {
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + p_name[i]);
+    }
+
+    return sum;
+}
+
+
+/**@brief Function for getting character i of the long name, as FAT stores it. */
+static uint16_t lfn_char(uint32_t i, uint32_t name_len)
+{
+    char c;
+
+    if (i == name_len)
+    {
+        return 0x0000;
+    }
+    if (i > name_len)
+    {
+        return 0xFFFF;
+    }
+
+    c = m_entry.name[i];
+    if (((uint8_t)c < 0x20) || ((uint8_t)c > 0x7E) || (strchr("\"*/:<>?\\|", c) != NULL))
+    {
+        return '_';
+    }
+
+    return (uint16_t)c;
+}
+
+
+/**@brief Function for writing the long name entries of the object, last part first.
+ *
+ * @return Number of entries written.
+ */
+static uint32_t dir_entries_lfn(uint8_t * p_dst)
+{
+    static const uint8_t offsets[LFN_CHARS] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+
+    uint32_t name_len = strnlen(m_entry.name, sizeof(m_entry.name));
+    uint32_t count    = (name_len + LFN_CHARS - 1) / LFN_CHARS;
+    uint8_t  checksum = short_name_checksum(m_object_short_name);
+
+    for (uint32_t n = count; n > 0; n--)
+    {
+        uint8_t * p_entry = p_dst + (count - n) * DIR_ENTRY_LEN;
+
+        p_entry[0]  = (uint8_t)(n | ((n == count) ? 0x40 : 0));
+        p_entry[11] = ATTR_LFN;
+        p_entry[13] = checksum;
+        for (uint32_t i = 0; i < LFN_CHARS; i++)
+        {
+            (void)uint16_encode(lfn_char((n - 1) * LFN_CHARS + i, name_len), &p_entry[offsets[i]]);
+        }
+    }
+
+    return count;
+}
+
+
+static void root_sector(uint8_t * p_dst)
+{
+    uint8_t * p_entry = p_dst;
+
+    dir_entry_short(p_entry, (uint8_t const *)"OTS STORE  ", ATTR_VOLUME_ID, 0, 0);
+    p_entry += DIR_ENTRY_LEN;
+
+    dir_entry_short(p_entry, (uint8_t const *)"INFO    TXT", ATTR_READ_ONLY, CLUSTER_INFO, m_info_len);
+    p_entry += DIR_ENTRY_LEN;
+
+    if (m_has_object)
+    {
+        p_entry += dir_entries_lfn(p_entry) * DIR_ENTRY_LEN;
+        dir_entry_short(p_entry,
+                        m_object_short_name,
+                        ATTR_READ_ONLY,
+                        (m_entry.size > 0) ? CLUSTER_OBJECT : 0,
+                        m_entry.size);
+    }
+}
+
+
+/**@brief Function for reading one cluster of the object.
+ *
+ * @retval true   Read.
+ * @retval false  The object was replaced after the snapshot; its data is no longer there.
+ */
+static bool object_sector(uint32_t index, uint8_t * p_dst)
+{
+    obj_journal_entry_t current;
+    uint32_t            offset = index * OBJ_DISK_BLOCK_SIZE;
+
+    // Erases run from the idle loop, so a run that is current here stays intact for this call.
+    if (!obj_store_current_get(&current) || (current.seq != m_entry.seq))
+    {
+        return false;
+    }
+
+    return flash_log_read(&m_entry.run, offset, p_dst, MIN(m_entry.size - offset, OBJ_DISK_BLOCK_SIZE)) == NRF_SUCCESS;
+}
+
+
+/**@brief Function for computing one sector of the volume.
+ *
+ * @retval true   Computed.
+ * @retval false  The sector's data is gone.
+ */
+static bool sector_read(uint32_t lba, uint8_t * p_dst)
+{
+    uint32_t cluster;
+
+    memset(p_dst, 0, OBJ_DISK_BLOCK_SIZE);
+
+    if (lba == 0)
+    {
+        // Hosts read the boot sector when they mount the volume.
+        snapshot_take();
+        boot_sector(p_dst);
+        return true;
+    }
+    if (lba < ROOT_LBA)
+    {
+        fat_sector((lba - RESERVED_SECTORS) % FAT_SECTORS, p_dst);
+        return true;
+    }
+    if (lba == ROOT_LBA)
+    {
+        root_sector(p_dst);
+        return true;
+    }
+
+    cluster = lba - DATA_LBA + 2;
+    if (cluster == CLUSTER_INFO)
+    {
+        memcpy(p_dst, m_info, m_info_len);
+        return true;
+    }
+    if ((cluster >= CLUSTER_OBJECT) && (cluster < CLUSTER_OBJECT + object_clusters()))
+    {
+        return object_sector(cluster - CLUSTER_OBJECT, p_dst);
+    }
+
+    return true;
+}
+
+
+static ret_code_t disk_init(nrf_block_dev_t const * p_blk_dev,
+                            nrf_block_dev_ev_handler ev_handler,
+                            void const             * p_context)
+{
+    m_ev_handler = ev_handler;
+    mp_context   = p_context;
+    snapshot_take();
+
+    if (m_ev_handler != NULL)
+    {
+        nrf_block_dev_event_t ev =
+        {
+            .ev_type   = NRF_BLOCK_DEV_EVT_INIT,
+            .result    = NRF_BLOCK_DEV_RESULT_SUCCESS,
+            .p_blk_req = NULL,
+            .p_context = mp_context,
+        };
+        m_ev_handler(p_blk_dev, &ev);
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+static ret_code_t disk_uninit(nrf_block_dev_t const * p_blk_dev)
+{
+    if (m_ev_handler != NULL)
+    {
+        nrf_block_dev_event_t ev =
+        {
+            .ev_type   = NRF_BLOCK_DEV_EVT_UNINIT,
+            .result    = NRF_BLOCK_DEV_RESULT_SUCCESS,
+            .p_blk_req = NULL,
+            .p_context = mp_context,
+        };
+        m_ev_handler(p_blk_dev, &ev);
+    }
+    m_ev_handler = NULL;
+
+    return NRF_SUCCESS;
+}
+
+
+static ret_code_t disk_read_req(nrf_block_dev_t const * p_blk_dev, nrf_block_req_t const * p_blk)
+{
+    nrf_block_dev_result_t result = NRF_BLOCK_DEV_RESULT_SUCCESS;
+    uint8_t              * p_dst  = p_blk->p_buff;
+
+    if ((p_blk->blk_id + p_blk->blk_count) > OBJ_DISK_BLOCK_COUNT)
+    {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+
+    for (uint32_t i = 0; i < p_blk->blk_count; i++)
+    {
+        if (!sector_read(p_blk->blk_id + i, p_dst + i * OBJ_DISK_BLOCK_SIZE))
+        {
+            result = NRF_BLOCK_DEV_RESULT_IO_ERROR;
+        }
+    }
+
+    if (m_ev_handler != NULL)
+    {
+        // Sectors are computed in place, so the request completes before this function returns.
+        nrf_block_dev_event_t ev =
+        {
+            .ev_type   = NRF_BLOCK_DEV_EVT_BLK_READ_DONE,
+            .result    = result,
+            .p_blk_req = p_blk,
+            .p_context = mp_context,
+        };
+        m_ev_handler(p_blk_dev, &ev);
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+static ret_code_t disk_write_req(nrf_block_dev_t const * p_blk_dev, nrf_block_req_t const * p_blk)
+{
+    if (m_ev_handler != NULL)
+    {
+        // The volume is a view of the store; nothing written to it could be kept.
+        nrf_block_dev_event_t ev =
+        {
+            .ev_type   = NRF_BLOCK_DEV_EVT_BLK_WRITE_DONE,
+            .result    = NRF_BLOCK_DEV_RESULT_IO_ERROR,
+            .p_blk_req = p_blk,
+            .p_context = mp_context,
+        };
+        m_ev_handler(p_blk_dev, &ev);
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+static ret_code_t disk_ioctl(nrf_block_dev_t const * p_blk_dev, nrf_block_dev_ioctl_req_t req, void * p_data)
+{
+    switch (req)
+    {
+        case NRF_BLOCK_DEV_IOCTL_REQ_CACHE_FLUSH:
+            if (p_data != NULL)
+            {
+                *(bool *)p_data = false;                                    // Nothing is cached.
+            }
+            return NRF_SUCCESS;
+
+        case NRF_BLOCK_DEV_IOCTL_REQ_INFO_STRINGS:
+            if (p_data == NULL)
+            {
+                return NRF_ERROR_INVALID_PARAM;
+            }
+            *(nrf_block_dev_info_strings_t const **)p_data = &m_info_strings;
+            return NRF_SUCCESS;
+
+        default:
+            return NRF_ERROR_NOT_SUPPORTED;
+    }
+}
+
+
+static nrf_block_dev_geometry_t const * disk_geometry(nrf_block_dev_t const * p_blk_dev)
+{
+    return &m_geometry;
+}
+
+
+const nrf_block_dev_ops_t obj_disk_ops =
+{
+    .init      = disk_init,
+    .uninit    = disk_uninit,
+    .read_req  = disk_read_req,
+    .write_req = disk_write_req,
+    .ioctl     = disk_ioctl,
+    .geometry  = disk_geometry,
+};
@@ -0,0 +1,78 @@
+/**@file
+ *
+ * @defgroup obj_disk Object store disk
+ * @{
+ * @brief Read-only block device that shows the stored object as a file on a FAT12 volume.
+ *
+ * @details The volume is given to the USB Mass Storage class, so the host can copy the object
+ *          with its own file tools, at bulk endpoint speed. No sector of it is stored: each one
+ *          is computed when the host reads it, from the committed copy in @ref obj_store. The
+ *          object's data is read straight from its @ref flash_log run.
+ *
+ *          | Sector  | Content                                                       |
+ *          |---------|---------------------------------------------------------------|
+ *          | 0       | Boot sector, one sector per cluster                           |
+ *          | 1-6     | Two copies of the FAT                                         |
+ *          | 7       | Root directory: volume label, INFO.TXT, the object            |
+ *          | 8       | INFO.TXT, cluster 2: name, size, CRC32 and commit of the object |
+ *          | 9-      | The object, from cluster 3 on, in consecutive clusters        |
+ *
+ *          The object's file keeps the name it was written with, as a long file name; its short
+ *          name is OBJECT.BIN. Characters FAT does not allow in names become underscores.
+ *
+ *          The volume describes the object committed when the host last read the boot sector,
+ *          which hosts do when they mount it. If a newer object is committed afterwards, reads
+ *          of the old object's data fail with an I/O error instead of returning the new data;
+ *          the host sees the new object once it mounts the volume again.
+ *
+ *          Writes fail with an I/O error, but the host is not told beforehand that the volume is
+ *          read-only. The MSC class of the SDK always answers MODE SENSE with the write protect
+ *          bit clear and gives the block device no way to set it. Hosts therefore mount the
+ *          volume read-write. A file copied onto it, or the dirty flag some hosts set on mount,
+ *          fails only when the host writes it back, and data the host had cached is lost.
+ *          Mount the volume read-only, as tools/obj_disk.py --mount does.
+ *
+ *          tools/obj_disk.py reads the volume back, from the device or from an image of it,
+ *          and checks the object against the CRC32 that INFO.TXT gives.
+ */
+#ifndef OBJ_DISK_H__
+#define OBJ_DISK_H__
+
+#include <stdint.h>
+#include "nrf_block_dev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBJ_DISK_BLOCK_SIZE     512         /**< Sector size. */
+#define OBJ_DISK_BLOCK_COUNT    1024        /**< Sectors in the volume; the object can be up to 507 kB. */
+
+
+/**@brief Block device instance. */
+typedef struct
+{
+    nrf_block_dev_t block_dev;              /**< Block device, for the MSC class. */
+} obj_disk_t;
+
+extern const nrf_block_dev_ops_t obj_disk_ops;
+
+
+/**@brief Macro for defining the block device instance. There can be only one.
+ *
+ * @param name  Name of the instance. Give NRF_BLOCKDEV_BASE_ADDR(name, block_dev) to the MSC class.
+ */
+#define OBJ_DISK_DEF(name)                                  \
+    static const obj_disk_t name =                          \
+    {                                                       \
+        .block_dev = { .p_ops = &obj_disk_ops },            \
+    }
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OBJ_DISK_H__
+
+/** @} */
@@ -0,0 +1,249 @@
+#include <string.h>
+#include "obj_journal.h"
+#include "sdk_common.h"
+#include "fds.h"
+#include "crc32.h"
+#include "transfer_metrics.h"
+
+
+/**@brief Commit record as stored in FDS. */
+typedef struct
+{
+    obj_journal_entry_t entry;
+    uint32_t            crc;                    /**< CRC32 of @ref entry. */
+} journal_record_t;
+
+STATIC_ASSERT(sizeof(journal_record_t) == OBJ_JOURNAL_RECORD_WORDS * sizeof(uint32_t));
+
+static obj_journal_evt_handler_t m_handler;
+static bool                      m_ready;       /**< The journal has been read. */
+static bool                      m_committing;
+static bool                      m_gc_wait;     /**< The commit waits for garbage collection. */
+static journal_record_t          m_record;      /**< Record being written; FDS reads it until the write completes. */
+static obj_journal_entry_t       m_recovered;
+static uint32_t                  m_next_seq;
+static uint32_t                  m_last_id;     /**< FDS record ID of the newest commit. */
+static bool                      m_last_valid;
+static uint32_t                  m_started;     /**< When the commit was asked for. */
+
+
+static bool record_is_valid(fds_flash_record_t const * p_record)
+{
+    journal_record_t const * p_data = p_record->p_data;
+
+    return (p_record->p_header->length_words == OBJ_JOURNAL_RECORD_WORDS) &&
+           (crc32_compute((uint8_t const *)&p_data->entry, sizeof(p_data->entry), NULL) == p_data->crc);
+}
+
+
+/**@brief Function for finding the newest valid commit and deleting every other record.
+ *
+ * @return NRF_SUCCESS, or FDS_ERR_NOT_INITIALIZED if FDS is not ready yet.
+ */
+static ret_code_t journal_read(void)
+{
+    fds_record_desc_t  desc;
+    fds_find_token_t   token = {0};
+    fds_flash_record_t record;
+    obj_journal_evt_t  evt;
+    ret_code_t         err_code;
+
+    err_code = fds_record_find(OBJ_JOURNAL_FILE_ID, OBJ_JOURNAL_RECORD_KEY, &desc, &token);
+    if (err_code == FDS_ERR_NOT_INITIALIZED)
+    {
+        return err_code;
+    }
+
+    m_last_valid = false;
+
+    for (; err_code == NRF_SUCCESS;
+         err_code = fds_record_find(OBJ_JOURNAL_FILE_ID, OBJ_JOURNAL_RECORD_KEY, &desc, &token))
+    {
+        if (fds_record_open(&desc, &record) != NRF_SUCCESS)
+        {
+            continue;
+        }
+
+        if (record_is_valid(&record))
+        {
+            journal_record_t const * p_data = record.p_data;
+
+            if (!m_last_valid || (p_data->entry.seq > m_recovered.seq))
+            {
+                m_recovered  = p_data->entry;
+                m_last_id    = desc.record_id;
+                m_last_valid = true;
+            }
+        }
+
+        (void)fds_record_close(&desc);
+    }
+
+    // A reset between a commit and the delete that follows it leaves an older record behind.
+    // Records that fail here are deleted again at the next start.
+    memset(&token, 0, sizeof(token));
+    while (fds_record_find(OBJ_JOURNAL_FILE_ID, OBJ_JOURNAL_RECORD_KEY, &desc, &token) == NRF_SUCCESS)
+    {
+        if (!m_last_valid || (desc.record_id != m_last_id))
+        {
+            (void)fds_record_delete(&desc);
+        }
+    }
+
+    m_next_seq = m_last_valid ? m_recovered.seq + 1 : 0;
+    m_ready    = true;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.type    = OBJ_JOURNAL_EVT_RECOVERED;
+    evt.p_entry = m_last_valid ? &m_recovered : NULL;
+    m_handler(&evt);
+
+    return NRF_SUCCESS;
+}
+
+
+static ret_code_t record_write(void)
+{
+    fds_record_t record =
+    {
+        .file_id           = OBJ_JOURNAL_FILE_ID,
+        .key               = OBJ_JOURNAL_RECORD_KEY,
+        .data.p_data       = &m_record,
+        .data.length_words = OBJ_JOURNAL_RECORD_WORDS,
+    };
+
+    return fds_record_write(NULL, &record);
+}
+
+
+static void commit_done(ret_code_t result, uint32_t record_id)
+{
+    obj_journal_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    m_committing   = false;
+    evt.result     = result;
+    evt.latency_us = transfer_metrics_elapsed_us(m_started);
+
+    if (result == NRF_SUCCESS)
+    {
+        if (m_last_valid)
+        {
+            fds_record_desc_t desc;
+
+            // Left behind if this fails; the next start deletes it.
+            (void)fds_descriptor_from_rec_id(&desc, m_last_id);
+            (void)fds_record_delete(&desc);
+        }
+
+        m_last_id    = record_id;
+        m_last_valid = true;
+        m_next_seq++;
+
+        evt.type    = OBJ_JOURNAL_EVT_COMMITTED;
+        evt.p_entry = &m_record.entry;
+    }
+    else
+    {
+        evt.type = OBJ_JOURNAL_EVT_COMMIT_FAILED;
+    }
+
+    m_handler(&evt);
+}
+
+
+static void fds_evt_handler(fds_evt_t const * p_evt)
+{
+    ret_code_t err_code;
+
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            if ((p_evt->result == NRF_SUCCESS) && !m_ready)
+            {
+                (void)journal_read();
+            }
+            break;
+
+        case FDS_EVT_WRITE:
+            if (m_committing && !m_gc_wait && (p_evt->write.file_id == OBJ_JOURNAL_FILE_ID))
+            {
+                commit_done(p_evt->result, p_evt->write.record_id);
+            }
+            break;
+
+        case FDS_EVT_GC:
+            if (m_gc_wait)
+            {
+                // Garbage collection run by another FDS user frees the space as well.
+                m_gc_wait = false;
+                err_code  = (p_evt->result == NRF_SUCCESS) ? record_write() : p_evt->result;
+                if (err_code != NRF_SUCCESS)
+                {
+                    commit_done(err_code, 0);
+                }
+            }
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+
+ret_code_t obj_journal_commit(obj_journal_entry_t const * p_entry)
+{
+    ret_code_t err_code;
+
+    if (!m_ready)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (m_committing)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    m_record.entry     = *p_entry;
+    m_record.entry.seq = m_next_seq;
+    m_record.crc       = crc32_compute((uint8_t const *)&m_record.entry, sizeof(m_record.entry), NULL);
+    m_started          = transfer_metrics_timestamp();
+
+    err_code = record_write();
+    if (err_code == FDS_ERR_NO_SPACE_IN_FLASH)
+    {
+        // Deleted commits still take space until garbage collection.
+        err_code  = fds_gc();
+        m_gc_wait = (err_code == NRF_SUCCESS);
+    }
+    VERIFY_SUCCESS(err_code);
+
+    m_committing = true;
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t obj_journal_init(obj_journal_evt_handler_t handler)
+{
+    ret_code_t err_code;
+
+    if (handler == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    m_handler    = handler;
+    m_ready      = false;
+    m_committing = false;
+    m_gc_wait    = false;
+
+    err_code = fds_register(fds_evt_handler);
+    VERIFY_SUCCESS(err_code);
+
+    // The Peer Manager starts FDS; it may be ready already.
+    err_code = journal_read();
+
+    return (err_code == FDS_ERR_NOT_INITIALIZED) ? NRF_SUCCESS : err_code;
+}
@@ -0,0 +1,105 @@
+/**@file
+ *
+ * @defgroup obj_journal Object commit journal
+ * @{
+ * @brief Write-ahead journal of the stored object's metadata, kept in FDS records.
+ *
+ * @details The object data lives in a @ref flash_log run. What makes it the stored object is a
+ *          single commit record: sequence number, run location (which gives its pages, since a
+ *          run covers consecutive pages of the ring), size, CRC32 of the data and name, with a
+ *          CRC32 of the record itself. A commit is one FDS record write of
+ *          @ref OBJ_JOURNAL_RECORD_WORDS words; the record it supersedes is deleted afterwards.
+ *          Nothing else about the object is rewritten.
+ *
+ *          FDS writes the record ID word last, so a record cut short by a reset is never found.
+ *          After a reset, the valid record with the highest sequence number is the stored object
+ *          and older records are deleted. Callers commit only once the run's data is in flash,
+ *          and release the previous run only once the commit is done, so at any moment the
+ *          newest complete record points to data that is complete and has not been erased.
+ *
+ *          tools/journal_fuzz.py models this protocol, cuts power at random flash operations and
+ *          checks what recovery finds; it also gives the commit latency.
+ */
+#ifndef OBJ_JOURNAL_H__
+#define OBJ_JOURNAL_H__
+
+#include <stdint.h>
+#include "flash_log.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBJ_JOURNAL_FILE_ID         0x0B1E      /**< FDS file of the journal. Below the range the Peer Manager uses. */
+#define OBJ_JOURNAL_RECORD_KEY      0x0001      /**< FDS key of commit records. */
+#define OBJ_JOURNAL_NAME_LEN        32          /**< Bytes of the object name kept, NUL padded. Longer names are cut. */
+
+
+/**@brief Metadata of a committed object. */
+typedef struct
+{
+    uint32_t        seq;                            /**< Commit sequence number. Set by @ref obj_journal_commit. */
+    flash_log_run_t run;                            /**< Location of the data. */
+    uint32_t        size;                           /**< Object size. */
+    uint32_t        checksum;                       /**< CRC32 of the data. */
+    char            name[OBJ_JOURNAL_NAME_LEN];     /**< Object name. */
+} obj_journal_entry_t;
+
+#define OBJ_JOURNAL_RECORD_WORDS    ((sizeof(obj_journal_entry_t) + sizeof(uint32_t)) / sizeof(uint32_t)) /**< Record length, with its CRC. */
+
+
+/**@brief Journal event types. */
+typedef enum
+{
+    OBJ_JOURNAL_EVT_RECOVERED,                      /**< The journal was read after a reset. */
+    OBJ_JOURNAL_EVT_COMMITTED,                      /**< A commit record is in flash. */
+    OBJ_JOURNAL_EVT_COMMIT_FAILED,                  /**< A commit record could not be written. */
+} obj_journal_evt_type_t;
+
+
+/**@brief Journal event. */
+typedef struct
+{
+    obj_journal_evt_type_t      type;
+    obj_journal_entry_t const * p_entry;            /**< Recovered or committed entry. NULL if nothing was recovered or the commit failed. */
+    ret_code_t                  result;             /**< FDS error of a failed commit. */
+    uint32_t                    latency_us;         /**< Time from @ref obj_journal_commit to the record being in flash. */
+} obj_journal_evt_t;
+
+
+/**@brief Journal event handler type. */
+typedef void (*obj_journal_evt_handler_t)(obj_journal_evt_t const * p_evt);
+
+
+/**@brief Function for initializing the journal.
+ *
+ * @details Registers with FDS. The journal is read as soon as FDS is initialized, which can be
+ *          before this function returns; @ref OBJ_JOURNAL_EVT_RECOVERED follows in either case.
+ *
+ * @param[in] handler  Event handler.
+ *
+ * @return NRF_SUCCESS or an error code from FDS.
+ */
+ret_code_t obj_journal_init(obj_journal_evt_handler_t handler);
+
+
+/**@brief Function for committing an object.
+ *
+ * @details The run's data must be in flash already. The entry is copied.
+ *
+ * @param[in] p_entry  Object to commit. Its sequence number is ignored.
+ *
+ * @return NRF_SUCCESS, NRF_ERROR_INVALID_STATE if the journal has not been read yet,
+ *         NRF_ERROR_BUSY if a commit is in progress, or an error code from FDS.
+ */
+ret_code_t obj_journal_commit(obj_journal_entry_t const * p_entry);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OBJ_JOURNAL_H__
+
+/** @} */
@@ -0,0 +1,313 @@
+#include <string.h>
+#include "obj_store.h"
+#include "sdk_common.h"
+#include "app_error.h"
+#include "ble.h"
+#include "nordic_common.h"
+#include "nrf_sdh_ble.h"
+#include "crc32.h"
+#include "flash_log.h"
+#include "obj_journal.h"
+#include "transfer_metrics.h"
+#include "msg.h"
+
+
+static ble_ots_object_t           * mp_object;
+static obj_store_restore_handler_t  m_restore_handler;
+static bool                         m_ready;                                /**< The journal has been read and the committed run claimed. */
+static uint16_t                     m_conn_handle = BLE_CONN_HANDLE_INVALID; /**< Link whose SDUs go to the open run. */
+static bool                         m_run_ok;                               /**< Every SDU of the open run was appended. */
+static obj_journal_entry_t          m_current;                              /**< Committed copy of the object. */
+static bool                         m_current_valid;
+static obj_journal_entry_t          m_staged;                               /**< Complete copy waiting for its data to reach flash. */
+static volatile bool                m_staged_valid;
+static flash_log_run_t              m_committing;                           /**< Copy whose commit record is being written. */
+static bool                         m_commit_busy;
+static uint32_t                     m_received;                             /**< When the staged copy's object was received. */
+
+
+/**@brief Function for writing the object from RAM as a new run. */
+static ret_code_t object_write(flash_log_run_t * p_run)
+{
+    ret_code_t err_code;
+
+    err_code = flash_log_run_begin();
+    VERIFY_SUCCESS(err_code);
+
+    err_code = flash_log_append(mp_object->data, mp_object->current_size);
+    if (err_code != NRF_SUCCESS)
+    {
+        flash_log_run_abort();
+        return err_code;
+    }
+
+    return flash_log_run_end(p_run);
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    ble_data_t const * p_sdu;
+
+    if ((m_conn_handle == BLE_CONN_HANDLE_INVALID) ||
+        (p_ble_evt->evt.gap_evt.conn_handle != m_conn_handle))
+    {
+        return;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_L2CAP_EVT_CH_RX:
+            p_sdu = &p_ble_evt->evt.l2cap_evt.params.rx.sdu_buf;
+            if (m_run_ok && (flash_log_append(p_sdu->p_data, p_sdu->len) != NRF_SUCCESS))
+            {
+                // The object is written from RAM once it is complete.
+                m_run_ok = false;
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            flash_log_run_abort();
+            m_conn_handle = BLE_CONN_HANDLE_INVALID;
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_obj_store_obs, OBJ_STORE_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+void obj_store_write_begin(uint16_t conn_handle)
+{
+    // A write that never completed leaves its run open.
+    flash_log_run_abort();
+
+    m_conn_handle = conn_handle;
+    m_run_ok      = m_ready && (flash_log_run_begin() == NRF_SUCCESS);
+}
+
+
+void obj_store_object_received(void)
+{
+    flash_log_run_t   run;
+    flash_log_stats_t stats;
+    ret_code_t        err_code = NRF_ERROR_INVALID_STATE;
+
+    if (!m_ready)
+    {
+        // The committed run's pages are not claimed yet; a new run could overwrite them.
+        msg("Store: object not saved, journal not read yet\r\n");
+        return;
+    }
+
+    if ((m_conn_handle != BLE_CONN_HANDLE_INVALID) && m_run_ok)
+    {
+        err_code = flash_log_run_end(&run);
+        if ((err_code == NRF_SUCCESS) && (run.len != mp_object->current_size))
+        {
+            // Only part of the object was sent, at an offset.
+            flash_log_run_release(&run);
+            err_code = NRF_ERROR_INVALID_LENGTH;
+        }
+    }
+    else
+    {
+        flash_log_run_abort();
+    }
+    m_conn_handle = BLE_CONN_HANDLE_INVALID;
+
+    if (err_code != NRF_SUCCESS)
+    {
+        err_code = object_write(&run);
+    }
+    if (err_code != NRF_SUCCESS)
+    {
+        msg("Store: object not saved (0x%x)\r\n", err_code);
+        return;
+    }
+
+    if (m_staged_valid)
+    {
+        // Superseded before it was committed.
+        flash_log_run_release(&m_staged.run);
+    }
+
+    memset(&m_staged, 0, sizeof(m_staged));
+    m_staged.run      = run;
+    m_staged.size     = mp_object->current_size;
+    m_staged.checksum = crc32_compute(mp_object->data, mp_object->current_size, NULL);
+    strncpy(m_staged.name, mp_object->name, sizeof(m_staged.name));
+    m_staged_valid    = true;
+    m_received        = transfer_metrics_timestamp();
+
+    flash_log_stats_get(&stats);
+    msg("Store: %u bytes at page %u, %u pages erased ahead, %u erased on the write path\r\n",
+        run.len, run.page, stats.erased_ahead, stats.path_erases);
+}
+
+
+void obj_store_process(void)
+{
+    ret_code_t err_code;
+
+    if (!m_ready || m_commit_busy)
+    {
+        // No erases before the committed run is claimed, nor while a commit waits for flash.
+        return;
+    }
+
+    if (m_staged_valid)
+    {
+        obj_journal_entry_t staged;
+        bool                taken = false;
+
+        // The staged copy is set from the BLE event handler; take it in one step. The record
+        // may only point to data that is in flash.
+        CRITICAL_REGION_ENTER();
+        if (!flash_log_is_busy())
+        {
+            staged         = m_staged;
+            m_staged_valid = false;
+            taken          = true;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (!taken)
+        {
+            return;
+        }
+
+        err_code = obj_journal_commit(&staged);
+        if (err_code == NRF_SUCCESS)
+        {
+            m_committing  = staged.run;
+            m_commit_busy = true;
+        }
+        else
+        {
+            msg("Store: commit not started (0x%x)\r\n", err_code);
+            flash_log_run_release(&staged.run);
+        }
+        return;
+    }
+
+    flash_log_process();
+}
+
+
+/**@brief Function for loading the committed object found after a reset. */
+static void object_restore(obj_journal_entry_t const * p_entry)
+{
+    ret_code_t err_code;
+
+    err_code = flash_log_run_claim(&p_entry->run);
+    if (err_code != NRF_SUCCESS)
+    {
+        msg("Store: commit %u points to pages that do not hold it (0x%x)\r\n", p_entry->seq, err_code);
+        return;
+    }
+
+    if ((p_entry->size != p_entry->run.len) ||
+        (p_entry->size > mp_object->alloc_len) ||
+        (flash_log_read(&p_entry->run, 0, mp_object->data, p_entry->size) != NRF_SUCCESS) ||
+        (crc32_compute(mp_object->data, p_entry->size, NULL) != p_entry->checksum))
+    {
+        msg("Store: commit %u does not match its data\r\n", p_entry->seq);
+        flash_log_run_release(&p_entry->run);
+        return;
+    }
+
+    mp_object->current_size = p_entry->size;
+    memset(mp_object->name, 0, sizeof(mp_object->name));
+    memcpy(mp_object->name, p_entry->name, MIN(sizeof(mp_object->name) - 1, sizeof(p_entry->name)));
+
+    m_current       = *p_entry;
+    m_current_valid = true;
+
+    msg("Store: restored %u bytes from commit %u\r\n", p_entry->size, p_entry->seq);
+
+    if (m_restore_handler != NULL)
+    {
+        m_restore_handler();
+    }
+}
+
+
+static void journal_evt_handler(obj_journal_evt_t const * p_evt)
+{
+    switch (p_evt->type)
+    {
+        case OBJ_JOURNAL_EVT_RECOVERED:
+            if (p_evt->p_entry != NULL)
+            {
+                object_restore(p_evt->p_entry);
+            }
+            m_ready = true;
+            break;
+
+        case OBJ_JOURNAL_EVT_COMMITTED:
+            // Only now may the previous copy's pages be erased.
+            if (m_current_valid)
+            {
+                flash_log_run_release(&m_current.run);
+            }
+            m_current       = *p_evt->p_entry;
+            m_current_valid = true;
+            m_commit_busy   = false;
+            msg("Store: commit %u in flash %u us after the object arrived, record written in %u us\r\n",
+                p_evt->p_entry->seq, transfer_metrics_elapsed_us(m_received), p_evt->latency_us);
+            break;
+
+        case OBJ_JOURNAL_EVT_COMMIT_FAILED:
+            flash_log_run_release(&m_committing);
+            m_commit_busy = false;
+            msg("Store: commit failed (0x%x)\r\n", p_evt->result);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+bool obj_store_current_get(obj_journal_entry_t * p_entry)
+{
+    if (m_current_valid)
+    {
+        *p_entry = m_current;
+    }
+
+    return m_current_valid;
+}
+
+
+ret_code_t obj_store_init(ble_ots_object_t * p_object, obj_store_restore_handler_t restore_handler)
+{
+    ret_code_t err_code;
+
+    if (p_object == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    mp_object         = p_object;
+    m_restore_handler = restore_handler;
+    m_ready           = false;
+    m_conn_handle     = BLE_CONN_HANDLE_INVALID;
+    m_current_valid   = false;
+    m_staged_valid    = false;
+    m_commit_busy     = false;
+
+    err_code = flash_log_init();
+    VERIFY_SUCCESS(err_code);
+
+    return obj_journal_init(journal_evt_handler);
+}
@@ -0,0 +1,90 @@
+/**@file
+ *
+ * @defgroup obj_store Flash-backed object store
+ * @{
+ * @brief Keeps a copy of the OTS object in flash, written while the object arrives.
+ *
+ * @details An OACP Write opens a run in @ref flash_log for the link that asked for it. The
+ *          module's BLE observer runs ahead of OTS and appends every SDU received on that link to
+ *          the run, so the data reaches flash during the transfer, on pages erased beforehand.
+ *          When the object is complete and its data has reached flash, one @ref obj_journal record
+ *          commits the run as the stored copy. Only then are the previous copy's pages released,
+ *          so a reset at any point leaves either the old or the new copy. While an object is
+ *          arriving, the commit of the one before it waits for the transfer to end.
+ *
+ *          If the SDUs do not add up to the object, because the write did not start at offset 0 or
+ *          the log ran out of room, or if the object came over the GATT bulk service, the whole
+ *          object is written from RAM instead.
+ *
+ *          After a reset, the committed copy is read back into the OTS object.
+ */
+#ifndef OBJ_STORE_H__
+#define OBJ_STORE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble_ots.h"
+#include "obj_journal.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBJ_STORE_BLE_OBSERVER_PRIO     1       /**< Priority of the BLE observer. Ahead of OTS, which hands the SDU buffer back to the SoftDevice. */
+
+
+/**@brief Handler called when the object has been restored from flash. */
+typedef void (*obj_store_restore_handler_t)(void);
+
+
+/**@brief Function for initializing the store, the flash log and the journal under it.
+ *
+ * @details Must be called after the Peer Manager, which starts FDS. The committed copy is
+ *          restored once FDS is ready, which can be before this function returns.
+ *
+ * @param[in] p_object         Object shared with OTS. Filled in when the committed copy is restored.
+ * @param[in] restore_handler  Called after the object was restored. Can be NULL.
+ *
+ * @return NRF_SUCCESS or an error code from @ref flash_log_init or @ref obj_journal_init.
+ */
+ret_code_t obj_store_init(ble_ots_object_t * p_object, obj_store_restore_handler_t restore_handler);
+
+
+/**@brief Function for starting to store the SDUs of an OACP Write.
+ *
+ * @param[in] conn_handle  Link the object is written on.
+ */
+void obj_store_write_begin(uint16_t conn_handle);
+
+
+/**@brief Function for making the received object the stored copy. */
+void obj_store_object_received(void);
+
+
+/**@brief Function for doing flash work that can wait for idle time: commits and erases. Call from
+ *        the idle loop.
+ */
+void obj_store_process(void);
+
+
+/**@brief Function for getting the committed copy of the object.
+ *
+ * @details Its run stays readable until a newer copy is committed, which changes the sequence
+ *          number, and is only erased from the idle loop after that.
+ *
+ * @param[out] p_entry  Commit of the copy.
+ *
+ * @retval true   There is a committed copy.
+ * @retval false  Nothing is committed.
+ */
+bool obj_store_current_get(obj_journal_entry_t * p_entry);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OBJ_STORE_H__
+
+/** @} */
@@ -0,0 +1,690 @@
+#include <string.h>
+#include "ots_collector.h"
+#include "ble.h"
+#include "ble_db_discovery.h"
+#include "ble_hci.h"
+#include "ble_ots_c.h"
+#include "nrf_ble_scan.h"
+#include "nrf_sdh_ble.h"
+#include "msg.h"
+#include "transfer_metrics.h"
+#include "usb_stream.h"
+
+
+#define ADDR_LEN    BLE_GAP_ADDR_LEN    /**< Length of the address at the start of every frame. */
+
+/**@brief Progress of the transfer on a collector link. */
+typedef enum
+{
+    COLLECT_STATE_IDLE,                 /**< Entry is free. */
+    COLLECT_STATE_DISCOVERING,          /**< Discovering OTS on the sensor node. */
+    COLLECT_STATE_SIZE_READ,            /**< Reading the size of the current object. */
+    COLLECT_STATE_CHANNEL_SETUP,        /**< Opening the L2CAP CoC. */
+    COLLECT_STATE_RECEIVING,            /**< OACP Read issued, receiving SDUs. */
+    COLLECT_STATE_CLOSING,              /**< Transfer ended, waiting for the disconnection. */
+} collect_state_t;
+
+/**@brief Sensor node seen while scanning. */
+typedef struct
+{
+    ble_gap_addr_t addr;                /**< Address of the node. */
+    int8_t         rssi;                /**< RSSI of the last advertising report. */
+    uint32_t       seen_ticks;          /**< Timestamp of the last advertising report. */
+    uint32_t       collected_ticks;     /**< Timestamp of the last complete transfer. */
+    bool           collected;           /**< collected_ticks is valid. */
+    bool           in_use;              /**< Entry holds a node. */
+} candidate_t;
+
+/**@brief State of one collector link. */
+typedef struct
+{
+    uint16_t        conn_handle;                        /**< Connection handle, BLE_CONN_HANDLE_INVALID if the entry is free. */
+    collect_state_t state;                              /**< Transfer progress. */
+    ble_gap_addr_t  peer_addr;                          /**< Address of the sensor node. */
+    uint16_t        local_cid;                          /**< L2CAP channel ID. */
+    uint32_t        object_size;                        /**< Size of the object being collected. */
+    uint32_t        received;                           /**< Bytes received so far. */
+    uint32_t        dropped;                            /**< Bytes that did not fit in the USB stream. */
+    uint32_t        started_ticks;                      /**< Timestamp of the OACP Read. */
+    sdu_buf_t     * p_rx;                               /**< Pool buffer the SoftDevice receives into. */
+} collector_link_t;
+
+NRF_BLE_SCAN_DEF(m_scan);
+BLE_DB_DISCOVERY_ARRAY_DEF(m_db_disc, OTS_COLLECTOR_LINK_COUNT);
+
+static nrf_ble_ots_c_t m_ots_c[OTS_COLLECTOR_LINK_COUNT];
+NRF_SDH_BLE_OBSERVERS(m_ots_c_obs, BLE_OTS_C_BLE_OBSERVER_PRIO, nrf_ble_ots_c_on_ble_evt, &m_ots_c, OTS_COLLECTOR_LINK_COUNT);
+
+static collector_link_t      m_links[OTS_COLLECTOR_LINK_COUNT];
+static candidate_t           m_candidates[OTS_COLLECTOR_CANDIDATE_COUNT];
+static candidate_t         * mp_connecting;             /**< Candidate a connection is being established to. */
+static ble_gap_scan_params_t m_connect_scan_params;     /**< Scan parameters with the connection timeout applied. */
+static uint8_t               m_conn_cfg_tag;
+static uint16_t              m_rx_mps;
+
+
+static uint32_t link_idx(collector_link_t const * p_link)
+{
+    return (uint32_t)(p_link - m_links);
+}
+
+
+static collector_link_t * link_find(uint16_t conn_handle)
+{
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < OTS_COLLECTOR_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static collector_link_t * link_find_addr(ble_gap_addr_t const * p_addr)
+{
+    for (uint32_t i = 0; i < OTS_COLLECTOR_LINK_COUNT; i++)
+    {
+        if ((m_links[i].conn_handle != BLE_CONN_HANDLE_INVALID) &&
+            (memcmp(m_links[i].peer_addr.addr, p_addr->addr, ADDR_LEN) == 0))
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static collector_link_t * link_free_find(void)
+{
+    for (uint32_t i = 0; i < OTS_COLLECTOR_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == BLE_CONN_HANDLE_INVALID)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static candidate_t * candidate_find(ble_gap_addr_t const * p_addr)
+{
+    for (uint32_t i = 0; i < OTS_COLLECTOR_CANDIDATE_COUNT; i++)
+    {
+        if (m_candidates[i].in_use &&
+            (m_candidates[i].addr.addr_type == p_addr->addr_type) &&
+            (memcmp(m_candidates[i].addr.addr, p_addr->addr, ADDR_LEN) == 0))
+        {
+            return &m_candidates[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static bool ticks_elapsed(uint32_t since, uint32_t ticks)
+{
+    return app_timer_cnt_diff_compute(app_timer_cnt_get(), since) >= ticks;
+}
+
+
+/**@brief Function for recording an advertising report of a sensor node.
+ *
+ * @details A node that is not yet known takes a free entry, or else the entry heard from least
+ *          recently.
+ */
+static void candidate_update(ble_gap_evt_adv_report_t const * p_report)
+{
+    candidate_t * p_cand = candidate_find(&p_report->peer_addr);
+    uint32_t      now    = app_timer_cnt_get();
+
+    if (p_cand == NULL)
+    {
+        uint32_t oldest_age = 0;
+
+        for (uint32_t i = 0; i < OTS_COLLECTOR_CANDIDATE_COUNT; i++)
+        {
+            uint32_t age = app_timer_cnt_diff_compute(now, m_candidates[i].seen_ticks);
+
+            if (!m_candidates[i].in_use)
+            {
+                p_cand = &m_candidates[i];
+                break;
+            }
+            if ((&m_candidates[i] != mp_connecting) && (age >= oldest_age))
+            {
+                p_cand     = &m_candidates[i];
+                oldest_age = age;
+            }
+        }
+
+        memset(p_cand, 0, sizeof(*p_cand));
+        p_cand->addr   = p_report->peer_addr;
+        p_cand->in_use = true;
+    }
+
+    p_cand->rssi       = p_report->rssi;
+    p_cand->seen_ticks = now;
+
+    if (p_cand->collected && ticks_elapsed(p_cand->collected_ticks, OTS_COLLECTOR_COOLDOWN))
+    {
+        p_cand->collected = false;
+    }
+}
+
+
+/**@brief Function for connecting to the best candidate if a collector link is free.
+ *
+ * @details The candidate with the strongest signal wins, as it gives the highest throughput.
+ *          Nodes that are connected, were collected from within @ref OTS_COLLECTOR_COOLDOWN, or
+ *          have not advertised within @ref OTS_COLLECTOR_CANDIDATE_TTL are skipped.
+ */
+static void schedule(void)
+{
+    candidate_t * p_best = NULL;
+    ret_code_t    err_code;
+
+    if ((mp_connecting != NULL) || (link_free_find() == NULL))
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < OTS_COLLECTOR_CANDIDATE_COUNT; i++)
+    {
+        candidate_t * p_cand = &m_candidates[i];
+
+        if (!p_cand->in_use ||
+            p_cand->collected ||
+            ticks_elapsed(p_cand->seen_ticks, OTS_COLLECTOR_CANDIDATE_TTL) ||
+            (link_find_addr(&p_cand->addr) != NULL))
+        {
+            continue;
+        }
+        if ((p_best == NULL) || (p_cand->rssi > p_best->rssi))
+        {
+            p_best = p_cand;
+        }
+    }
+
+    if (p_best == NULL)
+    {
+        return;
+    }
+
+    nrf_ble_scan_stop();
+
+    err_code = sd_ble_gap_connect(&p_best->addr,
+                                  &m_connect_scan_params,
+                                  &m_scan.conn_params,
+                                  m_conn_cfg_tag);
+    if (err_code == NRF_SUCCESS)
+    {
+        mp_connecting = p_best;
+        return;
+    }
+
+    msg("Collector: connect failed (0x%x)\r\n", err_code);
+    // Try another node next time.
+    p_best->in_use = false;
+    err_code = nrf_ble_scan_start(&m_scan);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for queueing a frame that starts with the address of the sensor node. */
+static ret_code_t frame_put(collector_link_t const * p_link,
+                            uint8_t                  type,
+                            uint8_t const          * p_fields,
+                            size_t                   fields_len,
+                            uint8_t const          * p_data,
+                            size_t                   data_len)
+{
+    uint8_t head[ADDR_LEN + 3 * sizeof(uint32_t)];
+
+    memcpy(head, p_link->peer_addr.addr, ADDR_LEN);
+    memcpy(&head[ADDR_LEN], p_fields, fields_len);
+
+    return usb_stream_frame_put(type, head, ADDR_LEN + fields_len, p_data, data_len);
+}
+
+
+/**@brief Function for reporting the end of an object transfer to the host. */
+static void transfer_report(collector_link_t const * p_link)
+{
+    uint8_t  fields[3 * sizeof(uint32_t)];
+    uint32_t duration_us = transfer_metrics_elapsed_us(p_link->started_ticks);
+
+    (void)uint32_encode(p_link->received, &fields[0]);
+    (void)uint32_encode(p_link->dropped, &fields[4]);
+    (void)uint32_encode(duration_us, &fields[8]);
+    (void)frame_put(p_link, OTS_COLLECTOR_FRAME_END, fields, sizeof(fields), NULL, 0);
+
+    msg("Collector: 0x%04x %u/%u bytes in %u us, %u dropped\r\n",
+        p_link->conn_handle, p_link->received, p_link->object_size, duration_us, p_link->dropped);
+}
+
+
+/**@brief Function for ending the transfer on a link and disconnecting.
+ *
+ * @param[in] p_link    Collector link.
+ * @param[in] cooldown  Do not connect to the node again before @ref OTS_COLLECTOR_COOLDOWN.
+ */
+static void collect_end(collector_link_t * p_link, bool cooldown)
+{
+    candidate_t * p_cand = candidate_find(&p_link->peer_addr);
+    ret_code_t    err_code;
+
+    if (p_link->state == COLLECT_STATE_CLOSING)
+    {
+        return;
+    }
+
+    if (p_link->state == COLLECT_STATE_RECEIVING)
+    {
+        transfer_report(p_link);
+    }
+
+    if (cooldown && (p_cand != NULL))
+    {
+        p_cand->collected       = true;
+        p_cand->collected_ticks = app_timer_cnt_get();
+    }
+
+    p_link->state = COLLECT_STATE_CLOSING;
+
+    err_code = sd_ble_gap_disconnect(p_link->conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+    if (err_code != NRF_ERROR_INVALID_STATE)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+
+/**@brief Function for opening the object channel once the object size is known. */
+static void channel_setup(collector_link_t * p_link)
+{
+    ble_l2cap_ch_setup_params_t params;
+    ret_code_t                  err_code;
+
+    p_link->local_cid = BLE_L2CAP_CID_INVALID;
+    p_link->state     = COLLECT_STATE_CHANNEL_SETUP;
+
+    if (p_link->p_rx == NULL)
+    {
+        p_link->p_rx = sdu_pool_alloc();
+    }
+    if (p_link->p_rx == NULL)
+    {
+        msg("Collector: no buffer for the channel\r\n");
+        collect_end(p_link, false);
+        return;
+    }
+
+    memset(&params, 0, sizeof(params));
+    params.le_psm                   = OTS_COLLECTOR_PSM;
+    params.rx_params.rx_mps         = m_rx_mps;
+    params.rx_params.rx_mtu         = OTS_COLLECTOR_SDU_SIZE;
+    params.rx_params.sdu_buf.p_data = sdu_buf_payload(p_link->p_rx);
+    params.rx_params.sdu_buf.len    = OTS_COLLECTOR_SDU_SIZE;
+
+    err_code = sd_ble_l2cap_ch_setup(p_link->conn_handle, &p_link->local_cid, &params);
+    if (err_code != NRF_SUCCESS)
+    {
+        msg("Collector: channel setup failed (0x%x)\r\n", err_code);
+        collect_end(p_link, false);
+    }
+}
+
+
+/**@brief Function for starting the OACP Read once the channel is open. */
+static void object_read(collector_link_t * p_link)
+{
+    uint8_t    fields[sizeof(uint32_t)];
+    ret_code_t err_code;
+
+    p_link->received      = 0;
+    p_link->dropped       = 0;
+    p_link->started_ticks = transfer_metrics_timestamp();
+    p_link->state         = COLLECT_STATE_RECEIVING;
+
+    (void)uint32_encode(p_link->object_size, fields);
+    (void)frame_put(p_link, OTS_COLLECTOR_FRAME_START, fields, sizeof(fields), NULL, 0);
+
+    err_code = nrf_ble_ots_c_oacp_read_object(&m_ots_c[link_idx(p_link)], 0, p_link->object_size);
+    if (err_code != NRF_SUCCESS)
+    {
+        msg("Collector: OACP read failed (0x%x)\r\n", err_code);
+        collect_end(p_link, false);
+    }
+}
+
+
+/**@brief Function for forwarding a received SDU to USB and giving the SoftDevice a new buffer.
+ *
+ * @details The SDU goes to USB in the buffer it was received in; the DATA frame header is
+ *          written into the headroom in front of it. If the pool is empty, the SDU is dropped
+ *          and its buffer is received into again.
+ */
+static void sdu_received(collector_link_t * p_link, uint16_t len)
+{
+    sdu_buf_t * p_sdu  = p_link->p_rx;
+    sdu_buf_t * p_next = sdu_pool_alloc();
+    uint8_t   * p_head;
+    ble_data_t  sdu_buf;
+    ret_code_t  err_code;
+
+    if (p_next == NULL)
+    {
+        p_link->dropped += len;
+    }
+    else
+    {
+        p_sdu->len = len;
+        p_head     = sdu_buf_push(p_sdu, ADDR_LEN + sizeof(uint32_t));
+        memcpy(p_head, p_link->peer_addr.addr, ADDR_LEN);
+        (void)uint32_encode(p_link->received, &p_head[ADDR_LEN]);
+
+        if (usb_stream_buf_put(OTS_COLLECTOR_FRAME_DATA, p_sdu) != NRF_SUCCESS)
+        {
+            p_link->dropped += len;
+        }
+        sdu_pool_release(p_sdu);
+        p_link->p_rx = p_next;
+    }
+    p_link->received += len;
+
+    transfer_metrics_bytes(p_link->conn_handle, TRANSFER_METRICS_TRANSPORT_OTS_CLIENT, len);
+
+    if (p_link->received >= p_link->object_size)
+    {
+        collect_end(p_link, true);
+        return;
+    }
+
+    sdu_buf.p_data = sdu_buf_payload(p_link->p_rx);
+    sdu_buf.len    = OTS_COLLECTOR_SDU_SIZE;
+    err_code = sd_ble_l2cap_ch_rx(p_link->conn_handle, p_link->local_cid, &sdu_buf);
+    if (err_code != NRF_SUCCESS)
+    {
+        collect_end(p_link, false);
+    }
+}
+
+
+/**@brief Function for handling OTS client events. */
+static void ots_c_evt_handler(nrf_ble_ots_c_evt_t * p_evt)
+{
+    collector_link_t * p_link = link_find(p_evt->conn_handle);
+    ret_code_t         err_code;
+
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    switch (p_evt->evt_type)
+    {
+        case NRF_BLE_OTS_C_EVT_DISCOVERY_COMPLETE:
+            err_code = nrf_ble_ots_c_handles_assign(&m_ots_c[link_idx(p_link)],
+                                                    p_evt->conn_handle,
+                                                    &p_evt->params.handles);
+            APP_ERROR_CHECK(err_code);
+
+            err_code = nrf_ble_ots_c_indication_enable(&m_ots_c[link_idx(p_link)], true);
+            if (err_code == NRF_SUCCESS)
+            {
+                p_link->state = COLLECT_STATE_SIZE_READ;
+                err_code      = nrf_ble_ots_c_obj_size_read(&m_ots_c[link_idx(p_link)]);
+            }
+            if (err_code != NRF_SUCCESS)
+            {
+                collect_end(p_link, false);
+            }
+            break;
+
+        case NRF_BLE_OTS_C_EVT_DISCOVERY_FAILED:
+            msg("Collector: 0x%04x has no OTS\r\n", p_evt->conn_handle);
+            collect_end(p_link, true);
+            break;
+
+        case NRF_BLE_OTS_C_EVT_SIZE_READ_RESP:
+            p_link->object_size = p_evt->params.size.current_size;
+            if (p_link->object_size == 0)
+            {
+                // Nothing to collect yet; try again after the cooldown.
+                collect_end(p_link, true);
+                break;
+            }
+            channel_setup(p_link);
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+
+/**@brief Function for forwarding database discovery events to the OTS client of the link. */
+static void db_disc_handler(ble_db_discovery_evt_t * p_evt)
+{
+    collector_link_t * p_link = link_find(p_evt->conn_handle);
+
+    if (p_link != NULL)
+    {
+        nrf_ble_ots_c_on_db_disc_evt(&m_ots_c[link_idx(p_link)], p_evt);
+    }
+}
+
+
+/**@brief Function for handling scanning events. */
+static void scan_evt_handler(scan_evt_t const * p_scan_evt)
+{
+    if (p_scan_evt->scan_evt_id == NRF_BLE_SCAN_EVT_FILTER_MATCH)
+    {
+        candidate_update(p_scan_evt->params.filter_match.p_adv_report);
+        schedule();
+    }
+}
+
+
+/**@brief Function for handling BLE events on collector links.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    collector_link_t * p_link;
+    ret_code_t         err_code;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            if ((p_ble_evt->evt.gap_evt.params.connected.role != BLE_GAP_ROLE_CENTRAL) ||
+                (mp_connecting == NULL))
+            {
+                break;
+            }
+
+            p_link = link_free_find();
+            // schedule() only connects while an entry is free.
+            APP_ERROR_CHECK_BOOL(p_link != NULL);
+
+            p_link->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+            p_link->p_rx        = NULL;
+            p_link->peer_addr   = mp_connecting->addr;
+            p_link->state       = COLLECT_STATE_DISCOVERING;
+            mp_connecting       = NULL;
+
+            msg("Collector: connected 0x%04x\r\n", p_link->conn_handle);
+
+            memset(&m_db_disc[link_idx(p_link)], 0, sizeof(m_db_disc[0]));
+            err_code = ble_db_discovery_start(&m_db_disc[link_idx(p_link)], p_link->conn_handle);
+            if (err_code != NRF_SUCCESS)
+            {
+                collect_end(p_link, false);
+            }
+
+            err_code = nrf_ble_scan_start(&m_scan);
+            APP_ERROR_CHECK(err_code);
+            break;
+
+        case BLE_GAP_EVT_TIMEOUT:
+            if ((p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_CONN) &&
+                (mp_connecting != NULL))
+            {
+                // The node went away; forget it until it advertises again.
+                mp_connecting->in_use = false;
+                mp_connecting         = NULL;
+                err_code = nrf_ble_scan_start(&m_scan);
+                APP_ERROR_CHECK(err_code);
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_link = link_find(p_ble_evt->evt.gap_evt.conn_handle);
+            if (p_link == NULL)
+            {
+                break;
+            }
+            if (p_link->state == COLLECT_STATE_RECEIVING)
+            {
+                // Dropped by the node or the link; the host still gets an END frame.
+                transfer_report(p_link);
+            }
+            if (p_link->p_rx != NULL)
+            {
+                sdu_pool_release(p_link->p_rx);
+                p_link->p_rx = NULL;
+            }
+            p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+            p_link->state       = COLLECT_STATE_IDLE;
+            schedule();
+            break;
+
+        case BLE_L2CAP_EVT_CH_SETUP:
+            p_link = link_find(p_ble_evt->evt.l2cap_evt.conn_handle);
+            if ((p_link != NULL) && (p_link->state == COLLECT_STATE_CHANNEL_SETUP))
+            {
+                p_link->local_cid = p_ble_evt->evt.l2cap_evt.local_cid;
+                object_read(p_link);
+            }
+            break;
+
+        case BLE_L2CAP_EVT_CH_SETUP_REFUSED:
+        case BLE_L2CAP_EVT_CH_RELEASED:
+            p_link = link_find(p_ble_evt->evt.l2cap_evt.conn_handle);
+            if ((p_link != NULL) && (p_link->state >= COLLECT_STATE_CHANNEL_SETUP))
+            {
+                collect_end(p_link, false);
+            }
+            break;
+
+        case BLE_L2CAP_EVT_CH_RX:
+            p_link = link_find(p_ble_evt->evt.l2cap_evt.conn_handle);
+            if ((p_link != NULL) && (p_link->state == COLLECT_STATE_RECEIVING))
+            {
+                sdu_received(p_link, p_ble_evt->evt.l2cap_evt.params.rx.sdu_len);
+            }
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_ots_collector_obs, OTS_COLLECTOR_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+ret_code_t ots_collector_init(ots_collector_init_t const * p_init)
+{
+    ble_uuid_t const        ots_uuid = {BLE_UUID_OTS_SERVICE, BLE_UUID_TYPE_BLE};
+    nrf_ble_scan_init_t     scan_init;
+    ble_db_discovery_init_t db_init;
+    nrf_ble_ots_c_init_t    ots_c_init;
+    ret_code_t              err_code;
+
+    if (p_init == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    m_conn_cfg_tag = p_init->conn_cfg_tag;
+    m_rx_mps       = p_init->rx_mps;
+
+    for (uint32_t i = 0; i < OTS_COLLECTOR_LINK_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+        m_links[i].state       = COLLECT_STATE_IDLE;
+    }
+
+    memset(&db_init, 0, sizeof(db_init));
+    db_init.evt_handler  = db_disc_handler;
+    db_init.p_gatt_queue = p_init->p_gatt_queue;
+
+    err_code = ble_db_discovery_init(&db_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    memset(&ots_c_init, 0, sizeof(ots_c_init));
+    ots_c_init.evt_handler  = ots_c_evt_handler;
+    ots_c_init.p_gatt_queue = p_init->p_gatt_queue;
+
+    for (uint32_t i = 0; i < OTS_COLLECTOR_LINK_COUNT; i++)
+    {
+        err_code = nrf_ble_ots_c_init(&m_ots_c[i], &ots_c_init);
+        if (err_code != NRF_SUCCESS)
+        {
+            return err_code;
+        }
+    }
+
+    // The scheduler picks the node, so matching reports must not connect by themselves.
+    memset(&scan_init, 0, sizeof(scan_init));
+    scan_init.connect_if_match = false;
+    scan_init.conn_cfg_tag     = p_init->conn_cfg_tag;
+
+    err_code = nrf_ble_scan_init(&m_scan, &scan_init, scan_evt_handler);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = nrf_ble_scan_filter_set(&m_scan, SCAN_UUID_FILTER, &ots_uuid);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = nrf_ble_scan_filters_enable(&m_scan, NRF_BLE_SCAN_UUID_FILTER, false);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    m_connect_scan_params         = m_scan.scan_params;
+    m_connect_scan_params.timeout = OTS_COLLECTOR_CONNECT_TIMEOUT;
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t ots_collector_start(void)
+{
+    return nrf_ble_scan_start(&m_scan);
+}
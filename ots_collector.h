@@ -0,0 +1,71 @@
+/**@file
+ *
+ * @defgroup ots_collector OTS object collector
+ * @{
+ * @brief Central role: pulls objects from sensor nodes over OTS and streams them to USB.
+ *
+ * @details The collector scans for devices advertising the OTS UUID and keeps a table of
+ *          candidates. Whenever a central link is free, the scheduler connects to the strongest
+ *          candidate that has not been collected from recently. On each link the collector
+ *          discovers OTS, reads the size of the current object, opens an L2CAP CoC, issues an
+ *          OACP Read and forwards every received SDU to the host as a @ref usb_stream frame.
+ *          The link is closed when the whole object has arrived.
+ *
+ *          All frame payloads start with the 6-byte address of the sensor node (LSB first).
+ */
+#ifndef OTS_COLLECTOR_H__
+#define OTS_COLLECTOR_H__
+
+#include <stdint.h>
+#include "app_timer.h"
+#include "nrf_ble_gq.h"
+#include "sdu_pool.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTS_COLLECTOR_BLE_OBSERVER_PRIO 2                               /**< Priority of the BLE event observer. */
+#define OTS_COLLECTOR_LINK_COUNT        NRF_SDH_BLE_CENTRAL_LINK_COUNT  /**< Number of sensor nodes collected from at once. */
+#define OTS_COLLECTOR_CANDIDATE_COUNT   8                               /**< Number of sensor nodes remembered by the scheduler. */
+#define OTS_COLLECTOR_CANDIDATE_TTL     APP_TIMER_TICKS(10000)          /**< Candidates not heard from for this long are not connected to. */
+#define OTS_COLLECTOR_COOLDOWN          APP_TIMER_TICKS(60000)          /**< Time before collecting from the same node again. */
+#define OTS_COLLECTOR_CONNECT_TIMEOUT   300                             /**< Connection establishment timeout (in units of 10 ms). */
+#define OTS_COLLECTOR_SDU_SIZE          SDU_POOL_DATA_SIZE              /**< Largest SDU received, one @ref sdu_pool buffer. */
+#define OTS_COLLECTOR_PSM               0x0025                          /**< L2CAP PSM of the OTS object channel. */
+
+#define OTS_COLLECTOR_FRAME_START       0x01    /**< Object transfer started. Payload: address, object size (u32). */
+#define OTS_COLLECTOR_FRAME_DATA        0x02    /**< Object data. Payload: address, offset (u32), data. */
+#define OTS_COLLECTOR_FRAME_END         0x03    /**< Object transfer ended. Payload: address, bytes received (u32), bytes dropped (u32), duration in us (u32). */
+
+
+/**@brief Collector initialization parameters. */
+typedef struct
+{
+    nrf_ble_gq_t * p_gatt_queue;    /**< GATT queue shared with the rest of the application. */
+    uint8_t        conn_cfg_tag;    /**< Connection configuration tag. Must have an L2CAP CoC configured. */
+    uint16_t       rx_mps;          /**< L2CAP MPS to receive with. Must not exceed the configured value. */
+} ots_collector_init_t;
+
+
+/**@brief Function for initializing the collector.
+ *
+ * @param[in] p_init  Initialization parameters.
+ *
+ * @return NRF_SUCCESS or an error code from the scanning, discovery or OTS client modules.
+ */
+ret_code_t ots_collector_init(ots_collector_init_t const * p_init);
+
+
+/**@brief Function for starting to scan for sensor nodes. */
+ret_code_t ots_collector_start(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OTS_COLLECTOR_H__
+
+/** @} */
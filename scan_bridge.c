@@ -0,0 +1,438 @@
+#include <string.h>
+#include "scan_bridge.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "ble.h"
+#include "ble_advdata.h"
+#include "nordic_common.h"
+#include "nrf_sdh_ble.h"
+#include "usb_stream.h"
+#include "msg.h"
+
+
+#define BATCH_HEADER_LEN    22                                  /**< Length of the batch header. */
+#define REPORT_HEADER_LEN   9                                   /**< Length of a report header. */
+#define DEDUP_MASK          (SCAN_BRIDGE_DEDUP_SIZE - 1)
+#define DEDUP_WINDOW        (SCAN_BRIDGE_DEDUP_WINDOW_MS / SCAN_BRIDGE_FLUSH_MS) /**< Aging window, in flush periods. */
+#define FNV_OFFSET          2166136261u
+#define FNV_PRIME           16777619u
+
+#define INFO_ADDR_TYPE_MASK 0x03
+#define INFO_CONNECTABLE    0x10
+#define INFO_SCAN_RESPONSE  0x20
+#define INFO_EXTENDED       0x40
+
+STATIC_ASSERT((SCAN_BRIDGE_DEDUP_SIZE & DEDUP_MASK) == 0);
+STATIC_ASSERT(SCAN_BRIDGE_DEDUP_PROBES <= SCAN_BRIDGE_DEDUP_SIZE);
+
+/**@brief Slot of the duplicate table. */
+typedef struct
+{
+    uint8_t  addr[BLE_GAP_ADDR_LEN];                            /**< Advertiser address. */
+    uint8_t  addr_type;                                         /**< Advertiser address type. */
+    bool     in_use;                                            /**< The slot has held an entry since the bridge started. */
+    uint32_t payload_hash;                                      /**< Hash of the advertising data. */
+    uint32_t stamp;                                             /**< Flush period the payload was last forwarded in. */
+} dedup_entry_t;
+
+/**@brief Bridge counters, sent in every batch header. */
+typedef struct
+{
+    uint32_t seen;                                              /**< Complete reports received. */
+    uint32_t forwarded;                                         /**< Reports put in a batch. */
+    uint32_t duplicates;                                        /**< Reports dropped by the duplicate table. */
+    uint32_t lost;                                              /**< Reports that passed but never reached the USB queue. */
+} bridge_stats_t;
+
+APP_TIMER_DEF(m_flush_timer);
+
+static volatile bool     m_running;
+static int8_t            m_rssi_floor;
+static uint16_t          m_uuids[SCAN_BRIDGE_UUID_MAX];
+static uint8_t           m_uuid_count;
+static uint16_t          m_companies[SCAN_BRIDGE_COMPANY_MAX];
+static uint8_t           m_company_count;
+static dedup_entry_t     m_table[SCAN_BRIDGE_DEDUP_SIZE];
+static volatile uint32_t m_now;                                 /**< Flush periods since the bridge started. */
+static sdu_buf_t       * mp_batch;                              /**< Batch being filled, or NULL. */
+static uint16_t          m_batch_count;                         /**< Reports in @ref mp_batch. */
+static bridge_stats_t    m_stats;
+
+
+static uint32_t fnv1a(uint8_t const * p_data, uint16_t len, uint32_t hash)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ p_data[i]) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+
+/**@brief Function for checking a report against the RSSI, UUID and company ID filters. */
+static bool report_wanted(ble_gap_evt_adv_report_t const * p_report)
+{
+    uint16_t offset = 0;
+    uint16_t len;
+
+    if (p_report->rssi < m_rssi_floor)
+    {
+        return false;
+    }
+    if ((m_uuid_count == 0) && (m_company_count == 0))
+    {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < m_uuid_count; i++)
+    {
+        ble_uuid_t const uuid = {m_uuids[i], BLE_UUID_TYPE_BLE};
+
+        if (ble_advdata_uuid_find(p_report->data.p_data, p_report->data.len, &uuid))
+        {
+            return true;
+        }
+    }
+
+    len = ble_advdata_search(p_report->data.p_data,
+                             p_report->data.len,
+                             &offset,
+                             BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA);
+    if (len >= sizeof(uint16_t))
+    {
+        uint16_t company = uint16_decode(&p_report->data.p_data[offset]);
+
+        for (uint8_t i = 0; i < m_company_count; i++)
+        {
+            if (m_companies[i] == company)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+/**@brief Function for looking a report up in the duplicate table and recording it if it is new.
+ *
+ * @return True if the same address sent the same payload within the aging window.
+ */
+static bool dedup_check(ble_gap_evt_adv_report_t const * p_report)
+{
+    uint32_t        payload_hash = fnv1a(p_report->data.p_data, p_report->data.len, FNV_OFFSET);
+    uint32_t        index        = fnv1a(p_report->peer_addr.addr, BLE_GAP_ADDR_LEN, payload_hash);
+    uint32_t        now          = m_now;
+    dedup_entry_t * p_free       = NULL;
+    dedup_entry_t * p_oldest     = NULL;
+
+    for (uint32_t i = 0; i < SCAN_BRIDGE_DEDUP_PROBES; i++)
+    {
+        dedup_entry_t * p_entry = &m_table[(index + i) & DEDUP_MASK];
+        bool            fresh   = p_entry->in_use && ((now - p_entry->stamp) < DEDUP_WINDOW);
+
+        if (!fresh)
+        {
+            if (p_free == NULL)
+            {
+                p_free = p_entry;
+            }
+            continue;
+        }
+        if ((p_entry->payload_hash == payload_hash) &&
+            (p_entry->addr_type == p_report->peer_addr.addr_type) &&
+            (memcmp(p_entry->addr, p_report->peer_addr.addr, BLE_GAP_ADDR_LEN) == 0))
+        {
+            return true;
+        }
+        if ((p_oldest == NULL) || ((now - p_entry->stamp) > (now - p_oldest->stamp)))
+        {
+            p_oldest = p_entry;
+        }
+    }
+
+    // Every probed slot is fresh: evict the oldest.
+    if (p_free == NULL)
+    {
+        p_free = p_oldest;
+    }
+
+    memcpy(p_free->addr, p_report->peer_addr.addr, BLE_GAP_ADDR_LEN);
+    p_free->addr_type    = p_report->peer_addr.addr_type;
+    p_free->in_use       = true;
+    p_free->payload_hash = payload_hash;
+    p_free->stamp        = now;
+
+    return false;
+}
+
+
+/**@brief Function for taking the batch being filled, with its header written. Must be called in a
+ *        critical region.
+ */
+static sdu_buf_t * batch_take(void)
+{
+    sdu_buf_t * p_buf = mp_batch;
+    uint8_t   * p_out;
+
+    if (p_buf == NULL)
+    {
+        return NULL;
+    }
+
+    p_out = sdu_buf_payload(p_buf);
+    (void)uint32_encode(m_now * SCAN_BRIDGE_FLUSH_MS, &p_out[0]);
+    (void)uint16_encode(m_batch_count, &p_out[4]);
+    (void)uint32_encode(m_stats.seen, &p_out[6]);
+    (void)uint32_encode(m_stats.forwarded, &p_out[10]);
+    (void)uint32_encode(m_stats.duplicates, &p_out[14]);
+    (void)uint32_encode(m_stats.lost, &p_out[18]);
+
+    mp_batch      = NULL;
+    m_batch_count = 0;
+
+    return p_buf;
+}
+
+
+static void batch_send(sdu_buf_t * p_buf)
+{
+    uint16_t count = uint16_decode(&sdu_buf_payload(p_buf)[4]);
+
+    if (usb_stream_buf_put(SCAN_BRIDGE_FRAME_BATCH, p_buf) != NRF_SUCCESS)
+    {
+        CRITICAL_REGION_ENTER();
+        m_stats.forwarded -= count;
+        m_stats.lost      += count;
+        CRITICAL_REGION_EXIT();
+    }
+    sdu_pool_release(p_buf);
+}
+
+
+/**@brief Function for adding a report to the batch, sending the batch first if it is full. */
+static void batch_add(ble_gap_evt_adv_report_t const * p_report)
+{
+    uint16_t    need   = REPORT_HEADER_LEN + p_report->data.len;
+    sdu_buf_t * p_full = NULL;
+    uint8_t   * p_out;
+
+    CRITICAL_REGION_ENTER();
+    if ((mp_batch != NULL) && (mp_batch->len + need > SDU_POOL_DATA_SIZE))
+    {
+        p_full = batch_take();
+    }
+    if (mp_batch == NULL)
+    {
+        mp_batch = sdu_pool_alloc();
+        if (mp_batch != NULL)
+        {
+            mp_batch->len = BATCH_HEADER_LEN;
+        }
+    }
+
+    if (mp_batch == NULL)
+    {
+        m_stats.lost++;
+    }
+    else
+    {
+        p_out = &sdu_buf_payload(mp_batch)[mp_batch->len];
+
+        memcpy(&p_out[0], p_report->peer_addr.addr, BLE_GAP_ADDR_LEN);
+        p_out[6] = (p_report->peer_addr.addr_type & INFO_ADDR_TYPE_MASK) |
+                   (p_report->type.connectable   ? INFO_CONNECTABLE   : 0) |
+                   (p_report->type.scan_response ? INFO_SCAN_RESPONSE : 0) |
+                   (p_report->type.extended_pdu  ? INFO_EXTENDED      : 0);
+        p_out[7] = (uint8_t)p_report->rssi;
+        p_out[8] = (uint8_t)p_report->data.len;
+        memcpy(&p_out[REPORT_HEADER_LEN], p_report->data.p_data, p_report->data.len);
+
+        mp_batch->len += need;
+        m_batch_count++;
+        m_stats.forwarded++;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (p_full != NULL)
+    {
+        batch_send(p_full);
+    }
+}
+
+
+static void flush_timeout_handler(void * p_context)
+{
+    sdu_buf_t * p_buf;
+
+    UNUSED_PARAMETER(p_context);
+
+    CRITICAL_REGION_ENTER();
+    m_now++;
+    p_buf = batch_take();
+    CRITICAL_REGION_EXIT();
+
+    if (p_buf != NULL)
+    {
+        batch_send(p_buf);
+    }
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    ble_gap_evt_adv_report_t const * p_report = &p_ble_evt->evt.gap_evt.params.adv_report;
+
+    if ((p_ble_evt->header.evt_id != BLE_GAP_EVT_ADV_REPORT) || !m_running)
+    {
+        return;
+    }
+    // The rest of a chained extended report follows in later events; only whole ones are sent.
+    if ((p_report->type.status != BLE_GAP_ADV_DATA_STATUS_COMPLETE) ||
+        (p_report->data.len > UINT8_MAX))
+    {
+        return;
+    }
+
+    m_stats.seen++;
+
+    if (!report_wanted(p_report))
+    {
+        return;
+    }
+    if (dedup_check(p_report))
+    {
+        m_stats.duplicates++;
+        return;
+    }
+
+    batch_add(p_report);
+}
+
+NRF_SDH_BLE_OBSERVER(m_scan_bridge_obs, SCAN_BRIDGE_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+
+static void bridge_stop(void)
+{
+    sdu_buf_t * p_buf;
+
+    if (!m_running)
+    {
+        return;
+    }
+
+    m_running = false;
+    (void)app_timer_stop(m_flush_timer);
+
+    // The last batch goes out even if empty, so the host gets the final counts.
+    CRITICAL_REGION_ENTER();
+    if (mp_batch == NULL)
+    {
+        mp_batch = sdu_pool_alloc();
+        if (mp_batch != NULL)
+        {
+            mp_batch->len = BATCH_HEADER_LEN;
+        }
+    }
+    p_buf = batch_take();
+    CRITICAL_REGION_EXIT();
+
+    if (p_buf != NULL)
+    {
+        batch_send(p_buf);
+    }
+
+    msg("Scan bridge: stopped, %u seen, %u forwarded, %u duplicates, %u lost\r\n",
+        m_stats.seen, m_stats.forwarded, m_stats.duplicates, m_stats.lost);
+}
+
+
+/**@brief Function for starting the bridge with the filters of a control frame. */
+static ret_code_t bridge_start(uint8_t const * p_data, uint16_t len)
+{
+    uint8_t uuid_count;
+    uint8_t company_count;
+
+    if (len < 4)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    uuid_count    = p_data[2];
+    company_count = p_data[3];
+
+    if ((uuid_count > SCAN_BRIDGE_UUID_MAX) ||
+        (company_count > SCAN_BRIDGE_COMPANY_MAX) ||
+        (len < 4 + 2 * (uuid_count + company_count)))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    // Stop first, so the observer does not see filters half written and the counts start over.
+    bridge_stop();
+
+    m_rssi_floor    = (int8_t)p_data[1];
+    m_uuid_count    = uuid_count;
+    m_company_count = company_count;
+    for (uint8_t i = 0; i < uuid_count; i++)
+    {
+        m_uuids[i] = uint16_decode(&p_data[4 + 2 * i]);
+    }
+    for (uint8_t i = 0; i < company_count; i++)
+    {
+        m_companies[i] = uint16_decode(&p_data[4 + 2 * (uuid_count + i)]);
+    }
+
+    memset(m_table, 0, sizeof(m_table));
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_now = 0;
+
+    m_running = true;
+
+    msg("Scan bridge: started, RSSI >= %d, %u UUIDs, %u companies\r\n",
+        m_rssi_floor, uuid_count, company_count);
+
+    return app_timer_start(m_flush_timer, APP_TIMER_TICKS(SCAN_BRIDGE_FLUSH_MS), NULL);
+}
+
+
+void scan_bridge_on_frame(sdu_buf_t * p_buf)
+{
+    uint8_t const * p_data = sdu_buf_payload(p_buf);
+    ret_code_t      err_code;
+
+    if (p_buf->len < 1)
+    {
+        return;
+    }
+
+    if (p_data[0] == 0)
+    {
+        bridge_stop();
+        return;
+    }
+
+    err_code = bridge_start(p_data, p_buf->len);
+    if (err_code != NRF_SUCCESS)
+    {
+        msg("Scan bridge: bad start frame (0x%x)\r\n", err_code);
+    }
+}
+
+
+ret_code_t scan_bridge_init(void)
+{
+    m_running = false;
+    mp_batch  = NULL;
+
+    return app_timer_create(&m_flush_timer, APP_TIMER_MODE_REPEATED, flush_timeout_handler);
+}
@@ -0,0 +1,107 @@
+/**@file
+ *
+ * @defgroup scan_bridge Scanner to USB bridge
+ * @{
+ * @brief Gateway mode: filters and deduplicates advertising reports on the dongle and sends the
+ *        rest to the host in batches.
+ *
+ * @details The module does not scan by itself. It reads the reports of the scan run by
+ *          @ref ots_collector, which sees every advertiser in range; that scan hands its buffer
+ *          back to the SoftDevice in its own observer, so this module's observer must run first.
+ *
+ *          While the bridge runs, a report is forwarded only if:
+ *          - its RSSI is at least the floor set by the host,
+ *          - it lists one of the host's 16-bit service UUIDs or carries manufacturer data of one
+ *            of the host's company IDs (no UUIDs and no company IDs: any report passes), and
+ *          - the same address has not sent the same payload within
+ *            @ref SCAN_BRIDGE_DEDUP_WINDOW_MS.
+ *
+ *          Duplicates are found in an open-addressing hash table of (address, payload hash)
+ *          with linear probing. A lookup probes at most @ref SCAN_BRIDGE_DEDUP_PROBES slots.
+ *          Entries older than the window count as free, and if every probed slot is fresh the
+ *          oldest one is replaced. The table is a cache: a miss forwards an extra report, it never
+ *          drops a new one.
+ *
+ *          Reports are packed into @ref sdu_pool buffers, sent as a @ref SCAN_BRIDGE_FRAME_BATCH
+ *          frame when full or every @ref SCAN_BRIDGE_FLUSH_MS. Batch payload:
+ *
+ *          | Offset | Size | Field                                                    |
+ *          |--------|------|----------------------------------------------------------|
+ *          | 0      | 4    | Time of the flush, in ms since the bridge started (LE)   |
+ *          | 4      | 2    | Number of reports in the batch (LE)                      |
+ *          | 6      | 4    | Reports seen since the bridge started (LE)               |
+ *          | 10     | 4    | Reports forwarded (LE)                                   |
+ *          | 14     | 4    | Reports dropped as duplicates (LE)                       |
+ *          | 18     | 4    | Reports lost for lack of buffers or USB queue room (LE)  |
+ *          | 22     | n    | Reports                                                  |
+ *
+ *          Each report:
+ *
+ *          | Offset | Size | Field                                                    |
+ *          |--------|------|----------------------------------------------------------|
+ *          | 0      | 6    | Address (LSB first)                                      |
+ *          | 6      | 1    | Bits 0-1: address type; 4: connectable; 5: scan response; 6: extended |
+ *          | 7      | 1    | RSSI (signed dBm)                                        |
+ *          | 8      | 1    | Data length n                                            |
+ *          | 9      | n    | Advertising data                                         |
+ *
+ *          The host starts the bridge with a @ref SCAN_BRIDGE_FRAME_CONTROL frame:
+ *
+ *          | Offset | Size | Field                                                    |
+ *          |--------|------|----------------------------------------------------------|
+ *          | 0      | 1    | 1: start, 0: stop (nothing else is needed to stop)       |
+ *          | 1      | 1    | RSSI floor (signed dBm)                                  |
+ *          | 2      | 1    | Number of service UUIDs u, at most @ref SCAN_BRIDGE_UUID_MAX |
+ *          | 3      | 1    | Number of company IDs c, at most @ref SCAN_BRIDGE_COMPANY_MAX |
+ *          | 4      | 2u   | 16-bit service UUIDs (LE)                                |
+ *          | 4+2u   | 2c   | Company IDs (LE)                                         |
+ *
+ *          On stop, the last batch is sent even if it is empty, so the host gets the final counts.
+ *          tools/scan_bridge.py starts the bridge and prints or logs the reports.
+ */
+#ifndef SCAN_BRIDGE_H__
+#define SCAN_BRIDGE_H__
+
+#include <stdint.h>
+#include "sdu_pool.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCAN_BRIDGE_BLE_OBSERVER_PRIO   0       /**< Priority of the BLE observer. Ahead of nrf_ble_scan, which restarts the scan into the same buffer. */
+
+#define SCAN_BRIDGE_UUID_MAX            4       /**< Service UUIDs in the filter at most. */
+#define SCAN_BRIDGE_COMPANY_MAX         4       /**< Company IDs in the filter at most. */
+
+#define SCAN_BRIDGE_DEDUP_SIZE          256     /**< Slots in the duplicate table. Must be a power of two. */
+#define SCAN_BRIDGE_DEDUP_PROBES        8       /**< Slots probed per lookup at most. */
+#define SCAN_BRIDGE_DEDUP_WINDOW_MS     1000    /**< The same payload from the same address is forwarded once per window. */
+#define SCAN_BRIDGE_FLUSH_MS            50      /**< Longest time a report waits in a batch. */
+
+#define SCAN_BRIDGE_FRAME_CONTROL       0x60    /**< Host to dongle: start or stop the bridge. */
+#define SCAN_BRIDGE_FRAME_BATCH         0x61    /**< Dongle to host: batch of reports. */
+
+
+/**@brief Function for initializing the module. The bridge starts stopped.
+ *
+ * @return NRF_SUCCESS or an error code from app_timer.
+ */
+ret_code_t scan_bridge_init(void);
+
+
+/**@brief Function for handling a @ref SCAN_BRIDGE_FRAME_CONTROL frame from the host.
+ *
+ * @param[in] p_buf  Buffer holding the frame payload.
+ */
+void scan_bridge_on_frame(sdu_buf_t * p_buf);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCAN_BRIDGE_H__
+
+/** @} */
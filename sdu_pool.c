@@ -0,0 +1,131 @@
+#include "sdu_pool.h"
+#include "nrf_balloc.h"
+#include "app_util_platform.h"
+
+
+NRF_BALLOC_DEF(m_pool, sizeof(sdu_buf_t), SDU_POOL_COUNT);
+
+static sdu_pool_stats_t m_stats;
+
+
+ret_code_t sdu_pool_init(void)
+{
+    m_stats.in_use         = 0;
+    m_stats.high_water     = 0;
+    m_stats.alloc_failures = 0;
+
+    return nrf_balloc_init(&m_pool);
+}
+
+
+sdu_buf_t * sdu_pool_alloc(void)
+{
+    sdu_buf_t * p_buf = nrf_balloc_alloc(&m_pool);
+
+    CRITICAL_REGION_ENTER();
+    if (p_buf == NULL)
+    {
+        m_stats.alloc_failures++;
+    }
+    else
+    {
+        m_stats.in_use++;
+        if (m_stats.in_use > m_stats.high_water)
+        {
+            m_stats.high_water = m_stats.in_use;
+        }
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (p_buf != NULL)
+    {
+        p_buf->ref_count = 1;
+        p_buf->offset    = SDU_POOL_HEADROOM;
+        p_buf->len       = 0;
+    }
+
+    return p_buf;
+}
+
+
+sdu_buf_t * sdu_pool_alloc_spare(void)
+{
+    bool spare;
+
+    // Another context may allocate between the check and the allocation; the reserve can then
+    // be short by a buffer for a moment.
+    CRITICAL_REGION_ENTER();
+    spare = (SDU_POOL_COUNT - m_stats.in_use > SDU_POOL_RESERVE);
+    CRITICAL_REGION_EXIT();
+
+    return spare ? sdu_pool_alloc() : NULL;
+}
+
+
+void sdu_pool_retain(sdu_buf_t * p_buf)
+{
+    CRITICAL_REGION_ENTER();
+    p_buf->ref_count++;
+    CRITICAL_REGION_EXIT();
+}
+
+
+void sdu_pool_release(sdu_buf_t * p_buf)
+{
+    bool last;
+
+    CRITICAL_REGION_ENTER();
+    last = (--p_buf->ref_count == 0);
+    if (last)
+    {
+        m_stats.in_use--;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (last)
+    {
+        nrf_balloc_free(&m_pool, p_buf);
+    }
+}
+
+
+uint8_t * sdu_buf_payload(sdu_buf_t * p_buf)
+{
+    return &p_buf->data[SDU_POOL_HEADROOM];
+}
+
+
+uint8_t * sdu_buf_push(sdu_buf_t * p_buf, uint16_t len)
+{
+    if (len > p_buf->offset)
+    {
+        return NULL;
+    }
+
+    p_buf->offset -= len;
+    p_buf->len    += len;
+
+    return &p_buf->data[p_buf->offset];
+}
+
+
+uint8_t * sdu_buf_pull(sdu_buf_t * p_buf, uint16_t len)
+{
+    if (len > p_buf->len)
+    {
+        return NULL;
+    }
+
+    p_buf->offset += len;
+    p_buf->len    -= len;
+
+    return &p_buf->data[p_buf->offset];
+}
+
+
+void sdu_pool_stats_get(sdu_pool_stats_t * p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_stats;
+    CRITICAL_REGION_EXIT();
+}
@@ -0,0 +1,122 @@
+/**@file
+ *
+ * @defgroup sdu_pool Shared SDU buffer pool
+ * @{
+ * @brief Reference-counted data buffers passed between the BLE, flash and USB stages.
+ *
+ * @details A buffer is allocated once where data enters the dongle and then handed from stage
+ *          to stage without copying. Each stage that keeps the buffer takes a reference with
+ *          @ref sdu_pool_retain and drops it with @ref sdu_pool_release. The buffer returns to
+ *          the pool when the last reference is dropped.
+ *
+ *          Every buffer has @ref SDU_POOL_HEADROOM bytes in front of its data. A stage can use
+ *          @ref sdu_buf_push to put its header in front of the payload without moving it, so
+ *          for example an L2CAP SDU goes out to USB as one contiguous frame.
+ *
+ *          Data that can be lost, like debug text, is allocated with @ref sdu_pool_alloc_spare,
+ *          which leaves the last @ref SDU_POOL_RESERVE buffers to the transfer path.
+ *
+ *          The pool counts buffers in use, the high-water mark and failed allocations. RAM can
+ *          then be sized from the real maximum of data in flight.
+ */
+#ifndef SDU_POOL_H__
+#define SDU_POOL_H__
+
+#include <stdint.h>
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SDU_POOL_COUNT          16      /**< Number of buffers. */
+#define SDU_POOL_DATA_SIZE      512     /**< Payload capacity of a buffer. */
+#define SDU_POOL_HEADROOM       16      /**< Room for headers in front of the payload. */
+#define SDU_POOL_RESERVE        4       /**< Buffers that @ref sdu_pool_alloc_spare does not take. */
+
+
+/**@brief Buffer. */
+typedef struct
+{
+    uint8_t  ref_count;                                 /**< Number of holders. */
+    uint16_t offset;                                    /**< Start of the valid data in @ref data. */
+    uint16_t len;                                       /**< Length of the valid data. */
+    uint8_t  data[SDU_POOL_HEADROOM + SDU_POOL_DATA_SIZE];
+} sdu_buf_t;
+
+
+/**@brief Pool occupancy. */
+typedef struct
+{
+    uint16_t in_use;                    /**< Buffers allocated now. */
+    uint16_t high_water;                /**< Most buffers allocated at once since init. */
+    uint32_t alloc_failures;            /**< Allocations that found the pool empty. */
+} sdu_pool_stats_t;
+
+
+/**@brief Function for initializing the pool. */
+ret_code_t sdu_pool_init(void);
+
+
+/**@brief Function for allocating a buffer.
+ *
+ * @details The buffer has one reference, no data, and the full headroom in front.
+ *
+ * @return Buffer, or NULL if the pool is empty.
+ */
+sdu_buf_t * sdu_pool_alloc(void);
+
+
+/**@brief Function for allocating a buffer for data that can be dropped.
+ *
+ * @details As @ref sdu_pool_alloc, but fails while only @ref SDU_POOL_RESERVE buffers or
+ *          fewer are free. Such a failure is not counted in the statistics.
+ *
+ * @return Buffer, or NULL if the pool is down to its reserve.
+ */
+sdu_buf_t * sdu_pool_alloc_spare(void);
+
+
+/**@brief Function for taking another reference to a buffer. */
+void sdu_pool_retain(sdu_buf_t * p_buf);
+
+
+/**@brief Function for dropping a reference. The buffer is freed with the last one. */
+void sdu_pool_release(sdu_buf_t * p_buf);
+
+
+/**@brief Function for getting the payload area of an empty buffer, after the headroom. */
+uint8_t * sdu_buf_payload(sdu_buf_t * p_buf);
+
+
+/**@brief Function for putting a header in front of the data.
+ *
+ * @param[in] p_buf  Buffer.
+ * @param[in] len    Header length.
+ *
+ * @return Where to write the header, or NULL if the headroom is used up.
+ */
+uint8_t * sdu_buf_push(sdu_buf_t * p_buf, uint16_t len);
+
+
+/**@brief Function for taking a header off the front of the data, undoing @ref sdu_buf_push.
+ *
+ * @param[in] p_buf  Buffer.
+ * @param[in] len    Header length.
+ *
+ * @return Start of the data after the header, or NULL if the data is shorter than the header.
+ */
+uint8_t * sdu_buf_pull(sdu_buf_t * p_buf, uint16_t len);
+
+
+/**@brief Function for getting the pool occupancy. */
+void sdu_pool_stats_get(sdu_pool_stats_t * p_stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SDU_POOL_H__
+
+/** @} */
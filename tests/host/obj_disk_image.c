@@ -0,0 +1,192 @@
+/**@file
+ *
+ * @brief Dumps the volume of the real @ref obj_disk, built for the host, to an image file, for
+ *        tools/obj_disk.py check.
+ *
+ * @details The committed object is made up here: @ref obj_store_current_get gives a journal
+ *          entry for it, and @ref flash_log_read reads its data from RAM. The object is written
+ *          to a file as well, for check --expect. Its name has characters FAT does not allow and
+ *          needs more than one long name entry. A size of 0 means that nothing is committed.
+ *
+ *          All sectors are read through @ref obj_disk_ops, the boot sector first, as the MSC
+ *          class reads them. After that a newer commit is made up, and a read of the object must
+ *          fail, as the volume still describes the old one.
+ *
+ *          Usage: obj_disk_image <object size> <object file> <image file>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "obj_disk.h"
+#include "obj_store.h"
+#include "flash_log.h"
+
+#define OBJECT_NAME     "log 2021-06-01: run*7.bin"
+#define OBJECT_SEQ      7
+#define OBJECT_LBA      9                                                       /**< First sector of the object, after the root directory and INFO.TXT. */
+#define OBJECT_SIZE_MAX ((OBJ_DISK_BLOCK_COUNT - OBJECT_LBA) * OBJ_DISK_BLOCK_SIZE)
+
+OBJ_DISK_DEF(m_disk);
+
+static uint8_t                m_data[OBJECT_SIZE_MAX];
+static uint32_t               m_size;
+static uint32_t               m_seq = OBJECT_SEQ;
+static nrf_block_dev_result_t m_result;                 /**< Result of the last read. */
+static uint32_t               m_events;
+
+
+static uint32_t crc32_compute(uint8_t const * p_data, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= p_data[i];
+        for (uint32_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        }
+    }
+
+    return ~crc;
+}
+
+
+bool obj_store_current_get(obj_journal_entry_t * p_entry)
+{
+    if (m_size == 0)
+    {
+        return false;
+    }
+
+    memset(p_entry, 0, sizeof(*p_entry));
+    p_entry->seq      = m_seq;
+    p_entry->run.len  = m_size;
+    p_entry->size     = m_size;
+    p_entry->checksum = crc32_compute(m_data, m_size);
+    strncpy(p_entry->name, OBJECT_NAME, sizeof(p_entry->name));
+
+    return true;
+}
+
+
+ret_code_t flash_log_read(flash_log_run_t const * p_run, uint32_t offset, uint8_t * p_dst, uint32_t len)
+{
+    if ((offset > p_run->len) || (len > p_run->len - offset))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    memcpy(p_dst, &m_data[offset], len);
+
+    return NRF_SUCCESS;
+}
+
+
+static void ev_handler(nrf_block_dev_t const * p_blk_dev, nrf_block_dev_event_t const * p_event)
+{
+    if (p_event->ev_type == NRF_BLOCK_DEV_EVT_BLK_READ_DONE)
+    {
+        m_result = p_event->result;
+        m_events++;
+    }
+}
+
+
+/**@brief Function for reading one sector through the block device.
+ *
+ * @return Result the read completed with.
+ */
+static nrf_block_dev_result_t sector_get(uint32_t lba, uint8_t * p_dst)
+{
+    nrf_block_req_t const req = { .blk_id = lba, .blk_count = 1, .p_buff = p_dst };
+    uint32_t              events = m_events;
+
+    m_result = NRF_BLOCK_DEV_RESULT_TIMEOUT;
+    if ((m_disk.block_dev.p_ops->read_req(&m_disk.block_dev, &req) != NRF_SUCCESS) ||
+        (m_events != events + 1))
+    {
+        return NRF_BLOCK_DEV_RESULT_TIMEOUT;
+    }
+
+    return m_result;
+}
+
+
+static bool file_write(char const * p_path, void const * p_data, size_t len)
+{
+    FILE * p_file = fopen(p_path, "wb");
+    bool   ok;
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        return false;
+    }
+    ok = (fwrite(p_data, 1, len, p_file) == len);
+    ok = (fclose(p_file) == 0) && ok;
+
+    return ok;
+}
+
+
+int main(int argc, char * argv[])
+{
+    static uint8_t                   image[OBJ_DISK_BLOCK_COUNT][OBJ_DISK_BLOCK_SIZE];
+    uint8_t                          sector[OBJ_DISK_BLOCK_SIZE];
+    nrf_block_dev_geometry_t const * p_geometry;
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "usage: %s <object size> <object file> <image file>\n", argv[0]);
+        return 2;
+    }
+
+    m_size = (uint32_t)strtoul(argv[1], NULL, 0);
+    if (m_size > OBJECT_SIZE_MAX)
+    {
+        fprintf(stderr, "the volume holds objects of up to %u bytes\n", OBJECT_SIZE_MAX);
+        return 2;
+    }
+    for (uint32_t i = 0; i < m_size; i++)
+    {
+        m_data[i] = (uint8_t)((i * 7) ^ (i >> 9));
+    }
+
+    p_geometry = m_disk.block_dev.p_ops->geometry(&m_disk.block_dev);
+    if ((p_geometry->blk_count != OBJ_DISK_BLOCK_COUNT) || (p_geometry->blk_size != OBJ_DISK_BLOCK_SIZE) ||
+        (m_disk.block_dev.p_ops->init(&m_disk.block_dev, ev_handler, NULL) != NRF_SUCCESS))
+    {
+        fprintf(stderr, "block device refused to start\n");
+        return 1;
+    }
+
+    for (uint32_t lba = 0; lba < OBJ_DISK_BLOCK_COUNT; lba++)
+    {
+        if (sector_get(lba, image[lba]) != NRF_BLOCK_DEV_RESULT_SUCCESS)
+        {
+            fprintf(stderr, "sector %u could not be read\n", lba);
+            return 1;
+        }
+    }
+
+    // A newer commit makes the object the volume describes unreadable.
+    if (m_size > 0)
+    {
+        m_seq++;
+        if (sector_get(OBJECT_LBA, sector) != NRF_BLOCK_DEV_RESULT_IO_ERROR)
+        {
+            fprintf(stderr, "object of an older commit could still be read\n");
+            return 1;
+        }
+    }
+
+    if (!file_write(argv[2], m_data, m_size) ||
+        !file_write(argv[3], image, sizeof(image)))
+    {
+        fprintf(stderr, "could not write the files\n");
+        return 1;
+    }
+    (void)m_disk.block_dev.p_ops->uninit(&m_disk.block_dev);
+
+    return 0;
+}
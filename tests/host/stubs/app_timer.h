@@ -0,0 +1,15 @@
+/**@file
+ *
+ * @brief Host build stand-in for app_timer.h: the tick rate of the RTC, for the headers that
+ *        convert ticks to time. The host tests give timestamps themselves.
+ */
+#ifndef APP_TIMER_H__
+#define APP_TIMER_H__
+
+#include <stdint.h>
+
+#define APP_TIMER_CLOCK_FREQ            32768
+#define APP_TIMER_CONFIG_RTC_FREQUENCY  0
+#define APP_TIMER_TICKS(ms)             ((uint32_t)(((uint64_t)(ms) * APP_TIMER_CLOCK_FREQ) / 1000))
+
+#endif // APP_TIMER_H__
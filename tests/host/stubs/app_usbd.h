@@ -0,0 +1,10 @@
+/**@file
+ *
+ * @brief Host build stand-in for app_usbd.h.
+ */
+#ifndef APP_USBD_H__
+#define APP_USBD_H__
+
+#include "app_usbd_class_base.h"
+
+#endif // APP_USBD_H__
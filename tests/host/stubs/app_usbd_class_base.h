@@ -0,0 +1,29 @@
+/**@file
+ *
+ * @brief Host build stand-in for app_usbd_class_base.h: only what a class header needs to
+ *        declare its instance type.
+ */
+#ifndef APP_USBD_CLASS_BASE_H__
+#define APP_USBD_CLASS_BASE_H__
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint8_t dummy;
+} app_usbd_class_methods_t;
+
+typedef struct
+{
+    app_usbd_class_methods_t const * p_class_methods;
+} app_usbd_class_inst_t;
+
+#define APP_USBD_CLASS_TYPEDEF(type_name, interface_configs, class_config_dec, class_data_dec) \
+    typedef struct                                                                            \
+    {                                                                                         \
+        app_usbd_class_inst_t base;                                                           \
+        class_config_dec                                                                      \
+        class_data_dec                                                                        \
+    } type_name ## _t
+
+#endif // APP_USBD_CLASS_BASE_H__
@@ -0,0 +1,49 @@
+/**@file
+ *
+ * @brief Host build stand-in for the parts of app_util.h and nordic_common.h the modules use.
+ */
+#ifndef APP_UTIL_H__
+#define APP_UTIL_H__
+
+#include <stdint.h>
+
+#ifndef MIN
+#define MIN(a, b)                   ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b)                   ((a) < (b) ? (b) : (a))
+#endif
+#define CEIL_DIV(a, b)              (((a) + (b) - 1) / (b))
+#define ROUNDED_DIV(a, b)           (((a) + ((b) / 2)) / (b))
+#define ARRAY_SIZE(arr)             (sizeof(arr) / sizeof((arr)[0]))
+#define UNUSED_PARAMETER(x)         ((void)(x))
+#define STATIC_ASSERT(expr)         _Static_assert(expr, #expr)
+
+static inline uint8_t uint16_encode(uint16_t value, uint8_t * p_encoded)
+{
+    p_encoded[0] = (uint8_t)value;
+    p_encoded[1] = (uint8_t)(value >> 8);
+    return sizeof(uint16_t);
+}
+
+static inline uint16_t uint16_decode(uint8_t const * p_encoded)
+{
+    return (uint16_t)(p_encoded[0] | (p_encoded[1] << 8));
+}
+
+static inline uint8_t uint32_encode(uint32_t value, uint8_t * p_encoded)
+{
+    p_encoded[0] = (uint8_t)value;
+    p_encoded[1] = (uint8_t)(value >> 8);
+    p_encoded[2] = (uint8_t)(value >> 16);
+    p_encoded[3] = (uint8_t)(value >> 24);
+    return sizeof(uint32_t);
+}
+
+static inline uint32_t uint32_decode(uint8_t const * p_encoded)
+{
+    return (uint32_t)p_encoded[0] | ((uint32_t)p_encoded[1] << 8) |
+           ((uint32_t)p_encoded[2] << 16) | ((uint32_t)p_encoded[3] << 24);
+}
+
+#endif // APP_UTIL_H__
@@ -0,0 +1,16 @@
+/**@file
+ *
+ * @brief Host build stand-in for app_util_platform.h. The tests run on one thread, so a
+ *        critical region is only a block.
+ */
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_util.h"
+
+#define CRITICAL_REGION_ENTER()     {
+#define CRITICAL_REGION_EXIT()      }
+
+#endif // APP_UTIL_PLATFORM_H__
@@ -0,0 +1,17 @@
+/**@file
+ *
+ * @brief Host build stand-in for ble_ots.h: the object type that obj_store.h names. The host
+ *        builds do not use its fields.
+ */
+#ifndef BLE_OTS_H__
+#define BLE_OTS_H__
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint8_t  * data;
+    uint32_t   current_size;
+} ble_ots_object_t;
+
+#endif // BLE_OTS_H__
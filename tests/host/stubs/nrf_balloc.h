@@ -0,0 +1,59 @@
+/**@file
+ *
+ * @brief Host build stand-in for nrf_balloc: a fixed array of blocks with a used flag each.
+ */
+#ifndef NRF_BALLOC_H__
+#define NRF_BALLOC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdk_errors.h"
+
+typedef struct
+{
+    uint8_t * p_mem;
+    bool    * p_used;
+    size_t    block_size;
+    size_t    count;
+} nrf_balloc_t;
+
+#define NRF_BALLOC_DEF(name, element_size, pool_size)                       \
+    static uint8_t      name##_mem[(element_size) * (pool_size)];           \
+    static bool         name##_used[pool_size];                             \
+    static nrf_balloc_t const name =                                        \
+    {                                                                       \
+        .p_mem      = name##_mem,                                           \
+        .p_used     = name##_used,                                          \
+        .block_size = (element_size),                                       \
+        .count      = (pool_size),                                          \
+    }
+
+static inline ret_code_t nrf_balloc_init(nrf_balloc_t const * p_pool)
+{
+    for (size_t i = 0; i < p_pool->count; i++)
+    {
+        p_pool->p_used[i] = false;
+    }
+    return NRF_SUCCESS;
+}
+
+static inline void * nrf_balloc_alloc(nrf_balloc_t const * p_pool)
+{
+    for (size_t i = 0; i < p_pool->count; i++)
+    {
+        if (!p_pool->p_used[i])
+        {
+            p_pool->p_used[i] = true;
+            return &p_pool->p_mem[i * p_pool->block_size];
+        }
+    }
+    return NULL;
+}
+
+static inline void nrf_balloc_free(nrf_balloc_t const * p_pool, void * p_element)
+{
+    p_pool->p_used[((uint8_t *)p_element - p_pool->p_mem) / p_pool->block_size] = false;
+}
+
+#endif // NRF_BALLOC_H__
@@ -0,0 +1,84 @@
+/**@file
+ *
+ * @brief Host build stand-in for nrf_block_dev.h: the block device interface, as the USB Mass
+ *        Storage class uses it.
+ */
+#ifndef NRF_BLOCK_DEV_H__
+#define NRF_BLOCK_DEV_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+
+typedef struct
+{
+    uint32_t blk_count;
+    uint32_t blk_size;
+} nrf_block_dev_geometry_t;
+
+typedef struct
+{
+    uint32_t blk_id;
+    uint32_t blk_count;
+    void   * p_buff;
+} nrf_block_req_t;
+
+typedef enum
+{
+    NRF_BLOCK_DEV_EVT_INIT,
+    NRF_BLOCK_DEV_EVT_UNINIT,
+    NRF_BLOCK_DEV_EVT_BLK_READ_DONE,
+    NRF_BLOCK_DEV_EVT_BLK_WRITE_DONE,
+} nrf_block_dev_event_type_t;
+
+typedef enum
+{
+    NRF_BLOCK_DEV_RESULT_SUCCESS = 0,
+    NRF_BLOCK_DEV_RESULT_IO_ERROR,
+    NRF_BLOCK_DEV_RESULT_TIMEOUT,
+} nrf_block_dev_result_t;
+
+typedef struct
+{
+    nrf_block_dev_event_type_t ev_type;
+    nrf_block_dev_result_t     result;
+    nrf_block_req_t const    * p_blk_req;
+    void const               * p_context;
+} nrf_block_dev_event_t;
+
+typedef enum
+{
+    NRF_BLOCK_DEV_IOCTL_REQ_CACHE_FLUSH = 0,
+    NRF_BLOCK_DEV_IOCTL_REQ_INFO_STRINGS,
+} nrf_block_dev_ioctl_req_t;
+
+typedef struct
+{
+    const char * p_vendor;
+    const char * p_product;
+    const char * p_revision;
+} nrf_block_dev_info_strings_t;
+
+struct nrf_block_dev_s;
+
+typedef void (*nrf_block_dev_ev_handler)(struct nrf_block_dev_s const * p_blk_dev,
+                                         nrf_block_dev_event_t const  * p_event);
+
+typedef struct nrf_block_dev_ops_s
+{
+    ret_code_t (*init)(struct nrf_block_dev_s const * p_blk_dev,
+                       nrf_block_dev_ev_handler       ev_handler,
+                       void const                   * p_context);
+    ret_code_t (*uninit)(struct nrf_block_dev_s const * p_blk_dev);
+    ret_code_t (*read_req)(struct nrf_block_dev_s const * p_blk_dev, nrf_block_req_t const * p_blk);
+    ret_code_t (*write_req)(struct nrf_block_dev_s const * p_blk_dev, nrf_block_req_t const * p_blk);
+    ret_code_t (*ioctl)(struct nrf_block_dev_s const * p_blk_dev, nrf_block_dev_ioctl_req_t req, void * p_data);
+    nrf_block_dev_geometry_t const * (*geometry)(struct nrf_block_dev_s const * p_blk_dev);
+} nrf_block_dev_ops_t;
+
+typedef struct nrf_block_dev_s
+{
+    nrf_block_dev_ops_t const * p_ops;
+} nrf_block_dev_t;
+
+#endif // NRF_BLOCK_DEV_H__
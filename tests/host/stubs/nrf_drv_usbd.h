@@ -0,0 +1,11 @@
+/**@file
+ *
+ * @brief Host build stand-in for nrf_drv_usbd.h: the endpoint names only.
+ */
+#ifndef NRF_DRV_USBD_H__
+#define NRF_DRV_USBD_H__
+
+#define NRF_DRV_USBD_EPIN3      0x83
+#define NRF_DRV_USBD_EPOUT3     0x03
+
+#endif // NRF_DRV_USBD_H__
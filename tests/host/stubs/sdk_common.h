@@ -0,0 +1,14 @@
+/**@file
+ *
+ * @brief Host build stand-in for sdk_common.h: the error codes and utility macros it pulls in.
+ */
+#ifndef SDK_COMMON_H__
+#define SDK_COMMON_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sdk_errors.h"
+#include "app_util.h"
+
+#endif // SDK_COMMON_H__
@@ -0,0 +1,27 @@
+/**@file
+ *
+ * @brief Checks shared by the host tests. A failed check is printed and counted; the test
+ *        returns the count, so make stops at the first test that fails.
+ */
+#ifndef TEST_H__
+#define TEST_H__
+
+#include <stdio.h>
+
+static int m_test_failures;
+
+#define CHECK(expr)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(expr))                                                        \
+        {                                                                   \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+            m_test_failures++;                                              \
+        }                                                                   \
+    } while (0)
+
+#define TEST_END()                                                          \
+    (printf("%s: %s\n", __FILE__, (m_test_failures == 0) ? "OK" : "FAILED"), \
+     (m_test_failures == 0) ? 0 : 1)
+
+#endif // TEST_H__
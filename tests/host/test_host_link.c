@@ -0,0 +1,393 @@
+/**@file
+ *
+ * @brief Host test of @ref usb_stream over @ref host_link_mem: text and frames out, flow
+ *        control, frames in, following the host to another link, frames to the vendor
+ *        interface, and what a full queue leaves behind.
+ */
+#include <string.h>
+#include "app_util.h"
+#include "usb_stream.h"
+#include "host_link_mem.h"
+#include "event_trace.h"
+#include "test.h"
+
+#define MEM_SIZE    1200                        /**< Room of the link; less than three full buffers. */
+
+HOST_LINK_MEM_DEF(m_link, MEM_SIZE);
+HOST_LINK_MEM_DEF(m_link_other, 64);            /**< Second link of the same kind, to be refused. */
+
+static uint8_t                   m_uart_data[64];
+static host_link_mem_buf_t const m_uart_buf = { .p_data = m_uart_data, .size = sizeof(m_uart_data) };
+static host_link_t const         m_link_uart =  /**< Memory link standing in for the UART. */
+{
+    .p_ops     = &host_link_mem_ops,
+    .id        = HOST_LINK_ID_UART,
+    .p_name    = "uart",
+    .p_context = &m_uart_buf,
+};
+
+static usb_vendor_t m_vendor;                  /**< Vendor interface; usb_vendor_write below stands in for it. */
+static uint8_t      m_vendor_out[64];
+static uint16_t     m_vendor_len;
+static uint16_t     m_vendor_room;              /**< Bytes the vendor interface takes before it is full. */
+static uint32_t     m_vendor_depth;             /**< Copies in progress. */
+static uint32_t     m_vendor_nested;            /**< Most copies in progress at once. */
+static sdu_buf_t  * mp_vendor_preempt;          /**< Frame put during the next copy, as the BLE handler would. */
+
+static uint32_t  m_write_failed;                /**< EVENT_TRACE_STREAM_WRITE_FAILED records. */
+static uint32_t  m_queue_full;                  /**< EVENT_TRACE_STREAM_QUEUE_FULL records. */
+static uint32_t  m_frames;                      /**< Frames handed to the RX handler. */
+static uint8_t   m_last_type;
+static uint16_t  m_last_len;
+
+
+uint32_t transfer_metrics_timestamp(void)
+{
+    return 0;
+}
+
+
+uint32_t transfer_metrics_elapsed_us(uint32_t since)
+{
+    return 10;
+}
+
+
+ret_code_t usb_vendor_write(usb_vendor_t const * p_vendor, void const * p_data, size_t len)
+{
+    sdu_buf_t * p_preempt = mp_vendor_preempt;
+
+    if (p_vendor != &m_vendor)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (len > m_vendor_room)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    m_vendor_depth++;
+    m_vendor_nested = MAX(m_vendor_nested, m_vendor_depth);
+    if (p_preempt != NULL)
+    {
+        mp_vendor_preempt = NULL;
+        CHECK(usb_stream_buf_put(0x31, p_preempt) == NRF_SUCCESS);
+    }
+    memcpy(&m_vendor_out[m_vendor_len], p_data, len);
+    m_vendor_len  += (uint16_t)len;
+    m_vendor_room -= (uint16_t)len;
+    m_vendor_depth--;
+
+    return NRF_SUCCESS;
+}
+
+
+void event_trace_record(event_trace_source_t source, uint8_t id, uint16_t arg)
+{
+    if (source == EVENT_TRACE_SOURCE_STREAM)
+    {
+        m_write_failed += (id == EVENT_TRACE_STREAM_WRITE_FAILED);
+        m_queue_full   += (id == EVENT_TRACE_STREAM_QUEUE_FULL);
+    }
+}
+
+
+/**@brief Frame handler: counts frames and sends type 0x71 back, as an echo. */
+static void rx_handler(uint8_t type, sdu_buf_t * p_buf)
+{
+    m_frames++;
+    m_last_type = type;
+    m_last_len  = p_buf->len;
+
+    if (type == 0x71)
+    {
+        CHECK(usb_stream_buf_put(type, p_buf) == NRF_SUCCESS);
+    }
+}
+
+
+static sdu_buf_t * buf_get(uint8_t fill, uint16_t len)
+{
+    sdu_buf_t * p_buf = sdu_pool_alloc();
+
+    CHECK(p_buf != NULL);
+    memset(sdu_buf_payload(p_buf), fill, len);
+    p_buf->len = len;
+
+    return p_buf;
+}
+
+
+static void raw_put(uint8_t const * p_data, uint16_t len)
+{
+    sdu_buf_t * p_buf = buf_get(0, len);
+
+    memcpy(sdu_buf_payload(p_buf), p_data, len);
+    CHECK(usb_stream_raw_put(p_buf) == NRF_SUCCESS);
+    sdu_pool_release(p_buf);
+}
+
+
+static void process(void)
+{
+    for (uint32_t i = 0; i < USB_STREAM_QUEUE_DEPTH + 2; i++)
+    {
+        host_link_process();
+    }
+}
+
+
+static void setup(void)
+{
+    CHECK(sdu_pool_init() == NRF_SUCCESS);
+    CHECK(usb_stream_init(&m_link) == NRF_SUCCESS);
+    usb_stream_rx_handler_set(rx_handler);
+    m_write_failed = 0;
+    m_queue_full   = 0;
+    m_frames       = 0;
+}
+
+
+static void test_open(void)
+{
+    sdu_pool_stats_t pool;
+
+    setup();
+
+    // Nothing is listening yet: the write is refused and the buffer dropped.
+    raw_put((uint8_t const *)"x", 1);
+    CHECK(m_write_failed == 1);
+    CHECK(host_link_state_get(&m_link) == HOST_LINK_STATE_CLOSED);
+
+    CHECK(host_link_open(&m_link) == NRF_SUCCESS);
+    CHECK(host_link_open(&m_link_other) == NRF_ERROR_INVALID_STATE);
+    CHECK(host_link_get(HOST_LINK_ID_MEM) == &m_link);
+    CHECK(host_link_state_get(&m_link) == HOST_LINK_STATE_READY);
+
+    sdu_pool_stats_get(&pool);
+    CHECK(pool.in_use == 0);
+}
+
+
+static void test_text(void)
+{
+    uint8_t           out[64];
+    host_link_stats_t stats;
+
+    setup();
+    CHECK(host_link_open(&m_link) == NRF_SUCCESS);
+
+    raw_put((uint8_t const *)"hello ", 6);
+    raw_put((uint8_t const *)"world", 5);
+    CHECK(host_link_state_get(&m_link) == HOST_LINK_STATE_BUSY);
+
+    process();
+    CHECK(host_link_state_get(&m_link) == HOST_LINK_STATE_READY);
+    CHECK(host_link_mem_read(&m_link, out, sizeof(out)) == 11);
+    CHECK(memcmp(out, "hello world", 11) == 0);
+
+    host_link_stats_get(&m_link, &stats);
+    CHECK(stats.tx_bytes == 11);
+    CHECK(stats.tx_writes == 2);
+    CHECK(stats.tx_us == 20);
+    CHECK(stats.tx_held == 0);
+}
+
+
+static void test_flow_control(void)
+{
+    static uint8_t    out[MEM_SIZE];
+    host_link_stats_t stats;
+    sdu_pool_stats_t  pool;
+
+    setup();
+    CHECK(host_link_open(&m_link) == NRF_SUCCESS);
+
+    // The third buffer does not fit until the host reads.
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        sdu_buf_t * p_buf = buf_get('a' + i, 500);
+
+        CHECK(usb_stream_raw_put(p_buf) == NRF_SUCCESS);
+        sdu_pool_release(p_buf);
+    }
+
+    process();
+    host_link_stats_get(&m_link, &stats);
+    CHECK(stats.tx_held == 1);
+    CHECK(stats.tx_writes == 2);
+    CHECK(host_link_state_get(&m_link) == HOST_LINK_STATE_BUSY);
+
+    CHECK(host_link_mem_read(&m_link, out, 1000) == 1000);
+    CHECK((out[0] == 'a') && (out[999] == 'b'));
+
+    // HOST_LINK_EVT_READY restarts the held write without a retry loop.
+    process();
+    CHECK(host_link_mem_read(&m_link, out, sizeof(out)) == 500);
+    CHECK((out[0] == 'c') && (out[499] == 'c'));
+
+    host_link_stats_get(&m_link, &stats);
+    CHECK(stats.tx_writes == 3);
+    CHECK(stats.tx_bytes == 1500);
+    sdu_pool_stats_get(&pool);
+    CHECK(pool.in_use == 0);
+}
+
+
+static void test_frames_in(void)
+{
+    static uint8_t const frames[] =
+    {
+        'x',                                        // Noise before the first frame.
+        USB_STREAM_SYNC, 0x71, 3, 0, 1, 2, 3,
+        USB_STREAM_SYNC, 0x20, 0, 0,
+    };
+    uint8_t          out[64];
+    sdu_pool_stats_t pool;
+
+    setup();
+    CHECK(host_link_open(&m_link) == NRF_SUCCESS);
+
+    // Split inside the length of the first frame.
+    host_link_mem_inject(&m_link, frames, 4);
+    CHECK(m_frames == 0);
+    host_link_mem_inject(&m_link, &frames[4], sizeof(frames) - 4);
+    CHECK(m_frames == 2);
+    CHECK(m_last_type == 0x20);
+    CHECK(m_last_len == 0);
+
+    // The echo of 0x71 comes back framed, byte for byte.
+    process();
+    CHECK(host_link_mem_read(&m_link, out, sizeof(out)) == 7);
+    CHECK(memcmp(out, &frames[1], 7) == 0);
+
+    sdu_pool_stats_get(&pool);
+    CHECK(pool.in_use == 0);
+}
+
+
+static void test_link_follow(void)
+{
+    static uint8_t const noise[] = { 0x00, 0xFF, USB_STREAM_SYNC, 0x30 };
+    static uint8_t const frame[] = { USB_STREAM_SYNC, 0x20, 1, 0, 'x' };
+    static uint8_t const rest[]  = { 0, 0 };
+
+    setup();
+    CHECK(host_link_open(&m_link) == NRF_SUCCESS);
+    CHECK(host_link_open(&m_link_uart) == NRF_SUCCESS);
+    CHECK(usb_stream_link_get() == &m_link);
+
+    // Noise, or a frame not complete yet, leaves the stream where it is.
+    host_link_mem_inject(&m_link_uart, noise, sizeof(noise));
+    CHECK(usb_stream_link_get() == &m_link);
+    CHECK(m_frames == 0);
+
+    // The end of that frame moves it.
+    host_link_mem_inject(&m_link_uart, rest, sizeof(rest));
+    CHECK(m_frames == 1);
+    CHECK(usb_stream_link_get() == &m_link_uart);
+
+    // And a whole frame on the first link moves it back.
+    host_link_mem_inject(&m_link, frame, sizeof(frame));
+    CHECK(m_frames == 2);
+    CHECK(usb_stream_link_get() == &m_link);
+}
+
+
+static void test_vendor(void)
+{
+    static uint8_t const expected[] =
+    {
+        USB_STREAM_SYNC, 0x30, 2, 0, 'a', 'a',
+        USB_STREAM_SYNC, 0x31, 2, 0, 'b', 'b',
+        USB_STREAM_SYNC, 0x30, 2, 0, 'c', 'c',
+    };
+    sdu_buf_t      * p_a;
+    sdu_buf_t      * p_b;
+    sdu_buf_t      * p_c;
+    sdu_pool_stats_t pool;
+
+    setup();
+    CHECK(host_link_open(&m_link) == NRF_SUCCESS);
+    usb_stream_vendor_set(&m_vendor);
+    m_vendor_len    = 0;
+    m_vendor_room   = 12;                       // Two frames.
+    m_vendor_nested = 0;
+    p_a = buf_get('a', 2);
+    p_b = buf_get('b', 2);
+    p_c = buf_get('c', 2);
+
+    // A frame put while another is copied is copied after it, not in the middle of it.
+    mp_vendor_preempt = p_b;
+    CHECK(usb_stream_buf_put(0x30, p_a) == NRF_SUCCESS);
+    CHECK(m_vendor_nested == 1);
+    CHECK(m_vendor_len == 12);
+
+    // No room: the frame waits for the end of a transfer.
+    CHECK(usb_stream_buf_put(0x30, p_c) == NRF_SUCCESS);
+    CHECK(m_vendor_len == 12);
+    m_vendor_room = 6;
+    usb_stream_on_vendor_tx_done();
+    CHECK(m_vendor_len == sizeof(expected));
+    CHECK(memcmp(m_vendor_out, expected, sizeof(expected)) == 0);
+    CHECK(host_link_mem_read(&m_link, NULL, MEM_SIZE) == 0);
+
+    usb_stream_vendor_set(NULL);
+    sdu_pool_release(p_a);
+    sdu_pool_release(p_b);
+    sdu_pool_release(p_c);
+    sdu_pool_stats_get(&pool);
+    CHECK(pool.in_use == 0);
+}
+
+
+static void test_queue_full(void)
+{
+    sdu_buf_t      * p_text;
+    sdu_buf_t      * p_buf;
+    sdu_pool_stats_t pool;
+
+    setup();
+    CHECK(host_link_open(&m_link) == NRF_SUCCESS);
+    p_text = buf_get('t', 10);
+    p_buf  = buf_get('f', 20);
+
+    for (uint32_t i = 0; i < USB_STREAM_QUEUE_DEPTH; i++)
+    {
+        CHECK(usb_stream_raw_put(p_text) == NRF_SUCCESS);
+    }
+
+    // A frame that is not queued leaves the buffer as it was, so it can be put again.
+    CHECK(usb_stream_buf_put(0x30, p_buf) == NRF_ERROR_NO_MEM);
+    CHECK(m_queue_full == 1);
+    CHECK(p_buf->len == 20);
+    CHECK(p_buf->offset == SDU_POOL_HEADROOM);
+    CHECK(p_buf->ref_count == 1);
+
+    process();
+    CHECK(host_link_mem_read(&m_link, NULL, MEM_SIZE) == 10 * USB_STREAM_QUEUE_DEPTH);
+
+    CHECK(usb_stream_buf_put(0x30, p_buf) == NRF_SUCCESS);
+    CHECK(p_buf->len == 20 + USB_STREAM_HEADER_LEN);
+    process();
+    CHECK(host_link_mem_read(&m_link, NULL, MEM_SIZE) == 20 + USB_STREAM_HEADER_LEN);
+
+    sdu_pool_release(p_text);
+    sdu_pool_release(p_buf);
+    sdu_pool_stats_get(&pool);
+    CHECK(pool.in_use == 0);
+}
+
+
+int main(void)
+{
+    test_open();
+    test_text();
+    test_flow_control();
+    test_frames_in();
+    test_link_follow();
+    test_vendor();
+    test_queue_full();
+
+    return TEST_END();
+}
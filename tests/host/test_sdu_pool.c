@@ -0,0 +1,140 @@
+/**@file
+ *
+ * @brief Host test of @ref sdu_pool: references, occupancy counts, header room and the reserve.
+ */
+#include <string.h>
+#include "sdu_pool.h"
+#include "test.h"
+
+
+static void test_alloc_release(void)
+{
+    sdu_buf_t      * p_bufs[SDU_POOL_COUNT];
+    sdu_pool_stats_t stats;
+
+    CHECK(sdu_pool_init() == NRF_SUCCESS);
+
+    for (uint32_t i = 0; i < SDU_POOL_COUNT; i++)
+    {
+        p_bufs[i] = sdu_pool_alloc();
+        CHECK(p_bufs[i] != NULL);
+        CHECK(p_bufs[i]->ref_count == 1);
+        CHECK(p_bufs[i]->len == 0);
+        CHECK(p_bufs[i]->offset == SDU_POOL_HEADROOM);
+    }
+
+    // The pool is empty now.
+    CHECK(sdu_pool_alloc() == NULL);
+    sdu_pool_stats_get(&stats);
+    CHECK(stats.in_use == SDU_POOL_COUNT);
+    CHECK(stats.high_water == SDU_POOL_COUNT);
+    CHECK(stats.alloc_failures == 1);
+
+    // A retained buffer returns with its last reference only.
+    sdu_pool_retain(p_bufs[0]);
+    sdu_pool_release(p_bufs[0]);
+    CHECK(sdu_pool_alloc() == NULL);
+    sdu_pool_release(p_bufs[0]);
+    p_bufs[0] = sdu_pool_alloc();
+    CHECK(p_bufs[0] != NULL);
+
+    for (uint32_t i = 0; i < SDU_POOL_COUNT; i++)
+    {
+        sdu_pool_release(p_bufs[i]);
+    }
+
+    sdu_pool_stats_get(&stats);
+    CHECK(stats.in_use == 0);
+    CHECK(stats.high_water == SDU_POOL_COUNT);
+}
+
+
+static void test_push_pull(void)
+{
+    sdu_buf_t * p_buf;
+    uint8_t   * p_header;
+
+    CHECK(sdu_pool_init() == NRF_SUCCESS);
+    p_buf = sdu_pool_alloc();
+    memcpy(sdu_buf_payload(p_buf), "data", 4);
+    p_buf->len = 4;
+
+    // A header goes in front of the payload, which stays where it is.
+    p_header = sdu_buf_push(p_buf, 4);
+    CHECK(p_header == &p_buf->data[SDU_POOL_HEADROOM - 4]);
+    CHECK(p_buf->len == 8);
+    memcpy(p_header, "head", 4);
+    CHECK(memcmp(&p_buf->data[p_buf->offset], "headdata", 8) == 0);
+
+    // Pulling it off gives the buffer back as it was.
+    CHECK(sdu_buf_pull(p_buf, 4) == sdu_buf_payload(p_buf));
+    CHECK(p_buf->len == 4);
+    CHECK(p_buf->offset == SDU_POOL_HEADROOM);
+
+    // Neither goes past the headroom or the data.
+    CHECK(sdu_buf_push(p_buf, SDU_POOL_HEADROOM + 1) == NULL);
+    CHECK(sdu_buf_push(p_buf, SDU_POOL_HEADROOM) == &p_buf->data[0]);
+    CHECK(sdu_buf_push(p_buf, 1) == NULL);
+    CHECK(sdu_buf_pull(p_buf, SDU_POOL_HEADROOM + 5) == NULL);
+    CHECK(sdu_buf_pull(p_buf, SDU_POOL_HEADROOM + 4) == &p_buf->data[SDU_POOL_HEADROOM + 4]);
+    CHECK(p_buf->len == 0);
+
+    sdu_pool_release(p_buf);
+}
+
+
+static void test_spare(void)
+{
+    sdu_buf_t      * p_bufs[SDU_POOL_COUNT];
+    sdu_buf_t      * p_spare;
+    sdu_pool_stats_t stats;
+    uint32_t         count = 0;
+
+    CHECK(sdu_pool_init() == NRF_SUCCESS);
+
+    // Spare allocations stop at the reserve, without counting as failures.
+    while ((p_bufs[count] = sdu_pool_alloc_spare()) != NULL)
+    {
+        count++;
+    }
+    CHECK(count == SDU_POOL_COUNT - SDU_POOL_RESERVE);
+    sdu_pool_stats_get(&stats);
+    CHECK(stats.alloc_failures == 0);
+
+    // The reserve is still there for plain allocations.
+    while (count < SDU_POOL_COUNT)
+    {
+        p_bufs[count] = sdu_pool_alloc();
+        CHECK(p_bufs[count] != NULL);
+        count++;
+    }
+
+    // One buffer back is not enough for a spare allocation.
+    sdu_pool_release(p_bufs[--count]);
+    CHECK(sdu_pool_alloc_spare() == NULL);
+
+    for (uint32_t i = 0; i < SDU_POOL_RESERVE; i++)
+    {
+        sdu_pool_release(p_bufs[--count]);
+    }
+    p_spare = sdu_pool_alloc_spare();
+    CHECK(p_spare != NULL);
+    sdu_pool_release(p_spare);
+
+    while (count > 0)
+    {
+        sdu_pool_release(p_bufs[--count]);
+    }
+    sdu_pool_stats_get(&stats);
+    CHECK(stats.in_use == 0);
+}
+
+
+int main(void)
+{
+    test_alloc_release();
+    test_push_pull();
+    test_spare();
+
+    return TEST_END();
+}
@@ -0,0 +1,275 @@
+/**@file
+ *
+ * @brief Replays a trace saved by tools/trace_replay.py through the real @ref sdu_pool,
+ *        @ref usb_stream and @ref host_link, built for the host.
+ *
+ * @details Records are fed in order, and the clock of @ref host_link follows their timestamps:
+ *          - BLE_L2CAP_EVT_CH_RX: the SDU is forwarded as @ref ots_collector does it. A new
+ *            receive buffer is taken from the pool, the SDU gets its frame header in the
+ *            headroom and goes to @ref usb_stream_buf_put. If the pool is empty, the SDU is
+ *            dropped.
+ *          - CDC ACM TX_DONE: the host has taken one write. The data is read out of
+ *            @ref host_link_mem and the end of the write is reported, which starts the next one.
+ *          - A reset starts the modules again; the figures of every run are added up.
+ *
+ *          Any other record only moves the clock. The report is printed as JSON, for
+ *          tools/trace_replay.py --harness.
+ *
+ *          Usage: trace_harness <trace file>
+ */
+#include <stdio.h>
+#include <string.h>
+#include "app_util.h"
+#include "usb_stream.h"
+#include "host_link_mem.h"
+#include "event_trace.h"
+
+#define FILE_MAGIC          "EVTRACE1"
+#define FILE_MAGIC_LEN      8
+#define RECORD_LEN          8
+
+#define BLE_ID_L2CAP_CH_RX  0x76                        /**< Low byte of BLE_L2CAP_EVT_CH_RX. */
+#define CDC_ID_TX_DONE      2                           /**< APP_USBD_CDC_ACM_USER_EVT_TX_DONE. */
+
+#define FRAME_DATA          0x02                        /**< OTS_COLLECTOR_FRAME_DATA. */
+#define FRAME_HEAD_LEN      (6 + sizeof(uint32_t))      /**< Address and offset that @ref ots_collector puts in front of each SDU. */
+#define LINK_SIZE           (SDU_POOL_HEADROOM + SDU_POOL_DATA_SIZE)    /**< Room for the longest write. */
+
+HOST_LINK_MEM_DEF(m_link, LINK_SIZE);
+
+/**@brief Figures of the replay, added up over resets. */
+typedef struct
+{
+    uint32_t          records;
+    uint32_t          resets;
+    uint32_t          sdu_received;
+    uint32_t          sdu_dropped;                  /**< Pool empty or stream full. */
+    uint32_t          bytes_forwarded;
+    uint32_t          queue_full;                   /**< EVENT_TRACE_STREAM_QUEUE_FULL raised by the replay. */
+    uint32_t          write_failed;
+    uint32_t          queue_full_recorded;          /**< EVENT_TRACE_STREAM_QUEUE_FULL in the trace. */
+    uint32_t          high_water;
+    uint32_t          alloc_failures;
+    host_link_stats_t link;
+} harness_report_t;
+
+static uint32_t         m_tick_hz;
+static uint32_t         m_now;                      /**< Timestamp of the record being replayed. */
+static uint32_t         m_offset;                   /**< Added to the timestamps of the run since the last reset. */
+static sdu_buf_t      * mp_rx;                      /**< Buffer the next SDU is received into. */
+static harness_report_t m_report;
+
+
+uint32_t transfer_metrics_timestamp(void)
+{
+    return m_now;
+}
+
+
+uint32_t transfer_metrics_elapsed_us(uint32_t since)
+{
+    return (uint32_t)(((uint64_t)(m_now - since) * 1000000) / m_tick_hz);
+}
+
+
+ret_code_t usb_vendor_write(usb_vendor_t const * p_vendor, void const * p_data, size_t len)
+{
+    return NRF_ERROR_INVALID_STATE;
+}
+
+
+void event_trace_record(event_trace_source_t source, uint8_t id, uint16_t arg)
+{
+    if (source == EVENT_TRACE_SOURCE_STREAM)
+    {
+        m_report.queue_full   += (id == EVENT_TRACE_STREAM_QUEUE_FULL);
+        m_report.write_failed += (id == EVENT_TRACE_STREAM_WRITE_FAILED);
+    }
+}
+
+
+static void start(void)
+{
+    (void)sdu_pool_init();
+    (void)usb_stream_init(&m_link);
+    (void)host_link_open(&m_link);
+    mp_rx = sdu_pool_alloc();
+}
+
+
+/**@brief Function for adding the figures of the run that ends to the report. */
+static void stop(void)
+{
+    sdu_pool_stats_t  pool;
+    host_link_stats_t link;
+
+    sdu_pool_stats_get(&pool);
+    host_link_stats_get(&m_link, &link);
+
+    m_report.high_water      = MAX(m_report.high_water, pool.high_water);
+    m_report.alloc_failures += pool.alloc_failures;
+    m_report.link.rx_bytes  += link.rx_bytes;
+    m_report.link.tx_bytes  += link.tx_bytes;
+    m_report.link.tx_writes += link.tx_writes;
+    m_report.link.tx_us     += link.tx_us;
+    m_report.link.tx_held   += link.tx_held;
+    m_report.link.tx_failed += link.tx_failed;
+}
+
+
+static void on_sdu(uint16_t len)
+{
+    sdu_buf_t * p_next = sdu_pool_alloc();
+    uint8_t   * p_head;
+
+    m_report.sdu_received++;
+
+    if (mp_rx == NULL)
+    {
+        // No receive buffer was given to the SoftDevice: the SDU had nowhere to go.
+        m_report.sdu_dropped++;
+        mp_rx = p_next;
+        return;
+    }
+    if (p_next == NULL)
+    {
+        // Pool empty: the SDU is dropped and its buffer received into again.
+        m_report.sdu_dropped++;
+        return;
+    }
+
+    mp_rx->len = MIN(len, SDU_POOL_DATA_SIZE);
+    p_head     = sdu_buf_push(mp_rx, FRAME_HEAD_LEN);
+    memset(p_head, 0, FRAME_HEAD_LEN);
+
+    if (usb_stream_buf_put(FRAME_DATA, mp_rx) == NRF_SUCCESS)
+    {
+        m_report.bytes_forwarded += MIN(len, SDU_POOL_DATA_SIZE);
+    }
+    else
+    {
+        m_report.sdu_dropped++;
+    }
+    sdu_pool_release(mp_rx);
+    mp_rx = p_next;
+}
+
+
+static void on_host_read(void)
+{
+    (void)host_link_mem_read(&m_link, NULL, LINK_SIZE);
+    host_link_process();
+}
+
+
+static void replay(uint8_t const * p_rec)
+{
+    uint32_t ticks  = uint32_decode(&p_rec[0]);
+    uint8_t  source = p_rec[4] >> EVENT_TRACE_SOURCE_POS;
+    uint8_t  id     = p_rec[5];
+    uint16_t arg    = uint16_decode(&p_rec[6]);
+
+    m_report.records++;
+
+    // A reset restarts the clock; later runs are laid after the earlier ones, as in
+    // tools/trace_replay.py.
+    if (source == EVENT_TRACE_SOURCE_RESET)
+    {
+        if (m_report.records > 1)
+        {
+            m_offset = m_now + 1 - ticks;
+        }
+        m_report.resets++;
+        stop();
+        start();
+    }
+    m_now = ticks + m_offset;
+
+    switch (source)
+    {
+        case EVENT_TRACE_SOURCE_BLE:
+            if (id == BLE_ID_L2CAP_CH_RX)
+            {
+                on_sdu(arg);
+            }
+            break;
+
+        case EVENT_TRACE_SOURCE_CDC:
+            if (id == CDC_ID_TX_DONE)
+            {
+                on_host_read();
+            }
+            break;
+
+        case EVENT_TRACE_SOURCE_STREAM:
+            m_report.queue_full_recorded += (id == EVENT_TRACE_STREAM_QUEUE_FULL);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+static void report_print(void)
+{
+    printf("{\n");
+    printf("  \"records\": %u,\n", m_report.records);
+    printf("  \"resets\": %u,\n", m_report.resets);
+    printf("  \"pool\": {\"high_water\": %u, \"alloc_failures\": %u},\n",
+           m_report.high_water, m_report.alloc_failures);
+    printf("  \"sdu\": {\"received\": %u, \"dropped\": %u, \"bytes_forwarded\": %u},\n",
+           m_report.sdu_received, m_report.sdu_dropped, m_report.bytes_forwarded);
+    printf("  \"stream\": {\"queue_full\": %u, \"queue_full_recorded\": %u, \"write_failed\": %u},\n",
+           m_report.queue_full, m_report.queue_full_recorded, m_report.write_failed);
+    printf("  \"link\": {\"tx_bytes\": %u, \"tx_writes\": %u, \"tx_us\": %u, \"tx_held\": %u, \"tx_failed\": %u}\n",
+           m_report.link.tx_bytes, m_report.link.tx_writes, m_report.link.tx_us,
+           m_report.link.tx_held, m_report.link.tx_failed);
+    printf("}\n");
+}
+
+
+int main(int argc, char * argv[])
+{
+    uint8_t header[FILE_MAGIC_LEN + sizeof(uint32_t)];
+    uint8_t rec[RECORD_LEN];
+    FILE  * p_file;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return 2;
+    }
+
+    p_file = fopen(argv[1], "rb");
+    if (p_file == NULL)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+    if ((fread(header, sizeof(header), 1, p_file) != 1) ||
+        (memcmp(header, FILE_MAGIC, FILE_MAGIC_LEN) != 0))
+    {
+        fprintf(stderr, "%s is not a saved trace\n", argv[1]);
+        fclose(p_file);
+        return 2;
+    }
+
+    m_tick_hz = uint32_decode(&header[FILE_MAGIC_LEN]);
+    if (m_tick_hz == 0)
+    {
+        m_tick_hz = 32768;
+    }
+
+    start();
+    while (fread(rec, sizeof(rec), 1, p_file) == 1)
+    {
+        replay(rec);
+    }
+    stop();
+    fclose(p_file);
+
+    report_print();
+
+    return 0;
+}
@@ -0,0 +1,258 @@
+#!/usr/bin/env python3
+"""Record and decode the dongle's BLE event capture.
+
+The dongle sends pcapng blocks in frames over its CDC ACM port while capture
+runs (see ble_capture.h). "record" starts capture, writes the blocks to a
+pcapng file until Ctrl-C or --duration, and stops capture so the dongle
+appends its statistics block. "decode" prints a pcapng file written that way,
+one event per line, and the capture cost reported by the dongle.
+
+The packets use link type USER0 (147). Wireshark opens the file, but shows the
+packets as raw data.
+
+Requires pyserial for "record".
+
+Examples:
+
+    tools/ble_capture.py record /dev/ttyACM0 -o slow_transfer.pcapng --duration 30
+    tools/ble_capture.py decode slow_transfer.pcapng --conn 0x0001
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+SYNC = 0xA5
+FRAME_CONTROL = 0x30
+FRAME_PCAPNG = 0x31
+LINKTYPE = 147
+
+BLOCK_SHB = 0x0A0D0D0A
+BLOCK_IDB = 0x00000001
+BLOCK_ISB = 0x00000005
+BLOCK_EPB = 0x00000006
+
+SOURCE_BLE = 0
+SOURCE_OTS = 1
+
+BLE_EVENTS = {
+    0x01: "USER_MEM_REQUEST", 0x02: "USER_MEM_RELEASE",
+    0x10: "GAP_CONNECTED", 0x11: "GAP_DISCONNECTED", 0x12: "GAP_CONN_PARAM_UPDATE",
+    0x13: "GAP_SEC_PARAMS_REQUEST", 0x14: "GAP_SEC_INFO_REQUEST", 0x15: "GAP_PASSKEY_DISPLAY",
+    0x16: "GAP_KEY_PRESSED", 0x17: "GAP_AUTH_KEY_REQUEST", 0x18: "GAP_LESC_DHKEY_REQUEST",
+    0x19: "GAP_AUTH_STATUS", 0x1A: "GAP_CONN_SEC_UPDATE", 0x1B: "GAP_TIMEOUT",
+    0x1C: "GAP_RSSI_CHANGED", 0x1D: "GAP_ADV_REPORT", 0x1E: "GAP_SEC_REQUEST",
+    0x1F: "GAP_CONN_PARAM_UPDATE_REQUEST", 0x20: "GAP_SCAN_REQ_REPORT",
+    0x21: "GAP_PHY_UPDATE_REQUEST", 0x22: "GAP_PHY_UPDATE",
+    0x23: "GAP_DATA_LENGTH_UPDATE_REQUEST", 0x24: "GAP_DATA_LENGTH_UPDATE",
+    0x25: "GAP_QOS_CHANNEL_SURVEY_REPORT", 0x26: "GAP_ADV_SET_TERMINATED",
+    0x30: "GATTC_PRIM_SRVC_DISC_RSP", 0x31: "GATTC_REL_DISC_RSP", 0x32: "GATTC_CHAR_DISC_RSP",
+    0x33: "GATTC_DESC_DISC_RSP", 0x34: "GATTC_ATTR_INFO_DISC_RSP",
+    0x35: "GATTC_CHAR_VAL_BY_UUID_READ_RSP", 0x36: "GATTC_READ_RSP",
+    0x37: "GATTC_CHAR_VALS_READ_RSP", 0x38: "GATTC_WRITE_RSP", 0x39: "GATTC_HVX",
+    0x3A: "GATTC_EXCHANGE_MTU_RSP", 0x3B: "GATTC_TIMEOUT", 0x3C: "GATTC_WRITE_CMD_TX_COMPLETE",
+    0x50: "GATTS_WRITE", 0x51: "GATTS_RW_AUTHORIZE_REQUEST", 0x52: "GATTS_SYS_ATTR_MISSING",
+    0x53: "GATTS_HVC", 0x54: "GATTS_SC_CONFIRM", 0x55: "GATTS_EXCHANGE_MTU_REQUEST",
+    0x56: "GATTS_TIMEOUT", 0x57: "GATTS_HVN_TX_COMPLETE",
+    0x70: "L2CAP_CH_SETUP_REQUEST", 0x71: "L2CAP_CH_SETUP_REFUSED", 0x72: "L2CAP_CH_SETUP",
+    0x73: "L2CAP_CH_RELEASED", 0x74: "L2CAP_CH_SDU_BUF_RELEASED", 0x75: "L2CAP_CH_CREDIT",
+    0x76: "L2CAP_CH_RX", 0x77: "L2CAP_CH_TX",
+}
+
+OTS_EVENTS = {
+    0: "OTS_OACP", 1: "OTS_OBJECT", 2: "OTS_INDICATION_ENABLED",
+    3: "OTS_INDICATION_DISABLED", 4: "OTS_OBJECT_RECEIVED",
+}
+
+
+def u16(body, offset):
+    if len(body) < offset + 2:
+        return None
+    return struct.unpack_from("<H", body, offset)[0]
+
+
+def details(event, body):
+    """Fields worth reading for the events that explain a slow transfer.
+
+    The body starts with the connection handle. The offsets below follow the
+    S140 7.x event structures: GAP and L2CAP parameters start at offset 4,
+    GATTS parameters at 2 and GATTC parameters at 6.
+    """
+    if event == 0x12 and len(body) >= 12:
+        lo, hi, latency, timeout = struct.unpack_from("<HHHH", body, 4)
+        return "interval %.2f-%.2f ms latency %d timeout %d ms" % (lo * 1.25, hi * 1.25, latency, timeout * 10)
+    if event == 0x11 and len(body) >= 5:
+        return "reason 0x%02x" % body[4]
+    if event == 0x22 and len(body) >= 7:
+        return "status 0x%02x tx_phy %d rx_phy %d" % (body[4], body[5], body[6])
+    if event == 0x24 and len(body) >= 8:
+        return "tx %d B rx %d B" % (u16(body, 4), u16(body, 6))
+    if event in (0x50, 0x51) and len(body) >= 16:
+        offset = 2 if event == 0x50 else 4
+        return "handle 0x%04x op 0x%02x len %d" % (u16(body, offset), body[offset + 6], u16(body, offset + 10))
+    if event == 0x55 and len(body) >= 4:
+        return "client rx mtu %d" % u16(body, 2)
+    if event == 0x57 and len(body) >= 3:
+        return "count %d" % body[2]
+    if event == 0x3C and len(body) >= 7:
+        return "count %d" % body[6]
+    if 0x70 <= event <= 0x77 and len(body) >= 4:
+        text = "cid 0x%04x" % u16(body, 2)
+        if event == 0x72 and len(body) >= 12:
+            text += " peer_mps %d tx_mtu %d credits %d" % (u16(body, 6), u16(body, 8), u16(body, 10))
+        elif event == 0x75 and len(body) >= 6:
+            text += " credits +%d" % u16(body, 4)
+        elif event == 0x76 and len(body) >= 6:
+            text += " sdu %d B" % u16(body, 4)
+        elif event in (0x74, 0x77) and len(body) >= 10:
+            text += " sdu %d B" % u16(body, 8)
+        return text
+    return ""
+
+
+def read_blocks(data):
+    offset = 0
+    while offset + 12 <= len(data):
+        block_type, length = struct.unpack_from("<II", data, offset)
+        if length < 12 or offset + length > len(data):
+            break
+        yield block_type, data[offset + 8:offset + length - 4]
+        offset += length
+
+
+def read_options(data):
+    offset = 0
+    while offset + 4 <= len(data):
+        code, length = struct.unpack_from("<HH", data, offset)
+        if code == 0:
+            return
+        yield code, data[offset + 4:offset + 4 + length]
+        offset += 4 + ((length + 3) & ~3)
+
+
+def decode(args):
+    with open(args.file, "rb") as f:
+        data = f.read()
+
+    conn = int(args.conn, 0) if args.conn is not None else None
+    first = None
+    previous = None
+    counts = {}
+
+    for block_type, body in read_blocks(data):
+        if block_type == BLOCK_IDB:
+            linktype = struct.unpack_from("<H", body, 0)[0]
+            if linktype != LINKTYPE:
+                sys.exit("ble_capture: link type %d is not a dongle capture" % linktype)
+        elif block_type == BLOCK_EPB:
+            _, ts_hi, ts_lo, cap_len, orig_len = struct.unpack_from("<IIIII", body, 0)
+            packet = body[20:20 + cap_len]
+            if len(packet) < 8:
+                continue
+            source, _, event, handle, event_len = struct.unpack_from("<BBHHH", packet, 0)
+            if conn is not None and handle != conn:
+                continue
+            ts = (ts_hi << 32) | ts_lo
+            first = ts if first is None else first
+            delta = 0 if previous is None else ts - previous
+            previous = ts
+            if source == SOURCE_BLE:
+                name = BLE_EVENTS.get(event, "BLE_0x%02x" % event)
+                text = details(event, packet[8:])
+            else:
+                name = OTS_EVENTS.get(event, "OTS_%d" % event)
+                text = "type %d" % packet[8] if event == 0 and len(packet) > 8 else ""
+            counts[name] = counts.get(name, 0) + 1
+            print("%12.6f %+10.3f ms  0x%04x  %-30s %s" % ((ts - first) / 1e6, delta / 1e3, handle, name, text))
+        elif block_type == BLOCK_ISB:
+            for code, value in read_options(body[12:]):
+                if code == 4:
+                    print("dongle: %d events" % struct.unpack("<Q", value)[0])
+                elif code == 5:
+                    print("dongle: %d dropped" % struct.unpack("<Q", value)[0])
+                elif code == 1:
+                    print("dongle: %s" % value.decode("ascii", "replace"))
+
+    if args.summary:
+        for name, count in sorted(counts.items(), key=lambda item: -item[1]):
+            print("%8d  %s" % (count, name))
+
+
+def record(args):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("ble_capture: pyserial is required (pip install pyserial)")
+
+    port = serial.Serial(args.port, timeout=0.05)
+    buf = bytearray()
+    blocks = 0
+
+    def control(enable):
+        port.write(struct.pack("<BBHB", SYNC, FRAME_CONTROL, 1, 1 if enable else 0))
+
+    def pump(out):
+        nonlocal blocks
+        buf.extend(port.read(port.in_waiting or 1))
+        got_isb = False
+        while True:
+            start = buf.find(SYNC)
+            if start < 0:
+                buf.clear()
+                return got_isb
+            del buf[:start]
+            if len(buf) < 4:
+                return got_isb
+            length = buf[2] | (buf[3] << 8)
+            if len(buf) < 4 + length:
+                return got_isb
+            frame_type = buf[1]
+            payload = bytes(buf[4:4 + length])
+            del buf[:4 + length]
+            if frame_type != FRAME_PCAPNG:
+                continue
+            out.write(payload)
+            for block_type, _ in read_blocks(payload):
+                blocks += 1
+                got_isb |= block_type == BLOCK_ISB
+
+    with open(args.output, "wb") as out:
+        control(True)
+        deadline = time.monotonic() + args.duration if args.duration else None
+        try:
+            while deadline is None or time.monotonic() < deadline:
+                pump(out)
+        except KeyboardInterrupt:
+            pass
+        control(False)
+        deadline = time.monotonic() + 5.0
+        while time.monotonic() < deadline:
+            if pump(out):
+                break
+
+    print("%d blocks written to %s" % (blocks, args.output))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("record", help="capture to a pcapng file")
+    p.add_argument("port", help="CDC ACM port of the dongle")
+    p.add_argument("-o", "--output", required=True, help="pcapng file to write")
+    p.add_argument("--duration", type=float, help="seconds to capture (default: until Ctrl-C)")
+    p.set_defaults(func=record)
+
+    p = sub.add_parser("decode", help="print a capture")
+    p.add_argument("file", help="pcapng file written by record")
+    p.add_argument("--conn", help="only this connection handle")
+    p.add_argument("--summary", action="store_true", help="also print event counts")
+    p.set_defaults(func=decode)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,529 @@
+#!/usr/bin/env python3
+"""Cut power at random flash operations of the object store and check recovery.
+
+The device side is modelled at the level of flash words: the flash_log ring
+(a port of flash_log.c, with its constants read from flash_log.h), FDS records
+as obj_journal.c writes and deletes them, and the commit order of obj_store.c:
+data first, then the commit record, then the delete of the old record and the
+release of the old run. Flash operations run in the order the firmware queues
+them, so the model runs them one after the other.
+
+A trial stores a series of random objects, cuts power at a random word write
+or page erase, boots the model again from what is in flash and checks the
+object it recovers. Several cuts are chained on the same flash, so pages and
+records left by earlier cuts are part of the test. The object recovered must
+be exactly the last one whose commit record was complete when power went.
+
+Assumptions, taken from the nRF52840 and FDS:
+  - A word write either happens or not. A cut page erase leaves any mix of old
+    and erased words.
+  - FDS writes a record's file ID word last and treats a record without it as
+    never written. Deleting a record clears its key.
+  - FDS garbage collection copies the live records to the swap page and marks
+    the copy complete before the data page is erased.
+
+Commit latency is the time from the object's data being in flash to its
+record being in flash, at 41 us per word and 85 ms per erase, garbage
+collection included. For comparison, rewriting the object and its metadata
+in place costs an erase and a write of every word. On the dongle, obj_store
+prints the measured latency after each commit.
+
+Example:
+
+    tools/journal_fuzz.py --trials 2000 --seed 3
+"""
+
+import argparse
+import os
+import random
+import re
+import struct
+import zlib
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "flash_log.h")
+
+WORD_US = 41                # nRF52840 t_WRITE
+ERASE_US = 85000            # nRF52840 t_ERASEPAGE
+BLANK = 0xFFFFFFFF
+PAGE_MAGIC = 0x464C4F47     # flash_log.c
+
+JOURNAL_FILE_ID = 0x0B1E    # obj_journal.h
+JOURNAL_RECORD_KEY = 0x0001
+NAME_LEN = 32
+ENTRY = struct.Struct("<IIHHIII%ds" % NAME_LEN)
+RECORD_WORDS = (ENTRY.size + 4) // 4
+
+FDS_MAGIC = 0xDEADC0DE
+FDS_SWAP = 0x5A5AFFFF       # Each tag only clears bits of the one before.
+FDS_COPIED = 0x5A5A00FF
+FDS_DATA = 0x5A5A0000
+FDS_HEADER_WORDS = 3        # Key and length, file ID, record ID
+
+
+class PowerFail(Exception):
+    pass
+
+
+class NoMem(Exception):
+    pass
+
+
+def load_constants(path):
+    constants = {}
+    with open(path) as f:
+        for name, value in re.findall(r"#define\s+(FLASH_LOG_\w+)\s+\(?(\d+)\)?\s", f.read()):
+            constants[name] = int(value)
+    return constants
+
+
+def to_words(data):
+    data = bytes(data) + b"\xff" * (-len(data) % 4)
+    return list(struct.unpack("<%dI" % (len(data) // 4), data))
+
+
+def from_words(words):
+    return struct.pack("<%dI" % len(words), *words)
+
+
+class Flash:
+    """Word-addressed flash that can lose power before any operation."""
+
+    def __init__(self, words, rng):
+        self.mem = [BLANK] * words
+        self.rng = rng
+        self.ops = 0
+        self.cut_at = None
+        self.clock_us = 0
+        self.words_written = 0
+
+    def _tick(self):
+        self.ops += 1
+        return self.cut_at is not None and self.ops >= self.cut_at
+
+    def write(self, addr, words):
+        for i, word in enumerate(words):
+            if self._tick():
+                raise PowerFail()
+            self.mem[addr + i] &= word
+            self.clock_us += WORD_US
+            self.words_written += 1
+
+    def erase(self, addr, words):
+        if self._tick():
+            for i in range(addr, addr + words):
+                if self.rng.random() < 0.5:
+                    self.mem[i] = BLANK
+            raise PowerFail()
+        self.mem[addr:addr + words] = [BLANK] * words
+        self.clock_us += ERASE_US
+
+
+class FlashLog:
+    """Port of flash_log.c over the first pages of the flash."""
+
+    def __init__(self, flash, c, pages):
+        self.f = flash
+        self.c = c
+        self.pages = pages
+        self.page_words = c["FLASH_LOG_PAGE_SIZE"] // 4
+        self.data_len = c["FLASH_LOG_PAGE_SIZE"] - c["FLASH_LOG_PAGE_HEADER_LEN"]
+        self.stage_size = 512
+
+    def addr(self, page):
+        return page * self.page_words
+
+    def init(self):
+        self.state = []
+        self.seq = [0] * self.pages
+        newest = None
+        self.head = self.pages - 1
+        for page in range(self.pages):
+            words = self.f.mem[self.addr(page):self.addr(page) + self.page_words]
+            if words[0] == PAGE_MAGIC and words[1] == words[2] ^ BLANK:
+                self.state.append("open")
+                self.seq[page] = words[1]
+                if newest is None or words[1] > newest:
+                    newest = words[1]
+                    self.head = page
+            else:
+                self.state.append("erased" if all(w == BLANK for w in words) else "dirty")
+        self.head_off = self.data_len
+        self.next_seq = 0 if newest is None else (newest + 1) & BLANK
+        self.live = []
+        self.run = None
+        self.stage = None
+
+    def run_pages(self, run):
+        return max(1, -(-(run[2] + run[3]) // self.data_len))
+
+    def free_count(self):
+        runs = self.live + ([self.run] if self.run else [])
+        if not runs:
+            return self.pages - 1
+        tail = min(runs, key=lambda r: r[0])[1]
+        return (tail + self.pages - self.head - 1) % self.pages
+
+    def process(self):
+        for i in range(min(self.free_count(), self.c["FLASH_LOG_ERASED_TARGET"])):
+            page = (self.head + 1 + i) % self.pages
+            if self.state[page] in ("dirty", "open"):
+                self.f.erase(self.addr(page), self.page_words)
+                self.state[page] = "erased"
+                return True
+        return False
+
+    def page_advance(self):
+        nxt = (self.head + 1) % self.pages
+        if self.free_count() == 0:
+            raise NoMem()
+        if self.state[nxt] in ("dirty", "open"):
+            self.f.erase(self.addr(nxt), self.page_words)
+        self.f.write(self.addr(nxt), [PAGE_MAGIC, self.next_seq, self.next_seq ^ BLANK])
+        self.state[nxt] = "open"
+        self.seq[nxt] = self.next_seq
+        self.next_seq = (self.next_seq + 1) & BLANK
+        self.head = nxt
+        self.head_off = 0
+
+    def stage_flush(self):
+        if self.stage is None:
+            return
+        data, addr = self.stage
+        self.stage = None
+        self.head_off += -len(data) % 4
+        self.f.write(addr, to_words(data))
+
+    def run_begin(self):
+        if self.head_off >= self.data_len:
+            self.page_advance()
+        self.run = [self.seq[self.head], self.head, self.head_off, 0]
+
+    def append(self, data):
+        pos = 0
+        while pos < len(data):
+            if self.head_off >= self.data_len:
+                self.stage_flush()
+                self.page_advance()
+            if self.stage is None:
+                header = self.c["FLASH_LOG_PAGE_HEADER_LEN"]
+                self.stage = (bytearray(), self.addr(self.head) + (header + self.head_off) // 4)
+            buf = self.stage[0]
+            chunk = min(len(data) - pos, self.stage_size - len(buf), self.data_len - self.head_off)
+            buf += data[pos:pos + chunk]
+            self.head_off += chunk
+            self.run[3] += chunk
+            pos += chunk
+            if len(buf) == self.stage_size:
+                self.stage_flush()
+
+    def run_end(self):
+        self.stage_flush()
+        run, self.run = tuple(self.run), None
+        if len(self.live) >= self.c["FLASH_LOG_RUN_MAX"]:
+            raise NoMem()
+        self.live.append(run)
+        return run
+
+    def run_abort(self):
+        if self.stage is not None:
+            self.head_off += -len(self.stage[0]) % 4
+            self.stage = None
+        self.run = None
+
+    def claim(self, run):
+        seq, first, offset, length = run
+        pages = self.run_pages(run)
+        if first >= self.pages or offset >= self.data_len or pages >= self.pages:
+            return False
+        for i in range(pages):
+            page = (first + i) % self.pages
+            if self.state[page] != "open" or self.seq[page] != seq + i:
+                return False
+        if len(self.live) >= self.c["FLASH_LOG_RUN_MAX"]:
+            return False
+        self.live.append(run)
+        return True
+
+    def release(self, run):
+        self.live = [r for r in self.live if r != run]
+
+    def read(self, run):
+        header = self.c["FLASH_LOG_PAGE_HEADER_LEN"]
+        out = bytearray()
+        pos = run[2]
+        while len(out) < run[3]:
+            page = (run[1] + pos // self.data_len) % self.pages
+            start = self.addr(page) * 4 + header + pos % self.data_len
+            chunk = min(run[3] - len(out), self.data_len - pos % self.data_len)
+            first = start // 4
+            last = (start + chunk + 3) // 4
+            raw = from_words(self.f.mem[first:last])
+            out += raw[start % 4:start % 4 + chunk]
+            pos += chunk
+        return bytes(out)
+
+
+class Fds:
+    """Two FDS pages after the log: one for data, one for swap."""
+
+    def __init__(self, flash, base, page_words):
+        self.f = flash
+        self.base = base
+        self.page_words = page_words
+
+    def page(self, i):
+        return self.base + i * self.page_words
+
+    def tag(self, i):
+        return self.f.mem[self.page(i) + 1] if self.f.mem[self.page(i)] == FDS_MAGIC else None
+
+    def format(self, i, tag):
+        self.f.erase(self.page(i), self.page_words)
+        self.f.write(self.page(i), [FDS_MAGIC, tag])
+
+    def init(self):
+        tags = [self.tag(0), self.tag(1)]
+        if FDS_COPIED in tags:
+            # Garbage collection stopped after the copy: the copy is the data.
+            data = tags.index(FDS_COPIED)
+            self.format(1 - data, FDS_SWAP)
+            self.f.write(self.page(data) + 1, [FDS_DATA])
+        elif FDS_DATA in tags:
+            data = tags.index(FDS_DATA)
+            swap = 1 - data
+            if tags[swap] != FDS_SWAP or any(w != BLANK for w in self.f.mem[self.page(swap) + 2:self.page(swap + 1)]):
+                self.format(swap, FDS_SWAP)
+        else:
+            data = 0
+            self.format(0, FDS_DATA)
+            self.format(1, FDS_SWAP)
+        self.data = data
+        self.scan()
+
+    def scan(self):
+        """Find the records and the end of the written area of the data page."""
+        self.records = []
+        start = self.page(self.data)
+        addr = start + 2
+        end = start + self.page_words
+        self.next_id = 1
+        while addr + FDS_HEADER_WORDS <= end and self.f.mem[addr] != BLANK:
+            tl, file_word, record_id = self.f.mem[addr:addr + FDS_HEADER_WORDS]
+            length = tl & 0xFFFF
+            if addr + FDS_HEADER_WORDS + length > end:
+                break
+            if record_id != BLANK:
+                self.next_id = max(self.next_id, record_id + 1)
+            self.records.append({
+                "addr": addr,
+                "key": tl >> 16,
+                "file_id": file_word >> 16,
+                "id": record_id,
+                "complete": file_word != BLANK,
+                "data": self.f.mem[addr + FDS_HEADER_WORDS:addr + FDS_HEADER_WORDS + length],
+            })
+            addr += FDS_HEADER_WORDS + length
+        self.end = addr
+
+    def find(self, file_id, key):
+        return [r for r in self.records if r["complete"] and r["key"] == key and r["file_id"] == file_id]
+
+    def write(self, file_id, key, words):
+        """Returns the record ID, or None if the page is full."""
+        if self.end + FDS_HEADER_WORDS + len(words) > self.page(self.data) + self.page_words:
+            return None
+        addr = self.end
+        record_id = self.next_id
+        self.next_id += 1
+        self.end += FDS_HEADER_WORDS + len(words)
+        self.f.write(addr, [(key << 16) | len(words)])
+        self.f.write(addr + 2, [record_id])
+        self.f.write(addr + FDS_HEADER_WORDS, words)
+        self.f.write(addr + 1, [(file_id << 16) | 0xFFFF])
+        self.records.append({"addr": addr, "key": key, "file_id": file_id, "id": record_id,
+                             "complete": True, "data": list(words)})
+        return record_id
+
+    def delete(self, record_id):
+        for r in self.records:
+            if r["id"] == record_id and r["key"] != 0:
+                self.f.write(r["addr"], [self.f.mem[r["addr"]] & 0xFFFF])
+                r["key"] = 0
+
+    def gc(self):
+        swap = 1 - self.data
+        addr = self.page(swap) + 2
+        for r in self.records:
+            if r["complete"] and r["key"] != 0:
+                self.f.write(addr, [(r["key"] << 16) | len(r["data"]), (r["file_id"] << 16) | 0xFFFF, r["id"]])
+                self.f.write(addr + FDS_HEADER_WORDS, r["data"])
+                addr += FDS_HEADER_WORDS + len(r["data"])
+        self.f.write(self.page(swap) + 1, [FDS_COPIED])
+        self.format(self.data, FDS_SWAP)
+        self.f.write(self.page(swap) + 1, [FDS_DATA])
+        self.data = swap
+        self.scan()
+
+
+class Device:
+    """obj_store.c and obj_journal.c over the flash model."""
+
+    def __init__(self, flash, c, pages, fds_words):
+        self.f = flash
+        self.log = FlashLog(flash, c, pages)
+        self.fds = Fds(flash, pages * self.log.page_words, fds_words)
+        self.durable = None
+        self.latencies = []
+        self.commit_words = []
+
+    def boot(self):
+        """Returns the restored object as (name, data), or None."""
+        self.fds.init()
+        self.log.init()
+        best = None
+        for r in self.fds.find(JOURNAL_FILE_ID, JOURNAL_RECORD_KEY):
+            words = r["data"]
+            if len(words) != RECORD_WORDS:
+                continue
+            raw = from_words(words)
+            if zlib.crc32(raw[:ENTRY.size]) != words[-1]:
+                continue
+            entry = ENTRY.unpack(raw[:ENTRY.size])
+            if best is None or entry[0] > best[1][0]:
+                best = (r["id"], entry)
+        for r in self.fds.find(JOURNAL_FILE_ID, JOURNAL_RECORD_KEY):
+            if best is None or r["id"] != best[0]:
+                self.fds.delete(r["id"])
+        self.current = None
+        self.last_id = None
+        self.next_seq = 0
+        if best is None:
+            return None
+        record_id, (seq, run_seq, page, offset, length, size, checksum, name) = best
+        self.last_id = record_id
+        self.next_seq = seq + 1
+        run = (run_seq, page, offset, length)
+        if not self.log.claim(run):
+            return None
+        data = self.log.read(run)
+        if size != length or zlib.crc32(data) != checksum:
+            self.log.release(run)
+            return None
+        self.current = run
+        return (name.rstrip(b"\0"), data)
+
+    def store(self, name, data):
+        self.log.run_abort()
+        self.log.run_begin()
+        self.log.append(data)
+        run = self.log.run_end()
+
+        start_us = self.f.clock_us
+        start_words = self.f.words_written
+        entry = ENTRY.pack(self.next_seq, run[0], run[1], run[2], run[3], len(data), zlib.crc32(data), name)
+        words = to_words(entry) + [zlib.crc32(entry)]
+        record_id = self.fds.write(JOURNAL_FILE_ID, JOURNAL_RECORD_KEY, words)
+        if record_id is None:
+            self.fds.gc()
+            record_id = self.fds.write(JOURNAL_FILE_ID, JOURNAL_RECORD_KEY, words)
+        if record_id is None:
+            self.log.release(run)
+            return False
+        self.durable = (name, bytes(data))
+        self.latencies.append(self.f.clock_us - start_us)
+        self.commit_words.append(self.f.words_written - start_words)
+
+        if self.last_id is not None:
+            self.fds.delete(self.last_id)
+        self.last_id = record_id
+        self.next_seq += 1
+        if self.current is not None:
+            self.log.release(self.current)
+        self.current = run
+        return True
+
+    def idle(self, count):
+        for _ in range(count):
+            if not self.log.process():
+                break
+
+
+def random_object(rng, max_len):
+    name = ("obj%d" % rng.randrange(100000)).encode()
+    return name, bytes(rng.randrange(256) for _ in range(rng.randrange(1, max_len + 1)))
+
+
+def run_rounds(args, c, seed, cuts):
+    """Stores objects on one flash, cutting power at the given operation counts."""
+    rng = random.Random(seed)
+    pages = args.pages
+    flash = Flash(pages * c["FLASH_LOG_PAGE_SIZE"] // 4 + 2 * args.fds_words, rng)
+    expected = None
+    outcomes = []
+    device = None
+    for cut in cuts + [None]:
+        flash.ops = 0
+        flash.cut_at = cut
+        device = Device(flash, c, pages, args.fds_words)
+        device.durable = expected
+        try:
+            restored = device.boot()
+            outcomes.append(restored == expected)
+            for _ in range(args.objects):
+                device.idle(rng.randrange(3))
+                try:
+                    device.store(*random_object(rng, args.object_max))
+                except NoMem:
+                    device.log.run_abort()
+                expected = device.durable
+        except PowerFail:
+            expected = device.durable
+    return outcomes, flash.ops, device
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--trials", type=int, default=500, help="chains of power cuts (default: %(default)s)")
+    parser.add_argument("--cuts", type=int, default=4, help="power cuts per trial (default: %(default)s)")
+    parser.add_argument("--objects", type=int, default=12, help="objects stored between cuts (default: %(default)s)")
+    parser.add_argument("--object-max", type=int, default=1024, help="largest object (default: %(default)s)")
+    parser.add_argument("--pages", type=int, default=5,
+                        help="pages in the log ring; few, so that it wraps often (default: %(default)s)")
+    parser.add_argument("--fds-words", type=int, default=128, help="words per FDS page (default: %(default)s)")
+    parser.add_argument("--seed", type=int, default=1, help="random seed (default: %(default)s)")
+    parser.add_argument("--header", default=HEADER, help="flash_log.h to read (default: the tree's)")
+    args = parser.parse_args()
+
+    c = load_constants(args.header)
+    rng = random.Random(args.seed)
+    checks = failures = 0
+    latencies = []
+    commit_words = []
+    sizes = []
+
+    for trial in range(args.trials):
+        seed = rng.randrange(1 << 30)
+        # A run without cuts gives the number of operations each round has to cut into.
+        _, ops, device = run_rounds(args, c, seed, [])
+        latencies += device.latencies
+        commit_words += device.commit_words
+        sizes += [len(device.durable[1])] if device.durable else []
+        cuts = [rng.randrange(1, ops + 1) for _ in range(args.cuts)]
+        outcomes, _, _ = run_rounds(args, c, seed, cuts)
+        checks += len(outcomes)
+        if not all(outcomes):
+            failures += 1
+            print("trial %d (seed %d, cuts %s): recovered the wrong object" % (trial, seed, cuts))
+
+    latencies.sort()
+    rewrite_us = [ERASE_US + ((size + ENTRY.size + 3) // 4) * WORD_US for size in sizes]
+    print("%d trials, %d recoveries checked, %d failed" % (args.trials, checks, failures))
+    print("commit latency: median %.2f ms, p99 %.2f ms, max %.2f ms, %.1f words per commit" % (
+        latencies[len(latencies) // 2] / 1000.0, latencies[len(latencies) * 99 // 100] / 1000.0,
+        latencies[-1] / 1000.0, sum(commit_words) / float(len(commit_words))))
+    print("rewrite in place: mean %.2f ms" % (sum(rewrite_us) / 1000.0 / len(rewrite_us)))
+    raise SystemExit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""USB-BLE loopback latency test.
+
+Sends loopback requests to the dongle over its CDC ACM port and prints latency
+percentiles per hop. A reference client must be connected to the dongle, have
+notifications of the Loopback characteristic enabled, and write every
+notification straight back (see loopback.h).
+
+Hops:
+
+    usb      host to dongle and back: rtt less the time the dongle held the request
+    to_air   dongle receive to notification acknowledged by the link layer
+    echo     notification acknowledged to echo received from the client
+    rtt      host send to host receive of the result
+
+Requires pyserial.
+
+Example:
+
+    tools/loopback.py /dev/ttyACM0 --count 500 --size 20 --interval 0.05
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+SYNC = 0xA5
+FRAME_REQUEST = 0x10
+FRAME_RESULT = 0x11
+RESULT = struct.Struct("<IBIII")
+STATUS = ("success", "no client", "invalid", "tx failed", "lost")
+
+
+class FrameReader:
+    """Splits the dongle's CDC stream into frames, skipping debug text."""
+
+    def __init__(self, port):
+        self.port = port
+        self.buf = bytearray()
+
+    def frames(self):
+        self.buf += self.port.read(self.port.in_waiting or 1)
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                self.buf.clear()
+                return
+            del self.buf[:start]
+            if len(self.buf) < 4:
+                return
+            length = self.buf[2] | (self.buf[3] << 8)
+            if len(self.buf) < 4 + length:
+                return
+            frame_type = self.buf[1]
+            payload = bytes(self.buf[4:4 + length])
+            del self.buf[:4 + length]
+            yield frame_type, payload
+
+
+def percentiles(values):
+    values = sorted(values)
+    if not values:
+        return "-"
+
+    def pick(p):
+        return values[min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))]
+
+    return "p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f ms" % (
+        pick(50) / 1000.0, pick(90) / 1000.0, pick(99) / 1000.0, values[-1] / 1000.0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("port", help="CDC ACM port of the dongle")
+    parser.add_argument("--count", type=int, default=200, help="requests to send (default: %(default)s)")
+    parser.add_argument("--size", type=int, default=20, help="request payload length, sequence number included (default: %(default)s)")
+    parser.add_argument("--interval", type=float, default=0.1, help="seconds between requests (default: %(default)s)")
+    parser.add_argument("--timeout", type=float, default=5.0, help="seconds to wait for the last results (default: %(default)s)")
+    args = parser.parse_args()
+
+    if args.size < 4:
+        parser.error("--size must be at least 4")
+
+    try:
+        import serial
+    except ImportError:
+        sys.exit("loopback: pyserial is required (pip install pyserial)")
+
+    port = serial.Serial(args.port, timeout=0.01)
+    reader = FrameReader(port)
+    sent = {}
+    hops = {"usb": [], "to_air": [], "echo": [], "rtt": []}
+    failures = {}
+
+    def collect():
+        for frame_type, payload in reader.frames():
+            if frame_type != FRAME_RESULT or len(payload) != RESULT.size:
+                continue
+            now = time.perf_counter()
+            seq, status, to_air, echo, total = RESULT.unpack(payload)
+            sent_at = sent.pop(seq, None)
+            if sent_at is None:
+                continue
+            if status != 0:
+                name = STATUS[status] if status < len(STATUS) else str(status)
+                failures[name] = failures.get(name, 0) + 1
+                continue
+            rtt = (now - sent_at) * 1e6
+            hops["rtt"].append(rtt)
+            hops["to_air"].append(to_air)
+            hops["echo"].append(echo)
+            hops["usb"].append(max(0.0, rtt - total))
+
+    filler = bytes(range(256)) * 2
+    next_send = time.perf_counter()
+    for seq in range(args.count):
+        payload = struct.pack("<I", seq) + filler[:args.size - 4]
+        frame = struct.pack("<BBH", SYNC, FRAME_REQUEST, len(payload)) + payload
+        while time.perf_counter() < next_send:
+            collect()
+        sent[seq] = time.perf_counter()
+        port.write(frame)
+        next_send += args.interval
+        collect()
+
+    deadline = time.perf_counter() + args.timeout
+    while sent and time.perf_counter() < deadline:
+        collect()
+
+    done = len(hops["rtt"])
+    print("%d requests, %d echoed, %d without result" % (args.count, done, len(sent)))
+    for name, count in sorted(failures.items()):
+        print("  %s: %d" % (name, count))
+    for name in ("usb", "to_air", "echo", "rtt"):
+        print("%-7s %s" % (name, percentiles(hops[name])))
+
+
+if __name__ == "__main__":
+    main()
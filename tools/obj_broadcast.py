@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Start, stop and receive the dongle's connectionless object broadcast.
+
+While broadcast runs, the dongle sends its OTS object in extended advertising,
+one segment per advertising set payload (see obj_broadcast.h). "start" and
+"stop" send the control frame over the dongle's CDC ACM port. "listen" scans
+with the host's Bluetooth adapter, collects the segments of one object
+version, checks the CRC32 of the whole object and writes it out. It never
+connects.
+
+The adapter must support extended scanning (Bluetooth 5). On Linux, BlueZ
+reports extended advertising to bleak like any other advertising.
+
+Requires pyserial for "start" and "stop", and bleak for "listen".
+
+Examples:
+
+    tools/obj_broadcast.py start /dev/ttyACM0
+    tools/obj_broadcast.py listen -o config.bin --timeout 30
+    tools/obj_broadcast.py stop /dev/ttyACM0
+"""
+
+import argparse
+import asyncio
+import struct
+import sys
+import time
+import zlib
+
+SYNC = 0xA5
+FRAME_CONTROL = 0x50
+
+OTS_UUID = "00001825-0000-1000-8000-00805f9b34fb"
+FORMAT = 1
+HEADER = struct.Struct("<BBBBHI")
+
+
+class Assembler:
+    """Collects the segments of one object version."""
+
+    def __init__(self):
+        self.key = None
+        self.segments = {}
+        self.versions = 0
+
+    def feed(self, data):
+        """Adds one service data payload. Returns the object once it is complete."""
+        if len(data) < HEADER.size:
+            # The advertised digest of connectable advertising, not a segment.
+            return None
+        fmt, version, index, count, length, crc = HEADER.unpack_from(data)
+        if fmt != FORMAT or index >= count:
+            return None
+        key = (version, count, length, crc)
+        if key != self.key:
+            self.key = key
+            self.segments = {}
+            self.versions += 1
+        self.segments[index] = bytes(data[HEADER.size:])
+        if len(self.segments) < count:
+            return None
+        obj = b"".join(self.segments[i] for i in range(count))
+        if len(obj) != length or zlib.crc32(obj) != crc:
+            # A segment was sent while the object was being written; wait for the next version.
+            self.segments = {}
+            return None
+        return obj
+
+
+def control(args, enable):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("obj_broadcast: pyserial is required (pip install pyserial)")
+
+    with serial.Serial(args.port) as port:
+        port.write(struct.pack("<BBHB", SYNC, FRAME_CONTROL, 1, 1 if enable else 0))
+    print("broadcast %s" % ("started" if enable else "stopped"))
+
+
+async def scan(args):
+    try:
+        from bleak import BleakScanner
+    except ImportError:
+        sys.exit("obj_broadcast: bleak is required (pip install bleak)")
+
+    assembler = Assembler()
+    done = asyncio.get_running_loop().create_future()
+    started = time.monotonic()
+
+    def on_advertisement(device, adv):
+        if done.done() or (args.address and device.address.upper() != args.address.upper()):
+            return
+        data = adv.service_data.get(OTS_UUID)
+        if data is None:
+            return
+        before = len(assembler.segments)
+        obj = assembler.feed(data)
+        if len(assembler.segments) != before and assembler.key is not None:
+            print("v%d: %d/%d segments" % (assembler.key[0], len(assembler.segments), assembler.key[1]))
+        if obj is not None:
+            done.set_result((device.address, assembler.key[0], obj))
+
+    async with BleakScanner(on_advertisement):
+        try:
+            return await asyncio.wait_for(done, args.timeout), time.monotonic() - started
+        except asyncio.TimeoutError:
+            return None, time.monotonic() - started
+
+
+def listen(args):
+    result, elapsed = asyncio.run(scan(args))
+    if result is None:
+        sys.exit("obj_broadcast: no complete object in %.0f s" % elapsed)
+    address, version, obj = result
+    with open(args.output, "wb") as out:
+        out.write(obj)
+    print("%d bytes, v%d from %s in %.1f s, CRC32 0x%08x, written to %s" %
+          (len(obj), version, address, elapsed, zlib.crc32(obj), args.output))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("start", help="start broadcast of the dongle's object")
+    p.add_argument("port", help="CDC ACM port of the dongle")
+    p.set_defaults(func=lambda args: control(args, True))
+
+    p = sub.add_parser("stop", help="stop broadcast and resume connectable advertising")
+    p.add_argument("port", help="CDC ACM port of the dongle")
+    p.set_defaults(func=lambda args: control(args, False))
+
+    p = sub.add_parser("listen", help="receive one object without connecting")
+    p.add_argument("-o", "--output", required=True, help="file to write the object to")
+    p.add_argument("--address", help="only this advertiser")
+    p.add_argument("--timeout", type=float, default=60.0, help="seconds to scan (default: %(default)s)")
+    p.set_defaults(func=listen)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,292 @@
+#!/usr/bin/env python3
+"""Read and check the dongle's object store disk.
+
+The dongle shows its stored object as a file on a small FAT12 volume over USB
+Mass Storage (see obj_disk.h). This tool reads that volume with its own FAT
+reader, from the block device or from an image of it, and checks it:
+
+    - the boot sector, both FAT copies and the root directory are consistent
+    - INFO.TXT is there, and the object's size and CRC32 match what it says
+    - with --expect, the object equals a local file
+
+    check IMAGE     Check a block device (/dev/sdX) or an image file.
+    model FILE      Build the volume the dongle would show for FILE, with the
+                    same layout as obj_disk.c, and check that. Runs without a
+                    dongle; --save keeps the image. This only checks the model:
+                    make -C tests/host builds obj_disk.c itself for the host and
+                    checks the volume it gives.
+
+With --mount, the image is also loop-mounted read-only (root only) and the
+object is read through the host's own FAT driver.
+
+Examples:
+
+    sudo tools/obj_disk.py check /dev/sdb --expect sent.bin
+    tools/obj_disk.py model sent.bin --name "log 2021-06-01.bin" --save disk.img
+"""
+
+import argparse
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+SECTOR = 512
+SECTORS = 1024          # OBJ_DISK_BLOCK_COUNT
+RESERVED = 1
+FAT_COUNT = 2
+FAT_SECTORS = 3
+ROOT_ENTRIES = 16
+NAME_LEN = 32           # OBJ_JOURNAL_NAME_LEN
+FAT_DATE = (41 << 9) | (1 << 5) | 1
+SHORT_NAME = b"OBJECT  BIN"
+LFN_OFFSETS = (1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30)
+
+
+class DiskError(Exception):
+    pass
+
+
+# Model of obj_disk.c.
+
+def lfn_checksum(short_name):
+    total = 0
+    for byte in short_name:
+        total = (((total & 1) << 7) + (total >> 1) + byte) & 0xFF
+    return total
+
+
+def model_image(data, name, seq):
+    name = name.encode("ascii", "replace")[:NAME_LEN]
+    info = b"Name: %s\r\nSize: %d\r\nCRC32: %08X\r\nCommit: %d\r\n" % (name, len(data), zlib.crc32(data), seq)
+    image = bytearray(SECTORS * SECTOR)
+
+    boot = image
+    boot[0:3] = b"\xEB\x3C\x90"
+    boot[3:11] = b"MSWIN4.1"
+    struct.pack_into("<HBHBHHBHHH", boot, 11, SECTOR, 1, RESERVED, FAT_COUNT, ROOT_ENTRIES,
+                     SECTORS, 0xF8, FAT_SECTORS, 1, 1)
+    boot[36] = 0x80
+    boot[38] = 0x29
+    struct.pack_into("<I", boot, 39, 0x0B1E0000 | (seq & 0xFFFF))
+    boot[43:54] = b"OTS STORE  "
+    boot[54:62] = b"FAT12   "
+    boot[510:512] = b"\x55\xAA"
+
+    clusters = (len(data) + SECTOR - 1) // SECTOR
+    entries = [0xFF8, 0xFFF, 0xFFF] + [0] * (SECTORS - RESERVED - FAT_COUNT * FAT_SECTORS - 1)
+    for n in range(clusters):
+        entries[3 + n] = 0xFFF if n == clusters - 1 else 4 + n
+    fat = bytearray(FAT_SECTORS * SECTOR)
+    for n in range(0, (len(fat) // 3) * 2, 2):
+        a = entries[n] if n < len(entries) else 0
+        b = entries[n + 1] if n + 1 < len(entries) else 0
+        fat[n * 3 // 2:n * 3 // 2 + 3] = bytes((a & 0xFF, ((a >> 8) & 0x0F) | ((b & 0x0F) << 4), b >> 4))
+    for copy in range(FAT_COUNT):
+        start = (RESERVED + copy * FAT_SECTORS) * SECTOR
+        image[start:start + len(fat)] = fat
+
+    def short_entry(short_name, attr, cluster, size):
+        entry = bytearray(32)
+        entry[0:11] = short_name
+        entry[11] = attr
+        struct.pack_into("<HH", entry, 16, FAT_DATE, FAT_DATE)
+        struct.pack_into("<HHI", entry, 24, FAT_DATE, cluster, size)
+        return entry
+
+    root = short_entry(b"OTS STORE  ", 0x08, 0, 0) + short_entry(b"INFO    TXT", 0x01, 2, len(info))
+    chars = [c if 0x20 <= c <= 0x7E and chr(c) not in '"*/:<>?\\|' else ord("_") for c in name]
+    chars = chars + [0x0000] + [0xFFFF] * 12
+    count = (len(name) + 12) // 13
+    for n in range(count, 0, -1):
+        entry = bytearray(32)
+        entry[0] = n | (0x40 if n == count else 0)
+        entry[11] = 0x0F
+        entry[13] = lfn_checksum(SHORT_NAME)
+        for i, offset in enumerate(LFN_OFFSETS):
+            struct.pack_into("<H", entry, offset, chars[(n - 1) * 13 + i])
+        root += entry
+    root += short_entry(SHORT_NAME, 0x01, 3 if data else 0, len(data))
+    root_lba = RESERVED + FAT_COUNT * FAT_SECTORS
+    image[root_lba * SECTOR:root_lba * SECTOR + len(root)] = root
+
+    data_lba = root_lba + 1
+    image[data_lba * SECTOR:data_lba * SECTOR + len(info)] = info
+    image[(data_lba + 1) * SECTOR:(data_lba + 1) * SECTOR + len(data)] = data
+
+    return bytes(image)
+
+
+# Reader, from the FAT specification rather than from the model.
+
+class Volume:
+    def __init__(self, image):
+        self.image = image
+        (self.sector, self.per_cluster, reserved, fat_count, root_entries, total16, _media,
+         fat_sectors) = struct.unpack_from("<HBHBHHBH", image, 11)
+        if image[510:512] != b"\x55\xAA":
+            raise DiskError("boot sector signature missing")
+        if self.sector not in (512, 1024, 2048, 4096) or self.per_cluster == 0:
+            raise DiskError("boot sector geometry invalid")
+        total = total16 or struct.unpack_from("<I", image, 32)[0]
+        if total * self.sector > len(image):
+            raise DiskError("volume of %d sectors, image has %d" % (total, len(image) // self.sector))
+
+        fat_len = fat_sectors * self.sector
+        fats = [image[(reserved + i * fat_sectors) * self.sector:][:fat_len] for i in range(fat_count)]
+        if any(fat != fats[0] for fat in fats):
+            raise DiskError("FAT copies differ")
+        self.fat = fats[0]
+
+        root_start = (reserved + fat_count * fat_sectors) * self.sector
+        root_len = root_entries * 32
+        self.root = image[root_start:root_start + root_len]
+        self.data_start = root_start + ((root_len + self.sector - 1) // self.sector) * self.sector
+        self.clusters = (total * self.sector - self.data_start) // (self.sector * self.per_cluster)
+        if self.clusters >= 4085:
+            raise DiskError("%d clusters: not FAT12" % self.clusters)
+
+    def fat_entry(self, n):
+        value = struct.unpack_from("<H", self.fat, n * 3 // 2)[0]
+        return (value >> 4) if n & 1 else (value & 0xFFF)
+
+    def files(self):
+        """Yields (long or short name, short name, attributes, cluster, size)."""
+        parts = {}
+        for offset in range(0, len(self.root), 32):
+            entry = self.root[offset:offset + 32]
+            if entry[0] == 0x00:
+                return
+            if entry[0] == 0xE5:
+                continue
+            if entry[11] == 0x0F:
+                raw = b"".join(entry[o:o + 2] for o in LFN_OFFSETS)
+                parts[entry[0] & 0x1F] = (raw.decode("utf-16-le").split("\0")[0].rstrip("￿"), entry[13])
+                continue
+            short = bytes(entry[0:11])
+            name = short[:8].rstrip().decode("ascii") + ("." + short[8:].rstrip().decode("ascii") if short[8:].strip() else "")
+            if parts:
+                if any(check != lfn_checksum(short) for _, check in parts.values()):
+                    raise DiskError("long name of %s does not belong to it" % name)
+                name = "".join(parts[n][0] for n in sorted(parts))
+                parts = {}
+            cluster, size = struct.unpack_from("<HI", entry, 26)
+            yield name, short, entry[11], cluster, size
+
+    def read(self, cluster, size):
+        out = bytearray()
+        cluster_len = self.sector * self.per_cluster
+        seen = set()
+        while len(out) < size:
+            if cluster < 2 or cluster >= self.clusters + 2 or cluster in seen:
+                raise DiskError("bad cluster chain at %d" % cluster)
+            seen.add(cluster)
+            start = self.data_start + (cluster - 2) * cluster_len
+            out += self.image[start:start + cluster_len]
+            cluster = self.fat_entry(cluster)
+        if size and cluster < 0xFF8:
+            raise DiskError("cluster chain longer than the file")
+        return bytes(out[:size])
+
+
+def parse_info(text):
+    fields = {}
+    for line in text.decode("ascii", "replace").splitlines():
+        key, _, value = line.partition(": ")
+        fields[key] = value
+    return fields
+
+
+def mount_read(path, name):
+    with tempfile.TemporaryDirectory() as mountpoint:
+        subprocess.run(["mount", "-o", "ro,loop", path, mountpoint], check=True)
+        try:
+            with open(os.path.join(mountpoint, name), "rb") as f:
+                return f.read()
+        finally:
+            subprocess.run(["umount", mountpoint], check=True)
+
+
+def check(image, path, expect, mount):
+    volume = Volume(image)
+    files = [f for f in volume.files() if not f[2] & 0x08]
+    info = [f for f in files if f[1] == b"INFO    TXT"]
+    if not info:
+        raise DiskError("INFO.TXT missing")
+    fields = parse_info(volume.read(info[0][3], info[0][4]))
+    for line in volume.read(info[0][3], info[0][4]).decode("ascii", "replace").splitlines():
+        print("  " + line)
+
+    objects = [f for f in files if f[1] == SHORT_NAME]
+    if "Size" not in fields:
+        if objects:
+            raise DiskError("object file without an object in INFO.TXT")
+        print("no object stored")
+        return None
+    if len(objects) != 1:
+        raise DiskError("object file missing")
+
+    name, _, _, cluster, size = objects[0]
+    data = volume.read(cluster, size)
+    if size != int(fields["Size"]):
+        raise DiskError("object is %d bytes, INFO.TXT says %s" % (size, fields["Size"]))
+    if "%08X" % zlib.crc32(data) != fields["CRC32"]:
+        raise DiskError("object CRC32 %08X, INFO.TXT says %s" % (zlib.crc32(data), fields["CRC32"]))
+    print("%s: %d bytes, CRC32 matches" % (name, size))
+
+    if expect is not None and data != expect:
+        raise DiskError("object differs from the expected file")
+    if mount:
+        if mount_read(path, name) != data:
+            raise DiskError("object read through the mounted volume differs")
+        print("mounted volume gives the same object")
+    return data
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    p_check = sub.add_parser("check", help="check a block device or image")
+    p_check.add_argument("image", help="block device or image file")
+    p_model = sub.add_parser("model", help="build and check the volume for a file")
+    p_model.add_argument("file", help="object content")
+    p_model.add_argument("--name", help="object name (default: the file name)")
+    p_model.add_argument("--seq", type=int, default=1, help="commit sequence number (default: %(default)s)")
+    p_model.add_argument("--save", metavar="IMAGE", help="write the image to IMAGE")
+    for p in (p_check, p_model):
+        p.add_argument("--expect", metavar="FILE", help="file the object must equal")
+        p.add_argument("--mount", action="store_true", help="also read the object through a loop mount (root)")
+    args = parser.parse_args()
+
+    expect = open(args.expect, "rb").read() if args.expect else None
+    path = None
+    if args.command == "check":
+        with open(args.image, "rb") as f:
+            image = f.read(SECTORS * SECTOR)
+        path = args.image
+    else:
+        data = open(args.file, "rb").read()
+        name = args.name if args.name is not None else os.path.basename(args.file)
+        image = model_image(data, name, args.seq)
+        expect = data if expect is None else expect
+        if args.save:
+            with open(args.save, "wb") as f:
+                f.write(image)
+            path = args.save
+
+    if args.mount and path is None:
+        parser.error("--mount needs an image file; use --save")
+
+    try:
+        check(image, path, expect, args.mount)
+    except (DiskError, subprocess.CalledProcessError) as err:
+        print("FAIL: %s" % err, file=sys.stderr)
+        return 1
+    print("OK")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Generate or check the content of the synthetic OTS object.
+
+The dongle serves a generated object at OACP Read offsets from 0x80000000 up
+(see virtual_object.h). A client reads it like any other object and saves what
+it received; this tool checks that file against the expected content.
+
+    verify FILE     Check FILE against the content at --offset.
+    generate FILE   Write --length bytes of content from --offset to FILE.
+
+--offset is the position in the virtual object, not the OACP offset: a Read at
+0x80000000 + n starts at position n. --seed and --pattern must match VOBJ_SEED
+and VOBJ_PATTERN in main.c.
+
+Examples:
+
+    tools/ots_verify.py --seed 0x5EED0001 verify read.bin
+    tools/ots_verify.py --seed 0x5EED0001 --offset 4096 generate --length 1048576 ref.bin
+"""
+
+import argparse
+import struct
+import sys
+
+PATTERNS = ("prng", "counter")
+CHUNK = 1 << 16
+MASK = 0xFFFFFFFF
+
+
+def mix32(x):
+    """lowbias32, as in virtual_object.c."""
+    x ^= x >> 16
+    x = (x * 0x7FEB352D) & MASK
+    x ^= x >> 15
+    x = (x * 0x846CA68B) & MASK
+    x ^= x >> 16
+    return x
+
+
+def content(pattern, seed, position, length):
+    """Return length bytes of the virtual object from position."""
+    first = position // 4
+    last = (position + length + 3) // 4
+    if pattern == "prng":
+        words = [mix32(seed ^ (i & MASK)) for i in range(first, last)]
+    else:
+        words = [(seed + i) & MASK for i in range(first, last)]
+    data = struct.pack("<%dI" % len(words), *words)
+    start = position - first * 4
+    return data[start:start + length]
+
+
+def cmd_verify(args):
+    position = args.offset
+    checked = 0
+    with open(args.file, "rb") as f:
+        while True:
+            chunk = f.read(CHUNK)
+            if not chunk:
+                break
+            expected = content(args.pattern, args.seed, position, len(chunk))
+            if chunk != expected:
+                bad = next(i for i in range(len(chunk)) if chunk[i] != expected[i])
+                print("Mismatch at position %d (file offset %d): got 0x%02x, expected 0x%02x"
+                      % (position + bad, checked + bad, chunk[bad], expected[bad]))
+                return 1
+            position += len(chunk)
+            checked += len(chunk)
+    print("OK: %d bytes from position %d" % (checked, args.offset))
+    return 0
+
+
+def cmd_generate(args):
+    position = args.offset
+    remaining = args.length
+    with open(args.file, "wb") as f:
+        while remaining > 0:
+            n = min(CHUNK, remaining)
+            f.write(content(args.pattern, args.seed, position, n))
+            position += n
+            remaining -= n
+    return 0
+
+
+def number(text):
+    return int(text, 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--seed", type=number, required=True, help="VOBJ_SEED of the firmware")
+    parser.add_argument("--pattern", choices=PATTERNS, default="prng", help="VOBJ_PATTERN (default: %(default)s)")
+    parser.add_argument("--offset", type=number, default=0, help="position the data starts at (default: 0)")
+    sub = parser.add_subparsers(dest="command")
+    sub.required = True
+
+    p_verify = sub.add_parser("verify", help="check a received file")
+    p_verify.add_argument("file")
+    p_verify.set_defaults(func=cmd_verify)
+
+    p_generate = sub.add_parser("generate", help="write reference content")
+    p_generate.add_argument("--length", type=number, required=True)
+    p_generate.add_argument("file")
+    p_generate.set_defaults(func=cmd_generate)
+
+    args = parser.parse_args()
+    args.seed &= MASK
+    sys.exit(args.func(args))
+
+
+if __name__ == "__main__":
+    main()
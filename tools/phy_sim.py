@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+"""Simulate the adaptive PHY policy of link_phy against modelled links.
+
+The policy below is a line-by-line port of link_evaluate() in link_phy.c. Its
+thresholds and period counts are read from link_phy.h, so a change to the
+header is simulated as it is. Each scenario is a path of true signal strength
+over time. The link model adds measurement noise and fading, derives a packet
+error rate per PHY from the receiver sensitivity, and turns it into goodput
+and acknowledged packets per interval. Packets the policy sees are the
+acknowledged ones, the same as on the dongle.
+
+For each scenario, the adaptive policy is compared with staying on 2M, 1M or
+Coded. The output gives mean goodput, time on each PHY, the number of PHY
+changes (fewer means less flapping), and the number of links dropped by
+supervision timeout while the signal was lost.
+
+Example:
+
+    tools/phy_sim.py --scenario all --seconds 600 --seed 7
+"""
+
+import argparse
+import math
+import os
+import random
+import re
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "link_phy.h")
+
+PHYS = ("2M", "1M", "Coded")
+SENSITIVITY_DBM = {"2M": -92.0, "1M": -95.0, "Coded": -103.0}   # nRF52840, 0.1 % BER
+RATE_KBPS = {"2M": 1300.0, "1M": 750.0, "Coded": 110.0}          # L2CAP goodput without errors
+PACKET_BYTES = 244
+SAMPLES_PER_INTERVAL = 4
+SUPERVISION_S = 4           # Intervals of near-total loss before the link drops
+RECONNECT_S = 3             # Intervals without a link after a drop
+
+
+def load_constants(path):
+    constants = {}
+    with open(path) as f:
+        for name, value in re.findall(r"#define\s+(LINK_PHY_\w+)\s+\(?(-?\d+)\)?\s", f.read()):
+            constants[name] = int(value)
+    return constants
+
+
+class Policy:
+    """Port of the per-link state and decisions of link_phy.c."""
+
+    def __init__(self, c, refused=()):
+        self.c = c
+        self.up_dbm = [127, c["LINK_PHY_1M_UP_DBM"], c["LINK_PHY_CODED_UP_DBM"]]
+        self.down_dbm = [c["LINK_PHY_2M_DOWN_DBM"], c["LINK_PHY_1M_DOWN_DBM"], -128]
+        self.collapse_pct = [c["LINK_PHY_2M_COLLAPSE_PCT"], c["LINK_PHY_1M_COLLAPSE_PCT"], 0]
+        self.loss_pct = [0, c["LINK_PHY_1M_LOSS_PCT"], 0]
+        self.rung = 1
+        self.refused = {PHYS.index(p) for p in refused}
+        self.rssi_avg = None
+        self.up_count = 0
+        self.down_count = 0
+        self.down_acked = 0
+        self.dwell = 0
+        self.acked_best = 0
+        self.changes = 0
+
+    def rssi_update(self, rssi):
+        sample = int(round(rssi)) * 16
+        if self.rssi_avg is None:
+            self.rssi_avg = sample
+        else:
+            # C division truncates toward zero.
+            self.rssi_avg += int((sample - self.rssi_avg) / self.c["LINK_PHY_RSSI_WEIGHT"])
+
+    def request(self, rung):
+        if rung in self.refused:
+            return
+        self.rung = rung
+        self.changes += 1
+        self.acked_best = 0
+        self.up_count = 0
+        self.down_count = 0
+        self.down_acked = 0
+        self.dwell = self.c["LINK_PHY_DWELL_PERIODS"]
+
+    def evaluate(self, acked):
+        c = self.c
+        self.acked_best = max(self.acked_best, acked)
+        if self.rssi_avg is None:
+            return
+        if self.dwell > 0:
+            self.dwell -= 1
+            return
+        dbm = int(self.rssi_avg / 16)
+        collapse = (self.acked_best >= c["LINK_PHY_BUSY_PACKETS"] and acked > 0 and
+                    acked * 100 < self.acked_best * self.collapse_pct[self.rung] and
+                    dbm <= self.up_dbm[self.rung])
+        if dbm < self.down_dbm[self.rung] or collapse:
+            self.down_count += 1
+            self.down_acked += acked
+        else:
+            self.down_count = 0
+            self.down_acked = 0
+        self.up_count = self.up_count + 1 if (dbm > self.up_dbm[self.rung] and not collapse) else 0
+        loss = (self.loss_pct[self.rung] == 0 or
+                self.acked_best < c["LINK_PHY_BUSY_PACKETS"] or
+                self.down_acked * 100 < self.acked_best * self.down_count * self.loss_pct[self.rung])
+        if self.down_count >= c["LINK_PHY_DOWN_PERIODS"] and self.rung + 1 < len(PHYS) and loss:
+            self.request(self.rung + 1)
+        elif self.up_count >= c["LINK_PHY_UP_PERIODS"] and self.rung > 0:
+            self.request(self.rung - 1)
+
+
+class FixedPolicy:
+    def __init__(self, phy):
+        self.rung = PHYS.index(phy)
+        self.changes = 0
+
+    def rssi_update(self, rssi):
+        pass
+
+    def evaluate(self, acked):
+        pass
+
+
+def packet_error_rate(rssi, phy):
+    """Logistic fall-off around the sensitivity, steep over a few dB."""
+    margin = rssi - SENSITIVITY_DBM[phy]
+    return 1.0 / (1.0 + math.exp((margin - 2.0) / 1.2))
+
+
+def scenario_path(name, seconds, rng):
+    if name == "near":
+        return [-45.0] * seconds
+    if name == "walk":
+        # Out to the edge of coverage and back.
+        half = seconds / 2.0
+        return [-45.0 - 60.0 * (1.0 - abs(t - half) / half) for t in range(seconds)]
+    if name == "edge":
+        return [-91.0 + 3.0 * math.sin(t / 20.0) for t in range(seconds)]
+    if name == "wander":
+        level = -70.0
+        path = []
+        for _ in range(seconds):
+            level = min(-40.0, max(-105.0, level + rng.gauss(0.0, 1.5)))
+            path.append(level)
+        return path
+    raise ValueError(name)
+
+
+def run(make, path, rng):
+    policy = make()
+    delivered_kbit = 0.0
+    time_on = [0] * len(PHYS)
+    changes = 0
+    drops = 0
+    lossy = 0
+    down = 0
+    for true_rssi in path:
+        if down > 0:
+            # Reconnected links start over on 1M, like a new connection on the dongle.
+            down -= 1
+            if down == 0:
+                changes += policy.changes
+                policy = make()
+            continue
+        phy = PHYS[policy.rung]
+        acked = 0
+        kbit = 0.0
+        worst = 0.0
+        for _ in range(SAMPLES_PER_INTERVAL):
+            fading = -abs(rng.gauss(0.0, 2.5))
+            measured = true_rssi + fading + rng.gauss(0.0, 2.0)
+            policy.rssi_update(measured)
+            per = packet_error_rate(true_rssi + fading, phy)
+            worst = max(worst, per)
+            part = RATE_KBPS[phy] / SAMPLES_PER_INTERVAL * (1.0 - per)
+            kbit += part
+            acked += int(part * 1000 / 8 / PACKET_BYTES)
+        delivered_kbit += kbit
+        time_on[policy.rung] += 1
+        lossy = lossy + 1 if kbit < 0.02 * RATE_KBPS[phy] else 0
+        if lossy >= SUPERVISION_S:
+            drops += 1
+            lossy = 0
+            down = RECONNECT_S
+            continue
+        policy.evaluate(acked)
+    return delivered_kbit / len(path), time_on, changes + policy.changes, drops
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--scenario", default="all", choices=("all", "near", "walk", "edge", "wander"))
+    parser.add_argument("--seconds", type=int, default=600, help="length of each scenario (default: %(default)s)")
+    parser.add_argument("--seed", type=int, default=1, help="random seed (default: %(default)s)")
+    parser.add_argument("--refuse", action="append", default=[], choices=PHYS, help="PHY the peer refuses")
+    parser.add_argument("--header", default=HEADER, help="link_phy.h to read (default: the tree's)")
+    args = parser.parse_args()
+
+    constants = load_constants(args.header)
+    scenarios = ("near", "walk", "edge", "wander") if args.scenario == "all" else (args.scenario,)
+
+    for name in scenarios:
+        path = scenario_path(name, args.seconds, random.Random(args.seed))
+        print("%s (%d s):" % (name, args.seconds))
+        candidates = [("adaptive", lambda: Policy(constants, args.refuse))]
+        candidates += [("fixed " + phy, lambda phy=phy: FixedPolicy(phy)) for phy in PHYS if phy not in args.refuse]
+        for label, make in candidates:
+            kbps, time_on, changes, drops = run(make, path, random.Random(args.seed + 1))
+            share = "  ".join("%s %3d%%" % (PHYS[i], 100 * time_on[i] // len(path)) for i in range(len(PHYS)))
+            print("  %-12s %7.1f kbps  %s  %3d changes  %3d drops" % (label, kbps, share, changes, drops))
+
+
+if __name__ == "__main__":
+    main()
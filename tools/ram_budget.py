@@ -0,0 +1,401 @@
+#!/usr/bin/env python3
+"""RAM budget for the dongle firmware.
+
+The SoftDevice takes the bottom of RAM, and how much it takes depends on the
+link profile: link counts, ATT MTU, data length, event length, attribute table
+size and the per-link queues main.c configures. The application starts at
+RAM_START, which must sit right above that.
+
+    estimate   Estimate the SoftDevice RAM for a link profile and print RAM_START.
+    patch      Write RAM_START/RAM_SIZE into the SES project (and a GNU ld script).
+    report     List the largest buffers in a linker .map file.
+
+The estimate is a first-order model, calibrated against the RAM start the
+SoftDevice reported for one reference profile (CALIBRATION below), and only a
+starting point. The exact value comes from nrf_sdh_ble_enable(): if RAM_START
+is too low, the firmware prints the value it needs over USB instead of
+starting (see ram_start_report() in main.c). Feed it back with
+"patch --ram-start", and when it was reported for a new profile, update
+CALIBRATION with it. "patch --estimate" needs an explicit --margin.
+
+Examples:
+
+    tools/ram_budget.py estimate --periph 2 --central 0 --mtu 23
+    tools/ram_budget.py patch --estimate --margin 0x1000
+    tools/ram_budget.py patch --ram-start 0x20009c80
+    tools/ram_budget.py report pca10059/s140/ses/Output/Debug/Exe/ble_file_transfer_pca10059_s140.map
+"""
+
+import argparse
+import os
+import re
+import sys
+
+ROOT = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), os.pardir))
+
+SDK_CONFIG = os.path.join(ROOT, "pca10059", "s140", "config", "sdk_config.h")
+EM_PROJECT = os.path.join(ROOT, "pca10059", "s140", "ses", "ble_file_transfer_pca10059_s140.emProject")
+APP_SOURCES = [os.path.join(ROOT, "main.c"), os.path.join(ROOT, "ble_bulk.h"), os.path.join(ROOT, "virtual_object.h")]
+
+# SDK services that add a vendor-specific UUID base in their init function.
+SDK_VS_UUID_USERS = ("ble_lbs_init", "ble_nus_init")
+
+RAM_BASE = 0x20000000
+
+# First-order model of S140 7.x RAM use, in bytes. SD_MIN is the SoftDevice
+# with its minimum configuration (one peripheral link, 23-byte MTU, 27-byte
+# data length, 1408-byte attribute table, 10 vendor UUIDs). The per-item costs
+# are approximations; nrf_sdh_ble_enable() has the final word.
+SD_MIN              = 0x1628
+SD_LINK             = 0x270     # Link context: GAP, SMP, GATT client and server state.
+SD_CENTRAL_EXTRA    = 0x40      # Initiator and scanner state per central link.
+SD_LL_BUF_OVERHEAD  = 16        # Link layer buffer header, per buffer.
+SD_ATT_BUF_OVERHEAD = 8         # ATT buffer header, per buffer.
+SD_HVN_ENTRY        = 8         # Notification queue entry.
+SD_L2CAP_CHANNEL    = 0x60      # L2CAP channel context.
+SD_L2CAP_BUF_OVERHEAD = 8       # L2CAP buffer header, per buffer.
+SD_L2CAP_TX_ENTRY   = 8         # L2CAP TX queue entry; the SDU stays in application RAM.
+SD_VS_UUID          = 16        # Vendor-specific UUID base.
+SD_MIN_MTU          = 23
+SD_MIN_DATA_LENGTH  = 27
+SD_MIN_ATTR_TAB     = 1408
+SD_MIN_VS_UUIDS     = 10
+
+# RAM_START that nrf_sdh_ble_enable() reported for a reference profile. What the
+# model misses there is spread over the links, where it is least accurate.
+CALIBRATION = {
+    "ram_start": 0x2000a000,
+    "profile": {
+        "periph": 4, "central": 2, "mtu": 247, "data_length": 251, "event_length": 13,
+        "attr_tab": 1920, "vs_uuids": 10, "l2cap_rx_mps": 60, "l2cap_tx_mps": 40,
+        "hvn_queue": 6, "l2cap_tx_queue": 3,
+    },
+}
+
+# Profile keys and where their values come from.
+CONFIG_DEFINES = {
+    "periph":       "NRF_SDH_BLE_PERIPHERAL_LINK_COUNT",
+    "central":      "NRF_SDH_BLE_CENTRAL_LINK_COUNT",
+    "mtu":          "NRF_SDH_BLE_GATT_MAX_MTU_SIZE",
+    "data_length":  "NRF_SDH_BLE_GAP_DATA_LENGTH",
+    "event_length": "NRF_SDH_BLE_GAP_EVENT_LENGTH",
+    "attr_tab":     "NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE",
+    "vs_uuids":     "NRF_SDH_BLE_VS_UUID_COUNT",
+}
+APP_DEFINES = {
+    "l2cap_rx_mps": "L2CAP_RX_MPS",
+    "l2cap_tx_mps": "L2CAP_TX_MPS",
+    "hvn_queue":    "BLE_BULK_HVN_TX_QUEUE_SIZE",
+    "l2cap_tx_queue": "VIRTUAL_OBJECT_TX_SDU_MAX",
+}
+
+
+def fail(text):
+    sys.exit("ram_budget: " + text)
+
+
+def read(path):
+    try:
+        with open(path, "r", encoding="utf-8", errors="replace") as f:
+            return f.read()
+    except OSError as e:
+        fail("cannot read %s: %s" % (path, e.strerror))
+
+
+def defines(paths, names):
+    """Return the integer value of each #define in names, from the first file that has it."""
+    values = {}
+    for path in paths:
+        text = read(path)
+        for key, name in names.items():
+            if key in values:
+                continue
+            m = re.search(r"^\s*#define\s+%s\s+(\w+)" % re.escape(name), text, re.MULTILINE)
+            if m:
+                values[key] = int(m.group(1), 0)
+    missing = [names[k] for k in names if k not in values]
+    if missing:
+        fail("not defined: " + ", ".join(missing))
+    return values
+
+
+def vs_uuids_used():
+    """Count the vendor-specific UUID bases the firmware adds: its own calls and SDK services."""
+    count = 0
+    for name in sorted(os.listdir(ROOT)):
+        if name.endswith(".c"):
+            text = read(os.path.join(ROOT, name))
+            count += len(re.findall(r"\bsd_ble_uuid_vs_add\s*\(", text))
+            count += sum(len(re.findall(r"\b%s\s*\(" % f, text)) for f in SDK_VS_UUID_USERS)
+    return count
+
+
+def profile_get(args):
+    profile = defines([args.config], CONFIG_DEFINES)
+    profile.update(defines(APP_SOURCES, APP_DEFINES))
+    for key in list(CONFIG_DEFINES) + list(APP_DEFINES):
+        value = getattr(args, key, None)
+        if value is not None:
+            profile[key] = value
+    profile["vs_uuids_used"] = vs_uuids_used()
+    if profile["vs_uuids_used"] > profile["vs_uuids"]:
+        fail("%d vendor UUID bases are added, NRF_SDH_BLE_VS_UUID_COUNT is %d"
+             % (profile["vs_uuids_used"], profile["vs_uuids"]))
+    return profile
+
+
+def align(value, alignment):
+    return (value + alignment - 1) // alignment * alignment
+
+
+def ll_buffers(event_length, data_length):
+    """Link layer buffers per direction: as many packets as fit in one event, 2 to 7."""
+    # 1M PHY: 8 us per byte of payload plus header and CRC, and 150 us inter-frame space.
+    pair_us = 2 * ((data_length + 14) * 8 + 150)
+    return max(2, min(7, event_length * 1250 // pair_us))
+
+
+def model(profile):
+    """Return (total, items): the SoftDevice RAM of the uncalibrated model and its breakdown."""
+    links = profile["periph"] + profile["central"]
+    ll_count = ll_buffers(profile["event_length"], profile["data_length"])
+    ll_buf = align(profile["data_length"] + SD_LL_BUF_OVERHEAD, 4)
+    ll_min = align(SD_MIN_DATA_LENGTH + SD_LL_BUF_OVERHEAD, 4)
+    att_buf = align(profile["mtu"] + SD_ATT_BUF_OVERHEAD, 4)
+    att_min = align(SD_MIN_MTU + SD_ATT_BUF_OVERHEAD, 4)
+    l2cap = (SD_L2CAP_CHANNEL
+             + align(profile["l2cap_rx_mps"] + SD_L2CAP_BUF_OVERHEAD, 4)
+             + align(profile["l2cap_tx_mps"] + SD_L2CAP_BUF_OVERHEAD, 4))
+
+    items = [
+        ("SoftDevice minimum", SD_MIN),
+        ("link contexts (%d more)" % (links - 1), (links - 1) * SD_LINK),
+        ("central links", profile["central"] * SD_CENTRAL_EXTRA),
+        ("LL buffers (%d x %d B per link)" % (2 * ll_count, ll_buf),
+         links * 2 * ll_count * ll_buf - 2 * 2 * ll_min),
+        ("ATT buffers (2 x %d B per link)" % att_buf, links * 2 * att_buf - 2 * att_min),
+        ("HVN queue (%d per link)" % profile["hvn_queue"], links * (profile["hvn_queue"] - 1) * SD_HVN_ENTRY),
+        ("L2CAP CoC (1 per link)", links * l2cap),
+        ("L2CAP TX queue (%d per link)" % profile["l2cap_tx_queue"],
+         links * (profile["l2cap_tx_queue"] - 1) * SD_L2CAP_TX_ENTRY),
+        ("attribute table", profile["attr_tab"] - SD_MIN_ATTR_TAB),
+        ("vendor UUIDs (%d, %d used)" % (profile["vs_uuids"], profile.get("vs_uuids_used", 0)),
+         (profile["vs_uuids"] - SD_MIN_VS_UUIDS) * SD_VS_UUID),
+    ]
+    return sum(size for _, size in items), items
+
+
+def estimate(profile):
+    """Return (total, items): the calibrated SoftDevice RAM estimate and its breakdown."""
+    total, items = model(profile)
+    reference = CALIBRATION["profile"]
+    reference_total, _ = model(reference)
+    reference_links = reference["periph"] + reference["central"]
+    per_link = (CALIBRATION["ram_start"] - RAM_BASE - reference_total) // reference_links
+    links = profile["periph"] + profile["central"]
+
+    items.append(("calibration (%d per link)" % per_link, links * per_link))
+    return total + links * per_link, items
+
+
+def placement_get(text):
+    m = re.search(r'linker_section_placement_macros="([^"]*)"', text)
+    if not m:
+        fail("no linker_section_placement_macros in the project")
+    macros = dict(item.split("=", 1) for item in m.group(1).split(";") if "=" in item)
+    return m, macros
+
+
+def cmd_estimate(args):
+    profile = profile_get(args)
+    total, items = estimate(profile)
+    margin = args.margin or 0
+    ram_start = RAM_BASE + align(total + margin, 0x100)
+
+    print("Profile: %d peripheral + %d central links, MTU %d, data length %d, event length %d (%.2f ms)"
+          % (profile["periph"], profile["central"], profile["mtu"], profile["data_length"],
+             profile["event_length"], profile["event_length"] * 1.25))
+    for name, size in items:
+        print("  %-36s %7d" % (name, size))
+    print("  %-36s %7d" % ("margin", margin))
+    print("Estimated SoftDevice RAM: %d bytes" % (total + margin))
+    if profile["vs_uuids"] > profile["vs_uuids_used"]:
+        print("NRF_SDH_BLE_VS_UUID_COUNT could be %d" % profile["vs_uuids_used"])
+    print("RAM_START=0x%08x" % ram_start)
+
+    _, macros = placement_get(read(args.project))
+    current = int(macros.get("RAM_START", "0"), 0)
+    print("Project:  RAM_START=0x%08x (%+d bytes)" % (current, current - ram_start))
+    return ram_start
+
+
+def cmd_patch(args):
+    if args.ram_start is not None:
+        ram_start = args.ram_start
+    elif args.margin is None:
+        fail("patch --estimate needs an explicit --margin; the estimate is not what the SoftDevice reports")
+    else:
+        ram_start = cmd_estimate(args)
+
+    if ram_start % 4 or not RAM_BASE <= ram_start < RAM_BASE + 0x40000:
+        fail("bad RAM_START 0x%08x" % ram_start)
+
+    text = read(args.project)
+    m, macros = placement_get(text)
+    ram_end = int(macros["RAM_PH_START"], 0) + int(macros["RAM_PH_SIZE"], 0)
+    ram_size = ram_end - ram_start
+    macros["RAM_START"] = "0x%x" % ram_start
+    macros["RAM_SIZE"] = "0x%x" % ram_size
+    placement = ";".join("%s=%s" % item for item in macros.items())
+    text = text[:m.start(1)] + placement + text[m.end(1):]
+    write(args.project, text, args.dry_run)
+
+    if args.ld:
+        ld = read(args.ld)
+        ld, count = re.subn(r"(RAM\s*\([^)]*\)\s*:\s*ORIGIN\s*=\s*)0x[0-9a-fA-F]+(\s*,\s*LENGTH\s*=\s*)0x[0-9a-fA-F]+",
+                            r"\g<1>0x%x\g<2>0x%x" % (ram_start, ram_size), ld)
+        if count != 1:
+            fail("no single RAM region in %s" % args.ld)
+        write(args.ld, ld, args.dry_run)
+
+    print("RAM_START=0x%08x RAM_SIZE=0x%x%s" % (ram_start, ram_size, " (dry run)" if args.dry_run else ""))
+
+
+def write(path, text, dry_run):
+    if dry_run:
+        print("would patch " + os.path.relpath(path, ROOT))
+        return
+    with open(path, "w", encoding="utf-8", newline="") as f:
+        f.write(text)
+    print("patched " + os.path.relpath(path, ROOT))
+
+
+# Output sections that live in RAM, and the prefixes of the input sections inside them.
+RAM_SECTIONS = (".data", ".bss", ".heap", ".stack", ".tbss", ".tdata", ".noinit", ".non_init")
+RAM_INPUT = re.compile(r"^ (\.(?:bss|data|noinit|non_init)(?:\.\S+)?|COMMON)\s*(.*)$")
+OUTPUT = re.compile(r"^(\.\w+)\s*(.*)$")
+ADDR_SIZE = re.compile(r"^\s*0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+(\S.*))?$")
+
+
+def map_parse(path):
+    """Return (outputs, buffers) from a GNU ld map: RAM output sections and the input sections in them."""
+    lines = read(path).splitlines()
+    outputs = {}
+    buffers = []
+    current = None
+    i = 0
+
+    def addr_size(rest, i):
+        # Long section names put the address and size on the next line.
+        m = ADDR_SIZE.match(rest) if rest else None
+        if not m and i + 1 < len(lines):
+            m = ADDR_SIZE.match(lines[i + 1])
+            if m:
+                i += 1
+        return m, i
+
+    while i < len(lines):
+        line = lines[i]
+        out = OUTPUT.match(line)
+        if out:
+            current = out.group(1) if out.group(1) in RAM_SECTIONS else None
+            if current:
+                m, i = addr_size(out.group(2), i)
+                if m:
+                    outputs[current] = (int(m.group(1), 16), int(m.group(2), 16))
+        elif current in (".data", ".bss", ".tbss", ".tdata", ".noinit", ".non_init"):
+            inp = RAM_INPUT.match(line)
+            if inp:
+                m, i = addr_size(inp.group(2), i)
+                if m and int(m.group(2), 16) > 0:
+                    name = re.sub(r"^\.(bss|data|noinit|non_init)\.?", "", inp.group(1))
+                    obj = os.path.basename(m.group(3) or "")
+                    # A bare section attribute, like .non_init, names no symbol.
+                    name = name or obj
+                    buffers.append((int(m.group(2), 16), name, current, obj))
+        i += 1
+    return outputs, buffers
+
+
+def cmd_report(args):
+    outputs, buffers = map_parse(args.map)
+    if not buffers:
+        fail("no .data/.bss sections in %s" % args.map)
+
+    print("Sections:")
+    for name in RAM_SECTIONS:
+        if name in outputs:
+            addr, size = outputs[name]
+            print("  %-8s 0x%08x %7d" % (name, addr, size))
+
+    if ".data" in outputs:
+        linked = outputs[".data"][0]
+        _, macros = placement_get(read(args.project))
+        project = int(macros.get("RAM_START", "0"), 0)
+        print("Linked at RAM_START=0x%08x, project has 0x%08x%s"
+              % (linked, project, "" if linked == project else " (map is stale)"))
+    if ".heap" in outputs and ".stack" in outputs:
+        heap_end = sum(outputs[".heap"])
+        print("Unused between heap and stack: %d bytes" % (outputs[".stack"][0] - heap_end))
+
+    buffers.sort(reverse=True)
+    total = sum(size for size, _, _, _ in buffers)
+    print()
+    print("Largest of %d buffers (%d bytes):" % (len(buffers), total))
+    for size, name, section, obj in buffers[:args.top]:
+        print("  %7d  %-5s %-48s %s" % (size, section, name, obj))
+
+    per_object = {}
+    for size, _, _, obj in buffers:
+        per_object[obj] = per_object.get(obj, 0) + size
+    print()
+    print("By object file:")
+    for obj, size in sorted(per_object.items(), key=lambda item: -item[1])[:args.top]:
+        print("  %7d  %s" % (size, obj))
+
+
+def number(text):
+    return int(text, 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--project", default=EM_PROJECT, help="SES project (default: %(default)s)")
+    sub = parser.add_subparsers(dest="command")
+    sub.required = True
+
+    p_estimate = sub.add_parser("estimate", help="estimate RAM_START for a link profile")
+    p_patch = sub.add_parser("patch", help="write RAM_START/RAM_SIZE into the linker placement")
+    for p in (p_estimate, p_patch):
+        p.add_argument("--config", default=SDK_CONFIG, help="sdk_config.h (default: %(default)s)")
+        p.add_argument("--margin", type=number, help="bytes added to the estimate (required by patch --estimate)")
+        p.add_argument("--periph", type=number, help="peripheral links")
+        p.add_argument("--central", type=number, help="central links")
+        p.add_argument("--mtu", type=number, help="ATT MTU")
+        p.add_argument("--data-length", dest="data_length", type=number, help="LL data length")
+        p.add_argument("--event-length", dest="event_length", type=number, help="event length, 1.25 ms units")
+        p.add_argument("--attr-tab", dest="attr_tab", type=number, help="attribute table size")
+        p.add_argument("--vs-uuids", dest="vs_uuids", type=number, help="vendor-specific UUID count")
+        p.add_argument("--hvn-queue", dest="hvn_queue", type=number, help="notification queue per link")
+        p.add_argument("--l2cap-tx-queue", dest="l2cap_tx_queue", type=number, help="L2CAP TX queue per link")
+    p_estimate.set_defaults(func=cmd_estimate)
+
+    source = p_patch.add_mutually_exclusive_group(required=True)
+    source.add_argument("--ram-start", dest="ram_start", type=number,
+                        help="value reported by the firmware")
+    source.add_argument("--estimate", action="store_true", help="use the estimate")
+    p_patch.add_argument("--ld", help="GNU ld script to patch as well")
+    p_patch.add_argument("--dry-run", action="store_true", help="show what would change")
+    p_patch.set_defaults(func=cmd_patch)
+
+    p_report = sub.add_parser("report", help="list the largest buffers in a .map file")
+    p_report.add_argument("map", help="linker map file")
+    p_report.add_argument("--top", type=number, default=20, help="rows to show (default: %(default)s)")
+    p_report.set_defaults(func=cmd_report)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Run the dongle as a gateway scanner and print or log what it forwards.
+
+"run" starts the scan bridge (see scan_bridge.h) with the given filters,
+prints one line per forwarded report or appends it to a JSON lines file,
+and stops the bridge on Ctrl-C or after --duration. The dongle filters by
+RSSI, service UUID and company ID and drops repeats of the same payload from
+the same address, so only a fraction of the reports it sees reach the host.
+The counts it sends with every batch are printed at the end.
+
+The bridge reads the reports of the scan the dongle runs to find sensor
+nodes, so it only sees advertising while that scan runs.
+
+Requires pyserial.
+
+Examples:
+
+    tools/scan_bridge.py run /dev/ttyACM0 --rssi -80 --company 0x004c
+    tools/scan_bridge.py run /dev/ttyACM0 --uuid 0x1825 --jsonl gateway.jsonl --duration 60
+"""
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+SYNC = 0xA5
+FRAME_CONTROL = 0x60
+FRAME_BATCH = 0x61
+
+BATCH_HEADER = struct.Struct("<IHIIII")
+REPORT_HEADER = struct.Struct("<6sBbB")
+
+ADDR_TYPES = ("public", "random", "rpa", "nrpa")
+
+
+def parse_batch(payload):
+    time_ms, count, seen, forwarded, duplicates, lost = BATCH_HEADER.unpack_from(payload)
+    stats = {"seen": seen, "forwarded": forwarded, "duplicates": duplicates, "lost": lost}
+    reports = []
+    offset = BATCH_HEADER.size
+    for _ in range(count):
+        addr, info, rssi, length = REPORT_HEADER.unpack_from(payload, offset)
+        offset += REPORT_HEADER.size
+        reports.append({
+            "time_ms": time_ms,
+            "addr": ":".join("%02X" % b for b in reversed(addr)),
+            "addr_type": ADDR_TYPES[info & 0x03],
+            "connectable": bool(info & 0x10),
+            "scan_response": bool(info & 0x20),
+            "extended": bool(info & 0x40),
+            "rssi": rssi,
+            "data": payload[offset:offset + length].hex(),
+        })
+        offset += length
+    return reports, stats
+
+
+def control_frame(args):
+    body = struct.pack("<BbBB", 1, args.rssi, len(args.uuid), len(args.company))
+    body += b"".join(struct.pack("<H", u) for u in args.uuid + args.company)
+    return struct.pack("<BBH", SYNC, FRAME_CONTROL, len(body)) + body
+
+
+def run(args):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("scan_bridge: pyserial is required (pip install pyserial)")
+
+    port = serial.Serial(args.port, timeout=0.05)
+    buf = bytearray()
+    out = open(args.jsonl, "a") if args.jsonl else None
+    stats = None
+    received = 0
+
+    def pump():
+        nonlocal stats, received
+        buf.extend(port.read(port.in_waiting or 1))
+        while True:
+            start = buf.find(SYNC)
+            if start < 0:
+                buf.clear()
+                return
+            del buf[:start]
+            if len(buf) < 4:
+                return
+            length = buf[2] | (buf[3] << 8)
+            if len(buf) < 4 + length:
+                return
+            frame_type = buf[1]
+            payload = bytes(buf[4:4 + length])
+            del buf[:4 + length]
+            if frame_type != FRAME_BATCH:
+                continue
+            reports, stats = parse_batch(payload)
+            received += len(reports)
+            for report in reports:
+                if out:
+                    out.write(json.dumps(report) + "\n")
+                else:
+                    print("%8d ms  %s %-6s %4d dBm  %s" % (report["time_ms"], report["addr"],
+                                                           report["addr_type"], report["rssi"],
+                                                           report["data"]))
+
+    port.write(control_frame(args))
+    deadline = time.monotonic() + args.duration if args.duration else None
+    try:
+        while deadline is None or time.monotonic() < deadline:
+            pump()
+    except KeyboardInterrupt:
+        pass
+    port.write(struct.pack("<BBHB", SYNC, FRAME_CONTROL, 1, 0))
+    # The dongle answers a stop with a last batch holding the final counts.
+    deadline = time.monotonic() + 1.0
+    while time.monotonic() < deadline:
+        pump()
+    if out:
+        out.close()
+
+    if stats is None:
+        sys.exit("scan_bridge: no batch received")
+    seen = stats["seen"]
+    print("%d seen, %d forwarded (%.1f %%), %d duplicates, %d lost on the dongle; %d received" %
+          (seen, stats["forwarded"], 100.0 * stats["forwarded"] / seen if seen else 0.0,
+           stats["duplicates"], stats["lost"], received))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("run", help="start the bridge and print what it forwards")
+    p.add_argument("port", help="CDC ACM port of the dongle")
+    p.add_argument("--rssi", type=int, default=-127, help="RSSI floor in dBm (default: none)")
+    p.add_argument("--uuid", type=lambda s: int(s, 0), action="append", default=[],
+                   help="16-bit service UUID to pass, up to 4")
+    p.add_argument("--company", type=lambda s: int(s, 0), action="append", default=[],
+                   help="company ID of manufacturer data to pass, up to 4")
+    p.add_argument("--duration", type=float, help="seconds to run (default: until Ctrl-C)")
+    p.add_argument("--jsonl", help="append reports to this file instead of printing them")
+    p.set_defaults(func=run)
+
+    args = parser.parse_args()
+    if len(args.uuid) > 4 or len(args.company) > 4:
+        parser.error("at most 4 UUIDs and 4 company IDs")
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,375 @@
+#!/usr/bin/env python3
+"""Save and replay the dongle's event trace.
+
+"dump" asks the dongle for its flight recorder (see event_trace.h) and saves
+it. "replay" runs a saved trace through a model of the dongle, in recorded
+order, and reports:
+
+    timing     events per source, gaps between them, busiest 100 ms window
+    pool       SDU pool occupancy over time; time a pool of --pool buffers
+               would have been exhausted
+    usb        CDC writes completed, stream overflows and overflow storms
+    l2cap      SDUs sent and received, credits granted, and TX stalls that
+               ended with a credit grant (credit starvation)
+
+"replay --harness" also runs the trace through the firmware's own SDU pool, USB
+stream and host link, built for the host (make -C tests/host), and adds what
+they did under "harness": pool high water and allocation failures, SDUs
+dropped, stream overflows, and the writes the host link completed.
+
+The replay is deterministic. "replay --save-baseline" stores the report of a
+known-good trace; "replay --baseline" compares a trace against it and exits
+with status 1 if a lower-is-better figure grew by more than --tolerance.
+Traces from the field become regression tests this way.
+
+Requires pyserial for "dump".
+
+Examples:
+
+    tools/trace_replay.py dump /dev/ttyACM0 -o field.trace --clear
+    tools/trace_replay.py replay field.trace --pool 12
+    tools/trace_replay.py replay good.trace --save-baseline good.json
+    tools/trace_replay.py replay field.trace --baseline good.json
+    tools/trace_replay.py replay field.trace --harness tests/host/build/trace_harness
+"""
+
+import argparse
+import json
+import os
+import struct
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from ble_capture import BLE_EVENTS  # noqa: E402
+
+SYNC = 0xA5
+FRAME_DUMP = 0x40
+FRAME_DATA = 0x41
+FILE_MAGIC = b"EVTRACE1"
+RECORD = struct.Struct("<IBBH")
+
+SOURCE_POS = 5
+POOL_MASK = 0x1F
+SOURCES = ("ble", "usbd", "cdc", "timer", "reset", "stream", "gap")
+CDC_EVENTS = ("PORT_OPEN", "PORT_CLOSE", "TX_DONE", "RX_DONE")
+TIMERS = ("METRICS_REPORT", "MSG_IDLE")
+STREAM_EVENTS = ("QUEUE_FULL", "WRITE_FAILED")
+
+L2CAP_CH_CREDIT = 0x75
+L2CAP_CH_RX = 0x76
+L2CAP_CH_TX = 0x77
+CDC_TX_DONE = 2
+STREAM_QUEUE_FULL = 0
+
+LOWER_IS_BETTER = (
+    "pool.max", "pool.exhausted_ms", "usb.overflows", "usb.storms", "usb.longest_storm_ms",
+    "l2cap.credit_stalls", "l2cap.credit_stall_ms", "l2cap.longest_tx_gap_ms",
+    "harness.pool.high_water", "harness.pool.alloc_failures", "harness.sdu.dropped",
+    "harness.stream.queue_full", "harness.stream.write_failed",
+)
+
+
+def event_name(source, event_id):
+    if source == 0:
+        return BLE_EVENTS.get(event_id, "BLE_0x%02x" % event_id)
+    if source == 2 and event_id < len(CDC_EVENTS):
+        return "CDC_" + CDC_EVENTS[event_id]
+    if source == 3 and event_id < len(TIMERS):
+        return "TIMER_" + TIMERS[event_id]
+    if source == 5 and event_id < len(STREAM_EVENTS):
+        return "STREAM_" + STREAM_EVENTS[event_id]
+    name = SOURCES[source] if source < len(SOURCES) else "src%d" % source
+    return "%s_%d" % (name.upper(), event_id)
+
+
+def load(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if not data.startswith(FILE_MAGIC):
+        sys.exit("trace_replay: %s is not a saved trace" % path)
+    tick_hz = struct.unpack_from("<I", data, len(FILE_MAGIC))[0]
+    body = data[len(FILE_MAGIC) + 4:]
+    records = []
+    for offset in range(0, len(body) - RECORD.size + 1, RECORD.size):
+        ticks, info, event_id, arg = RECORD.unpack_from(body, offset)
+        records.append((ticks, info >> SOURCE_POS, event_id, arg, info & POOL_MASK))
+    return tick_hz, records
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))]
+
+
+def replay(tick_hz, records, args):
+    ms = 1000.0 / tick_hz
+    report = {"events": len(records)}
+
+    # A reset restarts the clock; later epochs are laid after the earlier ones.
+    timeline = []
+    offset = 0
+    last = None
+    for ticks, source, event_id, arg, pool in records:
+        if source == 4 and last is not None:
+            offset = last + 1 - ticks
+        t = (ticks + offset) * ms
+        last = ticks + offset
+        timeline.append((t, source, event_id, arg, pool))
+
+    if not timeline:
+        return report
+
+    start, end = timeline[0][0], timeline[-1][0]
+    report["duration_ms"] = round(end - start, 3)
+    report["resets"] = sum(1 for e in timeline if e[1] == 4)
+    report["missed"] = sum(e[3] for e in timeline if e[1] == 6)
+
+    # Timing.
+    by_name = {}
+    for t, source, event_id, _, _ in timeline:
+        by_name.setdefault(event_name(source, event_id), []).append(t)
+    timing = {}
+    for name, times in sorted(by_name.items()):
+        gaps = [b - a for a, b in zip(times, times[1:])]
+        timing[name] = {
+            "count": len(times),
+            "gap_p50_ms": round(percentile(gaps, 50), 3),
+            "gap_p99_ms": round(percentile(gaps, 99), 3),
+            "gap_max_ms": round(max(gaps) if gaps else 0.0, 3),
+        }
+    report["timing"] = timing
+
+    busiest = 0
+    first = 0
+    for i, event in enumerate(timeline):
+        while event[0] - timeline[first][0] > 100.0:
+            first += 1
+        busiest = max(busiest, i - first + 1)
+    report["busiest_100ms"] = busiest
+
+    # Pool: occupancy holds from one event to the next.
+    held = {}
+    exhausted = 0.0
+    weighted = 0.0
+    for (t, _, _, _, pool), nxt in zip(timeline, timeline[1:] + [timeline[-1]]):
+        span = nxt[0] - t
+        held[pool] = held.get(pool, 0.0) + span
+        weighted += pool * span
+        if pool >= args.pool:
+            exhausted += span
+    total = max(end - start, 1e-9)
+    report["pool"] = {
+        "max": max(e[4] for e in timeline),
+        "mean": round(weighted / total, 2),
+        "exhausted_ms": round(exhausted, 3),
+        "size_modelled": args.pool,
+    }
+
+    # USB: overflows and storms of them.
+    overflows = [t for t, source, event_id, _, _ in timeline if source == 5 and event_id == STREAM_QUEUE_FULL]
+    storms = []
+    for t in overflows:
+        if storms and t - storms[-1][1] <= args.storm_ms:
+            storms[-1][1] = t
+            storms[-1][2] += 1
+        else:
+            storms.append([t, t, 1])
+    storms = [s for s in storms if s[2] >= args.storm_count]
+    report["usb"] = {
+        "tx_done": sum(1 for e in timeline if e[1] == 2 and e[2] == CDC_TX_DONE),
+        "overflows": len(overflows),
+        "storms": len(storms),
+        "longest_storm_ms": round(max((s[1] - s[0] for s in storms), default=0.0), 3),
+    }
+
+    # L2CAP: a TX gap longer than --stall-ms that ends right after a credit grant was spent
+    # waiting for credits.
+    tx_bytes = 0
+    rx_bytes = 0
+    credits = 0
+    stalls = 0
+    stall_ms = 0.0
+    longest_gap = 0.0
+    last_tx = None
+    credit_since_tx = False
+    for t, source, event_id, arg, _ in timeline:
+        if source != 0:
+            continue
+        if event_id == L2CAP_CH_CREDIT:
+            credits += arg
+            credit_since_tx = True
+        elif event_id == L2CAP_CH_RX:
+            rx_bytes += arg
+        elif event_id == L2CAP_CH_TX:
+            tx_bytes += arg
+            if last_tx is not None:
+                gap = t - last_tx
+                longest_gap = max(longest_gap, gap)
+                if gap > args.stall_ms and credit_since_tx:
+                    stalls += 1
+                    stall_ms += gap
+            last_tx = t
+            credit_since_tx = False
+    report["l2cap"] = {
+        "tx_bytes": tx_bytes,
+        "rx_bytes": rx_bytes,
+        "credits_granted": credits,
+        "tx_kbps": round(tx_bytes * 8 / total, 1),
+        "credit_stalls": stalls,
+        "credit_stall_ms": round(stall_ms, 3),
+        "longest_tx_gap_ms": round(longest_gap, 3),
+    }
+
+    return report
+
+
+def run_harness(path, trace):
+    try:
+        out = subprocess.run([path, trace], check=True, stdout=subprocess.PIPE).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        sys.exit("trace_replay: harness failed: %s" % e)
+    return json.loads(out)
+
+
+def flatten(report, prefix=""):
+    flat = {}
+    for key, value in report.items():
+        if isinstance(value, dict):
+            flat.update(flatten(value, prefix + key + "."))
+        else:
+            flat[prefix + key] = value
+    return flat
+
+
+def print_report(report):
+    flat = flatten(report)
+    for key in sorted(k for k in flat if not k.startswith("timing.")):
+        print("%-28s %s" % (key, flat[key]))
+    print()
+    print("%-34s %7s %10s %10s %10s" % ("event", "count", "gap p50", "gap p99", "gap max"))
+    for name, row in sorted(report.get("timing", {}).items(), key=lambda item: -item[1]["count"]):
+        print("%-34s %7d %8.2f ms %7.2f ms %7.2f ms" % (
+            name, row["count"], row["gap_p50_ms"], row["gap_p99_ms"], row["gap_max_ms"]))
+
+
+def compare(report, baseline, tolerance):
+    now = flatten(report)
+    base = flatten(baseline)
+    failures = []
+    for key in LOWER_IS_BETTER:
+        if key not in now or key not in base:
+            continue
+        limit = base[key] * (1.0 + tolerance)
+        # Absolute slack, so a baseline of zero does not fail on timer jitter.
+        limit += 1.0 if key.endswith("_ms") else 0
+        if now[key] > limit:
+            failures.append("%s: %s, baseline %s" % (key, now[key], base[key]))
+    return failures
+
+
+def cmd_replay(args):
+    tick_hz, records = load(args.trace)
+    report = replay(tick_hz, records, args)
+    if args.harness:
+        report["harness"] = run_harness(args.harness, args.trace)
+
+    if args.json:
+        print(json.dumps(report, indent=2, sort_keys=True))
+    else:
+        print_report(report)
+
+    if args.save_baseline:
+        with open(args.save_baseline, "w") as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            failures = compare(report, json.load(f), args.tolerance)
+        for failure in failures:
+            print("REGRESSION %s" % failure)
+        if failures:
+            sys.exit(1)
+
+
+def cmd_dump(args):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("trace_replay: pyserial is required (pip install pyserial)")
+
+    port = serial.Serial(args.port, timeout=0.05)
+    port.write(struct.pack("<BBHB", SYNC, FRAME_DUMP, 1, 1 if args.clear else 0))
+
+    buf = bytearray()
+    records = {}
+    total = None
+    deadline = time.monotonic() + args.timeout
+    while time.monotonic() < deadline and (total is None or len(records) < total):
+        buf += port.read(port.in_waiting or 1)
+        while True:
+            start = buf.find(SYNC)
+            if start < 0:
+                buf.clear()
+                break
+            del buf[:start]
+            if len(buf) < 4:
+                break
+            length = buf[2] | (buf[3] << 8)
+            if len(buf) < 4 + length:
+                break
+            frame_type = buf[1]
+            payload = bytes(buf[4:4 + length])
+            del buf[:4 + length]
+            if frame_type != FRAME_DATA or len(payload) < 4:
+                continue
+            index, total = struct.unpack_from("<HH", payload, 0)
+            for i in range((len(payload) - 4) // RECORD.size):
+                records[index + i] = payload[4 + i * RECORD.size:4 + (i + 1) * RECORD.size]
+
+    if total is None:
+        sys.exit("trace_replay: no answer from the dongle")
+    if len(records) < total:
+        print("trace_replay: %d of %d records received" % (len(records), total), file=sys.stderr)
+
+    with open(args.output, "wb") as f:
+        f.write(FILE_MAGIC + struct.pack("<I", args.tick_hz))
+        for index in sorted(records):
+            f.write(records[index])
+    print("%d records written to %s" % (len(records), args.output))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("dump", help="save the dongle's trace")
+    p.add_argument("port", help="CDC ACM port of the dongle")
+    p.add_argument("-o", "--output", required=True, help="trace file to write")
+    p.add_argument("--clear", action="store_true", help="empty the dongle's ring after the dump")
+    p.add_argument("--tick-hz", type=int, default=32768, help="app_timer tick rate (default: %(default)s)")
+    p.add_argument("--timeout", type=float, default=5.0, help="seconds to wait (default: %(default)s)")
+    p.set_defaults(func=cmd_dump)
+
+    p = sub.add_parser("replay", help="replay a saved trace")
+    p.add_argument("trace", help="trace file written by dump")
+    p.add_argument("--pool", type=int, default=16, help="SDU pool size to model (default: %(default)s)")
+    p.add_argument("--stall-ms", type=float, default=50.0, help="TX gap counted as a stall (default: %(default)s)")
+    p.add_argument("--storm-ms", type=float, default=10.0, help="overflows this close belong to one storm (default: %(default)s)")
+    p.add_argument("--storm-count", type=int, default=4, help="overflows that make a storm (default: %(default)s)")
+    p.add_argument("--harness", metavar="BINARY", help="also replay through tests/host/build/trace_harness")
+    p.add_argument("--json", action="store_true", help="print the report as JSON")
+    p.add_argument("--save-baseline", metavar="FILE", help="write the report as a baseline")
+    p.add_argument("--baseline", metavar="FILE", help="compare against a baseline")
+    p.add_argument("--tolerance", type=float, default=0.1, help="allowed growth over the baseline (default: %(default)s)")
+    p.set_defaults(func=cmd_replay)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
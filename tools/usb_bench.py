@@ -0,0 +1,456 @@
+#!/usr/bin/env python3
+"""Host link throughput test: CDC ACM, the vendor bulk interface, UARTE and RTT.
+
+Moves test data through the dongle's host stream in both directions and prints
+the throughput the host sees, with the dongle's own timing (see usb_bench.h).
+A loopback run then has the dongle echo data frames back and checks them.
+Last, the statistics of every host link (host_link.h) over the test are
+printed, with the throughput each link had while it was writing.
+
+Links:
+
+    cdc    the CDC ACM port, through the tty layer (pyserial)
+    bulk   the vendor interface, through libusb (pyusb); the dongle sends its
+           frames there while the tool has it open
+    uart   the UARTE link (host_uart.h), through a USB serial adapter with
+           RTS/CTS wired (pyserial); the dongle moves its stream there once
+           the tool sends on it, and back when the CDC port is opened
+    rtt    RTT channel 1 through a J-Link (pylink); the dongle moves its stream
+           there once the tool sends on it
+    fake   an in-process model of the dongle, to check the tool itself
+
+Writes to the bulk OUT endpoint whose length is a multiple of 64 are followed
+by a zero-length packet, which the dongle needs to end the transfer. On
+Windows, libusb needs the vendor interface bound to WinUSB first.
+
+Example:
+
+    tools/usb_bench.py --cdc /dev/ttyACM0 --bulk --size 1000000
+    tools/usb_bench.py --uart /dev/ttyUSB0 --baud 1000000 --size 200000
+    tools/usb_bench.py --rtt --size 100000
+    tools/usb_bench.py --fake --size 200000
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+SYNC = 0xA5
+FRAME_CONTROL = 0x70
+FRAME_DATA = 0x71
+FRAME_REPORT = 0x72
+FRAME_LINKS = 0x73
+OP_SEND = 1
+OP_REPORT = 2
+OP_RESET = 3
+OP_ECHO = 4
+OP_LINKS = 5
+REPORT = struct.Struct("<IIIIII")
+LINK_REC = struct.Struct("<BIIIIII")   # id, rx bytes, tx bytes, writes, tx us, held, refused
+LINK_NAMES = {0: "cdc", 1: "uart", 2: "rtt", 3: "mem"}   # host_link_id_t
+FRAME_PAYLOAD = 512                     # SDU_POOL_DATA_SIZE
+USB_VID = 0x1915
+USB_PID = 0x520F
+VENDOR_INTERFACE = 2
+VENDOR_REQ_OPEN = 0x01
+PACKET_SIZE = 64
+BULK_WRITE = 8 * (FRAME_PAYLOAD + 4)    # Frames per host write on the bulk link.
+ECHO_WINDOW = 4                         # Echoed frames in flight; well under USB_STREAM_QUEUE_DEPTH.
+
+
+def frame(frame_type, payload=b""):
+    return struct.pack("<BBH", SYNC, frame_type, len(payload)) + payload
+
+
+def pattern(offset, length):
+    """Test data as the dongle sends it: byte n of the stream is n modulo 256."""
+    return bytes((offset + i) & 0xFF for i in range(length))
+
+
+class FrameReader:
+    """Splits a byte stream into frames, skipping debug text."""
+
+    def __init__(self):
+        self.buf = bytearray()
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                self.buf.clear()
+                return
+            del self.buf[:start]
+            if len(self.buf) < 4:
+                return
+            length = self.buf[2] | (self.buf[3] << 8)
+            if len(self.buf) < 4 + length:
+                return
+            frame_type = self.buf[1]
+            payload = bytes(self.buf[4:4 + length])
+            del self.buf[:4 + length]
+            yield frame_type, payload
+
+
+class CdcLink:
+    name = "cdc"
+
+    def __init__(self, port):
+        import serial
+        self.port = serial.Serial(port, timeout=0.1)
+        self.port.reset_input_buffer()
+
+    def write(self, data):
+        self.port.write(data)
+
+    def read(self):
+        return self.port.read(self.port.in_waiting or 1)
+
+    def close(self):
+        self.port.close()
+
+
+class UartLink(CdcLink):
+    name = "uart"
+
+    def __init__(self, port, baud):
+        import serial
+        self.port = serial.Serial(port, baud, rtscts=True, timeout=0.1)
+        self.port.reset_input_buffer()
+
+
+class RttLink:
+    name = "rtt"
+    CHANNEL = 1                         # HOST_LINK_RTT_CHANNEL
+
+    def __init__(self):
+        import pylink
+        self.jlink = pylink.JLink()
+        self.jlink.open()
+        self.jlink.set_tif(pylink.enums.JLinkInterfaces.SWD)
+        self.jlink.connect("NRF52840_XXAA")
+        self.jlink.rtt_start()
+        deadline = time.monotonic() + 5
+        while True:
+            try:
+                if self.jlink.rtt_get_num_up_buffers() > self.CHANNEL:
+                    break
+            except pylink.errors.JLinkRTTException:
+                pass
+            if time.monotonic() > deadline:
+                raise RuntimeError("rtt: control block not found")
+            time.sleep(0.1)
+
+    def write(self, data):
+        data = list(data)
+        while data:
+            written = self.jlink.rtt_write(self.CHANNEL, data)
+            del data[:written]
+
+    def read(self):
+        return bytes(self.jlink.rtt_read(self.CHANNEL, 4096))
+
+    def close(self):
+        self.jlink.rtt_stop()
+        self.jlink.close()
+
+
+class BulkLink:
+    name = "bulk"
+
+    def __init__(self):
+        import usb.core
+        import usb.util
+        self.usb = usb
+        self.dev = usb.core.find(idVendor=USB_VID, idProduct=USB_PID)
+        if self.dev is None:
+            raise RuntimeError("dongle %04x:%04x not found" % (USB_VID, USB_PID))
+        intf = self.dev.get_active_configuration()[(VENDOR_INTERFACE, 0)]
+        usb.util.claim_interface(self.dev, VENDOR_INTERFACE)
+        direction = usb.util.endpoint_direction
+        self.ep_in = usb.util.find_descriptor(intf, custom_match=lambda e: direction(e.bEndpointAddress) == usb.util.ENDPOINT_IN)
+        self.ep_out = usb.util.find_descriptor(intf, custom_match=lambda e: direction(e.bEndpointAddress) == usb.util.ENDPOINT_OUT)
+        self.open_request(1)
+
+    def open_request(self, value):
+        request_type = self.usb.util.build_request_type(self.usb.util.CTRL_OUT,
+                                                        self.usb.util.CTRL_TYPE_VENDOR,
+                                                        self.usb.util.CTRL_RECIPIENT_INTERFACE)
+        self.dev.ctrl_transfer(request_type, VENDOR_REQ_OPEN, value, VENDOR_INTERFACE)
+
+    def write(self, data):
+        self.ep_out.write(data)
+        if len(data) % PACKET_SIZE == 0:
+            self.ep_out.write(b"")
+
+    def read(self):
+        try:
+            return bytes(self.ep_in.read(4096, timeout=100))
+        except self.usb.core.USBTimeoutError:
+            return b""
+
+    def close(self):
+        self.open_request(0)
+        self.usb.util.release_interface(self.dev, VENDOR_INTERFACE)
+
+
+class FakeLink:
+    """The dongle's usb_bench and frame parser, run in process."""
+
+    name = "fake"
+
+    def __init__(self):
+        self.reader = FrameReader()
+        self.out = bytearray()
+        self.start = time.monotonic()
+        self.link = [0] * 6             # As the RAM link: rx, tx, writes, tx us, held, refused.
+        self.reset()
+
+    def now_us(self):
+        return int((time.monotonic() - self.start) * 1e6) & 0xFFFFFFFF
+
+    def reset(self):
+        self.rx = [0, 0, 0, 0]          # bytes, frames, started, elapsed
+        self.tx = [0, 0, 0, 0]
+        self.tx_left = 0
+        self.echo = False
+
+    def write(self, data):
+        self.link[0] += len(data)
+        for frame_type, payload in self.reader.feed(data):
+            if frame_type == FRAME_DATA:
+                if self.rx[1] == 0:
+                    self.rx[2] = self.now_us()
+                self.rx[0] += len(payload)
+                self.rx[1] += 1
+                self.rx[3] = self.now_us() - self.rx[2]
+                if self.echo:
+                    if self.tx[1] == 0:
+                        self.tx[2] = self.rx[2]
+                    self.out += frame(FRAME_DATA, payload)
+                    self.tx[0] += len(payload)
+                    self.tx[1] += 1
+                    self.tx[3] = self.now_us() - self.tx[2]
+            elif frame_type == FRAME_CONTROL and payload:
+                if payload[0] == OP_SEND and len(payload) >= 5:
+                    self.tx = [0, 0, self.now_us(), 0]
+                    self.tx_left = struct.unpack_from("<I", payload, 1)[0]
+                elif payload[0] == OP_REPORT:
+                    self.out += frame(FRAME_REPORT, REPORT.pack(self.rx[0], self.rx[1], self.rx[3],
+                                                                self.tx[0], self.tx[1], self.tx[3]))
+                elif payload[0] == OP_RESET:
+                    self.reset()
+                elif payload[0] == OP_ECHO and len(payload) >= 2:
+                    self.echo = payload[1] != 0
+                elif payload[0] == OP_LINKS:
+                    self.out += frame(FRAME_LINKS, LINK_REC.pack(3, *self.link))
+
+    def read(self):
+        while self.tx_left > 0 and len(self.out) < 4096:
+            length = min(self.tx_left, FRAME_PAYLOAD)
+            self.out += frame(FRAME_DATA, pattern(self.tx[0], length))
+            self.tx[0] += length
+            self.tx[1] += 1
+            self.tx_left -= length
+            self.tx[3] = self.now_us() - self.tx[2]
+        data = bytes(self.out)
+        self.out.clear()
+        if data:
+            self.link[1] += len(data)
+            self.link[2] += 1
+            self.link[3] += max(1, len(data) * 8 // 12)     # As if at 12 Mbit/s.
+        return data
+
+    def close(self):
+        pass
+
+
+def wait_frame(link, reader, frame_type, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        for got_type, payload in reader.feed(link.read()):
+            if got_type == frame_type:
+                return payload
+    raise RuntimeError("%s: no frame 0x%02x within %.1f s" % (link.name, frame_type, timeout))
+
+
+def report(link, reader, timeout):
+    link.write(frame(FRAME_CONTROL, bytes([OP_REPORT])))
+    return REPORT.unpack(wait_frame(link, reader, FRAME_REPORT, timeout))
+
+
+def link_stats(link, timeout):
+    """Statistics of every open host link, by name."""
+    reader = FrameReader()
+    link.write(frame(FRAME_CONTROL, bytes([OP_LINKS])))
+    payload = wait_frame(link, reader, FRAME_LINKS, timeout)
+    return {LINK_NAMES.get(rec[0], "link%d" % rec[0]): rec[1:] for rec in LINK_REC.iter_unpack(payload)}
+
+
+def run_in(link, size, timeout):
+    """Dongle to host. Returns host seconds, dongle report, pattern errors."""
+    reader = FrameReader()
+    link.write(frame(FRAME_CONTROL, bytes([OP_RESET])))
+    started = time.monotonic()
+    link.write(frame(FRAME_CONTROL, struct.pack("<BI", OP_SEND, size)))
+
+    received = 0
+    errors = 0
+    deadline = started + timeout
+    while received < size:
+        if time.monotonic() > deadline:
+            raise RuntimeError("%s: %d of %d bytes within %.1f s" % (link.name, received, size, timeout))
+        for frame_type, payload in reader.feed(link.read()):
+            if frame_type != FRAME_DATA:
+                continue
+            if payload != pattern(received, len(payload)):
+                errors += 1
+            received += len(payload)
+    elapsed = time.monotonic() - started
+
+    return elapsed, report(link, reader, timeout), errors
+
+
+def run_out(link, size, timeout):
+    """Host to dongle. Returns host seconds, dongle report."""
+    reader = FrameReader()
+    link.write(frame(FRAME_CONTROL, bytes([OP_RESET])))
+    started = time.monotonic()
+
+    chunk = bytearray()
+    sent = 0
+    while sent < size:
+        length = min(size - sent, FRAME_PAYLOAD)
+        chunk += frame(FRAME_DATA, pattern(sent, length))
+        sent += length
+        if len(chunk) >= BULK_WRITE or sent == size:
+            link.write(bytes(chunk))
+            chunk.clear()
+
+    # The report comes after the dongle has parsed every frame sent before it.
+    result = report(link, reader, timeout)
+    elapsed = time.monotonic() - started
+
+    return elapsed, result
+
+
+def run_echo(link, size, timeout):
+    """Host to dongle and back. Returns host seconds, dongle report, mismatched frames."""
+    reader = FrameReader()
+    link.write(frame(FRAME_CONTROL, bytes([OP_RESET])))
+    link.write(frame(FRAME_CONTROL, bytes([OP_ECHO, 1])))
+    started = time.monotonic()
+
+    sent = 0
+    received = 0
+    errors = 0
+    in_flight = []
+    deadline = started + timeout
+    while received < size:
+        if time.monotonic() > deadline:
+            raise RuntimeError("%s: %d of %d bytes echoed within %.1f s" % (link.name, received, size, timeout))
+        chunk = bytearray()
+        while sent < size and len(in_flight) < ECHO_WINDOW:
+            length = min(size - sent, FRAME_PAYLOAD)
+            in_flight.append(pattern(sent, length))
+            chunk += frame(FRAME_DATA, in_flight[-1])
+            sent += length
+        if chunk:
+            link.write(bytes(chunk))
+        for frame_type, payload in reader.feed(link.read()):
+            if frame_type != FRAME_DATA:
+                continue
+            if not in_flight or payload != in_flight.pop(0):
+                errors += 1
+            received += len(payload)
+    elapsed = time.monotonic() - started
+
+    link.write(frame(FRAME_CONTROL, bytes([OP_ECHO, 0])))
+    return elapsed, report(link, reader, timeout), errors
+
+
+def kbps(size, seconds):
+    return size / seconds / 1000.0 if seconds > 0 else float("inf")
+
+
+def bench(link, size, timeout):
+    results = {}
+    before = link_stats(link, timeout)
+
+    elapsed, (rx_bytes, rx_frames, rx_us, tx_bytes, tx_frames, tx_us), errors = run_in(link, size, timeout)
+    print("%-5s in   host %9.1f kB/s   dongle queued %d bytes in %d frames, %.1f ms   pattern errors %d" % (
+        link.name, kbps(size, elapsed), tx_bytes, tx_frames, tx_us / 1000.0, errors))
+    results["in"] = kbps(size, elapsed)
+    ok = (tx_bytes == size) and (errors == 0)
+
+    elapsed, (rx_bytes, rx_frames, rx_us, tx_bytes, tx_frames, tx_us) = run_out(link, size, timeout)
+    print("%-5s out  host %9.1f kB/s   dongle received %d bytes in %d frames, %.1f ms (%.1f kB/s)" % (
+        link.name, kbps(size, elapsed), rx_bytes, rx_frames, rx_us / 1000.0, kbps(rx_bytes, rx_us / 1e6)))
+    results["out"] = kbps(size, elapsed)
+    ok = ok and (rx_bytes == size)
+
+    elapsed, (rx_bytes, rx_frames, rx_us, tx_bytes, tx_frames, tx_us), errors = run_echo(link, size, timeout)
+    print("%-5s echo host %9.1f kB/s   dongle echoed %d bytes in %d frames, %.1f ms   frame errors %d" % (
+        link.name, kbps(size, elapsed), tx_bytes, tx_frames, tx_us / 1000.0, errors))
+    results["echo"] = kbps(size, elapsed)
+    ok = ok and (tx_bytes == size) and (errors == 0)
+
+    after = link_stats(link, timeout)
+    for name, stats in sorted(after.items()):
+        rx, tx, writes, tx_us, held, refused = (a - b for a, b in zip(stats, before.get(name, (0,) * 6)))
+        print("%-5s link %-4s wrote %d bytes in %d writes, %.1f kB/s while writing, %d held off, %d refused; read %d bytes" % (
+            link.name, name, tx, writes, kbps(tx, tx_us / 1e6), held, refused, rx))
+
+    return results, ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--cdc", metavar="PORT", help="CDC ACM port of the dongle")
+    parser.add_argument("--bulk", action="store_true", help="test the vendor bulk interface (needs pyusb)")
+    parser.add_argument("--uart", metavar="PORT", help="serial port wired to the dongle's UARTE link")
+    parser.add_argument("--baud", type=int, default=1000000, help="UARTE line rate (default: %(default)s)")
+    parser.add_argument("--rtt", action="store_true", help="test RTT through a J-Link (needs pylink)")
+    parser.add_argument("--fake", action="store_true", help="test against an in-process model of the dongle")
+    parser.add_argument("--size", type=int, default=1000000, help="bytes per direction (default: %(default)s)")
+    parser.add_argument("--timeout", type=float, default=30.0, help="seconds per direction (default: %(default)s)")
+    args = parser.parse_args()
+
+    links = []
+    if args.cdc:
+        links.append(lambda: CdcLink(args.cdc))
+    if args.bulk:
+        links.append(BulkLink)
+    if args.uart:
+        links.append(lambda: UartLink(args.uart, args.baud))
+    if args.rtt:
+        links.append(RttLink)
+    if args.fake:
+        links.append(FakeLink)
+    if not links:
+        parser.error("give at least one of --cdc, --bulk, --uart, --rtt, --fake")
+
+    results = {}
+    failed = False
+    for make in links:
+        link = make()
+        try:
+            results[link.name], ok = bench(link, args.size, args.timeout)
+            failed = failed or not ok
+        except RuntimeError as err:
+            print(err, file=sys.stderr)
+            failed = True
+        finally:
+            link.close()
+
+    for name in ("bulk", "uart", "rtt"):
+        if "cdc" in results and name in results:
+            for direction in ("in", "out", "echo"):
+                print("%s/cdc %-4s x%.2f" % (name, direction, results[name][direction] / results["cdc"][direction]))
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,361 @@
+#include <string.h>
+#include "transfer_metrics.h"
+#include "ble.h"
+#include "nrf_sdh_ble.h"
+#include "msg.h"
+#include "sdu_pool.h"
+#include "event_trace.h"
+
+
+#define LINK_COUNT  NRF_SDH_BLE_TOTAL_LINK_COUNT    /**< Number of links tracked. */
+
+/**@brief Latency aggregate for one class of peer. */
+typedef struct
+{
+    uint32_t count;                         /**< Number of connections that reached the first SDU. */
+    uint32_t sum_us;                        /**< Sum of connect-to-first-byte latencies. */
+    uint32_t min_us;                        /**< Smallest latency seen. */
+    uint32_t max_us;                        /**< Largest latency seen. */
+} latency_stats_t;
+
+/**@brief Milestones and byte counters of one connection. */
+typedef struct
+{
+    uint16_t conn_handle;                                   /**< Connection handle, BLE_CONN_HANDLE_INVALID when idle. */
+    uint32_t connected_ticks;                               /**< Timestamp of BLE_GAP_EVT_CONNECTED. */
+    uint32_t milestone_us[TRANSFER_METRICS_MILESTONE_COUNT];/**< Time from connection to each milestone. */
+    uint32_t reached_mask;                                  /**< Bit n is set when milestone n was reached. */
+    bool     bonded_peer;                                   /**< Peer reconnected with an existing bond. */
+    uint8_t  role;                                          /**< BLE_GAP_ROLE_PERIPH or BLE_GAP_ROLE_CENTRAL. */
+    uint32_t bytes[TRANSFER_METRICS_TRANSPORT_COUNT];       /**< Bytes moved since the last report. */
+} link_metrics_t;
+
+APP_TIMER_DEF(m_report_timer);
+
+static link_metrics_t  m_links[LINK_COUNT];
+static latency_stats_t m_stats_bonded;                      /**< Reconnections with a restored bond. */
+static latency_stats_t m_stats_new;                         /**< Connections from unknown peers. */
+static uint32_t        m_report_ticks;                      /**< Timestamp of the last throughput report. */
+
+static char const * const m_milestone_names[TRANSFER_METRICS_MILESTONE_COUNT] =
+{
+    "secured",
+    "sys_attr",
+    "oacp",
+    "first_sdu",
+};
+
+static char const * const m_transport_names[TRANSFER_METRICS_TRANSPORT_COUNT] =
+{
+    "ots",
+    "ots_c",
+    "gatt",
+};
+
+
+uint32_t transfer_metrics_timestamp(void)
+{
+    return app_timer_cnt_get();
+}
+
+
+uint32_t transfer_metrics_elapsed_us(uint32_t since)
+{
+    return TRANSFER_METRICS_TICKS_TO_US(app_timer_cnt_diff_compute(app_timer_cnt_get(), since));
+}
+
+
+static link_metrics_t * link_find(uint16_t conn_handle)
+{
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static void stats_add(latency_stats_t * p_stats, uint32_t latency_us)
+{
+    if ((p_stats->count == 0) || (latency_us < p_stats->min_us))
+    {
+        p_stats->min_us = latency_us;
+    }
+    if (latency_us > p_stats->max_us)
+    {
+        p_stats->max_us = latency_us;
+    }
+    p_stats->sum_us += latency_us;
+    p_stats->count++;
+}
+
+
+static void stats_print(char const * p_label, latency_stats_t const * p_stats)
+{
+    if (p_stats->count == 0)
+    {
+        return;
+    }
+
+    msg("%s peers: n=%u avg=%u us min=%u us max=%u us\r\n",
+        p_label,
+        p_stats->count,
+        p_stats->sum_us / p_stats->count,
+        p_stats->min_us,
+        p_stats->max_us);
+}
+
+
+/**@brief Function for printing the latency report of a connection. */
+static void latency_report_print(link_metrics_t const * p_link)
+{
+    msg("Connect-to-first-byte on 0x%04x (%s peer):\r\n",
+        p_link->conn_handle,
+        p_link->bonded_peer ? "bonded" : "new");
+
+    for (uint32_t i = 0; i < TRANSFER_METRICS_MILESTONE_COUNT; i++)
+    {
+        if (p_link->reached_mask & (1UL << i))
+        {
+            msg("  %s: %u us\r\n", m_milestone_names[i], p_link->milestone_us[i]);
+        }
+    }
+
+    stats_print("Bonded", &m_stats_bonded);
+    stats_print("New", &m_stats_new);
+}
+
+
+/**@brief Function for converting a byte count over an interval to kbit/s. */
+static uint32_t kbps(uint32_t bytes, uint32_t interval_us)
+{
+    if (interval_us == 0)
+    {
+        return 0;
+    }
+
+    return (uint32_t)(((uint64_t)bytes * 8 * 1000) / interval_us);
+}
+
+
+/**@brief Function for printing and resetting the throughput counters.
+ *
+ * @param[in] p_context Unused.
+ */
+static void report_timeout_handler(void * p_context)
+{
+    uint32_t interval_us = transfer_metrics_elapsed_us(m_report_ticks);
+    uint32_t total[TRANSFER_METRICS_TRANSPORT_COUNT] = {0};
+    uint32_t link_count  = 0;
+    uint32_t total_bytes = 0;
+    sdu_pool_stats_t pool;
+
+    UNUSED_PARAMETER(p_context);
+    event_trace_record(EVENT_TRACE_SOURCE_TIMER, EVENT_TRACE_TIMER_METRICS_REPORT, 0);
+
+    m_report_ticks = transfer_metrics_timestamp();
+
+    for (uint32_t i = 0; i < LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+        {
+            link_count++;
+        }
+        for (uint32_t t = 0; t < TRANSFER_METRICS_TRANSPORT_COUNT; t++)
+        {
+            total[t]    += m_links[i].bytes[t];
+            total_bytes += m_links[i].bytes[t];
+        }
+    }
+
+    if (total_bytes == 0)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < LINK_COUNT; i++)
+    {
+        for (uint32_t t = 0; t < TRANSFER_METRICS_TRANSPORT_COUNT; t++)
+        {
+            if (m_links[i].bytes[t] != 0)
+            {
+                msg("  0x%04x %s: %u kbps\r\n",
+                    m_links[i].conn_handle,
+                    m_transport_names[t],
+                    kbps(m_links[i].bytes[t], interval_us));
+                m_links[i].bytes[t] = 0;
+            }
+        }
+    }
+
+    for (uint32_t t = 0; t < TRANSFER_METRICS_TRANSPORT_COUNT; t++)
+    {
+        msg("Aggregate %s: %u kbps over %u links\r\n",
+            m_transport_names[t],
+            kbps(total[t], interval_us),
+            link_count);
+    }
+
+    sdu_pool_stats_get(&pool);
+    msg("SDU pool: %u/%u in use, high water %u, %u failed allocations\r\n",
+        pool.in_use,
+        SDU_POOL_COUNT,
+        pool.high_water,
+        pool.alloc_failures);
+}
+
+
+ret_code_t transfer_metrics_init(void)
+{
+    ret_code_t err_code;
+
+    for (uint32_t i = 0; i < LINK_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    err_code = app_timer_create(&m_report_timer, APP_TIMER_MODE_REPEATED, report_timeout_handler);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    m_report_ticks = transfer_metrics_timestamp();
+
+    return app_timer_start(m_report_timer, TRANSFER_METRICS_REPORT_INTERVAL, NULL);
+}
+
+
+void transfer_metrics_bytes(uint16_t conn_handle, transfer_metrics_transport_t transport, uint32_t len)
+{
+    link_metrics_t * p_link = link_find(conn_handle);
+
+    if (p_link != NULL)
+    {
+        p_link->bytes[transport] += len;
+    }
+}
+
+
+void transfer_metrics_milestone(uint16_t conn_handle, transfer_metrics_milestone_t milestone)
+{
+    link_metrics_t * p_link = link_find(conn_handle);
+
+    if ((p_link == NULL) || (p_link->reached_mask & (1UL << milestone)))
+    {
+        return;
+    }
+
+    uint32_t elapsed_us = transfer_metrics_elapsed_us(p_link->connected_ticks);
+
+    p_link->milestone_us[milestone] = elapsed_us;
+    p_link->reached_mask           |= (1UL << milestone);
+
+    if (milestone == TRANSFER_METRICS_MILESTONE_FIRST_SDU)
+    {
+        stats_add(p_link->bonded_peer ? &m_stats_bonded : &m_stats_new, elapsed_us);
+        latency_report_print(p_link);
+    }
+}
+
+
+void transfer_metrics_peer_bonded(uint16_t conn_handle)
+{
+    link_metrics_t * p_link = link_find(conn_handle);
+
+    if (p_link != NULL)
+    {
+        p_link->bonded_peer = true;
+    }
+}
+
+
+/**@brief Function for checking whether a link is served by the OTS server.
+ *
+ * @details The collector counts the CoC of central links itself.
+ */
+static bool link_is_server(uint16_t conn_handle)
+{
+    link_metrics_t const * p_link = link_find(conn_handle);
+
+    return (p_link != NULL) && (p_link->role == BLE_GAP_ROLE_PERIPH);
+}
+
+
+/**@brief Function for handling BLE events.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ * @param[in]   p_context   Unused.
+ */
+static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    link_metrics_t * p_link;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            p_link = NULL;
+            for (uint32_t i = 0; (p_link == NULL) && (i < LINK_COUNT); i++)
+            {
+                if (m_links[i].conn_handle == BLE_CONN_HANDLE_INVALID)
+                {
+                    p_link = &m_links[i];
+                }
+            }
+            if (p_link != NULL)
+            {
+                memset(p_link, 0, sizeof(*p_link));
+                p_link->conn_handle     = p_ble_evt->evt.gap_evt.conn_handle;
+                p_link->connected_ticks = transfer_metrics_timestamp();
+                p_link->role            = p_ble_evt->evt.gap_evt.params.connected.role;
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_link = link_find(p_ble_evt->evt.gap_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+            }
+            break;
+
+        case BLE_L2CAP_EVT_CH_RX:
+            if (!link_is_server(p_ble_evt->evt.l2cap_evt.conn_handle))
+            {
+                break;
+            }
+            transfer_metrics_milestone(p_ble_evt->evt.l2cap_evt.conn_handle,
+                                       TRANSFER_METRICS_MILESTONE_FIRST_SDU);
+            transfer_metrics_bytes(p_ble_evt->evt.l2cap_evt.conn_handle,
+                                   TRANSFER_METRICS_TRANSPORT_OTS,
+                                   p_ble_evt->evt.l2cap_evt.params.rx.sdu_buf.len);
+            break;
+
+        case BLE_L2CAP_EVT_CH_TX:
+            if (!link_is_server(p_ble_evt->evt.l2cap_evt.conn_handle))
+            {
+                break;
+            }
+            transfer_metrics_milestone(p_ble_evt->evt.l2cap_evt.conn_handle,
+                                       TRANSFER_METRICS_MILESTONE_FIRST_SDU);
+            transfer_metrics_bytes(p_ble_evt->evt.l2cap_evt.conn_handle,
+                                   TRANSFER_METRICS_TRANSPORT_OTS,
+                                   p_ble_evt->evt.l2cap_evt.params.tx.sdu_buf.len);
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_transfer_metrics_obs, TRANSFER_METRICS_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
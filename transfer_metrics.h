@@ -0,0 +1,116 @@
+/**@file
+ *
+ * @defgroup transfer_metrics Transfer metrics
+ * @{
+ * @brief Timestamps and latency statistics for the BLE file transfer.
+ *
+ * @details The module stamps the milestones of a connection (link up, link secured, system
+ *          attributes restored, first OACP procedure, first L2CAP SDU) and reports the
+ *          connect-to-first-byte latency over the debug channel when the first SDU goes
+ *          over the air. Latency is aggregated separately for bonded and new peers, so the
+ *          effect of a restored bond can be read straight from the report.
+ *
+ *          L2CAP SDU bytes are counted per link and per transport, and the per-link and
+ *          aggregate throughput is reported periodically together with the number of links.
+ */
+#ifndef TRANSFER_METRICS_H__
+#define TRANSFER_METRICS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_timer.h"
+#include "app_util.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRANSFER_METRICS_BLE_OBSERVER_PRIO  0                       /**< Priority of the BLE observer. Runs first so that the connection is stamped before any other handler. */
+#define TRANSFER_METRICS_REPORT_INTERVAL    APP_TIMER_TICKS(5000)   /**< Interval between throughput reports. */
+
+/**@brief Macro for converting app_timer ticks to microseconds. */
+#define TRANSFER_METRICS_TICKS_TO_US(ticks)                                                  \
+    ((uint32_t)ROUNDED_DIV((uint64_t)(ticks) * 1000000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1), \
+                           APP_TIMER_CLOCK_FREQ))
+
+
+/**@brief Connection milestones. */
+typedef enum
+{
+    TRANSFER_METRICS_MILESTONE_SECURED,         /**< Link encrypted (bond restored or new pairing finished). */
+    TRANSFER_METRICS_MILESTONE_SYS_ATTR,        /**< System attributes (CCCDs) applied. */
+    TRANSFER_METRICS_MILESTONE_FIRST_OACP,      /**< First OACP procedure from the client. */
+    TRANSFER_METRICS_MILESTONE_FIRST_SDU,       /**< First L2CAP SDU sent or received. */
+    TRANSFER_METRICS_MILESTONE_COUNT
+} transfer_metrics_milestone_t;
+
+
+/**@brief Transports whose throughput is counted. */
+typedef enum
+{
+    TRANSFER_METRICS_TRANSPORT_OTS,             /**< OTS over an L2CAP CoC. */
+    TRANSFER_METRICS_TRANSPORT_OTS_CLIENT,      /**< Objects pulled from sensor nodes, see @ref ots_collector. */
+    TRANSFER_METRICS_TRANSPORT_GATT,            /**< GATT bulk service, see @ref ble_bulk. */
+    TRANSFER_METRICS_TRANSPORT_COUNT
+} transfer_metrics_transport_t;
+
+
+/**@brief Function for initializing the module.
+ *
+ * @details Creates the throughput report timer.
+ *
+ * @return NRF_SUCCESS or an error code from app_timer.
+ */
+ret_code_t transfer_metrics_init(void);
+
+
+/**@brief Function for adding transferred bytes to the throughput counters.
+ *
+ * @param[in] conn_handle Connection the bytes were sent or received on.
+ * @param[in] transport   Transport that carried them.
+ * @param[in] len         Number of payload bytes.
+ */
+void transfer_metrics_bytes(uint16_t conn_handle, transfer_metrics_transport_t transport, uint32_t len);
+
+
+/**@brief Function for getting the current timestamp.
+ *
+ * @return Timestamp in app_timer ticks.
+ */
+uint32_t transfer_metrics_timestamp(void);
+
+
+/**@brief Function for getting the time elapsed since a timestamp.
+ *
+ * @param[in] since Timestamp returned by @ref transfer_metrics_timestamp.
+ *
+ * @return Elapsed time in microseconds.
+ */
+uint32_t transfer_metrics_elapsed_us(uint32_t since);
+
+
+/**@brief Function for recording a connection milestone.
+ *
+ * @details Only the first occurrence of each milestone on a connection is recorded.
+ *
+ * @param[in] conn_handle Connection the milestone applies to.
+ * @param[in] milestone   Milestone reached.
+ */
+void transfer_metrics_milestone(uint16_t conn_handle, transfer_metrics_milestone_t milestone);
+
+
+/**@brief Function for marking the peer of a connection as bonded.
+ *
+ * @param[in] conn_handle Connection handle.
+ */
+void transfer_metrics_peer_bonded(uint16_t conn_handle);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRANSFER_METRICS_H__
+
+/** @} */
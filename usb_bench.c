@@ -0,0 +1,189 @@
+#include <stdbool.h>
+#include <string.h>
+#include "usb_bench.h"
+#include "app_util.h"
+#include "transfer_metrics.h"
+#include "host_link.h"
+#include "usb_stream.h"
+
+
+#define REPORT_LEN      24      /**< Length of a report payload. */
+#define LINK_REC_LEN    25      /**< Length of a link record in a links payload. */
+
+/**@brief Counters of one direction. */
+typedef struct
+{
+    uint32_t bytes;
+    uint32_t frames;
+    uint32_t started;                   /**< Timestamp of the first frame. */
+    uint32_t elapsed_us;                /**< First to last frame. */
+} bench_dir_t;
+
+static bench_dir_t m_rx;
+static bench_dir_t m_tx;
+static uint32_t    m_tx_left;           /**< Bytes still to queue. */
+static bool        m_echo;              /**< Send data frames from the host back. */
+
+
+static void report_send(void)
+{
+    uint8_t report[REPORT_LEN];
+
+    (void)uint32_encode(m_rx.bytes,      &report[0]);
+    (void)uint32_encode(m_rx.frames,     &report[4]);
+    (void)uint32_encode(m_rx.elapsed_us, &report[8]);
+    (void)uint32_encode(m_tx.bytes,      &report[12]);
+    (void)uint32_encode(m_tx.frames,     &report[16]);
+    (void)uint32_encode(m_tx.elapsed_us, &report[20]);
+
+    (void)usb_stream_frame_put(USB_BENCH_FRAME_REPORT, report, sizeof(report), NULL, 0);
+}
+
+
+static void links_send(void)
+{
+    uint8_t  links[HOST_LINK_ID_COUNT * LINK_REC_LEN];
+    uint16_t len = 0;
+
+    for (uint32_t id = 0; id < HOST_LINK_ID_COUNT; id++)
+    {
+        host_link_t const * p_link = host_link_get((host_link_id_t)id);
+        host_link_stats_t   stats;
+
+        if (p_link == NULL)
+        {
+            continue;
+        }
+        host_link_stats_get(p_link, &stats);
+
+        links[len] = (uint8_t)id;
+        (void)uint32_encode(stats.rx_bytes,  &links[len + 1]);
+        (void)uint32_encode(stats.tx_bytes,  &links[len + 5]);
+        (void)uint32_encode(stats.tx_writes, &links[len + 9]);
+        (void)uint32_encode(stats.tx_us,     &links[len + 13]);
+        (void)uint32_encode(stats.tx_held,   &links[len + 17]);
+        (void)uint32_encode(stats.tx_failed, &links[len + 21]);
+        len += LINK_REC_LEN;
+    }
+
+    (void)usb_stream_frame_put(USB_BENCH_FRAME_LINKS, links, len, NULL, 0);
+}
+
+
+static void on_control(uint8_t const * p_data, uint16_t len)
+{
+    if (len < 1)
+    {
+        return;
+    }
+
+    switch (p_data[0])
+    {
+        case USB_BENCH_OP_SEND:
+            if (len >= 5)
+            {
+                memset(&m_tx, 0, sizeof(m_tx));
+                m_tx.started = transfer_metrics_timestamp();
+                m_tx_left    = uint32_decode(&p_data[1]);
+            }
+            break;
+
+        case USB_BENCH_OP_REPORT:
+            report_send();
+            break;
+
+        case USB_BENCH_OP_RESET:
+            memset(&m_rx, 0, sizeof(m_rx));
+            memset(&m_tx, 0, sizeof(m_tx));
+            m_tx_left = 0;
+            m_echo    = false;
+            break;
+
+        case USB_BENCH_OP_ECHO:
+            if (len >= 2)
+            {
+                m_echo = (p_data[1] != 0);
+            }
+            break;
+
+        case USB_BENCH_OP_LINKS:
+            links_send();
+            break;
+
+        default:
+            // Unknown operation; ignored.
+            break;
+    }
+}
+
+
+void usb_bench_on_frame(uint8_t type, sdu_buf_t * p_buf)
+{
+    if (type == USB_BENCH_FRAME_CONTROL)
+    {
+        on_control(sdu_buf_payload(p_buf), p_buf->len);
+        return;
+    }
+
+    if (m_rx.frames == 0)
+    {
+        m_rx.started = transfer_metrics_timestamp();
+    }
+    m_rx.bytes     += p_buf->len;
+    m_rx.frames    += 1;
+    m_rx.elapsed_us = transfer_metrics_elapsed_us(m_rx.started);
+
+    if (m_echo)
+    {
+        uint16_t len = p_buf->len;
+
+        if (m_tx.frames == 0)
+        {
+            m_tx.started = m_rx.started;
+        }
+
+        // Sent from the receive buffer itself; the header goes into its headroom.
+        if (usb_stream_buf_put(USB_BENCH_FRAME_DATA, p_buf) == NRF_SUCCESS)
+        {
+            m_tx.bytes     += len;
+            m_tx.frames    += 1;
+            m_tx.elapsed_us = transfer_metrics_elapsed_us(m_tx.started);
+        }
+    }
+}
+
+
+void usb_bench_process(void)
+{
+    while (m_tx_left > 0)
+    {
+        sdu_buf_t * p_buf = sdu_pool_alloc();
+        uint16_t    len   = (uint16_t)MIN(m_tx_left, SDU_POOL_DATA_SIZE);
+        uint8_t   * p_data;
+        ret_code_t  err_code;
+
+        if (p_buf == NULL)
+        {
+            return;
+        }
+
+        p_data = sdu_buf_payload(p_buf);
+        for (uint16_t i = 0; i < len; i++)
+        {
+            p_data[i] = (uint8_t)(m_tx.bytes + i);
+        }
+        p_buf->len = len;
+
+        err_code = usb_stream_buf_put(USB_BENCH_FRAME_DATA, p_buf);
+        sdu_pool_release(p_buf);
+        if (err_code != NRF_SUCCESS)
+        {
+            return;
+        }
+
+        m_tx.bytes     += len;
+        m_tx.frames    += 1;
+        m_tx_left      -= len;
+        m_tx.elapsed_us = transfer_metrics_elapsed_us(m_tx.started);
+    }
+}
@@ -0,0 +1,101 @@
+/**@file
+ *
+ * @defgroup usb_bench USB throughput test
+ * @{
+ * @brief Frame source and sink for measuring the USB stream in both directions.
+ *
+ * @details The host drives the test with @ref USB_BENCH_FRAME_CONTROL frames. The first payload
+ *          byte is the operation (@ref usb_bench_op_t):
+ *
+ *          | Operation              | Arguments                  | Dongle does                            |
+ *          |------------------------|----------------------------|----------------------------------------|
+ *          | @ref USB_BENCH_OP_SEND   | Bytes to send, 4 bytes LE  | Sends @ref USB_BENCH_FRAME_DATA frames |
+ *          | @ref USB_BENCH_OP_REPORT | None                       | Sends a @ref USB_BENCH_FRAME_REPORT    |
+ *          | @ref USB_BENCH_OP_RESET  | None                       | Clears the counters, stops echoing     |
+ *          | @ref USB_BENCH_OP_ECHO   | 1 byte: 1 on, 0 off        | Sends data frames from the host back   |
+ *          | @ref USB_BENCH_OP_LINKS  | None                       | Sends a @ref USB_BENCH_FRAME_LINKS     |
+ *
+ *          Data frames are as long as a pool buffer allows. Byte n of the stream is n modulo 256,
+ *          counted over all data frames since the send began, so the host can check it. Data
+ *          frames from the host are counted, then dropped or, while echoing, sent back unchanged
+ *          and counted as sent. An echoed frame that finds the stream's queue full is dropped, so
+ *          the host should keep no more than a few frames in flight.
+ *
+ *          Report payload, all fields 4 bytes LE:
+ *
+ *          | Offset | Field                                                   |
+ *          |--------|---------------------------------------------------------|
+ *          | 0      | Payload bytes received                                  |
+ *          | 4      | Data frames received                                    |
+ *          | 8      | First to last data frame received, in us                |
+ *          | 12     | Payload bytes queued                                    |
+ *          | 16     | Data frames queued                                      |
+ *          | 20     | Send request to last data frame queued, in us           |
+ *
+ *          The links payload has one 25-byte record per open @ref host_link, with the link's
+ *          statistics since it was opened, all fields 4 bytes LE after the first:
+ *
+ *          | Offset | Field                                                   |
+ *          |--------|---------------------------------------------------------|
+ *          | 0      | Kind of link, @ref host_link_id_t, 1 byte               |
+ *          | 1      | Bytes received                                          |
+ *          | 5      | Bytes written                                           |
+ *          | 9      | Writes                                                  |
+ *          | 13     | Time writes were in progress, in us                     |
+ *          | 17     | Writes held off by flow control                         |
+ *          | 21     | Writes refused                                          |
+ *
+ *          Frames go to the vendor interface when the host has it open and to the current
+ *          @ref host_link otherwise, as every frame of @ref usb_stream does. tools/usb_bench.py
+ *          runs the test over any of them and compares them.
+ */
+#ifndef USB_BENCH_H__
+#define USB_BENCH_H__
+
+#include <stdint.h>
+#include "sdu_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define USB_BENCH_FRAME_CONTROL     0x70        /**< Host to dongle: operation. */
+#define USB_BENCH_FRAME_DATA        0x71        /**< Both ways: test data. */
+#define USB_BENCH_FRAME_REPORT      0x72        /**< Dongle to host: counters. */
+#define USB_BENCH_FRAME_LINKS       0x73        /**< Dongle to host: host link statistics. */
+
+
+/**@brief Operations of a @ref USB_BENCH_FRAME_CONTROL frame. */
+typedef enum
+{
+    USB_BENCH_OP_SEND   = 1,                    /**< Send data frames. */
+    USB_BENCH_OP_REPORT = 2,                    /**< Send the counters. */
+    USB_BENCH_OP_RESET  = 3,                    /**< Clear the counters and stop sending and echoing. */
+    USB_BENCH_OP_ECHO   = 4,                    /**< Start or stop sending data frames back. */
+    USB_BENCH_OP_LINKS  = 5,                    /**< Send the statistics of every host link. */
+} usb_bench_op_t;
+
+
+/**@brief Function for handling a frame of type @ref USB_BENCH_FRAME_CONTROL or
+ *        @ref USB_BENCH_FRAME_DATA from the host.
+ *
+ * @param[in] type   Frame type.
+ * @param[in] p_buf  Buffer holding the payload.
+ */
+void usb_bench_on_frame(uint8_t type, sdu_buf_t * p_buf);
+
+
+/**@brief Function for queueing data frames while a send is in progress.
+ *
+ * @details Call from the main loop. Fills the USB stream until it or the pool is full.
+ */
+void usb_bench_process(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_BENCH_H__
+
+/** @} */
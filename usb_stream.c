@@ -0,0 +1,490 @@
+#include <string.h>
+#include "usb_stream.h"
+#include "app_util_platform.h"
+#include "event_trace.h"
+
+
+/**@brief Buffers waiting for one link. */
+typedef struct
+{
+    sdu_buf_t * queue[USB_STREAM_QUEUE_DEPTH];
+    uint8_t     head;                               /**< Index of the oldest buffer; the one being written while busy. */
+    uint8_t     count;
+    bool        busy;                               /**< A host link write is in progress. Not used by the vendor queue. */
+    bool        pumping;                            /**< A context is copying into the vendor interface. Vendor queue only. */
+    bool        pump_again;                         /**< The vendor queue changed while it did. */
+} stream_tx_t;
+
+/**@brief Frame parser of one link. */
+typedef struct
+{
+    uint8_t     header[USB_STREAM_HEADER_LEN];
+    uint8_t     header_len;                         /**< Header bytes received of the frame coming in. */
+    uint16_t    remaining;                          /**< Payload bytes still to come. */
+    sdu_buf_t * p_buf;                              /**< Buffer of the frame coming in, NULL if it is skipped. */
+    host_link_t const * p_link;                     /**< Link the parser reads, NULL for the vendor interface. */
+} stream_rx_t;
+
+static host_link_t const        * mp_link;          /**< Link of the text and frame queue. */
+static host_link_t const        * mp_tx_link;       /**< Link of the write in progress. */
+static usb_vendor_t const       * mp_vendor;        /**< Open vendor interface, or NULL. */
+static stream_tx_t                m_link_tx;        /**< Text, and frames while the vendor interface is closed. */
+static stream_tx_t                m_vendor_tx;
+static stream_rx_t                m_link_rx[HOST_LINK_ID_COUNT];
+static stream_rx_t                m_vendor_rx;
+static usb_stream_rx_handler_t    m_rx_handler;
+
+static void tx_done(void);
+static void rx_parse(stream_rx_t * p_rx, uint8_t const * p_data, size_t len);
+
+
+/**@brief Function for starting the next write if none is in progress. */
+static void tx_kick(void)
+{
+    sdu_buf_t * p_buf = NULL;
+    ret_code_t  err_code;
+
+    CRITICAL_REGION_ENTER();
+    if (!m_link_tx.busy && (m_link_tx.count > 0))
+    {
+        p_buf          = m_link_tx.queue[m_link_tx.head];
+        m_link_tx.busy = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (p_buf == NULL)
+    {
+        return;
+    }
+
+    mp_tx_link = mp_link;
+    err_code   = host_link_write(mp_tx_link, &p_buf->data[p_buf->offset], p_buf->len);
+
+    if (err_code == NRF_ERROR_BUSY)
+    {
+        // Held off by flow control; tried again on HOST_LINK_EVT_READY.
+        CRITICAL_REGION_ENTER();
+        m_link_tx.busy = false;
+        CRITICAL_REGION_EXIT();
+    }
+    else if (err_code != NRF_SUCCESS)
+    {
+        // Link closed; the buffer is dropped.
+        event_trace_record(EVENT_TRACE_SOURCE_STREAM, EVENT_TRACE_STREAM_WRITE_FAILED, p_buf->len);
+        tx_done();
+    }
+}
+
+
+/**@brief Function for taking the vendor queue, or asking its holder to run once more.
+ *
+ * @return true if the caller now copies the queue.
+ */
+static bool vendor_take(void)
+{
+    bool taken;
+
+    CRITICAL_REGION_ENTER();
+    taken = !m_vendor_tx.pumping;
+    if (taken)
+    {
+        m_vendor_tx.pumping = true;
+    }
+    else
+    {
+        m_vendor_tx.pump_again = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return taken;
+}
+
+
+/**@brief Function for copying queued frames into the vendor interface while it has room.
+ *
+ * @details Called from the BLE event handler, through @ref usb_stream_buf_put, and from the main
+ *          loop. Only the queue indexes are read and updated in a critical region; the frame is
+ *          copied outside it, so a full queue does not hold interrupts off for 16 copies. One
+ *          context copies at a time, so the oldest frame cannot be copied twice. A call that
+ *          finds the queue taken makes the holder run again before it lets go.
+ */
+static void vendor_kick(void)
+{
+    bool done = false;
+
+    if (!vendor_take())
+    {
+        return;
+    }
+
+    while (!done)
+    {
+        usb_vendor_t const * p_vendor;
+        sdu_buf_t          * p_buf;
+
+        CRITICAL_REGION_ENTER();
+        m_vendor_tx.pump_again = false;
+        p_vendor               = mp_vendor;
+        p_buf                  = ((p_vendor != NULL) && (m_vendor_tx.count > 0)) ?
+                                 m_vendor_tx.queue[m_vendor_tx.head] : NULL;
+        CRITICAL_REGION_EXIT();
+
+        // Producers only write behind the oldest frame, so it stays as it is until popped.
+        while (p_buf != NULL)
+        {
+            sdu_buf_t * p_next;
+
+            if (usb_vendor_write(p_vendor, &p_buf->data[p_buf->offset], p_buf->len) != NRF_SUCCESS)
+            {
+                // No room; resumed by usb_stream_on_vendor_tx_done. Or closed, and dropped there.
+                break;
+            }
+
+            CRITICAL_REGION_ENTER();
+            m_vendor_tx.head  = (m_vendor_tx.head + 1) % USB_STREAM_QUEUE_DEPTH;
+            m_vendor_tx.count--;
+            p_vendor          = mp_vendor;
+            p_next            = ((p_vendor != NULL) && (m_vendor_tx.count > 0)) ?
+                                m_vendor_tx.queue[m_vendor_tx.head] : NULL;
+            CRITICAL_REGION_EXIT();
+
+            sdu_pool_release(p_buf);
+            p_buf = p_next;
+        }
+
+        // A frame queued, or a copy that made room, while this one was copied is seen here.
+        CRITICAL_REGION_ENTER();
+        done = !m_vendor_tx.pump_again;
+        if (done)
+        {
+            m_vendor_tx.pumping = false;
+        }
+        CRITICAL_REGION_EXIT();
+    }
+}
+
+
+/**@brief Function for adding a buffer to a queue, taking a reference. */
+static ret_code_t queue_put(stream_tx_t * p_tx, sdu_buf_t * p_buf)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    CRITICAL_REGION_ENTER();
+    if (p_tx->count == USB_STREAM_QUEUE_DEPTH)
+    {
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        sdu_pool_retain(p_buf);
+        p_tx->queue[(p_tx->head + p_tx->count) % USB_STREAM_QUEUE_DEPTH] = p_buf;
+        p_tx->count++;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code != NRF_SUCCESS)
+    {
+        event_trace_record(EVENT_TRACE_SOURCE_STREAM, EVENT_TRACE_STREAM_QUEUE_FULL, p_buf->len);
+    }
+
+    return err_code;
+}
+
+
+/**@brief Function for handling the events of every host link. */
+static void link_evt_handler(host_link_evt_t const * p_evt)
+{
+    switch (p_evt->type)
+    {
+        case HOST_LINK_EVT_RX:
+            m_link_rx[p_evt->p_link->id].p_link = p_evt->p_link;
+            rx_parse(&m_link_rx[p_evt->p_link->id], p_evt->p_data, p_evt->len);
+            tx_kick();
+            break;
+
+        case HOST_LINK_EVT_TX_DONE:
+            if (m_link_tx.busy && (p_evt->p_link == mp_tx_link))
+            {
+                tx_done();
+            }
+            break;
+
+        case HOST_LINK_EVT_READY:
+            tx_kick();
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+ret_code_t usb_stream_init(host_link_t const * p_link)
+{
+    mp_link    = p_link;
+    mp_tx_link = NULL;
+    mp_vendor  = NULL;
+
+    memset(&m_link_tx, 0, sizeof(m_link_tx));
+    memset(&m_vendor_tx, 0, sizeof(m_vendor_tx));
+    memset(m_link_rx, 0, sizeof(m_link_rx));
+    memset(&m_vendor_rx, 0, sizeof(m_vendor_rx));
+
+    return host_link_init(link_evt_handler);
+}
+
+
+ret_code_t usb_stream_raw_put(sdu_buf_t * p_buf)
+{
+    ret_code_t err_code = queue_put(&m_link_tx, p_buf);
+
+    if (err_code == NRF_SUCCESS)
+    {
+        tx_kick();
+    }
+
+    return err_code;
+}
+
+
+ret_code_t usb_stream_buf_put(uint8_t type, sdu_buf_t * p_buf)
+{
+    uint16_t   payload_len = p_buf->len;
+    uint8_t  * p_header    = sdu_buf_push(p_buf, USB_STREAM_HEADER_LEN);
+    ret_code_t err_code;
+
+    if (p_header == NULL)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    p_header[0] = USB_STREAM_SYNC;
+    p_header[1] = type;
+    (void)uint16_encode(payload_len, &p_header[2]);
+
+    if (mp_vendor == NULL)
+    {
+        err_code = usb_stream_raw_put(p_buf);
+    }
+    else
+    {
+        err_code = queue_put(&m_vendor_tx, p_buf);
+        if (err_code == NRF_SUCCESS)
+        {
+            vendor_kick();
+        }
+    }
+
+    if (err_code != NRF_SUCCESS)
+    {
+        // Leave the buffer as it came, so a retry does not send the header twice.
+        (void)sdu_buf_pull(p_buf, USB_STREAM_HEADER_LEN);
+    }
+
+    return err_code;
+}
+
+
+ret_code_t usb_stream_frame_put(uint8_t         type,
+                                uint8_t const * p_head,
+                                size_t          head_len,
+                                uint8_t const * p_data,
+                                size_t          data_len)
+{
+    sdu_buf_t * p_buf;
+    ret_code_t  err_code;
+
+    if (head_len + data_len > SDU_POOL_DATA_SIZE)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    p_buf = sdu_pool_alloc();
+    if (p_buf == NULL)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    memcpy(sdu_buf_payload(p_buf), p_head, head_len);
+    memcpy(sdu_buf_payload(p_buf) + head_len, p_data, data_len);
+    p_buf->len = (uint16_t)(head_len + data_len);
+
+    err_code = usb_stream_buf_put(type, p_buf);
+    sdu_pool_release(p_buf);
+
+    return err_code;
+}
+
+
+/**@brief Function for ending the write in progress and starting the next one. */
+static void tx_done(void)
+{
+    sdu_buf_t * p_buf = NULL;
+
+    CRITICAL_REGION_ENTER();
+    if (m_link_tx.busy)
+    {
+        p_buf          = m_link_tx.queue[m_link_tx.head];
+        m_link_tx.head = (m_link_tx.head + 1) % USB_STREAM_QUEUE_DEPTH;
+        m_link_tx.count--;
+        m_link_tx.busy = false;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (p_buf != NULL)
+    {
+        sdu_pool_release(p_buf);
+    }
+
+    tx_kick();
+}
+
+
+void usb_stream_rx_handler_set(usb_stream_rx_handler_t handler)
+{
+    m_rx_handler = handler;
+}
+
+
+/**@brief Function for ending the frame coming in, handing it over if it was kept.
+ *
+ * @details The stream follows the link the host last sent a whole frame on. Noise on a floating
+ *          input never completes one, so it cannot take the stream away.
+ */
+static void rx_frame_end(stream_rx_t * p_rx)
+{
+    if (p_rx->p_link != NULL)
+    {
+        mp_link = p_rx->p_link;
+    }
+
+    if (p_rx->p_buf != NULL)
+    {
+        if (m_rx_handler != NULL)
+        {
+            m_rx_handler(p_rx->header[1], p_rx->p_buf);
+        }
+        sdu_pool_release(p_rx->p_buf);
+        p_rx->p_buf = NULL;
+    }
+    p_rx->header_len = 0;
+}
+
+
+static void rx_parse(stream_rx_t * p_rx, uint8_t const * p_data, size_t len)
+{
+    while (len > 0)
+    {
+        if (p_rx->header_len < USB_STREAM_HEADER_LEN)
+        {
+            uint8_t byte = *p_data++;
+            len--;
+
+            if ((p_rx->header_len == 0) && (byte != USB_STREAM_SYNC))
+            {
+                continue;
+            }
+            p_rx->header[p_rx->header_len++] = byte;
+
+            if (p_rx->header_len == USB_STREAM_HEADER_LEN)
+            {
+                p_rx->remaining = uint16_decode(&p_rx->header[2]);
+                if (p_rx->remaining > SDU_POOL_DATA_SIZE)
+                {
+                    // Not a frame we can hold; look for the next one.
+                    p_rx->header_len = 0;
+                    continue;
+                }
+                p_rx->p_buf = sdu_pool_alloc();
+                if (p_rx->remaining == 0)
+                {
+                    rx_frame_end(p_rx);
+                }
+            }
+            continue;
+        }
+
+        uint16_t chunk = (uint16_t)MIN(len, p_rx->remaining);
+
+        if (p_rx->p_buf != NULL)
+        {
+            memcpy(sdu_buf_payload(p_rx->p_buf) + p_rx->p_buf->len, p_data, chunk);
+            p_rx->p_buf->len += chunk;
+        }
+        p_data          += chunk;
+        len             -= chunk;
+        p_rx->remaining -= chunk;
+
+        if (p_rx->remaining == 0)
+        {
+            rx_frame_end(p_rx);
+        }
+    }
+}
+
+
+void usb_stream_vendor_set(usb_vendor_t const * p_vendor)
+{
+    sdu_buf_t * p_buf = NULL;
+
+    CRITICAL_REGION_ENTER();
+    mp_vendor = p_vendor;
+    CRITICAL_REGION_EXIT();
+
+    if (p_vendor != NULL)
+    {
+        return;
+    }
+
+    // Frames that did not make it out before the close are dropped.
+    do
+    {
+        p_buf = NULL;
+
+        CRITICAL_REGION_ENTER();
+        if (m_vendor_tx.count > 0)
+        {
+            p_buf             = m_vendor_tx.queue[m_vendor_tx.head];
+            m_vendor_tx.head  = (m_vendor_tx.head + 1) % USB_STREAM_QUEUE_DEPTH;
+            m_vendor_tx.count--;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (p_buf != NULL)
+        {
+            sdu_pool_release(p_buf);
+        }
+    } while (p_buf != NULL);
+
+    if (m_vendor_rx.p_buf != NULL)
+    {
+        sdu_pool_release(m_vendor_rx.p_buf);
+    }
+    memset(&m_vendor_rx, 0, sizeof(m_vendor_rx));
+}
+
+
+void usb_stream_on_vendor_rx(uint8_t const * p_data, size_t len)
+{
+    rx_parse(&m_vendor_rx, p_data, len);
+}
+
+
+void usb_stream_on_vendor_tx_done(void)
+{
+    vendor_kick();
+}
+
+
+void usb_stream_link_set(host_link_t const * p_link)
+{
+    // A write in progress still ends on the link it started on.
+    mp_link = p_link;
+    tx_kick();
+}
+
+
+host_link_t const * usb_stream_link_get(void)
+{
+    return mp_link;
+}
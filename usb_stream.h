@@ -0,0 +1,176 @@
+/**@file
+ *
+ * @defgroup usb_stream USB binary stream
+ * @{
+ * @brief Everything written to the host, over a @ref host_link or the USB vendor interface.
+ *
+ * @details Data waits as @ref sdu_pool buffers in a queue and is written to the current
+ *          @ref host_link one buffer at a time, straight from the buffer. The next buffer goes out
+ *          on @ref HOST_LINK_EVT_TX_DONE, which also drops the stream's reference to the buffer
+ *          just sent. A write the link holds off stays at the head of the queue until
+ *          @ref HOST_LINK_EVT_READY; a write the link refuses because it is closed is dropped.
+ *          Debug text and binary frames share the queue, so they never overwrite each other.
+ *
+ *          The stream follows the link the host last sent a complete frame on, and can be moved
+ *          at any time with @ref usb_stream_link_set; a write in progress ends on the old link.
+ *          Bytes that do not make up a frame leave the stream where it is.
+ *
+ *          Binary frames have a header the host can resynchronize on:
+ *
+ *          | Offset | Size | Field                       |
+ *          |--------|------|-----------------------------|
+ *          | 0      | 1    | @ref USB_STREAM_SYNC        |
+ *          | 1      | 1    | Frame type                  |
+ *          | 2      | 2    | Payload length (LE)         |
+ *          | 4      | n    | Payload                     |
+ *
+ *          The host sends frames to the dongle in the same format. Bytes outside a frame are
+ *          skipped until the next @ref USB_STREAM_SYNC. Each complete frame is handed to the
+ *          RX handler in a pool buffer.
+ *
+ *          While the host has the @ref usb_vendor interface open, frames go there instead, through
+ *          a queue of their own, and debug text stays on the host link. Frames are copied into the
+ *          vendor interface's transfer buffers as long as they have room, so several frames leave
+ *          in one bulk transfer. Frames from the host are taken from every link and the vendor interface,
+ *          each with its own parser. Frames longer than @ref SDU_POOL_DATA_SIZE, and frames that
+ *          find the pool empty, are skipped.
+ */
+#ifndef USB_STREAM_H__
+#define USB_STREAM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "host_link.h"
+#include "sdu_pool.h"
+#include "usb_vendor.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define USB_STREAM_SYNC             0xA5        /**< First byte of every frame. Never used in debug text. */
+#define USB_STREAM_HEADER_LEN       4           /**< Length of the frame header. */
+#define USB_STREAM_QUEUE_DEPTH      16          /**< Buffers waiting for the host at most. */
+
+
+/**@brief Handler of frames from the host.
+ *
+ * @param[in] type   Frame type.
+ * @param[in] p_buf  Buffer holding the payload. The handler must retain it to keep it.
+ */
+typedef void (*usb_stream_rx_handler_t)(uint8_t type, sdu_buf_t * p_buf);
+
+
+/**@brief Function for initializing the stream and @ref host_link.
+ *
+ * @details Links are opened with @ref host_link_open afterwards.
+ *
+ * @param[in] p_link  Link to write to until the host uses another one.
+ *
+ * @return NRF_SUCCESS.
+ */
+ret_code_t usb_stream_init(host_link_t const * p_link);
+
+
+/**@brief Function for queueing a buffer as it is, without a frame header.
+ *
+ * @details The stream takes its own reference; the caller keeps its reference.
+ *
+ * @retval NRF_SUCCESS        The buffer was queued.
+ * @retval NRF_ERROR_NO_MEM   Queue full.
+ */
+ret_code_t usb_stream_raw_put(sdu_buf_t * p_buf);
+
+
+/**@brief Function for queueing a buffer as a frame.
+ *
+ * @details The frame header is written into the headroom of the buffer, in front of the data.
+ *          The stream takes its own reference; the caller keeps its reference. The frame goes
+ *          to the vendor interface if it is open, otherwise to the host link. If it is not
+ *          queued, the header is taken off again and the buffer can be put again as it is.
+ *
+ * @param[in] type   Frame type.
+ * @param[in] p_buf  Buffer holding the payload.
+ *
+ * @retval NRF_SUCCESS        The frame was queued.
+ * @retval NRF_ERROR_NO_MEM   Queue full or headroom used up.
+ */
+ret_code_t usb_stream_buf_put(uint8_t type, sdu_buf_t * p_buf);
+
+
+/**@brief Function for queueing a frame from memory that is not in a pool buffer.
+ *
+ * @details The payload is copied into a new buffer. It is given in two parts, so a caller can
+ *          put a header in front of the data. Either part can be empty.
+ *
+ * @param[in] type      Frame type.
+ * @param[in] p_head    First part of the payload.
+ * @param[in] head_len  Length of the first part.
+ * @param[in] p_data    Second part of the payload.
+ * @param[in] data_len  Length of the second part.
+ *
+ * @retval NRF_SUCCESS               The frame was queued.
+ * @retval NRF_ERROR_NO_MEM          Pool empty or queue full; nothing was queued.
+ * @retval NRF_ERROR_INVALID_LENGTH  Payload larger than a buffer.
+ */
+ret_code_t usb_stream_frame_put(uint8_t         type,
+                                uint8_t const * p_head,
+                                size_t          head_len,
+                                uint8_t const * p_data,
+                                size_t          data_len);
+
+
+/**@brief Function for setting the handler of frames from the host.
+ *
+ * @param[in] handler  Handler, or NULL to drop frames.
+ */
+void usb_stream_rx_handler_set(usb_stream_rx_handler_t handler);
+
+
+/**@brief Function for switching frames to the vendor interface or back to the host link.
+ *
+ * @details Must be called with the instance on @ref USB_VENDOR_EVT_OPEN and with NULL on
+ *          @ref USB_VENDOR_EVT_CLOSE. Frames still queued for the vendor interface when it
+ *          closes are dropped.
+ *
+ * @param[in] p_vendor  Open vendor interface, or NULL.
+ */
+void usb_stream_vendor_set(usb_vendor_t const * p_vendor);
+
+
+/**@brief Function for handling data read from the vendor interface.
+ *
+ * @details Must be called with the data of every @ref USB_VENDOR_EVT_RX.
+ *
+ * @param[in] p_data  Data read.
+ * @param[in] len     Length of the data.
+ */
+void usb_stream_on_vendor_rx(uint8_t const * p_data, size_t len);
+
+
+/**@brief Function for handling the end of a vendor interface transfer.
+ *
+ * @details Must be called on @ref USB_VENDOR_EVT_TX_DONE.
+ */
+void usb_stream_on_vendor_tx_done(void);
+
+
+/**@brief Function for choosing the link of text, and of frames while the vendor interface is closed.
+ *
+ * @param[in] p_link  Open link.
+ */
+void usb_stream_link_set(host_link_t const * p_link);
+
+
+/**@brief Function for getting the link the stream writes to. */
+host_link_t const * usb_stream_link_get(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_STREAM_H__
+
+/** @} */
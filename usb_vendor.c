@@ -0,0 +1,322 @@
+#include <string.h>
+#include "usb_vendor.h"
+#include "sdk_common.h"
+#include "app_util_platform.h"
+#include "app_usbd_core.h"
+
+
+#define IFACE_IDX       0               /**< The class has a single interface. */
+#define EPIN_IDX        0               /**< Index of the IN endpoint in the interface configuration. */
+#define EPOUT_IDX       1               /**< Index of the OUT endpoint in the interface configuration. */
+
+#define DESC_IFACE_LEN  9
+#define DESC_EP_LEN     7
+
+
+static usb_vendor_t const * vendor_get(app_usbd_class_inst_t const * p_inst)
+{
+    return (usb_vendor_t const *)p_inst;
+}
+
+
+static usb_vendor_ctx_t * ctx_get(usb_vendor_t const * p_vendor)
+{
+    return &p_vendor->specific.p_data->ctx;
+}
+
+
+static nrf_drv_usbd_ep_t ep_get(app_usbd_class_inst_t const * p_inst, uint8_t ep_idx)
+{
+    app_usbd_class_iface_conf_t const * p_iface = app_usbd_class_iface_get(p_inst, IFACE_IDX);
+
+    return app_usbd_class_ep_address_get(app_usbd_class_iface_ep_get(p_iface, ep_idx));
+}
+
+
+static void evt_send(usb_vendor_t const * p_vendor, usb_vendor_evt_type_t type, uint8_t const * p_data, size_t len)
+{
+    usb_vendor_evt_t evt =
+    {
+        .type   = type,
+        .p_data = p_data,
+        .len    = len,
+    };
+
+    p_vendor->specific.inst.evt_handler(&evt);
+}
+
+
+/**@brief Function for sending the buffer being filled and switching to the other one.
+ *
+ * @details Called in a critical region, with no IN transfer running.
+ */
+static void tx_start(usb_vendor_t const * p_vendor)
+{
+    usb_vendor_ctx_t * p_ctx = ctx_get(p_vendor);
+    uint8_t            send  = p_ctx->tx_fill;
+
+    NRF_DRV_USBD_TRANSFER_IN(transfer, p_ctx->tx_buf[send], p_ctx->tx_len[send], NRF_DRV_USBD_TRANSFER_ZLP_FLAG);
+
+    if (app_usbd_ep_transfer(ep_get(&p_vendor->base, EPIN_IDX), &transfer) == NRF_SUCCESS)
+    {
+        p_ctx->tx_fill ^= 1;
+        p_ctx->tx_busy  = true;
+    }
+    else
+    {
+        // Endpoint not ready; the data is dropped rather than left to block every later write.
+        p_ctx->tx_len[send] = 0;
+    }
+}
+
+
+/**@brief Function for reading into the next OUT buffer. */
+static ret_code_t rx_start(usb_vendor_t const * p_vendor)
+{
+    usb_vendor_ctx_t * p_ctx = ctx_get(p_vendor);
+
+    NRF_DRV_USBD_TRANSFER_OUT(transfer, p_ctx->rx_buf[p_ctx->rx_next], USB_VENDOR_RX_BUF_SIZE);
+
+    return app_usbd_ep_transfer(ep_get(&p_vendor->base, EPOUT_IDX), &transfer);
+}
+
+
+static void vendor_open(usb_vendor_t const * p_vendor)
+{
+    usb_vendor_ctx_t * p_ctx = ctx_get(p_vendor);
+
+    if (p_ctx->open)
+    {
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    p_ctx->tx_len[0] = 0;
+    p_ctx->tx_len[1] = 0;
+    p_ctx->tx_fill   = 0;
+    p_ctx->tx_busy   = false;
+    p_ctx->rx_next   = 0;
+    p_ctx->open      = true;
+    CRITICAL_REGION_EXIT();
+
+    (void)rx_start(p_vendor);
+    evt_send(p_vendor, USB_VENDOR_EVT_OPEN, NULL, 0);
+}
+
+
+static void vendor_close(usb_vendor_t const * p_vendor)
+{
+    usb_vendor_ctx_t * p_ctx = ctx_get(p_vendor);
+
+    if (!p_ctx->open)
+    {
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    p_ctx->open = false;
+    CRITICAL_REGION_EXIT();
+
+    nrf_drv_usbd_ep_abort(ep_get(&p_vendor->base, EPIN_IDX));
+    nrf_drv_usbd_ep_abort(ep_get(&p_vendor->base, EPOUT_IDX));
+
+    evt_send(p_vendor, USB_VENDOR_EVT_CLOSE, NULL, 0);
+}
+
+
+static ret_code_t setup_req_vendor(usb_vendor_t const * p_vendor, app_usbd_setup_evt_t const * p_setup_ev)
+{
+    if ((app_usbd_setup_req_dir(p_setup_ev->setup.bmRequestType) != APP_USBD_SETUP_REQDIR_OUT) ||
+        (p_setup_ev->setup.bRequest != USB_VENDOR_REQ_OPEN) ||
+        (p_setup_ev->setup.wLength.w != 0))
+    {
+        return NRF_ERROR_NOT_SUPPORTED;
+    }
+
+    if (p_setup_ev->setup.wValue.w != 0)
+    {
+        vendor_open(p_vendor);
+    }
+    else
+    {
+        vendor_close(p_vendor);
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+static ret_code_t setup_event_handler(usb_vendor_t const * p_vendor, app_usbd_setup_evt_t const * p_setup_ev)
+{
+    if ((app_usbd_setup_req_typ(p_setup_ev->setup.bmRequestType) == APP_USBD_SETUP_REQTYPE_VENDOR) &&
+        (app_usbd_setup_req_rec(p_setup_ev->setup.bmRequestType) == APP_USBD_SETUP_REQREC_INTERFACE))
+    {
+        return setup_req_vendor(p_vendor, p_setup_ev);
+    }
+
+    // Standard requests to the interface are answered by the core.
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+
+static ret_code_t endpoint_event_handler(usb_vendor_t const * p_vendor, app_usbd_complex_evt_t const * p_event)
+{
+    usb_vendor_ctx_t * p_ctx = ctx_get(p_vendor);
+    nrf_drv_usbd_ep_t  ep    = p_event->drv_evt.data.eptransfer.ep;
+    bool               ok    = (p_event->drv_evt.data.eptransfer.status == NRF_USBD_EP_OK);
+
+    if (ep == ep_get(&p_vendor->base, EPIN_IDX))
+    {
+        CRITICAL_REGION_ENTER();
+        p_ctx->tx_len[p_ctx->tx_fill ^ 1] = 0;
+        p_ctx->tx_busy                    = false;
+        if (p_ctx->open && (p_ctx->tx_len[p_ctx->tx_fill] > 0))
+        {
+            tx_start(p_vendor);
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (p_ctx->open)
+        {
+            evt_send(p_vendor, USB_VENDOR_EVT_TX_DONE, NULL, 0);
+        }
+        return NRF_SUCCESS;
+    }
+
+    if (ep == ep_get(&p_vendor->base, EPOUT_IDX))
+    {
+        uint8_t done = p_ctx->rx_next;
+        size_t  size = 0;
+
+        if (!p_ctx->open || !ok)
+        {
+            return NRF_SUCCESS;
+        }
+
+        (void)nrf_drv_usbd_ep_status_get(ep, &size);
+
+        // The host can send the next transfer while this one is handled.
+        p_ctx->rx_next ^= 1;
+        (void)rx_start(p_vendor);
+
+        evt_send(p_vendor, USB_VENDOR_EVT_RX, p_ctx->rx_buf[done], size);
+        return NRF_SUCCESS;
+    }
+
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+
+static ret_code_t vendor_event_handler(app_usbd_class_inst_t const * p_inst, app_usbd_complex_evt_t const * p_event)
+{
+    usb_vendor_t const * p_vendor = vendor_get(p_inst);
+
+    switch (p_event->app_evt.type)
+    {
+        case APP_USBD_EVT_DRV_SETUP:
+            return setup_event_handler(p_vendor, (app_usbd_setup_evt_t const *)p_event);
+
+        case APP_USBD_EVT_DRV_EPTRANSFER:
+            return endpoint_event_handler(p_vendor, p_event);
+
+        case APP_USBD_EVT_DRV_RESET:
+        case APP_USBD_EVT_DRV_SUSPEND:
+        case APP_USBD_EVT_STOPPED:
+        case APP_USBD_EVT_INST_REMOVE:
+            vendor_close(p_vendor);
+            return NRF_SUCCESS;
+
+        case APP_USBD_EVT_INST_APPEND:
+            memset(ctx_get(p_vendor), 0, sizeof(usb_vendor_ctx_t));
+            return NRF_SUCCESS;
+
+        default:
+            return NRF_ERROR_NOT_SUPPORTED;
+    }
+}
+
+
+static bool vendor_feed_descriptors(app_usbd_class_descriptor_ctx_t * p_ctx,
+                                    app_usbd_class_inst_t const     * p_inst,
+                                    uint8_t                         * p_buff,
+                                    size_t                            max_size)
+{
+    static app_usbd_class_iface_conf_t const * p_iface = NULL;
+
+    APP_USBD_CLASS_DESCRIPTOR_INIT();
+
+    p_iface = app_usbd_class_iface_get(p_inst, IFACE_IDX);
+
+    APP_USBD_CLASS_DESCRIPTOR_WRITE(DESC_IFACE_LEN);
+    APP_USBD_CLASS_DESCRIPTOR_WRITE(APP_USBD_DESCRIPTOR_INTERFACE);
+    APP_USBD_CLASS_DESCRIPTOR_WRITE(app_usbd_class_iface_number_get(p_iface));
+    APP_USBD_CLASS_DESCRIPTOR_WRITE(0x00);                  // bAlternateSetting
+    APP_USBD_CLASS_DESCRIPTOR_WRITE(2);                     // bNumEndpoints
+    APP_USBD_CLASS_DESCRIPTOR_WRITE(0xFF);                  // bInterfaceClass: vendor specific
+    APP_USBD_CLASS_DESCRIPTOR_WRITE(0x00);                  // bInterfaceSubClass
+    APP_USBD_CLASS_DESCRIPTOR_WRITE(0x00);                  // bInterfaceProtocol
+    APP_USBD_CLASS_DESCRIPTOR_WRITE(0x00);                  // iInterface
+
+    static uint8_t i = 0;
+
+    for (i = 0; i < 2; i++)
+    {
+        APP_USBD_CLASS_DESCRIPTOR_WRITE(DESC_EP_LEN);
+        APP_USBD_CLASS_DESCRIPTOR_WRITE(APP_USBD_DESCRIPTOR_ENDPOINT);
+        APP_USBD_CLASS_DESCRIPTOR_WRITE(app_usbd_class_ep_address_get(app_usbd_class_iface_ep_get(p_iface, i)));
+        APP_USBD_CLASS_DESCRIPTOR_WRITE(APP_USBD_DESCRIPTOR_EP_ATTR_TYPE_BULK);
+        APP_USBD_CLASS_DESCRIPTOR_WRITE(LSB_16(NRF_DRV_USBD_EPSIZE));
+        APP_USBD_CLASS_DESCRIPTOR_WRITE(MSB_16(NRF_DRV_USBD_EPSIZE));
+        APP_USBD_CLASS_DESCRIPTOR_WRITE(0x00);              // bInterval
+    }
+
+    APP_USBD_CLASS_DESCRIPTOR_END();
+}
+
+
+const app_usbd_class_methods_t usb_vendor_class_methods =
+{
+    .event_handler    = vendor_event_handler,
+    .feed_descriptors = vendor_feed_descriptors,
+};
+
+
+ret_code_t usb_vendor_write(usb_vendor_t const * p_vendor, void const * p_data, size_t len)
+{
+    usb_vendor_ctx_t * p_ctx    = ctx_get(p_vendor);
+    ret_code_t         err_code = NRF_SUCCESS;
+
+    if (len > USB_VENDOR_TX_BUF_SIZE)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    CRITICAL_REGION_ENTER();
+    if (!p_ctx->open)
+    {
+        err_code = NRF_ERROR_INVALID_STATE;
+    }
+    else if (p_ctx->tx_len[p_ctx->tx_fill] + len > USB_VENDOR_TX_BUF_SIZE)
+    {
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        memcpy(&p_ctx->tx_buf[p_ctx->tx_fill][p_ctx->tx_len[p_ctx->tx_fill]], p_data, len);
+        p_ctx->tx_len[p_ctx->tx_fill] += (uint16_t)len;
+
+        if (!p_ctx->tx_busy)
+        {
+            tx_start(p_vendor);
+        }
+    }
+    CRITICAL_REGION_EXIT();
+
+    return err_code;
+}
+
+
+bool usb_vendor_is_open(usb_vendor_t const * p_vendor)
+{
+    return ctx_get(p_vendor)->open;
+}
@@ -0,0 +1,150 @@
+/**@file
+ *
+ * @defgroup usb_vendor USB vendor bulk interface
+ * @{
+ * @brief app_usbd class with one vendor-specific interface and a bulk IN/OUT endpoint pair.
+ *
+ * @details The host reaches the interface through libusb, without the tty layer that sits on top
+ *          of CDC ACM. It opens the interface with the vendor request @ref USB_VENDOR_REQ_OPEN
+ *          (wValue 1) and closes it with wValue 0; reset, suspend and USB stop close it as well.
+ *
+ *          IN data is copied into one of two buffers of @ref USB_VENDOR_TX_BUF_SIZE. While the
+ *          transfer of one buffer runs, writes fill the other, and it goes out as one transfer as
+ *          soon as the first one ends, so under load transfers are several kilobytes long. A
+ *          transfer whose length is a multiple of the packet size ends with a zero-length packet.
+ *
+ *          OUT data is read into two buffers of @ref USB_VENDOR_RX_BUF_SIZE in turn. The transfer
+ *          into the next buffer starts before the data of the last one is handed over. A transfer
+ *          ends when its buffer is full or on a short packet, so a host write whose length is a
+ *          multiple of 64 must end with a zero-length packet.
+ *
+ *          Events come from app_usbd_event_queue_process(), in the main loop.
+ */
+#ifndef USB_VENDOR_H__
+#define USB_VENDOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "app_usbd.h"
+#include "app_usbd_class_base.h"
+#include "nrf_drv_usbd.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define USB_VENDOR_TX_BUF_SIZE      4096        /**< Size of each IN buffer; the longest IN transfer. */
+#define USB_VENDOR_RX_BUF_SIZE      1024        /**< Size of each OUT buffer; the longest OUT transfer. */
+#define USB_VENDOR_REQ_OPEN         0x01        /**< Vendor request to the interface: wValue 1 opens it, 0 closes it. */
+
+
+/**@brief Vendor interface event types. */
+typedef enum
+{
+    USB_VENDOR_EVT_OPEN,                        /**< The host opened the interface. */
+    USB_VENDOR_EVT_CLOSE,                       /**< The interface was closed. Queued IN data is dropped. */
+    USB_VENDOR_EVT_RX,                          /**< OUT data arrived. */
+    USB_VENDOR_EVT_TX_DONE,                     /**< An IN transfer ended; a buffer is free. */
+} usb_vendor_evt_type_t;
+
+
+/**@brief Vendor interface event. */
+typedef struct
+{
+    usb_vendor_evt_type_t type;
+    uint8_t const       * p_data;               /**< Data of @ref USB_VENDOR_EVT_RX, valid during the call. */
+    size_t                len;                  /**< Length of the data. */
+} usb_vendor_evt_t;
+
+
+/**@brief Vendor interface event handler type. */
+typedef void (*usb_vendor_evt_handler_t)(usb_vendor_evt_t const * p_evt);
+
+
+/**@brief Part of the instance in flash. */
+typedef struct
+{
+    usb_vendor_evt_handler_t evt_handler;
+} usb_vendor_inst_t;
+
+
+/**@brief Part of the instance in RAM. */
+typedef struct
+{
+    uint8_t  tx_buf[2][USB_VENDOR_TX_BUF_SIZE];
+    uint16_t tx_len[2];
+    uint8_t  tx_fill;                           /**< Buffer that writes go to. */
+    bool     tx_busy;                           /**< The other buffer is being sent. */
+    uint8_t  rx_buf[2][USB_VENDOR_RX_BUF_SIZE];
+    uint8_t  rx_next;                           /**< Buffer of the OUT transfer in progress. */
+    bool     open;
+} usb_vendor_ctx_t;
+
+
+/**@brief Interface configuration: interface number, IN endpoint, OUT endpoint. */
+#define USB_VENDOR_CONFIG(iface, epin, epout)   ((iface, epin, epout))
+
+#define USB_VENDOR_INSTANCE_SPECIFIC_DEC        usb_vendor_inst_t inst;
+#define USB_VENDOR_DATA_SPECIFIC_DEC            usb_vendor_ctx_t  ctx;
+#define USB_VENDOR_INST_CONFIG(handler)         .inst = { .evt_handler = handler }
+
+APP_USBD_CLASS_TYPEDEF(usb_vendor,
+                       USB_VENDOR_CONFIG(0, NRF_DRV_USBD_EPIN3, NRF_DRV_USBD_EPOUT3),
+                       USB_VENDOR_INSTANCE_SPECIFIC_DEC,
+                       USB_VENDOR_DATA_SPECIFIC_DEC);
+
+extern const app_usbd_class_methods_t usb_vendor_class_methods;
+
+
+/**@brief Macro for defining a vendor interface instance.
+ *
+ * @param instance_name  Name of the instance.
+ * @param handler        Event handler.
+ * @param iface          Interface number.
+ * @param epin           Bulk IN endpoint.
+ * @param epout          Bulk OUT endpoint.
+ */
+#define USB_VENDOR_GLOBAL_DEF(instance_name, handler, iface, epin, epout)   \
+    APP_USBD_CLASS_INST_GLOBAL_DEF(instance_name,                           \
+                                   usb_vendor,                              \
+                                   &usb_vendor_class_methods,               \
+                                   USB_VENDOR_CONFIG(iface, epin, epout),   \
+                                   (USB_VENDOR_INST_CONFIG(handler)))
+
+
+/**@brief Function for getting the class instance of a vendor interface, for app_usbd_class_append(). */
+static inline app_usbd_class_inst_t const * usb_vendor_class_inst_get(usb_vendor_t const * p_vendor)
+{
+    return &p_vendor->base;
+}
+
+
+/**@brief Function for queueing IN data.
+ *
+ * @details The data is copied. Can be called from any context.
+ *
+ * @param[in] p_vendor  Instance.
+ * @param[in] p_data    Data.
+ * @param[in] len       Length.
+ *
+ * @retval NRF_SUCCESS               The data was queued.
+ * @retval NRF_ERROR_INVALID_STATE   The interface is not open.
+ * @retval NRF_ERROR_NO_MEM          Not enough room in the buffer being filled.
+ * @retval NRF_ERROR_INVALID_LENGTH  Longer than a buffer.
+ */
+ret_code_t usb_vendor_write(usb_vendor_t const * p_vendor, void const * p_data, size_t len);
+
+
+/**@brief Function for checking whether the host has opened the interface. */
+bool usb_vendor_is_open(usb_vendor_t const * p_vendor);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_VENDOR_H__
+
+/** @} */
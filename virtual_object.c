@@ -0,0 +1,436 @@
+#include <string.h>
+#include "virtual_object.h"
+#include "app_util.h"
+#include "hvx_queue.h"
+#include "msg.h"
+#include "sdu_pool.h"
+
+
+#define OACP_UUID                   0x2AC5  /**< UUID of the OTS Object Action Control Point. */
+
+#define OACP_OP_READ                0x05    /**< OACP Read: offset (u32), length (u32). */
+#define OACP_OP_ABORT               0x07    /**< OACP Abort. */
+#define OACP_OP_RESPONSE            0x60    /**< OACP response: request op code, result. */
+#define OACP_READ_LEN               9       /**< Length of an OACP Read request. */
+
+#define OACP_RES_SUCCESS            0x01
+#define OACP_RES_INVALID_PARAM      0x03
+#define OACP_RES_CHANNEL_UNAVAIL    0x06
+#define OACP_RES_NOT_PERMITTED      0x08
+
+/**@brief Virtual object state of one link. */
+typedef struct
+{
+    uint16_t    conn_handle;                /**< Connection handle, BLE_CONN_HANDLE_INVALID if the entry is free. */
+    uint16_t    local_cid;                  /**< L2CAP channel accepted by OTS, BLE_L2CAP_CID_INVALID if none. */
+    uint16_t    tx_mtu;                     /**< Largest SDU the peer takes. */
+    uint16_t    tx_mps;                     /**< Largest K-frame payload the peer takes. */
+    uint16_t    credits;                    /**< K-frames the peer takes, less those of the SDUs queued. */
+    uint32_t    position;                   /**< Next position in the virtual object. */
+    uint32_t    remaining;                  /**< Bytes left to queue. */
+    sdu_buf_t * tx[VIRTUAL_OBJECT_TX_SDU_MAX];  /**< SDUs in the SoftDevice, oldest first. */
+    uint8_t     tx_head;                    /**< Index of the oldest SDU in @ref tx. */
+    uint8_t     tx_count;                   /**< Number of SDUs in the SoftDevice. */
+} vobj_link_t;
+
+static vobj_link_t              m_links[VIRTUAL_OBJECT_LINK_COUNT];
+static virtual_object_pattern_t m_pattern;
+static uint32_t                 m_seed;
+static uint16_t                 m_oacp_handle;  /**< Value handle of the OACP, 0 until the first OACP write. */
+
+
+static vobj_link_t * link_find(uint16_t conn_handle)
+{
+    for (uint32_t i = 0; i < VIRTUAL_OBJECT_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**@brief Function for mixing the bits of a word (lowbias32). */
+static uint32_t mix32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    return x;
+}
+
+
+static uint32_t word_get(uint32_t index)
+{
+    if (m_pattern == VIRTUAL_OBJECT_PATTERN_PRNG)
+    {
+        return mix32(m_seed ^ index);
+    }
+
+    return m_seed + index;
+}
+
+
+/**@brief Function for generating the content at a position. */
+static void content_fill(uint8_t * p_dst, uint32_t position, uint32_t len)
+{
+    while (len > 0)
+    {
+        uint32_t word = word_get(position / sizeof(uint32_t));
+
+        for (uint32_t b = position % sizeof(uint32_t); (b < sizeof(uint32_t)) && (len > 0); b++)
+        {
+            *p_dst++ = (uint8_t)(word >> (8 * b));
+            position++;
+            len--;
+        }
+    }
+}
+
+
+static void oacp_respond(uint16_t conn_handle, uint8_t op, uint8_t result)
+{
+    uint8_t                rsp[] = {OACP_OP_RESPONSE, op, result};
+    uint16_t               len   = sizeof(rsp);
+    ble_gatts_hvx_params_t hvx_params;
+
+    memset(&hvx_params, 0, sizeof(hvx_params));
+    hvx_params.handle = m_oacp_handle;
+    hvx_params.type   = BLE_GATT_HVX_INDICATION;
+    hvx_params.p_len  = &len;
+    hvx_params.p_data = rsp;
+
+    (void)hvx_queue_put(conn_handle, &hvx_params);
+}
+
+
+/**@brief Function for releasing the SDUs of a link the SoftDevice no longer holds. */
+static void tx_flush(vobj_link_t * p_link)
+{
+    while (p_link->tx_count > 0)
+    {
+        sdu_pool_release(p_link->tx[p_link->tx_head]);
+        p_link->tx_head = (p_link->tx_head + 1) % VIRTUAL_OBJECT_TX_SDU_MAX;
+        p_link->tx_count--;
+    }
+    p_link->remaining = 0;
+}
+
+
+/**@brief Function for getting the credits an SDU takes: one per K-frame, the first of which
+ *        also carries the 2-byte SDU length.
+ */
+static uint16_t sdu_credits(vobj_link_t const * p_link, uint16_t len)
+{
+    return (uint16_t)CEIL_DIV(len + sizeof(uint16_t), p_link->tx_mps);
+}
+
+
+/**@brief Function for handing SDUs to the SoftDevice until the transfer, the SDU queue, the
+ *        peer's credits or the pool runs out.
+ *
+ * @details Queueing resumes on BLE_L2CAP_EVT_CH_TX and BLE_L2CAP_EVT_CH_CREDIT. The transfer
+ *          ends if nothing is in flight and an SDU cannot be queued, since no TX event would
+ *          follow.
+ */
+static void tx_fill(vobj_link_t * p_link)
+{
+    while ((p_link->remaining > 0) && (p_link->tx_count < VIRTUAL_OBJECT_TX_SDU_MAX))
+    {
+        uint16_t    len     = (uint16_t)MIN(MIN(p_link->tx_mtu, SDU_POOL_DATA_SIZE), p_link->remaining);
+        uint16_t    credits = sdu_credits(p_link, len);
+        sdu_buf_t * p_buf;
+        ble_data_t  sdu;
+        ret_code_t  err_code;
+
+        if (credits > p_link->credits)
+        {
+            // An SDU queued without credits would only hold a buffer.
+            return;
+        }
+
+        p_buf = sdu_pool_alloc();
+        if (p_buf == NULL)
+        {
+            if (p_link->tx_count == 0)
+            {
+                msg("Virtual object: pool empty on 0x%04x\r\n", p_link->conn_handle);
+                p_link->remaining = 0;
+            }
+            return;
+        }
+
+        content_fill(sdu_buf_payload(p_buf), p_link->position, len);
+        p_buf->len = len;
+
+        sdu.p_data = sdu_buf_payload(p_buf);
+        sdu.len    = len;
+
+        err_code = sd_ble_l2cap_ch_tx(p_link->conn_handle, p_link->local_cid, &sdu);
+        if (err_code != NRF_SUCCESS)
+        {
+            sdu_pool_release(p_buf);
+            if ((err_code != NRF_ERROR_RESOURCES) || (p_link->tx_count == 0))
+            {
+                msg("Virtual object: L2CAP TX failed on 0x%04x, 0x%x\r\n", p_link->conn_handle, err_code);
+                p_link->remaining = 0;
+            }
+            return;
+        }
+
+        p_link->tx[(p_link->tx_head + p_link->tx_count) % VIRTUAL_OBJECT_TX_SDU_MAX] = p_buf;
+        p_link->tx_count++;
+        p_link->credits   -= credits;
+        p_link->position  += len;
+        p_link->remaining -= len;
+    }
+}
+
+
+/**@brief Function for handling an OACP Read request for the virtual object. */
+static void read_start(vobj_link_t * p_link, uint32_t offset, uint32_t len)
+{
+    uint8_t result = OACP_RES_SUCCESS;
+
+    if ((len == 0) || (len - 1 > UINT32_MAX - offset))
+    {
+        result = OACP_RES_INVALID_PARAM;
+    }
+    else if (p_link->local_cid == BLE_L2CAP_CID_INVALID)
+    {
+        result = OACP_RES_CHANNEL_UNAVAIL;
+    }
+    else if ((p_link->remaining > 0) || (p_link->tx_count > 0))
+    {
+        result = OACP_RES_NOT_PERMITTED;
+    }
+
+    oacp_respond(p_link->conn_handle, OACP_OP_READ, result);
+    if (result != OACP_RES_SUCCESS)
+    {
+        return;
+    }
+
+    msg("Virtual object read on 0x%04x: %u bytes from %u\r\n",
+        p_link->conn_handle, len, offset - VIRTUAL_OBJECT_OFFSET);
+
+    p_link->position  = offset - VIRTUAL_OBJECT_OFFSET;
+    p_link->remaining = len;
+    tx_fill(p_link);
+}
+
+
+/**@brief Function for checking whether a written handle is the OACP.
+ *
+ * @details The OACP handle is learnt from its UUID on the first write, so the module does not
+ *          depend on the internals of the OTS module.
+ */
+static bool is_oacp(uint16_t handle)
+{
+    ble_uuid_t uuid;
+
+    if (m_oacp_handle != 0)
+    {
+        return handle == m_oacp_handle;
+    }
+
+    if ((sd_ble_gatts_attr_get(handle, &uuid, NULL) == NRF_SUCCESS) &&
+        (uuid.type == BLE_UUID_TYPE_BLE) && (uuid.uuid == OACP_UUID))
+    {
+        m_oacp_handle = handle;
+        return true;
+    }
+
+    return false;
+}
+
+
+/**@brief Function for checking whether an OACP request is for the virtual object. */
+static bool oacp_is_virtual(vobj_link_t const * p_link, uint8_t const * p_data, uint16_t len)
+{
+    if ((len == OACP_READ_LEN) && (p_data[0] == OACP_OP_READ))
+    {
+        return uint32_decode(&p_data[1]) >= VIRTUAL_OBJECT_OFFSET;
+    }
+
+    return (len == 1) && (p_data[0] == OACP_OP_ABORT) && (p_link->remaining > 0);
+}
+
+
+/**@brief Function for handling an OACP request for the virtual object. */
+static void oacp_on_write(vobj_link_t * p_link, uint8_t const * p_data)
+{
+    if (p_data[0] == OACP_OP_READ)
+    {
+        read_start(p_link, uint32_decode(&p_data[1]), uint32_decode(&p_data[5]));
+    }
+    else
+    {
+        // The SDUs already in the SoftDevice still complete.
+        p_link->remaining = 0;
+        oacp_respond(p_link->conn_handle, OACP_OP_ABORT, OACP_RES_SUCCESS);
+    }
+}
+
+
+static bool on_gatts_write(vobj_link_t * p_link, ble_gatts_evt_write_t const * p_write)
+{
+    if ((p_write->op != BLE_GATTS_OP_WRITE_REQ) ||
+        !is_oacp(p_write->handle) ||
+        !oacp_is_virtual(p_link, p_write->data, p_write->len))
+    {
+        return false;
+    }
+
+    oacp_on_write(p_link, p_write->data);
+    return true;
+}
+
+
+/**@brief Function for handling an OACP write that needs authorization.
+ *
+ * @details Requests that are not for the virtual object are left for OTS to authorize.
+ */
+static bool on_rw_authorize(vobj_link_t * p_link, ble_gatts_evt_rw_authorize_request_t const * p_req)
+{
+    ble_gatts_evt_write_t const         * p_write = &p_req->request.write;
+    ble_gatts_rw_authorize_reply_params_t reply;
+
+    if ((p_req->type != BLE_GATTS_AUTHORIZE_TYPE_WRITE) ||
+        (p_write->op != BLE_GATTS_OP_WRITE_REQ) ||
+        !is_oacp(p_write->handle) ||
+        !oacp_is_virtual(p_link, p_write->data, p_write->len))
+    {
+        return false;
+    }
+
+    memset(&reply, 0, sizeof(reply));
+    reply.type                     = BLE_GATTS_AUTHORIZE_TYPE_WRITE;
+    reply.params.write.gatt_status = BLE_GATT_STATUS_SUCCESS;
+    reply.params.write.update      = 1;
+    reply.params.write.len         = p_write->len;
+    reply.params.write.p_data      = p_write->data;
+    (void)sd_ble_gatts_rw_authorize_reply(p_link->conn_handle, &reply);
+
+    oacp_on_write(p_link, p_write->data);
+    return true;
+}
+
+
+/**@brief Function for handling the end of an SDU.
+ *
+ * @return false if the SDU was not one of the module's.
+ */
+static bool on_tx(vobj_link_t * p_link, ble_l2cap_evt_t const * p_evt)
+{
+    if ((p_link->tx_count == 0) ||
+        (p_evt->local_cid != p_link->local_cid) ||
+        (p_evt->params.tx.sdu_buf.p_data != sdu_buf_payload(p_link->tx[p_link->tx_head])))
+    {
+        return false;
+    }
+
+    // SDUs end in the order they were queued.
+    sdu_pool_release(p_link->tx[p_link->tx_head]);
+    p_link->tx_head = (p_link->tx_head + 1) % VIRTUAL_OBJECT_TX_SDU_MAX;
+    p_link->tx_count--;
+
+    tx_fill(p_link);
+    if ((p_link->remaining == 0) && (p_link->tx_count == 0))
+    {
+        msg("Virtual object read on 0x%04x done at %u\r\n", p_link->conn_handle, p_link->position);
+    }
+
+    return true;
+}
+
+
+bool virtual_object_on_ble_evt(ble_evt_t const * p_ble_evt)
+{
+    uint16_t      conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    vobj_link_t * p_link;
+
+    if (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED)
+    {
+        p_link = link_find(BLE_CONN_HANDLE_INVALID);
+        if (p_link != NULL)
+        {
+            p_link->conn_handle = conn_handle;
+            p_link->local_cid   = BLE_L2CAP_CID_INVALID;
+            p_link->remaining   = 0;
+            p_link->tx_head     = 0;
+            p_link->tx_count    = 0;
+        }
+        return false;
+    }
+
+    p_link = link_find(conn_handle);
+    if (p_link == NULL)
+    {
+        return false;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_DISCONNECTED:
+            tx_flush(p_link);
+            p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+            return false;
+
+        case BLE_L2CAP_EVT_CH_SETUP:
+            p_link->local_cid = p_ble_evt->evt.l2cap_evt.local_cid;
+            p_link->tx_mtu    = p_ble_evt->evt.l2cap_evt.params.ch_setup.tx_params.tx_mtu;
+            p_link->tx_mps    = p_ble_evt->evt.l2cap_evt.params.ch_setup.tx_params.tx_mps;
+            p_link->credits   = p_ble_evt->evt.l2cap_evt.params.ch_setup.tx_params.credits;
+            return false;
+
+        case BLE_L2CAP_EVT_CH_CREDIT:
+            if (p_link->local_cid == p_ble_evt->evt.l2cap_evt.local_cid)
+            {
+                p_link->credits += p_ble_evt->evt.l2cap_evt.params.credit.credits;
+                tx_fill(p_link);
+            }
+            return false;
+
+        case BLE_L2CAP_EVT_CH_RELEASED:
+            if (p_link->local_cid == p_ble_evt->evt.l2cap_evt.local_cid)
+            {
+                tx_flush(p_link);
+                p_link->local_cid = BLE_L2CAP_CID_INVALID;
+            }
+            return false;
+
+        case BLE_L2CAP_EVT_CH_TX:
+            return on_tx(p_link, &p_ble_evt->evt.l2cap_evt);
+
+        case BLE_GATTS_EVT_WRITE:
+            return on_gatts_write(p_link, &p_ble_evt->evt.gatts_evt.params.write);
+
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+            return on_rw_authorize(p_link, &p_ble_evt->evt.gatts_evt.params.authorize_request);
+
+        default:
+            return false;
+    }
+}
+
+
+ret_code_t virtual_object_init(virtual_object_pattern_t pattern, uint32_t seed)
+{
+    m_pattern     = pattern;
+    m_seed        = seed;
+    m_oacp_handle = 0;
+
+    for (uint32_t i = 0; i < VIRTUAL_OBJECT_LINK_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+        m_links[i].tx_count    = 0;
+    }
+
+    return NRF_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/**@file
+ *
+ * @defgroup virtual_object Synthetic OTS object
+ * @{
+ * @brief Object content generated on demand, for downlink benchmarks without storage limits.
+ *
+ * @details The virtual object is mapped into the OACP Read offset space at
+ *          @ref VIRTUAL_OBJECT_OFFSET, above anything the stored object can hold. An OACP Read
+ *          at offset @ref VIRTUAL_OBJECT_OFFSET + n returns the virtual object from position n.
+ *          The read can be as long as the 32-bit offset space allows, so multi-megabyte
+ *          transfers need no RAM or flash. Reads below the offset go to OTS as before.
+ *
+ *          The content is a stream of 32-bit little-endian words. Word i is:
+ *
+ *          | Pattern                          | Word i                          |
+ *          |----------------------------------|---------------------------------|
+ *          | @ref VIRTUAL_OBJECT_PATTERN_COUNTER | seed + i                     |
+ *          | @ref VIRTUAL_OBJECT_PATTERN_PRNG    | lowbias32(seed ^ i)          |
+ *
+ *          Every word depends only on its index, so any range can be generated and checked on
+ *          its own. tools/ots_verify.py generates the same content on the host and checks a
+ *          received file against it.
+ *
+ *          The module answers the OACP Read itself and streams the data over the link's
+ *          L2CAP CoC, which OTS has already accepted. It sees BLE events through the
+ *          @ref link_ctx filter and keeps the events of its own transfers from OTS.
+ *
+ *          Up to @ref VIRTUAL_OBJECT_TX_SDU_MAX SDUs of a link are in the SoftDevice at once, so
+ *          the next one is ready when one ends. The module counts the peer's credits, one per
+ *          K-frame, and only queues an SDU the peer has the credits for. Each SDU takes an
+ *          @ref sdu_pool buffer until it ends; if the pool is empty, the link waits for its own
+ *          SDUs to end.
+ */
+#ifndef VIRTUAL_OBJECT_H__
+#define VIRTUAL_OBJECT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "nrf_sdh_ble.h"
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VIRTUAL_OBJECT_LINK_COUNT   NRF_SDH_BLE_PERIPHERAL_LINK_COUNT   /**< Number of links served at once. */
+#define VIRTUAL_OBJECT_OFFSET       0x80000000UL                        /**< OACP Read offset of the virtual object. */
+#define VIRTUAL_OBJECT_TX_SDU_MAX   3                                   /**< SDUs of a link in the SoftDevice at once. Sets the L2CAP TX queue size. */
+
+
+/**@brief Content patterns. */
+typedef enum
+{
+    VIRTUAL_OBJECT_PATTERN_COUNTER,         /**< Incrementing 32-bit counter. */
+    VIRTUAL_OBJECT_PATTERN_PRNG,            /**< Pseudo-random words. */
+} virtual_object_pattern_t;
+
+
+/**@brief Function for initializing the module.
+ *
+ * @param[in] pattern  Content pattern.
+ * @param[in] seed     Seed of the pattern.
+ *
+ * @return NRF_SUCCESS.
+ */
+ret_code_t virtual_object_init(virtual_object_pattern_t pattern, uint32_t seed);
+
+
+/**@brief Function for handling BLE events of peripheral links, before OTS sees them.
+ *
+ * @details Meant as the @ref link_ctx filter.
+ *
+ * @param[in] p_ble_evt  Bluetooth stack event.
+ *
+ * @retval true   The event belongs to a virtual object transfer; OTS must not see it.
+ * @retval false  Pass the event on to OTS.
+ */
+bool virtual_object_on_ble_evt(ble_evt_t const * p_ble_evt);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIRTUAL_OBJECT_H__
+
+/** @} */